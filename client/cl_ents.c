@@ -48,39 +48,16 @@ Returns the entity number and the header bits
 int	bitcounts[32];	/// just for protocol profiling
 int CL_ParseEntityBits (unsigned *bits)
 {
-	unsigned	b, total;
 	int			i;
 	int			number;
 
-	total = MSG_ReadByte (&net_message);
-	if (total & U_MOREBITS1)
-	{
-		b = MSG_ReadByte (&net_message);
-		total |= b<<8;
-	}
-	if (total & U_MOREBITS2)
-	{
-		b = MSG_ReadByte (&net_message);
-		total |= b<<16;
-	}
-	if (total & U_MOREBITS3)
-	{
-		b = MSG_ReadByte (&net_message);
-		total |= b<<24;
-	}
+	number = MSG_ReadEntityBits (&net_message, bits);
 
 	// count the bits for net profiling
 	for (i=0 ; i<32 ; i++)
-		if (total&(1<<i))
+		if (*bits&(1<<i))
 			bitcounts[i]++;
 
-	if (total & U_NUMBER16)
-		number = MSG_ReadShort (&net_message);
-	else
-		number = MSG_ReadByte (&net_message);
-
-	*bits = total;
-
 	return number;
 }
 
@@ -93,74 +70,7 @@ Can go from either a baseline or a previous packet_entity
 */
 void CL_ParseDelta (entity_state_t *from, entity_state_t *to, int number, int bits)
 {
-	// set everything to the state we are delta'ing from
-	*to = *from;
-
-	VectorCopy (from->origin, to->old_origin);
-	to->number = number;
-
-	if (bits & U_MODEL)
-		to->modelindex = MSG_ReadByte (&net_message);
-	if (bits & U_MODEL2)
-		to->modelindex2 = MSG_ReadByte (&net_message);
-	if (bits & U_MODEL3)
-		to->modelindex3 = MSG_ReadByte (&net_message);
-	if (bits & U_MODEL4)
-		to->modelindex4 = MSG_ReadByte (&net_message);
-
-	if (bits & U_FRAME8)
-		to->frame = MSG_ReadByte (&net_message);
-	if (bits & U_FRAME16)
-		to->frame = MSG_ReadShort (&net_message);
-
-	if ((bits & U_SKIN8) && (bits & U_SKIN16))		//used for laser colors
-		to->skinnum = MSG_ReadLong(&net_message);
-	else if (bits & U_SKIN8)
-		to->skinnum = MSG_ReadByte(&net_message);
-	else if (bits & U_SKIN16)
-		to->skinnum = MSG_ReadShort(&net_message);
-
-	if ( (bits & (U_EFFECTS8|U_EFFECTS16)) == (U_EFFECTS8|U_EFFECTS16) )
-		to->effects = MSG_ReadLong(&net_message);
-	else if (bits & U_EFFECTS8)
-		to->effects = MSG_ReadByte(&net_message);
-	else if (bits & U_EFFECTS16)
-		to->effects = MSG_ReadShort(&net_message);
-
-	if ( (bits & (U_RENDERFX8|U_RENDERFX16)) == (U_RENDERFX8|U_RENDERFX16) )
-		to->renderfx = MSG_ReadLong(&net_message);
-	else if (bits & U_RENDERFX8)
-		to->renderfx = MSG_ReadByte(&net_message);
-	else if (bits & U_RENDERFX16)
-		to->renderfx = MSG_ReadShort(&net_message);
-
-	if (bits & U_ORIGIN1)
-		to->origin[0] = MSG_ReadCoord (&net_message);
-	if (bits & U_ORIGIN2)
-		to->origin[1] = MSG_ReadCoord (&net_message);
-	if (bits & U_ORIGIN3)
-		to->origin[2] = MSG_ReadCoord (&net_message);
-
-	if (bits & U_ANGLE1)
-		to->angles[0] = MSG_ReadAngle(&net_message);
-	if (bits & U_ANGLE2)
-		to->angles[1] = MSG_ReadAngle(&net_message);
-	if (bits & U_ANGLE3)
-		to->angles[2] = MSG_ReadAngle(&net_message);
-
-	if (bits & U_OLDORIGIN)
-		MSG_ReadPos (&net_message, to->old_origin);
-
-	if (bits & U_SOUND)
-		to->sound = MSG_ReadByte (&net_message);
-
-	if (bits & U_EVENT)
-		to->event = MSG_ReadByte (&net_message);
-	else
-		to->event = 0;
-
-	if (bits & U_SOLID)
-		to->solid = MSG_ReadShort (&net_message);
+	MSG_ReadDeltaEntity (&net_message, from, to, number, bits);
 }
 
 /*
@@ -168,10 +78,10 @@ void CL_ParseDelta (entity_state_t *from, entity_state_t *to, int number, int bi
 CL_DeltaEntity
 
 Parses deltas from the given base and adds the resulting entity
-to the current frame
+to the current frame. bm is the bit stream on PROTOCOL_PACKED.
 ==================
 */
-void CL_DeltaEntity (frame_t *frame, int newnum, entity_state_t *old, int bits)
+void CL_DeltaEntity (frame_t *frame, int newnum, entity_state_t *old, int bits, bitmsg_t *bm)
 {
 	centity_t	*ent;
 	entity_state_t	*state;
@@ -182,7 +92,10 @@ void CL_DeltaEntity (frame_t *frame, int newnum, entity_state_t *old, int bits)
 	cl.parse_entities++;
 	frame->num_entities++;
 
-	CL_ParseDelta (old, state, newnum, bits);
+	if (bm)
+		MSG_ReadPackedEntity (bm, old, state, newnum, bits);
+	else
+		CL_ParseDelta (old, state, newnum, bits);
 
 	// some data changes will force no lerping
 	if (state->modelindex != ent->current.modelindex
@@ -239,6 +152,8 @@ void CL_ParsePacketEntities (frame_t *oldframe, frame_t *newframe)
 	int			bits;
 	entity_state_t	*oldstate = NULL;
 	int			oldindex, oldnum;
+	bitmsg_t	bits_msg, *bm;
+	int			lastnum;
 
 	newframe->parse_entities = cl.parse_entities;
 	newframe->num_entities = 0;
@@ -258,9 +173,20 @@ void CL_ParsePacketEntities (frame_t *oldframe, frame_t *newframe)
 		}
 	}
 
+	bm = NULL;
+	if (cls.serverProtocol == PROTOCOL_PACKED)
+	{
+		bm = &bits_msg;
+		MSG_BeginReadingBits (bm, &net_message);
+	}
+	lastnum = 0;
+
 	while (1)
 	{
-		newnum = CL_ParseEntityBits ( (unsigned *)&bits );
+		if (bm)
+			newnum = lastnum = MSG_ReadPackedEntityBits (bm, (unsigned *)&bits, lastnum);
+		else
+			newnum = CL_ParseEntityBits ( (unsigned *)&bits );
 		if (newnum >= MAX_EDICTS)
 			Com_Error (ERR_DROP,"CL_ParsePacketEntities: bad number:%i", newnum);
 
@@ -274,7 +200,7 @@ void CL_ParsePacketEntities (frame_t *oldframe, frame_t *newframe)
 		{	// one or more entities from the old packet are unchanged
 			if (cl_shownet->value == 3)
 				Com_Printf ("   unchanged: %i\n", oldnum);
-			CL_DeltaEntity (newframe, oldnum, oldstate, 0);
+			CL_DeltaEntity (newframe, oldnum, oldstate, 0, NULL);
 
 			oldindex++;
 
@@ -313,7 +239,7 @@ void CL_ParsePacketEntities (frame_t *oldframe, frame_t *newframe)
 		{	// delta from previous state
 			if (cl_shownet->value == 3)
 				Com_Printf ("   delta: %i\n", newnum);
-			CL_DeltaEntity (newframe, newnum, oldstate, bits);
+			CL_DeltaEntity (newframe, newnum, oldstate, bits, bm);
 
 			oldindex++;
 
@@ -331,7 +257,7 @@ void CL_ParsePacketEntities (frame_t *oldframe, frame_t *newframe)
 		{	// delta from baseline
 			if (cl_shownet->value == 3)
 				Com_Printf ("   baseline: %i\n", newnum);
-			CL_DeltaEntity (newframe, newnum, &cl_entities[newnum].baseline, bits);
+			CL_DeltaEntity (newframe, newnum, &cl_entities[newnum].baseline, bits, bm);
 			continue;
 		}
 
@@ -342,7 +268,7 @@ void CL_ParsePacketEntities (frame_t *oldframe, frame_t *newframe)
 	{	// one or more entities from the old packet are unchanged
 		if (cl_shownet->value == 3)
 			Com_Printf ("   unchanged: %i\n", oldnum);
-		CL_DeltaEntity (newframe, oldnum, oldstate, 0);
+		CL_DeltaEntity (newframe, oldnum, oldstate, 0, NULL);
 
 		oldindex++;
 
@@ -365,10 +291,8 @@ CL_ParsePlayerstate
 */
 void CL_ParsePlayerstate (frame_t *oldframe, frame_t *newframe)
 {
-	int			flags;
 	player_state_t	*state;
-	int			i;
-	int			statbits;
+	bitmsg_t		bm;
 
 	state = &newframe->playerstate;
 
@@ -378,133 +302,306 @@ void CL_ParsePlayerstate (frame_t *oldframe, frame_t *newframe)
 	else
 		memset (state, 0, sizeof(*state));
 
-	flags = MSG_ReadShort (&net_message);
-
-	//
-	// parse the pmove_state_t
-	//
-	if (flags & PS_M_TYPE)
-		state->pmove.pm_type = MSG_ReadByte (&net_message);
-
-	if (flags & PS_M_ORIGIN)
+	if (cls.serverProtocol == PROTOCOL_PACKED)
 	{
-		state->pmove.origin[0] = MSG_ReadSizeInt (&net_message, coord_bytes);
-		state->pmove.origin[1] = MSG_ReadSizeInt (&net_message, coord_bytes);
-		state->pmove.origin[2] = MSG_ReadSizeInt (&net_message, coord_bytes);
+		MSG_BeginReadingBits (&bm, &net_message);
+		MSG_ReadPackedPlayerstate (&bm, state);
 	}
+	else
+		MSG_ReadDeltaPlayerstate (&net_message, state);
 
-	if (flags & PS_M_VELOCITY)
-	{
-		state->pmove.velocity[0] = MSG_ReadShort (&net_message);
-		state->pmove.velocity[1] = MSG_ReadShort (&net_message);
-		state->pmove.velocity[2] = MSG_ReadShort (&net_message);
-	}
+	if (cl.attractloop)
+		state->pmove.pm_type = PM_FREEZE;		// demo playback
+}
 
-	if (flags & PS_M_TIME)
-		state->pmove.pm_time = MSG_ReadByte (&net_message);
 
-	if (flags & PS_M_FLAGS)
-		state->pmove.pm_flags = MSG_ReadByte (&net_message);
+/*
+==================
+CL_FireEntityEvents
 
-	if (flags & PS_M_GRAVITY)
-		state->pmove.gravity = MSG_ReadShort (&net_message);
+==================
+*/
+void CL_FireEntityEvents (frame_t *frame)
+{
+	entity_state_t		*s1;
+	int					pnum, num;
 
-	if (flags & PS_M_DELTA_ANGLES)
+	for (pnum = 0 ; pnum<frame->num_entities ; pnum++)
 	{
-		state->pmove.delta_angles[0] = MSG_ReadShort (&net_message);
-		state->pmove.delta_angles[1] = MSG_ReadShort (&net_message);
-		state->pmove.delta_angles[2] = MSG_ReadShort (&net_message);
+		num = (frame->parse_entities + pnum)&(MAX_PARSE_ENTITIES-1);
+		s1 = &cl_parse_entities[num];
+		if (s1->event)
+			CL_EntityEvent (s1);
+
+		// EF_TELEPORTER acts like an event, but is not cleared each frame
+		if (s1->effects & EF_TELEPORTER)
+			CL_BigTeleportParticles(s1->origin);
 	}
+}
 
-	if (cl.attractloop)
-		state->pmove.pm_type = PM_FREEZE;		// demo playback
 
-	//
-	// parse the rest of the player_state_t
-	//
-	if (flags & PS_VIEWOFFSET)
+/*
+=========================================================================
+
+DELTA BENCHMARK
+
+Replays a demo, re-encodes every frame in both the old and the packed
+format, and checks that both decode to the same thing.
+
+=========================================================================
+*/
+
+#define DELTABENCH_REPEAT	16
+
+static struct
+{
+	qboolean			active;
+	int					frames;
+	int					mismatches;
+	unsigned long long	oldbytes, packedbytes, codedbytes;
+	unsigned long long	encodetime[2], decodetime[2];	// microseconds
+} deltabench;
+
+static entity_state_t	deltabench_baselines[MAX_EDICTS];
+static entity_state_t	deltabench_ents[2][MAX_EDICTS];
+
+/*
+================
+CL_DeltaBenchOld
+
+Returns the old frame's entity at index and sets *num, 99999 past the end
+================
+*/
+static entity_state_t *CL_DeltaBenchOld (entitylist_t *from, int index, int *num)
+{
+	entity_state_t	*state;
+
+	if (!from || index >= from->count)
 	{
-		state->viewoffset[0] = MSG_ReadChar (&net_message) * 0.25;
-		state->viewoffset[1] = MSG_ReadChar (&net_message) * 0.25;
-		state->viewoffset[2] = MSG_ReadChar (&net_message) * 0.25;
+		*num = 99999;
+		return NULL;
 	}
+	state = &from->ring[(from->first+index)%from->ringsize];
+	*num = state->number;
+	return state;
+}
+
+/*
+================
+CL_DeltaBenchRead
+
+Same merge as CL_ParsePacketEntities, without touching the client state.
+Returns the entity count, -1 on a bad message.
+================
+*/
+static int CL_DeltaBenchRead (sizebuf_t *sb, qboolean packed, entitylist_t *from,
+	player_state_t *ps, entity_state_t *out)
+{
+	bitmsg_t		bm;
+	entity_state_t	*oldstate;
+	int				oldindex, oldnum, newnum, lastnum;
+	unsigned		bits;
+	int				count;
 
-	if (flags & PS_VIEWANGLES)
+	if (packed)
 	{
-		state->viewangles[0] = MSG_ReadAngle16 (&net_message);
-		state->viewangles[1] = MSG_ReadAngle16 (&net_message);
-		state->viewangles[2] = MSG_ReadAngle16 (&net_message);
+		MSG_BeginReadingBits (&bm, sb);
+		MSG_ReadPackedPlayerstate (&bm, ps);
+		MSG_BeginReadingBits (&bm, sb);
 	}
+	else
+		MSG_ReadDeltaPlayerstate (sb, ps);
+
+	count = 0;
+	lastnum = 0;
+	oldindex = 0;
+	oldstate = CL_DeltaBenchOld (from, oldindex, &oldnum);
 
-	if (flags & PS_KICKANGLES)
+	while (1)
 	{
-		state->kick_angles[0] = MSG_ReadChar (&net_message) * 0.25;
-		state->kick_angles[1] = MSG_ReadChar (&net_message) * 0.25;
-		state->kick_angles[2] = MSG_ReadChar (&net_message) * 0.25;
+		if (packed)
+			newnum = lastnum = MSG_ReadPackedEntityBits (&bm, &bits, lastnum);
+		else
+			newnum = MSG_ReadEntityBits (sb, &bits);
+		if (newnum >= MAX_EDICTS || sb->readcount > sb->cursize)
+			return -1;
+		if (!newnum)
+			break;
+
+		while (oldnum < newnum && count < MAX_EDICTS)
+		{
+			MSG_ReadDeltaEntity (sb, oldstate, &out[count++], oldnum, 0);
+			oldstate = CL_DeltaBenchOld (from, ++oldindex, &oldnum);
+		}
+
+		if (bits & U_REMOVE)
+		{
+			oldstate = CL_DeltaBenchOld (from, ++oldindex, &oldnum);
+			continue;
+		}
+
+		if (count >= MAX_EDICTS)
+			return -1;
+		if (packed)
+			MSG_ReadPackedEntity (&bm, oldnum == newnum ? oldstate : &deltabench_baselines[newnum],
+				&out[count++], newnum, bits);
+		else
+			MSG_ReadDeltaEntity (sb, oldnum == newnum ? oldstate : &deltabench_baselines[newnum],
+				&out[count++], newnum, bits);
+		if (oldnum == newnum)
+			oldstate = CL_DeltaBenchOld (from, ++oldindex, &oldnum);
 	}
 
-	if (flags & PS_WEAPONINDEX)
+	while (oldnum != 99999 && count < MAX_EDICTS)
 	{
-		state->gunindex = MSG_ReadByte (&net_message);
+		MSG_ReadDeltaEntity (sb, oldstate, &out[count++], oldnum, 0);
+		oldstate = CL_DeltaBenchOld (from, ++oldindex, &oldnum);
 	}
 
-	if (flags & PS_WEAPONFRAME)
+	return count;
+}
+
+/*
+================
+CL_DeltaBenchFrame
+
+Called for every valid frame while the bench is running
+================
+*/
+static void CL_DeltaBenchFrame (frame_t *old, frame_t *frame)
+{
+	static byte		data[2][MAX_MSGLEN], coded[MAX_MSGLEN], decoded[MAX_MSGLEN];
+	sizebuf_t		msg[2];
+	bitmsg_t		bm;
+	entitylist_t	from, to;
+	player_state_t	nullstate, *fromstate, ps[2];
+	int				count[2];
+	int				i, p, maxclients, codedsize;
+	unsigned long long	start;
+
+	if (old && !old->valid)
+		return;
+
+	for (i = 0; i < MAX_EDICTS; i++)
+		deltabench_baselines[i] = cl_entities[i].baseline;
+	maxclients = atoi (cl.configstrings[CS_MAXCLIENTS]);
+
+	if (old)
 	{
-		state->gunframe = MSG_ReadByte (&net_message);
-		state->gunoffset[0] = MSG_ReadChar (&net_message)*0.25;
-		state->gunoffset[1] = MSG_ReadChar (&net_message)*0.25;
-		state->gunoffset[2] = MSG_ReadChar (&net_message)*0.25;
-		state->gunangles[0] = MSG_ReadChar (&net_message)*0.25;
-		state->gunangles[1] = MSG_ReadChar (&net_message)*0.25;
-		state->gunangles[2] = MSG_ReadChar (&net_message)*0.25;
+		from.ring = cl_parse_entities;
+		from.ringsize = MAX_PARSE_ENTITIES;
+		from.first = old->parse_entities & (MAX_PARSE_ENTITIES-1);
+		from.count = old->num_entities;
+		fromstate = &old->playerstate;
 	}
-
-	if (flags & PS_BLEND)
+	else
 	{
-		state->blend[0] = MSG_ReadByte (&net_message)/255.0;
-		state->blend[1] = MSG_ReadByte (&net_message)/255.0;
-		state->blend[2] = MSG_ReadByte (&net_message)/255.0;
-		state->blend[3] = MSG_ReadByte (&net_message)/255.0;
+		memset (&nullstate, 0, sizeof(nullstate));
+		fromstate = &nullstate;
 	}
+	to.ring = cl_parse_entities;
+	to.ringsize = MAX_PARSE_ENTITIES;
+	to.first = frame->parse_entities & (MAX_PARSE_ENTITIES-1);
+	to.count = frame->num_entities;
 
-	if (flags & PS_FOV)
-		state->fov = MSG_ReadByte (&net_message);
+	for (p = 0; p < 2; p++)
+	{
+		start = Sys_Microseconds ();
+		for (i = 0; i < DELTABENCH_REPEAT; i++)
+		{
+			SZ_Init (&msg[p], data[p], sizeof(data[p]));
+			if (p)
+			{
+				MSG_BeginWritingBits (&bm, &msg[p]);
+				MSG_WritePackedPlayerstate (&bm, fromstate, &frame->playerstate);
+				MSG_EndWritingBits (&bm);
+			}
+			else
+				MSG_WriteDeltaPlayerstate (fromstate, &frame->playerstate, &msg[p]);
+			MSG_WritePacketEntities (&msg[p], old ? &from : NULL, &to,
+				deltabench_baselines, maxclients, p);
+		}
+		deltabench.encodetime[p] += Sys_Microseconds () - start;
 
-	if (flags & PS_RDFLAGS)
-		state->rdflags = MSG_ReadByte (&net_message);
+		start = Sys_Microseconds ();
+		for (i = 0; i < DELTABENCH_REPEAT; i++)
+		{
+			msg[p].readcount = 0;
+			ps[p] = *fromstate;
+			count[p] = CL_DeltaBenchRead (&msg[p], p, old ? &from : NULL, &ps[p], deltabench_ents[p]);
+		}
+		deltabench.decodetime[p] += Sys_Microseconds () - start;
+	}
 
-	// parse stats
-	statbits = MSG_ReadLong (&net_message);
-	for (i=0 ; i<MAX_STATS ; i++)
-		if (statbits & (1<<i) )
-			state->stats[i] = MSG_ReadShort(&net_message);
+	if (msg[0].overflowed || msg[1].overflowed || count[0] < 0 || count[0] != count[1]
+		|| memcmp (&ps[0], &ps[1], sizeof(ps[0]))
+		|| memcmp (deltabench_ents[0], deltabench_ents[1], count[0]*sizeof(entity_state_t)))
+		deltabench.mismatches++;
+
+	codedsize = Netchan_EncodePayload (msg[1].data, msg[1].cursize, coded, sizeof(coded));
+	if (codedsize < 0 || codedsize >= msg[1].cursize)
+		codedsize = msg[1].cursize + 1;	// sent raw with the prefix byte
+	else if (!Netchan_DecodePayload (coded, codedsize, decoded, msg[1].cursize)
+		|| memcmp (decoded, msg[1].data, msg[1].cursize))
+		deltabench.mismatches++;
+
+	deltabench.frames++;
+	deltabench.oldbytes += msg[0].cursize;
+	deltabench.packedbytes += msg[1].cursize;
+	deltabench.codedbytes += codedsize;
 }
 
-
 /*
-==================
-CL_FireEntityEvents
+================
+CL_DeltaBenchReport
 
-==================
+Prints the results when the demo ends
+================
 */
-void CL_FireEntityEvents (frame_t *frame)
+void CL_DeltaBenchReport (void)
 {
-	entity_state_t		*s1;
-	int					pnum, num;
+	double	frames, runs;
 
-	for (pnum = 0 ; pnum<frame->num_entities ; pnum++)
-	{
-		num = (frame->parse_entities + pnum)&(MAX_PARSE_ENTITIES-1);
-		s1 = &cl_parse_entities[num];
-		if (s1->event)
-			CL_EntityEvent (s1);
+	if (!deltabench.active)
+		return;
+	deltabench.active = false;
 
-		// EF_TELEPORTER acts like an event, but is not cleared each frame
-		if (s1->effects & EF_TELEPORTER)
-			CL_BigTeleportParticles(s1->origin);
+	if (!deltabench.frames)
+	{
+		Com_Printf ("deltabench: no frames\n");
+		return;
 	}
+
+	frames = deltabench.frames;
+	runs = frames * DELTABENCH_REPEAT;
+	Com_Printf ("deltabench: %i frames, %i mismatches\n", deltabench.frames, deltabench.mismatches);
+	Com_Printf ("bytes/frame: old %.1f, packed %.1f, coded %.1f (%.1f%% of old)\n",
+		deltabench.oldbytes/frames, deltabench.packedbytes/frames, deltabench.codedbytes/frames,
+		deltabench.oldbytes ? 100.0*deltabench.codedbytes/deltabench.oldbytes : 0);
+	Com_Printf ("ns/frame: old encode %.0f decode %.0f, packed encode %.0f decode %.0f\n",
+		deltabench.encodetime[0]*1000.0/runs, deltabench.decodetime[0]*1000.0/runs,
+		deltabench.encodetime[1]*1000.0/runs, deltabench.decodetime[1]*1000.0/runs);
 }
 
+/*
+================
+CL_DeltaBench_f
+
+deltabench <demo>
+================
+*/
+void CL_DeltaBench_f (void)
+{
+	if (Cmd_Argc() != 2)
+	{
+		Com_Printf ("usage: deltabench <demo>\n");
+		return;
+	}
+
+	memset (&deltabench, 0, sizeof(deltabench));
+	deltabench.active = true;
+	Cbuf_AddText (va("demomap %s\n", Cmd_Argv(1)));
+}
 
 /*
 ================
@@ -619,6 +716,9 @@ void CL_ParseFrame (void)
 		// fire entity events
 		CL_FireEntityEvents (&cl.frame);
 		CL_CheckPredictionError ();
+
+		if (deltabench.active)
+			CL_DeltaBenchFrame (old, &cl.frame);
 	}
 }
 
@@ -1696,11 +1796,21 @@ void CL_AddEntities (void)
 	CL_CalcViewValues ();
 
 	// PMM - moved this here so the heat beam has the right values for the vieworg, and can lock the beam to the gun
+	CL_StageBegin (STAGE_PACKETENTITIES);
 	CL_AddPacketEntities (&cl.frame);
+	CL_StageEnd (STAGE_PACKETENTITIES);
+	CL_StageBegin (STAGE_TENTS);
 	CL_AddTEnts ();
+	CL_StageEnd (STAGE_TENTS);
+	CL_StageBegin (STAGE_PARTICLES);
 	CL_AddParticles ();
+	CL_StageEnd (STAGE_PARTICLES);
+	CL_StageBegin (STAGE_DLIGHTS);
 	CL_AddDLights ();
+	CL_StageEnd (STAGE_DLIGHTS);
+	CL_StageBegin (STAGE_CLENTITIES);
 	CL_AddClEntities();
+	CL_StageEnd (STAGE_CLENTITIES);
 	CL_AddLightStyles ();
 }
 
@@ -23,6 +23,8 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #include "config.h"
 #endif
 
+#include <float.h>
+
 #include "client.h"
 #include "ref_gl/r_image.h"
 #include "ref_gl/qgl.h"
@@ -441,30 +443,60 @@ PARTICLE MANAGEMENT
 ==============================================================
 */
 
-particle_t	*active_particles, *free_particles;
+particle_t	*free_particles;
 
 particle_t	particles[MAX_PARTICLES];
 int			cl_numparticles = MAX_PARTICLES;
 
+/*
+Live particles, as parallel arrays. Spawners still get a particle_t from
+new_particle and fill it in; the next CL_AddParticles copies the fields
+that change over time in here, and from then on the per-frame update is a
+straight pass over contiguous floats that the compiler can vectorize. Dead
+particles are swap-removed, so the live set is always [0, num).
+*/
+typedef struct
+{
+	int			num;
+	int			numloaded;			// [numloaded, num) are fresh from new_particle
+
+	particle_t	*rec[MAX_PARTICLES];
+
+	float		time[MAX_PARTICLES];
+	float		org[3][MAX_PARTICLES];
+	float		vel[3][MAX_PARTICLES];
+	float		accel[3][MAX_PARTICLES];
+	float		alpha[MAX_PARTICLES];
+	float		alphavel[MAX_PARTICLES];
+	float		scale[MAX_PARTICLES];
+	float		scalevel[MAX_PARTICLES];
+	float		color[MAX_PARTICLES];
+	float		colorvel[MAX_PARTICLES];
+	float		floor[MAX_PARTICLES];		// weather dies at or below this
+
+	// results of the last update
+	float		cur_org[3][MAX_PARTICLES];
+	float		cur_alpha[MAX_PARTICLES];
+	float		cur_scale[MAX_PARTICLES];
+	float		cur_color[MAX_PARTICLES];
+} cl_particles_t;
+
+static cl_particles_t	cl_parts;
+
 void addParticleLight (particle_t *p, float light, float lightvel, float lcol0, float lcol1, float lcol2)
 {
-	int i;
+	cplight_t *plight;
 
-	for (i=0; i<P_LIGHTS_MAX; i++)
-	{
-		cplight_t *plight = &p->lights[i];
+	if (p->numlights >= P_LIGHTS_MAX)
+		return;
 
-		if (!plight->isactive)
-		{
-			plight->isactive = true;
-			plight->light = light;
-			plight->lightvel = lightvel;
-			plight->lightcol[0] = lcol0;
-			plight->lightcol[1] = lcol1;
-			plight->lightcol[2] = lcol2;
-			return;
-		}
-	}
+	plight = &p->lights[p->numlights++];
+	plight->isactive = true;
+	plight->light = light;
+	plight->lightvel = lightvel;
+	plight->lightcol[0] = lcol0;
+	plight->lightcol[1] = lcol1;
+	plight->lightcol[2] = lcol2;
 }
 /*
 ===============
@@ -481,7 +513,7 @@ void CL_ClearParticles (void)
 
 
 	free_particles = &particles[0];
-	active_particles = NULL;
+	cl_parts.num = cl_parts.numloaded = 0;
 
 	for (i=0 ;i<cl_numparticles ; i++)
 		particles[i].next = &particles[i+1];
@@ -491,7 +523,6 @@ void CL_ClearParticles (void)
 static inline particle_t *new_particle (void)
 {
 	particle_t	*p;
-	//int j;
 
 	if (!free_particles)
 		return NULL;
@@ -499,12 +530,14 @@ static inline particle_t *new_particle (void)
 	p = free_particles;
 	free_particles = p->next;
 	
-	memset (p, 0, sizeof(*p));
+	// the lights array is most of the struct and numlights says how much
+	// of it is in use
+	memset (p, 0, offsetof (particle_t, lights));
 	
-	p->next = active_particles;
 	p->time = cl.time;
+	cl_parts.rec[cl_parts.num++] = p;
 
-	return (active_particles = p);
+	return p;
 }
 
 #define WEATHER_PARTICLES 2048
@@ -4565,6 +4598,117 @@ void CL_ParticleDustEffect (cl_sustain_t *self)
 	self->nextthink += self->thinkinterval;
 }
 
+/*
+===============
+CL_LoadNewParticles
+
+Copy what spawners filled in since the last update into the arrays.
+===============
+*/
+static void CL_LoadNewParticles (void)
+{
+	cl_particles_t	*s = &cl_parts;
+	particle_t		*p;
+	int				i, j;
+
+	for (i = s->numloaded; i < s->num; i++)
+	{
+		p = s->rec[i];
+		s->time[i] = p->time;
+		for (j = 0; j < 3; j++)
+		{
+			s->org[j][i] = p->org[j];
+			s->vel[j][i] = p->vel[j];
+			s->accel[j][i] = p->accel[j];
+		}
+		s->alpha[i] = p->alpha;
+		s->alphavel[i] = p->alphavel;
+		s->scale[i] = p->scale;
+		s->scalevel[i] = p->scalevel;
+		s->color[i] = p->color;
+		s->colorvel[i] = p->colorvel;
+		if (p->type == PARTICLE_WEATHER || p->type == PARTICLE_FLUTTERWEATHER)
+			s->floor[i] = p->end[2];
+		else
+			s->floor[i] = -FLT_MAX;
+	}
+	s->numloaded = s->num;
+}
+
+/*
+===============
+CL_SimulateParticles
+
+Branch-free over the arrays so it vectorizes.
+===============
+*/
+static void CL_SimulateParticles (int num, float now)
+{
+	cl_particles_t	*s = &cl_parts;
+	float			t, sv, sc, c;
+	int				i;
+
+	for (i = 0; i < num; i++)
+	{
+		t = (now - s->time[i]) * 0.001f;
+
+		// select inputs rather than results, or gcc won't vectorize
+		sv = s->scalevel[i] > 1 ? s->scalevel[i] : 0;
+		sc = s->scale[i] + t * sv;
+		sc = sc > 64 ? 64 : sc;	// don't want them getting too large
+		sc = sc < 0 ? 0 : sc;
+		c = s->color[i] + t * s->colorvel[i];
+		c = c < 0 ? 0 : c;
+
+		s->cur_org[0][i] = s->org[0][i] + t * (s->vel[0][i] + t * s->accel[0][i]);
+		s->cur_org[1][i] = s->org[1][i] + t * (s->vel[1][i] + t * s->accel[1][i]);
+		s->cur_org[2][i] = s->org[2][i] + t * (s->vel[2][i] + t * s->accel[2][i]);
+		s->cur_alpha[i] = s->alpha[i] + t * s->alphavel[i];
+		s->cur_scale[i] = sc;
+		s->cur_color[i] = c;
+	}
+}
+
+/*
+===============
+CL_RemoveParticle
+
+Swap-remove slot i; the caller looks at slot i again.
+===============
+*/
+static void CL_RemoveParticle (int i)
+{
+	cl_particles_t	*s = &cl_parts;
+	int				last, j;
+
+	free_particle (s->rec[i]);
+
+	last = --s->num;
+	s->numloaded = s->num;
+	if (i == last)
+		return;
+
+	s->rec[i] = s->rec[last];
+	s->time[i] = s->time[last];
+	for (j = 0; j < 3; j++)
+	{
+		s->org[j][i] = s->org[j][last];
+		s->vel[j][i] = s->vel[j][last];
+		s->accel[j][i] = s->accel[j][last];
+		s->cur_org[j][i] = s->cur_org[j][last];
+	}
+	s->alpha[i] = s->alpha[last];
+	s->alphavel[i] = s->alphavel[last];
+	s->scale[i] = s->scale[last];
+	s->scalevel[i] = s->scalevel[last];
+	s->color[i] = s->color[last];
+	s->colorvel[i] = s->colorvel[last];
+	s->floor[i] = s->floor[last];
+	s->cur_alpha[i] = s->cur_alpha[last];
+	s->cur_scale[i] = s->cur_scale[last];
+	s->cur_color[i] = s->cur_color[last];
+}
+
 /*
 ===============
 CL_AddParticles
@@ -4572,73 +4716,40 @@ CL_AddParticles
 */
 void CL_AddParticles (void)
 {
-	particle_t		*p, *next;
+	cl_particles_t	*s = &cl_parts;
+	particle_t		*p;
 	float			light;
-	float			time = 0.0f;
-	particle_t		*active, *tail;
-	int				i;
+	float			time;
+	int				i, j;
 	
 	Cl_WeatherEffects();
 
-	active = NULL;
-	tail = NULL;
+	CL_LoadNewParticles ();
+	CL_SimulateParticles (s->num, cl.time);
 
-	for (p = active_particles; p; p = next)
+	// compact, and hand the results back to the particle_t records
+	for (i = 0; i < s->num; )
 	{
-		next = p->next;
+		p = s->rec[i];
 
 		// PMM - added INSTANT_PARTICLE handling for heat beam
-		if (p->alphavel != INSTANT_PARTICLE)
+		if (s->alphavel[i] == INSTANT_PARTICLE)
 		{
-			time = (cl.time - p->time)*0.001; 
-		
-			p->current_alpha = p->alpha + time*p->alphavel;
-			if (p->current_alpha <= 0)
-			{	// faded out
-				free_particle (p);
-				continue;
-			}
+			s->cur_alpha[i] = s->alpha[i];
+			s->alpha[i] = s->alphavel[i] = 0.0f;
 		}
-		else
-		{
-			p->current_alpha = p->alpha;
-			p->alpha = p->alphavel = 0.0f;
-		}
-		if(p->scalevel > 1) {
-			time = (cl.time - p->time)*0.001;
-			p->current_scale = p->scale + time * p->scalevel;
+		else if (s->cur_alpha[i] <= 0 || s->cur_org[2][i] <= s->floor[i])
+		{	// faded out, or weather that has hit the ground
+			CL_RemoveParticle (i);
+			continue;
 		}
-		else
-			p->current_scale = p->scale;
-			
-        if (p->colorvel != 0) {
-            time = (cl.time - p->time)*0.001;
-            p->current_color = (p->color + time * p->colorvel);
-        } else
-            p->current_color = p->color;
-
-		if(p->current_scale > 64)
-			p->current_scale = 64; //don't want them getting too large.
-		if(p->current_scale < 0)
-		    p->current_scale = 0;
-		
-		if(p->current_color < 0)
-		    p->current_color = 0;
 
-		// update origin
-		for(i = 0; i < 3; i++) {
-			p->current_origin[i] = p->org[i] + p->vel[i]*time + p->accel[i]*(time*time);
-		}
-		
-		// free up weather particles that have hit the ground
-		if(p->type == PARTICLE_WEATHER || p->type == PARTICLE_FLUTTERWEATHER)
-		{
-			if (p->current_origin[2] <= p->end[2]){
-				free_particle (p);
-				continue;
-			}
-		}
-		
+		for (j = 0; j < 3; j++)
+			p->current_origin[j] = s->cur_org[j][i];
+		p->current_alpha = s->cur_alpha[i] > 1.0f ? 1.0f : s->cur_alpha[i];
+		p->current_scale = s->cur_scale[i];
+		p->current_color = s->cur_color[i];
+
 		// some weather particles flutter around as they fall
 		if (p->type == PARTICLE_FLUTTERWEATHER)
 		{
@@ -4657,34 +4768,25 @@ void CL_AddParticles (void)
 			VectorScale (distance, 360.0f/circumference, p->angle);
 		}
 
-		p->next = NULL;
-		if (!tail)
-			active = tail = p;
-		else
-		{
-			tail->next = p;
-			tail = p;
-		}
-
-		if (p->current_alpha > 1.0)
-			p->current_alpha = 1;
-
-		for (i=0;i<P_LIGHTS_MAX;i++)
+		if (p->numlights && !p->fromsustainedeffect)
 		{
-			const cplight_t *plight = &p->lights[i];
-			if (plight->isactive && !p->fromsustainedeffect)
+			time = (cl.time - p->time)*0.001;
+			for (j = 0; j < p->numlights; j++)
 			{
+				const cplight_t *plight = &p->lights[j];
 				light = plight->light*p->current_alpha*2.0 + plight->lightvel*time;
 				V_AddLight (p->current_origin, light, plight->lightcol[0], plight->lightcol[1], plight->lightcol[2]);
 			}
 		}
-	}
 
-	active_particles = active;
+		i++;
+	}
 	
 	// second pass: clean up chains that have had some of their members expire
-	for (p = active_particles; p; p = p->next)
+	for (i = 0; i < s->num; i++)
 	{
+		p = s->rec[i];
+
 		if (p->type == PARTICLE_CHAINED && p->chain_prev != NULL && p->chain_prev->free)
 			p->chain_prev = NULL;
 		
@@ -4716,6 +4818,83 @@ void CL_AddParticles (void)
 	}
 }
 
+/*
+===============
+CL_ParticleBench_f
+
+"particlebench [seconds]" replays a heavy firefight at 60 frames a second:
+rocket and blaster trails, impacts and blood every frame, plus whatever
+weather is on. Nothing is drawn; spawning and CL_AddParticles are timed
+separately.
+===============
+*/
+void CL_ParticleBench_f (void)
+{
+	static centity_t	trails[4];
+	vec3_t				org, end, dir;
+	float				seconds;
+	int					frames, frame, i, savedtime;
+	int					live, peak;
+	double				total;
+	unsigned long long	start, spawn_us, update_us, worst_us, t;
+
+	seconds = Cmd_Argc() > 1 ? atof (Cmd_Argv (1)) : 60;
+	if (seconds <= 0)
+		seconds = 60;
+	frames = seconds * 60;
+
+	savedtime = cl.time;
+	CL_ClearParticles ();
+
+	spawn_us = update_us = worst_us = 0;
+	total = 0;
+	peak = 0;
+	for (frame = 0; frame < frames; frame++)
+	{
+		cl.time = savedtime + frame * 1000 / 60;
+
+		start = Sys_Microseconds ();
+		for (i = 0; i < 4; i++)
+		{
+			VectorSet (org, crand()*1024, crand()*1024, crand()*256);
+			VectorSet (dir, crand(), crand(), crand());
+			VectorNormalize (dir);
+			VectorMA (org, 40, dir, end);
+			trails[i].trailcount = 1024;
+			CL_RocketTrail (org, end, &trails[i]);
+			CL_BlasterTrail (org, end, BLASTER_PARTICLE_COLOR);
+		}
+		VectorSet (org, crand()*1024, crand()*1024, crand()*256);
+		CL_BlasterParticles (org, dir);
+		CL_ParticleEffect (org, dir, 0xe0, 32);
+		CL_BloodEffect (org, dir, 450, 24);
+		spawn_us += Sys_Microseconds () - start;
+
+		V_ClearScene ();
+		start = Sys_Microseconds ();
+		CL_AddParticles ();
+		t = Sys_Microseconds () - start;
+		update_us += t;
+		if (t > worst_us)
+			worst_us = t;
+
+		live = cl_parts.num;
+		total += live;
+		if (live > peak)
+			peak = live;
+	}
+
+	cl.time = savedtime;
+	CL_ClearParticles ();
+	V_ClearScene ();
+
+	Com_Printf ("%i frames, %.0f live particles on average, %i peak\n",
+		frames, total / frames, peak);
+	Com_Printf ("spawn  %8.1f us/frame\n", (double)spawn_us / frames);
+	Com_Printf ("update %8.1f us/frame, worst %llu us\n",
+		(double)update_us / frames, worst_us);
+}
+
 
 /*
 ==============
@@ -542,7 +542,13 @@ void CL_SendCmd (void)
 
 	if ( cls.state == ca_connected)
 	{
-		if (cls.netchan.message.cursize	|| curtime - cls.netchan.last_sent > 1000 )
+		if (cls.downloadwindowed)
+		{	// the server waits on these to move the window along
+			SZ_Init (&buf, data, sizeof(data));
+			CL_WriteDownloadAck (&buf);
+			Netchan_Transmit (&cls.netchan, buf.cursize, buf.data);
+		}
+		else if (cls.netchan.message.cursize	|| curtime - cls.netchan.last_sent > 1000 )
 			Netchan_Transmit (&cls.netchan, 0, data);
 		return;
 	}
@@ -595,6 +601,9 @@ void CL_SendCmd (void)
 		buf.data + checksumIndex + 1, buf.cursize - checksumIndex - 1,
 		cls.netchan.outgoing_sequence);
 
+	if (cls.downloadwindowed)
+		CL_WriteDownloadAck (&buf);
+
 	//
 	// deliver the message
 	//
@@ -96,6 +96,10 @@ cvar_t	*cl_showclamp;
 
 cvar_t	*cl_paused;
 cvar_t	*cl_timedemo;
+cvar_t	*cl_timedemojson;
+cvar_t	*cl_timedemocampath;
+cvar_t	*cl_packedprotocol;
+cvar_t	*cl_dlwindow;
 cvar_t	*cl_demoquit;
 
 cvar_t	*lookspring;
@@ -337,7 +341,7 @@ void CL_Record_f (void)
 
 	// send the serverdata
 	MSG_WriteByte (&buf, svc_serverdata);
-	MSG_WriteLong (&buf, PROTOCOL_VERSION);
+	MSG_WriteLong (&buf, cls.serverProtocol);
 	MSG_WriteLong (&buf, 0x10000 + cl.servercount);
 	MSG_WriteByte (&buf, 1);	// demos are always attract loops
 	MSG_WriteString (&buf, cl.gamedir);
@@ -562,8 +566,13 @@ void CL_SendConnectPacket (void)
 	port = Cvar_VariableValue ("qport");
 	userinfo_modified = false;
 
-	Netchan_OutOfBandPrint (NS_CLIENT, adr, "connect %i %i %i \"%s\"\n",
-		PROTOCOL_VERSION, port, cls.challenge, Cvar_Userinfo() );
+	// older servers ignore the extra argument
+	if (cl_packedprotocol->integer)
+		Netchan_OutOfBandPrint (NS_CLIENT, adr, "connect %i %i %i \"%s\" %i\n",
+			PROTOCOL_VERSION, port, cls.challenge, Cvar_Userinfo(), PROTOCOL_PACKED );
+	else
+		Netchan_OutOfBandPrint (NS_CLIENT, adr, "connect %i %i %i \"%s\"\n",
+			PROTOCOL_VERSION, port, cls.challenge, Cvar_Userinfo() );
 }
 
 /*
@@ -719,6 +728,181 @@ void CL_Rcon_f (void)
 }
 
 
+/*
+==============================================================================
+
+TIMEDEMO PROFILE
+
+While a timedemo runs, each stage of the client simulation is timed and the
+zone allocations made inside it are counted. When the demo ends the totals
+are printed per frame, and written as JSON to timedemo_json if it is set, so
+a build without a display can watch cl_ents.c and cl_fx.c for regressions.
+The view of every frame can also be written to timedemo_campath, for the
+renderer's worldcullbench to replay.
+
+==============================================================================
+*/
+
+static const char *cl_stagenames[NUM_STAGES] =
+{
+	"parse",
+	"predict",
+	"packetentities",
+	"tents",
+	"particles",
+	"dlights",
+	"clentities",
+	"refresh"
+};
+
+static struct
+{
+	unsigned long long	start, usec;
+	int					allocstart, allocs;
+	int					calls;
+} cl_stages[NUM_STAGES];
+
+static int		cl_stageallocs;		// zone count when the demo started
+static double	cl_stageentities, cl_stageparticles, cl_stagedlights;
+static FILE		*cl_campath;
+
+/*
+=====================
+CL_StageReset
+
+Called when timedemo starts counting frames
+=====================
+*/
+void CL_StageReset (void)
+{
+	memset (cl_stages, 0, sizeof(cl_stages));
+	cl_stageentities = cl_stageparticles = cl_stagedlights = 0;
+	cl_stageallocs = Z_Allocations ();
+
+	if (cl_campath)
+		fclose (cl_campath);
+	cl_campath = NULL;
+	if (cl_timedemocampath->string[0])
+	{
+		cl_campath = fopen (cl_timedemocampath->string, "w");
+		if (!cl_campath)
+			Com_Printf ("Couldn't open %s\n", cl_timedemocampath->string);
+		else
+			fprintf (cl_campath, "campath %s\n", cl.configstrings[CS_MODELS+1]);
+	}
+}
+
+void CL_StageBegin (clstage_t stage)
+{
+	if (!cl_timedemo->integer || cl.timedemo_start <= 0)
+	{
+		cl_stages[stage].start = 0;
+		return;
+	}
+	cl_stages[stage].start = Sys_Microseconds ();
+	cl_stages[stage].allocstart = Z_Allocations ();
+}
+
+void CL_StageEnd (clstage_t stage)
+{
+	// the demo may have started or ended inside the stage
+	if (!cl_stages[stage].start || cl.timedemo_start <= 0)
+		return;
+	cl_stages[stage].usec += Sys_Microseconds () - cl_stages[stage].start;
+	cl_stages[stage].allocs += Z_Allocations () - cl_stages[stage].allocstart;
+	cl_stages[stage].calls++;
+	cl_stages[stage].start = 0;
+}
+
+/*
+=====================
+CL_StageRefdef
+
+Counts what the frame hands the renderer
+=====================
+*/
+void CL_StageRefdef (refdef_t *fd)
+{
+	if (!cl_timedemo->integer || cl.timedemo_start <= 0)
+		return;
+	cl_stageentities += fd->num_entities;
+	cl_stageparticles += fd->num_particles;
+	cl_stagedlights += fd->num_dlights;
+
+	if (cl_campath && fd->areabits && !(fd->rdflags & RDF_NOWORLDMODEL))
+	{
+		int i;
+
+		fprintf (cl_campath, "%.3f %.3f %.3f %.3f %.3f %.3f %.3f %.3f ",
+			fd->vieworg[0], fd->vieworg[1], fd->vieworg[2],
+			fd->viewangles[0], fd->viewangles[1], fd->viewangles[2],
+			fd->fov_x, fd->fov_y);
+		for (i = 0; i < MAX_MAP_AREAS/8; i++)
+			fprintf (cl_campath, "%02x", fd->areabits[i]);
+		fprintf (cl_campath, "\n");
+	}
+}
+
+/*
+=====================
+CL_StageReport
+=====================
+*/
+void CL_StageReport (int frames, int msec)
+{
+	FILE	*f;
+	int		i;
+
+	if (cl_campath)
+	{
+		fclose (cl_campath);
+		cl_campath = NULL;
+		Com_Printf ("Wrote %s\n", cl_timedemocampath->string);
+	}
+
+	if (frames <= 0)
+		return;
+
+	Com_Printf ("stage             usec/frame  allocs/frame\n");
+	for (i = 0; i < NUM_STAGES; i++)
+		Com_Printf ("%-16s %11.2f %13.2f\n", cl_stagenames[i],
+			(double)cl_stages[i].usec / frames, (double)cl_stages[i].allocs / frames);
+	Com_Printf ("%.1f entities, %.1f particles, %.1f dlights, %.2f allocs per frame\n",
+		cl_stageentities / frames, cl_stageparticles / frames, cl_stagedlights / frames,
+		(double)(Z_Allocations () - cl_stageallocs) / frames);
+
+	if (!cl_timedemojson->string[0])
+		return;
+
+	f = fopen (cl_timedemojson->string, "w");
+	if (!f)
+	{
+		Com_Printf ("Couldn't open %s\n", cl_timedemojson->string);
+		return;
+	}
+
+	fprintf (f, "{\n");
+	fprintf (f, "\t\"frames\": %i,\n", frames);
+	fprintf (f, "\t\"seconds\": %.3f,\n", msec / 1000.0);
+	fprintf (f, "\t\"fps\": %.2f,\n", frames * 1000.0 / msec);
+	fprintf (f, "\t\"entities\": %.2f,\n", cl_stageentities / frames);
+	fprintf (f, "\t\"particles\": %.2f,\n", cl_stageparticles / frames);
+	fprintf (f, "\t\"dlights\": %.2f,\n", cl_stagedlights / frames);
+	fprintf (f, "\t\"allocs\": %.3f,\n", (double)(Z_Allocations () - cl_stageallocs) / frames);
+	fprintf (f, "\t\"stages\": {\n");
+	for (i = 0; i < NUM_STAGES; i++)
+		fprintf (f, "\t\t\"%s\": { \"usec\": %.3f, \"allocs\": %.3f, \"calls\": %i }%s\n",
+			cl_stagenames[i], (double)cl_stages[i].usec / frames,
+			(double)cl_stages[i].allocs / frames, cl_stages[i].calls,
+			i == NUM_STAGES - 1 ? "" : ",");
+	fprintf (f, "\t}\n");
+	fprintf (f, "}\n");
+	fclose (f);
+
+	Com_Printf ("Wrote %s\n", cl_timedemojson->string);
+}
+
+
 /*
 =====================
 CL_ClearState
@@ -762,10 +946,14 @@ void CL_Disconnect (void)
 
 		time = Sys_Milliseconds () - cl.timedemo_start;
 		if (time > 0)
+		{
 			Com_Printf ("%i frames, %3.1f seconds: %3.1f fps\n", cl.timedemo_frames,
 			time/1000.0, cl.timedemo_frames*1000.0 / time);
+			CL_StageReport (cl.timedemo_frames, time);
+		}
 		cl.timedemo_start = 0;
 	}
+	CL_DeltaBenchReport ();
 
 	VectorClear (cl.refdef.blend);
 
@@ -792,6 +980,8 @@ void CL_Disconnect (void)
 			fclose(cls.download);
 		cls.download = NULL;
 	}
+	cls.downloadwindowed = false;
+	cls.downloadbench = false;
 
 	cls.state = ca_disconnected;
 
@@ -1236,10 +1426,14 @@ static void CL_ConnectionlessPacket (void)
 		cls.state = ca_connected;
 
 		memset(cls.downloadurl, 0, sizeof(cls.downloadurl));
-		if(Cmd_Argc() == 2)  // http download url
+		if(Cmd_Argc() >= 2 && *Cmd_Argv(1))  // http download url
 		{
 			strncpy(cls.downloadurl, Cmd_Argv(1), sizeof(cls.downloadurl) - 1);
 		}
+
+		// the server agreed to the packed protocol
+		if (Cmd_Argc() >= 3 && atoi(Cmd_Argv(2)) == PROTOCOL_PACKED)
+			cls.netchan.packed = true;
 		is_localhost = !strcmp(cls.servername, "localhost");
 		Netchan_OutOfBandPrint (NS_CLIENT, net_from, va("status %i", PROTOCOL_VERSION));
 		return;
@@ -1385,7 +1579,9 @@ static void CL_ReadPackets (void)
 		}
 		if (!Netchan_Process(&cls.netchan, &net_message))
 			continue;		// wasn't accepted for some reason
+		CL_StageBegin (STAGE_PARSE);
 		CL_ParseServerMessage ();
+		CL_StageEnd (STAGE_PARSE);
 	}
 
 	//
@@ -2029,6 +2225,14 @@ void CL_InitLocal (void)
 	cl_paused = Cvar_Get ("paused", "0", 0);
 	cl_timedemo = Cvar_Get ("timedemo", "0", CVARDOC_BOOL);
 	Cvar_Describe (cl_timedemo, "play back demos (recorded games) in benchmark mode.");
+	cl_timedemojson = Cvar_Get ("timedemo_json", "", 0);
+	Cvar_Describe (cl_timedemojson, "file to write the per stage timedemo profile to, as JSON. Empty to only print it.");
+	cl_timedemocampath = Cvar_Get ("timedemo_campath", "", 0);
+	Cvar_Describe (cl_timedemocampath, "file to write the view of each timedemo frame to, for worldcullbench to replay. Empty for none.");
+	cl_packedprotocol = Cvar_Get ("cl_packedprotocol", "0", CVAR_ARCHIVE | CVARDOC_BOOL);
+	Cvar_Describe (cl_packedprotocol, "ask servers for the bit packed, range coded protocol, which needs less bandwidth. Servers that don't have it use the normal one.");
+	cl_dlwindow = Cvar_Get ("cl_dlwindow", "1", CVARDOC_BOOL);
+	Cvar_Describe (cl_dlwindow, "ask servers for windowed downloads, which keep many chunks in flight instead of one per round trip.");
 	cl_demoquit = Cvar_Get ("demoquit", "0", CVARDOC_BOOL);
 	Cvar_Describe (cl_demoquit, "quit automatically after a demo has finished.");
 	
@@ -2098,6 +2302,9 @@ void CL_InitLocal (void)
 	Cmd_AddCommand ("disconnect", CL_Disconnect_f);
 	Cmd_AddCommand ("record", CL_Record_f);
 	Cmd_AddCommand ("stop", CL_Stop_f);
+	Cmd_AddCommand ("deltabench", CL_DeltaBench_f);
+
+	Cmd_AddCommand ("particlebench", CL_ParticleBench_f);
 
 	Cmd_AddCommand ("quit", CL_Quit_f);
 
@@ -2112,6 +2319,7 @@ void CL_InitLocal (void)
 
 	Cmd_AddCommand ("download", CL_Download_f);
 	Cmd_AddCommand ("downloadhttp", CL_Download_f);
+	Cmd_AddCommand ("dlbench", CL_DownloadBench_f);
 
 	Cmd_AddCommand ("irc_connect", CL_InitIRC);
 	Cmd_AddCommand ("irc_quit", CL_IRCInitiateShutdown);
@@ -2654,7 +2862,9 @@ void CL_Frame( int msec )
 		 * predict movement for un-acked client-to-server packets
 		 * [The Quake trick that keeps players view smooth in on-line play.]
 		 */
+		CL_StageBegin (STAGE_PREDICT);
 		CL_PredictMovement (packet_timer);
+		CL_StageEnd (STAGE_PREDICT);
 		
 		if (speedometer && speedometer->cvar->integer) {
 	        speedometer->counter = sqrt(
@@ -2697,7 +2907,9 @@ void CL_Frame( int msec )
 			cls.frametime  = ((float)packet_timer) / 1000.0f;
 			Sys_SendKeyEvents();
 			
+			CL_StageBegin (STAGE_PREDICT);
 			CL_PredictMovement (packet_timer);
+			CL_StageEnd (STAGE_PREDICT);
 		}
 
 		/*
@@ -49,7 +49,9 @@ char *svc_strings[256] =
 	"svc_playerinfo",
 	"svc_packetentities",
 	"svc_deltapacketentities",
-	"svc_frame"
+	"svc_frame",
+	"svc_dlstart",
+	"svc_dlchunk"
 };
 
 static size_t szr; // just for unused result warnings
@@ -80,6 +82,27 @@ void CL_DownloadFileName (char *dest, int destlen, char *fn)
 	Com_sprintf (dest, destlen-1, "%s/%s", FS_Gamedir(), fn);
 }
 
+/*
+===============
+CL_RequestDownload
+
+Asks the server for cls.downloadname from offset on
+===============
+*/
+static void CL_RequestDownload (int offset)
+{
+	MSG_WriteByte (&cls.netchan.message, clc_stringcmd);
+	if (cl_dlwindow->integer)	// older servers ignore the third argument
+		MSG_WriteString (&cls.netchan.message,
+			va("download %s %i 1", cls.downloadname, offset));
+	else if (offset)
+		MSG_WriteString (&cls.netchan.message,
+			va("download %s %i", cls.downloadname, offset));
+	else
+		MSG_WriteString (&cls.netchan.message,
+			va("download %s", cls.downloadname));
+}
+
 // Current download has been completed, rename temp file to main file
 void CL_DownloadComplete (void)
 {
@@ -95,6 +118,7 @@ void CL_DownloadComplete (void)
 		Com_Printf ("failed to rename.\n");
 	else
 		Com_Printf("Download complete: %s\n", cls.downloadname );
+	FS_InvalidateIndex (newn);
 }
 
 /*
@@ -208,15 +232,11 @@ qboolean	CL_CheckOrDownloadFile (char *filename)
 
 		// give the server an offset to start the download
 		Com_Printf ("Resuming %s\n", cls.downloadname);
-		MSG_WriteByte (&cls.netchan.message, clc_stringcmd);
-		MSG_WriteString (&cls.netchan.message,
-			va("download %s %i", cls.downloadname, len));
+		CL_RequestDownload (len);
 	} else
 	{
 		Com_Printf ("Downloading %s\n", cls.downloadname);
-		MSG_WriteByte (&cls.netchan.message, clc_stringcmd);
-		MSG_WriteString (&cls.netchan.message,
-			va("download %s", cls.downloadname));
+		CL_RequestDownload (0);
 	}
 
 	cls.downloadnumber++;
@@ -287,9 +307,7 @@ void	CL_Download_f (void)
 
 	if (udp)
 	{
-		MSG_WriteByte (&cls.netchan.message, clc_stringcmd);
-		MSG_WriteString (&cls.netchan.message,
-			va("download %s", cls.downloadname));
+		CL_RequestDownload (0);
 
 		cls.downloadnumber++;
 	}
@@ -323,6 +341,90 @@ void CL_RegisterSounds (void)
 }
 
 
+/*
+===============
+CL_DownloadBench_f
+
+dlbench <filename>: downloads a file the server has, reports the
+throughput and throws it away. Works on a listen server too, where the
+file is already there.
+===============
+*/
+void CL_DownloadBench_f (void)
+{
+	if (Cmd_Argc () != 2)
+	{
+		Com_Printf ("Usage: dlbench <filename>\n");
+		return;
+	}
+	if (cls.state < ca_connected)
+	{
+		Com_Printf ("Not connected to a server.\n");
+		return;
+	}
+	if (cls.download)
+	{
+		Com_Printf ("Already downloading something.\n");
+		return;
+	}
+	if (strstr (Cmd_Argv(1), ".."))
+	{
+		Com_Printf ("Refusing to download a path with ..\n");
+		return;
+	}
+
+	Q_strncpyz (cls.downloadname, Cmd_Argv(1), sizeof(cls.downloadname));
+	Q_strncpyz (cls.downloadtempname, "dlbench.tmp", sizeof(cls.downloadtempname));
+	cls.downloadbench = true;
+	cls.downloadbenchstart = Sys_Milliseconds ();
+
+	CL_RequestDownload (0);
+	send_packet_now = true;
+}
+
+/*
+=====================
+CL_FinishDownload
+
+The last of the file has been written
+=====================
+*/
+static void CL_FinishDownload (void)
+{
+	char	name[MAX_OSPATH];
+	int		bytes, msec;
+	qboolean	windowed;
+
+	bytes = (int)ftell (cls.download);
+	fclose (cls.download);
+
+	windowed = cls.downloadwindowed;
+	cls.download = NULL;
+	cls.downloadpercent = 0;
+	cls.downloadwindowed = false;
+
+	if (cls.downloadbench)
+	{
+		cls.downloadbench = false;
+		CL_DownloadFileName (name, sizeof(name), cls.downloadtempname);
+		remove (name);
+
+		msec = Sys_Milliseconds () - cls.downloadbenchstart;
+		if (msec < 1)
+			msec = 1;
+		Com_Printf ("dlbench: %i bytes in %i ms, %.1f KB/s (%s)\n", bytes, msec,
+			bytes / 1.024 / msec, windowed ? "windowed" : "one chunk per round trip");
+		cls.downloadname[0] = 0;
+		cls.downloadtempname[0] = 0;
+		return;
+	}
+
+	CL_DownloadComplete ();
+
+	// get another file if needed
+	CL_RequestNextDownload ();
+}
+
 /* Helper functions for CL_ParseDownload
  */
 static void jpg_to_tga()
@@ -390,10 +492,7 @@ void CL_ParseDownload (void)
 			else
 			{ // No HTTP, try UDP
 				Com_Printf("Downloading %s\n", cls.downloadname);
-				MSG_WriteByte(
-					&cls.netchan.message, clc_stringcmd);
-				MSG_WriteString(
-					&cls.netchan.message, va("download %s", cls.downloadname));
+				CL_RequestDownload (0);
 			}
 			return;
 		}
@@ -429,17 +528,142 @@ void CL_ParseDownload (void)
 		send_packet_now = true;
 	}
 	else
+		CL_FinishDownload ();
+}
+
+/*
+=====================
+CL_ParseDownloadStart
+
+The server is about to send cls.downloadname as unreliable chunks
+=====================
+*/
+void CL_ParseDownloadStart (void)
+{
+	int		size, offset;
+	char	name[MAX_OSPATH];
+
+	size = MSG_ReadLong (&net_message);
+	offset = MSG_ReadLong (&net_message);
+
+	if (!cls.downloadname[0] || cls.downloadhttp)
+		return;
+
+	if (!cls.download)
 	{
-		fclose (cls.download);
+		CL_DownloadFileName(name, sizeof(name), cls.downloadtempname);
 
-		cls.download = NULL;
-		cls.downloadpercent = 0;
-		
-		CL_DownloadComplete ();
+		FS_CreatePath (name);
+
+		cls.download = fopen (name, "wb");
+		if (!cls.download)
+		{
+			Com_Printf ("Failed to open %s\n", cls.downloadtempname);
+
+			// tell the server we're done with it
+			MSG_WriteByte (&cls.netchan.message, clc_dlack);
+			MSG_WriteLong (&cls.netchan.message, size);
+			MSG_WriteLong (&cls.netchan.message, 0);
+			MSG_WriteLong (&cls.netchan.message, 0);
+			CL_RequestNextDownload ();
+			return;
+		}
+	}
+	fseek (cls.download, offset, SEEK_SET);
+
+	cls.downloadwindowed = true;
+	cls.downloadsize = size;
+	cls.downloadstart = offset;
+	cls.downloadpos = offset;
+	cls.downloadmask = 0;
+	cls.downloadpercent = size ? (int)(offset*100.0/size) : 0;
+
+	if (offset >= size)
+		CL_FinishDownload ();
+}
+
+/*
+=====================
+CL_ParseDownloadChunk
 
-		// get another file if needed
-		CL_RequestNextDownload ();
+Chunks are only ever written in order, so an interrupted download leaves
+a tmp file that can be resumed from its length. Chunks that arrive ahead
+of that are held in the window until the gap is filled.
+=====================
+*/
+static byte	cl_dlwindowdata[DL_WINDOW_MAX][DL_CHUNKSIZE];
+static int	cl_dlwindowsize[DL_WINDOW_MAX];
+
+void CL_ParseDownloadChunk (void)
+{
+	int		offset, size;
+	int		k, slot;
+	byte	*data;
+	qboolean	held;
+
+	offset = MSG_ReadLong (&net_message);
+	size = MSG_ReadShort (&net_message);
+	if (size < 0 || size > DL_CHUNKSIZE || net_message.readcount + size > net_message.cursize)
+		Com_Error (ERR_DROP, "CL_ParseDownloadChunk: bad chunk");
+	data = net_message.data + net_message.readcount;
+	net_message.readcount += size;
+
+	if (!cls.downloadwindowed || !cls.download)
+		return;
+	if (offset < cls.downloadpos || (offset - cls.downloadpos) % DL_CHUNKSIZE)
+		return;		// already written
+	k = (offset - cls.downloadpos) / DL_CHUNKSIZE;
+	if (k >= DL_WINDOW_MAX)
+		return;
+
+	if (k)
+	{	// ahead of the gap, hold on to it
+		if (cls.downloadmask & (1ULL << (k-1)))
+			return;
+		slot = ((offset - cls.downloadstart) / DL_CHUNKSIZE) % DL_WINDOW_MAX;
+		memcpy (cl_dlwindowdata[slot], data, size);
+		cl_dlwindowsize[slot] = size;
+		cls.downloadmask |= 1ULL << (k-1);
+		return;
+	}
+
+	// write it and everything held right behind it
+	szr = fwrite (data, 1, size, cls.download);
+	cls.downloadpos += size;
+	held = cls.downloadmask & 1;
+	cls.downloadmask >>= 1;
+	while (held)
+	{
+		slot = ((cls.downloadpos - cls.downloadstart) / DL_CHUNKSIZE) % DL_WINDOW_MAX;
+		szr = fwrite (cl_dlwindowdata[slot], 1, cl_dlwindowsize[slot], cls.download);
+		cls.downloadpos += cl_dlwindowsize[slot];
+		held = cls.downloadmask & 1;
+		cls.downloadmask >>= 1;
 	}
+
+	cls.downloadpercent = (int)(cls.downloadpos*100.0/cls.downloadsize);
+
+	if (cls.downloadpos >= cls.downloadsize)
+	{
+		// the last ack goes reliably, so the server lets go of the file
+		CL_WriteDownloadAck (&cls.netchan.message);
+		CL_FinishDownload ();
+	}
+}
+
+/*
+=====================
+CL_WriteDownloadAck
+
+Sent with every packet while a windowed download is running
+=====================
+*/
+void CL_WriteDownloadAck (sizebuf_t *buf)
+{
+	MSG_WriteByte (buf, clc_dlack);
+	MSG_WriteLong (buf, cls.downloadpos);
+	MSG_WriteLong (buf, (int)(cls.downloadmask & 0xffffffff));
+	MSG_WriteLong (buf, (int)(cls.downloadmask >> 32));
 }
 
 
@@ -477,7 +701,7 @@ void CL_ParseServerData (void)
 	if (Com_ServerState() && (PROTOCOL_VERSION == 34 || PROTOCOL_VERSION == 35 || PROTOCOL_VERSION == 36))
 	{
 	}
-	else if (i != PROTOCOL_VERSION)
+	else if (i != PROTOCOL_VERSION && i != PROTOCOL_PACKED)
 		Com_Error (ERR_DROP,"Server returned version %i, not %i", i, PROTOCOL_VERSION);
 
 	cl.servercount = MSG_ReadLong (&net_message);
@@ -1009,6 +1233,14 @@ void CL_ParseServerMessage (void)
 			CL_ParseDownload ();
 			break;
 
+		case svc_dlstart:
+			CL_ParseDownloadStart ();
+			break;
+
+		case svc_dlchunk:
+			CL_ParseDownloadChunk ();
+			break;
+
 		case svc_frame:
 			CL_ParseFrame ();
 			break;
@@ -781,6 +781,7 @@ void V_RenderView( float stereo_separation )
 		{ /* time demo start trigger */
 			cl.timedemo_start = Sys_Milliseconds ();
 			cl.timedemo_frames = 0;
+			CL_StageReset ();
 		}
 	}
 
@@ -875,7 +876,10 @@ void V_RenderView( float stereo_separation )
 
 	cl.refdef.rdflags |= RDF_BLOOM;   //BLOOMS
 
+	CL_StageRefdef (&cl.refdef);
+	CL_StageBegin (STAGE_REFRESH);
 	R_RenderFrame (&cl.refdef);
+	CL_StageEnd (STAGE_REFRESH);
 	if (cl_stats->value)
 		Com_Printf ("ent:%i  lt:%i  part:%i\n", r_numentities, r_numdlights, r_numparticles);
 	if ( log_stats->value && ( log_stats_file != 0 ) )
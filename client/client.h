@@ -265,6 +265,13 @@ typedef struct
 	char		downloadurl[MAX_OSPATH];  // for http downloads
 	qboolean	downloadhttp;
 	qboolean	downloadfromcommand;
+	qboolean	downloadwindowed;	// chunks arrive out of order, see CL_ParseDownloadChunk
+	int			downloadsize;
+	int			downloadstart;		// offset the windowed download began at
+	int			downloadpos;		// bytes written
+	unsigned long long	downloadmask;	// chunks past downloadpos held in the window
+	qboolean	downloadbench;		// dlbench: time the transfer, then delete it
+	int			downloadbenchstart;
 
 // demo recording info must be here, so it isn't cleared on level change
 	qboolean	demorecording;
@@ -336,6 +343,9 @@ extern	cvar_t	*freelook;
 
 extern	cvar_t	*cl_paused;
 extern	cvar_t	*cl_timedemo;
+extern	cvar_t	*cl_timedemojson;
+extern	cvar_t	*cl_timedemocampath;
+extern	cvar_t	*cl_dlwindow;
 
 extern	cvar_t	*cl_vwep;
 
@@ -445,6 +455,8 @@ void CL_ClearTEnts (void);
 int CL_ParseEntityBits (unsigned *bits);
 void CL_ParseDelta (entity_state_t *from, entity_state_t *to, int number, int bits);
 void CL_ParseFrame (void);
+void CL_DeltaBench_f (void);
+void CL_DeltaBenchReport (void);
 
 void CL_ParseTEnt (void);
 void CL_ParseConfigString (void);
@@ -491,6 +503,25 @@ void CL_Snd_Restart_f (void);
 void CL_Precache_f (void);
 void CL_RequestNextDownload (void);
 
+typedef enum
+{
+	STAGE_PARSE,
+	STAGE_PREDICT,
+	STAGE_PACKETENTITIES,
+	STAGE_TENTS,
+	STAGE_PARTICLES,
+	STAGE_DLIGHTS,
+	STAGE_CLENTITIES,
+	STAGE_REFRESH,
+	NUM_STAGES
+} clstage_t;
+
+void CL_StageReset (void);
+void CL_StageBegin (clstage_t stage);
+void CL_StageEnd (clstage_t stage);
+void CL_StageRefdef (refdef_t *fd);
+void CL_StageReport (int frames, int msec);
+
 //
 // cl_input
 //
@@ -554,6 +585,8 @@ void CL_ParseClientinfo (int player);
 void CL_DownloadFileName (char *dest, int destlen, char *fn);
 void CL_DownloadComplete (void);
 void CL_Download_f (void);
+void CL_DownloadBench_f (void);
+void CL_WriteDownloadAck (sizebuf_t *buf);
 
 //
 // cl_scrn.c
@@ -641,6 +674,7 @@ void V_Init (void);
 void V_RenderView( float stereo_separation );
 void V_AddEntity (entity_t *ent);
 void V_AddViewEntity (entity_t *ent);
+void V_ClearScene (void);
 void V_AddParticle (particle_t	*p);
 void V_AddLight (vec3_t org, float intensity, float r, float g, float b);
 void V_AddTeamLight (vec3_t org, float intensity, float r, float g, float b, int team);
@@ -678,6 +712,7 @@ void CL_BlasterMark(vec3_t org, vec3_t dir);
 void CL_DiminishingTrail (vec3_t start, vec3_t end, centity_t *old, int flags);
 void CL_BfgParticles (entity_t *ent);
 void CL_AddParticles (void);
+void CL_ParticleBench_f (void);
 void CL_EntityEvent (entity_state_t *ent);
 qboolean server_is_team; //used for player visibility light code
 void CL_BloodEffect (vec3_t org, vec3_t dir, int color, int count);
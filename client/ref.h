@@ -206,11 +206,12 @@ typedef struct
 
 #define P_LIGHTS_MAX 8
 
+// Effect spawners fill one of these in and the renderer reads the current_*
+// fields back, but the client simulates particles in its own parallel arrays
+// (see cl_fx.c), so this is only the per-particle record the two share.
 typedef struct particle_s
 {
-	struct particle_s	*next;
-
-	cplight_t	lights[P_LIGHTS_MAX];
+	struct particle_s	*next;		// free list
 	
 	qboolean	free;
 
@@ -247,6 +248,11 @@ typedef struct particle_s
 	struct particle_s	*chain_prev;
 	vec3_t				current_pspan;
 
+	// new_particle clears everything above here; only the first numlights
+	// lights are valid
+	int			numlights;
+	cplight_t	lights[P_LIGHTS_MAX];
+
 } particle_t;
 
 
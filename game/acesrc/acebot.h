@@ -144,6 +144,7 @@ extern node_t nodes[MAX_NODES];
 extern item_table_t item_table[MAX_EDICTS];
 extern qboolean debug_mode;
 extern int bot_numnodes;
+extern qboolean node_grid;
 extern int num_items;
 extern int num_bots;
 
@@ -187,6 +188,8 @@ void     ACEMV_Wander (edict_t *self, usercmd_t *ucmd);
 
 // acebot_nodes.c protos
 int      ACEND_FindCost(int from, int to);
+int      ACEND_NextNode(int from, int to);
+void     ACEND_LinkNodeGrid(int node);
 int      ACEND_FindCloseReachableNode(edict_t *self, int dist, int type);
 int      ACEND_FindClosestReachableNode(edict_t *self, int range, int type);
 void     ACEND_SetGoal(edict_t *self, int goal_node);
@@ -201,6 +204,7 @@ void     ACEND_ShowPath(edict_t *self, int goal_node);
 int      ACEND_AddNode(edict_t *self, int type);
 void     ACEND_UpdateNodeEdge(int from, int to);
 void     ACEND_RemoveNodeEdge(edict_t *self, int from, int to);
+void     ACEND_MoveNode(int node, vec3_t origin);
 void     ACEND_ResolveAllPaths();
 void     ACEND_SaveNodes();
 void     ACEND_LoadNodes();
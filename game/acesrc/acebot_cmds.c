@@ -111,10 +111,13 @@ qboolean ACECM_Commands(edict_t *ent)
 
 	else if(Q_strcasecmp (cmd, "movenode") == 0 && debug_mode)
 	{
+		vec3_t origin;
+
 		node = atoi(gi.argv(1));
-		nodes[node].origin[0] = atof(gi.argv(2));
-		nodes[node].origin[1] = atof(gi.argv(3));
-		nodes[node].origin[2] = atof(gi.argv(4));
+		origin[0] = atof(gi.argv(2));
+		origin[1] = atof(gi.argv(3));
+		origin[2] = atof(gi.argv(4));
+		ACEND_MoveNode(node, origin);
 		safe_bprintf(PRINT_MEDIUM,"node: %d moved to x: %f y: %f z %f\n",node, nodes[node].origin[0],nodes[node].origin[1],nodes[node].origin[2]);
 	}
 
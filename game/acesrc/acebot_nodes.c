@@ -80,65 +80,517 @@ int show_path_to = -1;
 // array for node data
 node_t nodes[MAX_NODES];
 edict_t *node_showents[MAX_NODES];
-short int path_table[MAX_NODES][MAX_NODES];
 
 ///////////////////////////////////////////////////////////////////////
-// NODE INFORMATION FUNCTIONS
+// NODE GRAPH
+//
+// Links are kept as a linked list of outgoing links per node, drawn
+// from a fixed pool. Routes are found with A* when they are needed, and
+// the answers are kept in a small LRU cache, since bots keep asking the
+// same questions until they reach their goal.
 ///////////////////////////////////////////////////////////////////////
 
+#define MAX_NODE_LINKS (MAX_NODES*16)
+
+typedef struct
+{
+	int to;
+	int next;		// next link out of the same node
+	float cost;
+} node_link_t;
+
+static node_link_t node_links[MAX_NODE_LINKS];
+static int node_firstlink[MAX_NODES];
+static int node_freelinks;	// unused links, chained through next
+static int num_node_links;
+
+// one answer per (from, to) pair, including "no route"
+#define PATH_CACHE_SIZE 4096
+#define PATH_HASH_SIZE 8192
+
+typedef struct
+{
+	short from, to;
+	short next;		// first node on the way, or INVALID
+	short hops;		// hops left to the goal, or INVALID
+	int hashnext;
+	int lruprev, lrunext;
+} path_cache_t;
+
+static path_cache_t path_cache[PATH_CACHE_SIZE];
+static int path_hash[PATH_HASH_SIZE];
+static int path_lru = -1;	// most recently used, list is circular
+static int path_cache_used;
+
+// Nodes are also hashed into a grid of NODE_DENSITY sized columns, so
+// the closest node search only has to look at nodes in range
+#define NODE_GRID_HASH 1024
+#define NODE_GRID_HASHKEY(x,y) ((((unsigned)(x)*73856093u)^((unsigned)(y)*19349663u))&(NODE_GRID_HASH-1))
+
+static int node_gridhead[NODE_GRID_HASH];
+static int node_gridnext[MAX_NODES];
+static int node_gridbucket[MAX_NODES];	// INVALID if not in the grid
+static int node_gridsearch[NODE_GRID_HASH];	// to visit each bucket once
+static int node_gridsearches;
+qboolean node_grid = true;	// false searches all nodes, for comparison
+
+// A* scratch, reset by bumping astar_search
+typedef struct
+{
+	int search;		// valid when equal to astar_search
+	qboolean closed;
+	float g, f;
+	int parent;
+	unsigned int heapidx;
+} astar_node_t;
+
+static astar_node_t astar_nodes[MAX_NODES];
+static astar_node_t *astar_heap[MAX_NODES];	// open list, a binary min-heap on f
+static int astar_heapcount;
+static int astar_search;
+
 ///////////////////////////////////////////////////////////////////////
-// Determine cost of moving from one node to another
+// Empty the route cache, needed whenever a link changes
 ///////////////////////////////////////////////////////////////////////
-int ACEND_FindCost(int from, int to)
+static void ACEND_FlushPathCache(void)
 {
-	int curnode;
-	int cost=1; // Shortest possible is 1
+	memset(path_hash,-1,sizeof(path_hash));
+	path_lru = -1;
+	path_cache_used = 0;
+}
 
-	// If we can not get there then return invalid
-	if (path_table[from][to] == INVALID)
+///////////////////////////////////////////////////////////////////////
+// Remove all links
+///////////////////////////////////////////////////////////////////////
+static void ACEND_ClearLinks(void)
+{
+	int i;
+
+	for(i=0;i<MAX_NODES;i++)
+		node_firstlink[i] = INVALID;
+
+	for(i=0;i<MAX_NODE_LINKS-1;i++)
+		node_links[i].next = i+1;
+	node_links[MAX_NODE_LINKS-1].next = INVALID;
+	node_freelinks = 0;
+	num_node_links = 0;
+
+	ACEND_FlushPathCache();
+}
+
+///////////////////////////////////////////////////////////////////////
+// Find the link from -> to, or INVALID
+///////////////////////////////////////////////////////////////////////
+static int ACEND_FindLink(int from, int to)
+{
+	int l;
+
+	for(l=node_firstlink[from];l!=INVALID;l=node_links[l].next)
+		if(node_links[l].to == to)
+			return l;
+
+	return INVALID;
+}
+
+///////////////////////////////////////////////////////////////////////
+// Add a link without any checks or cache handling
+///////////////////////////////////////////////////////////////////////
+static qboolean ACEND_AddLink(int from, int to)
+{
+	int l;
+	vec3_t v;
+
+	if(ACEND_FindLink(from,to) != INVALID)
+		return true;
+
+	if(node_freelinks == INVALID)
 	{
-		//if(debug_mode)
-		//		debug_printf("Found invalid path!");
-		return INVALID;
+		gi.dprintf("ACEND_AddLink: MAX_NODE_LINKS exceeded\n");
+		return false;
 	}
-	// Otherwise check the path and return the cost
-	curnode = path_table[from][to];
 
-	// Find a path (linear time, very fast)
-	while(curnode != to)
+	l = node_freelinks;
+	node_freelinks = node_links[l].next;
+
+	VectorSubtract(nodes[to].origin,nodes[from].origin,v);
+	node_links[l].to = to;
+	node_links[l].cost = VectorLength(v);
+	node_links[l].next = node_firstlink[from];
+	node_firstlink[from] = l;
+	num_node_links++;
+
+	return true;
+}
+
+///////////////////////////////////////////////////////////////////////
+// Look up a cached route, moving it to the front of the LRU list
+///////////////////////////////////////////////////////////////////////
+static path_cache_t *ACEND_CachedPath(int from, int to)
+{
+	int i;
+	path_cache_t *p;
+
+	for(i=path_hash[(from*MAX_NODES+to)&(PATH_HASH_SIZE-1)];i!=INVALID;i=p->hashnext)
 	{
-		curnode = path_table[curnode][to];
-		if(curnode == INVALID) // something has corrupted the path abort
+		p = &path_cache[i];
+		if(p->from != from || p->to != to)
+			continue;
+
+		if(i != path_lru)
 		{
-			//if(debug_mode)
-			//	debug_printf("Found invalid path!");
+			// unlink, then put back in front of the old head
+			path_cache[p->lruprev].lrunext = p->lrunext;
+			path_cache[p->lrunext].lruprev = p->lruprev;
+			p->lrunext = path_lru;
+			p->lruprev = path_cache[path_lru].lruprev;
+			path_cache[p->lruprev].lrunext = i;
+			path_cache[path_lru].lruprev = i;
+			path_lru = i;
+		}
+		return p;
+	}
+
+	return NULL;
+}
+
+///////////////////////////////////////////////////////////////////////
+// Remember a route, throwing out the least recently used one if full
+///////////////////////////////////////////////////////////////////////
+static void ACEND_CachePath(int from, int to, int next, int hops)
+{
+	int i, *link;
+	path_cache_t *p;
 
-			return INVALID;
+	if(ACEND_CachedPath(from,to))
+		return; // already known from an earlier search
+
+	if(path_cache_used < PATH_CACHE_SIZE)
+	{
+		i = path_cache_used++;
+		p = &path_cache[i];
+		if(path_lru == INVALID)
+		{
+			p->lruprev = p->lrunext = i;
 		}
-		cost++;
-		if(cost > 500) {
-			if(debug_mode)
-				debug_printf("Cost exceeded maximum!\n");
+		else
+		{
+			p->lrunext = path_lru;
+			p->lruprev = path_cache[path_lru].lruprev;
+			path_cache[p->lruprev].lrunext = i;
+			path_cache[path_lru].lruprev = i;
+		}
+	}
+	else
+	{
+		// the tail of the circular list is the oldest; reuse it in place
+		i = path_cache[path_lru].lruprev;
+		p = &path_cache[i];
+		for(link=&path_hash[(p->from*MAX_NODES+p->to)&(PATH_HASH_SIZE-1)];*link!=i;link=&path_cache[*link].hashnext)
+			;
+		*link = p->hashnext;
+	}
+	path_lru = i;
+
+	p->from = from;
+	p->to = to;
+	p->next = next;
+	p->hops = hops;
+	p->hashnext = path_hash[(from*MAX_NODES+to)&(PATH_HASH_SIZE-1)];
+	path_hash[(from*MAX_NODES+to)&(PATH_HASH_SIZE-1)] = i;
+}
+
+///////////////////////////////////////////////////////////////////////
+// The open list. Kept here rather than using qcommon/binheap.c, since
+// the game module can't rely on engine objects being linked in. Ties
+// on f are broken by address so the pop order is the same every run.
+///////////////////////////////////////////////////////////////////////
+static qboolean ACEND_AStarLess(const astar_node_t *a, const astar_node_t *b)
+{
+	if(a->f != b->f)
+		return a->f < b->f;
+	return a < b;
+}
+
+static void ACEND_HeapPlace(astar_node_t *n, unsigned int i)
+{
+	astar_heap[i] = n;
+	n->heapidx = i;
+}
+
+// n is at i, or going there, and its f has not gone up
+static void ACEND_HeapUp(astar_node_t *n, unsigned int i)
+{
+	unsigned int p;
+
+	while(i > 0)
+	{
+		p = (i-1)/2;
+		if(!ACEND_AStarLess(n,astar_heap[p]))
+			break;
+		ACEND_HeapPlace(astar_heap[p],i);
+		i = p;
+	}
+	ACEND_HeapPlace(n,i);
+}
+
+static void ACEND_HeapPush(astar_node_t *n)
+{
+	ACEND_HeapUp(n,astar_heapcount++);
+}
+
+static astar_node_t *ACEND_HeapPop(void)
+{
+	astar_node_t *root, *last;
+	unsigned int i, c, count;
+
+	root = astar_heap[0];
+	last = astar_heap[--astar_heapcount];
+	count = astar_heapcount;
+
+	// sift the last item down from the root
+	i = 0;
+	while((c = 2*i+1) < count)
+	{
+		if(c+1 < count && ACEND_AStarLess(astar_heap[c+1],astar_heap[c]))
+			c++;
+		if(!ACEND_AStarLess(astar_heap[c],last))
 			break;
+		ACEND_HeapPlace(astar_heap[c],i);
+		i = c;
+	}
+	if(count)
+		ACEND_HeapPlace(last,i);
+
+	return root;
+}
+
+///////////////////////////////////////////////////////////////////////
+// A* from -> to over the link graph. Every node on the route found is
+// put in the cache, since the rest of a shortest route is a shortest
+// route too.
+///////////////////////////////////////////////////////////////////////
+static void ACEND_SearchPath(int from, int to)
+{
+	astar_node_t *cur, *n;
+	int node, l, next, hops;
+	int route[MAX_NODES];
+	float g;
+	vec3_t v;
+
+	astar_search++;
+	astar_heapcount = 0;
+
+	cur = &astar_nodes[from];
+	cur->search = astar_search;
+	cur->closed = false;
+	cur->g = 0;
+	VectorSubtract(nodes[to].origin,nodes[from].origin,v);
+	cur->f = VectorLength(v);
+	cur->parent = INVALID;
+	ACEND_HeapPush(cur);
+
+	while(astar_heapcount)
+	{
+		cur = ACEND_HeapPop();
+		cur->closed = true;
+		node = cur - astar_nodes;
+
+		if(node == to)
+		{
+			// walk back to get the route in order
+			hops = 0;
+			for(;node!=INVALID;node=astar_nodes[node].parent)
+				route[hops++] = node;
+
+			for(l=hops-1;l>0;l--)
+				ACEND_CachePath(route[l],to,route[l-1],l);
+			return;
+		}
+
+		for(l=node_firstlink[node];l!=INVALID;l=node_links[l].next)
+		{
+			next = node_links[l].to;
+			n = &astar_nodes[next];
+			g = cur->g + node_links[l].cost;
+
+			if(n->search == astar_search)
+			{
+				if(n->closed || g >= n->g)
+					continue;
+			}
+			else
+			{
+				n->search = astar_search;
+				n->closed = false;
+				n->heapidx = astar_heapcount++;
+			}
+
+			// f only goes down here, so sifting up is enough for a
+			// node already on the open list
+			n->g = g;
+			VectorSubtract(nodes[to].origin,nodes[next].origin,v);
+			n->f = g + VectorLength(v);
+			n->parent = node;
+			ACEND_HeapUp(n,n->heapidx);
 		}
 	}
 
-	return cost;
+	ACEND_CachePath(from,to,INVALID,INVALID); // no way there
 }
 
 ///////////////////////////////////////////////////////////////////////
-// Find the closest node to the player within a certain range
+// Route lookup, searching on a cache miss
 ///////////////////////////////////////////////////////////////////////
-int ACEND_FindClosestReachableNode(edict_t *self, int range, int type)
+static path_cache_t *ACEND_FindPath(int from, int to)
+{
+	path_cache_t *p;
+
+	if(from < 0 || to < 0 || from >= bot_numnodes || to >= bot_numnodes || from == to)
+		return NULL;
+
+	p = ACEND_CachedPath(from,to);
+	if(!p)
+	{
+		ACEND_SearchPath(from,to);
+		p = ACEND_CachedPath(from,to);
+	}
+
+	return p;
+}
+
+///////////////////////////////////////////////////////////////////////
+// Next node to head for on the way from -> to
+///////////////////////////////////////////////////////////////////////
+int ACEND_NextNode(int from, int to)
+{
+	path_cache_t *p = ACEND_FindPath(from,to);
+
+	return p ? p->next : INVALID;
+}
+
+///////////////////////////////////////////////////////////////////////
+// NODE INFORMATION FUNCTIONS
+///////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////
+// Determine cost of moving from one node to another
+///////////////////////////////////////////////////////////////////////
+int ACEND_FindCost(int from, int to)
+{
+	path_cache_t *p = ACEND_FindPath(from,to);
+
+	// If we can not get there then return invalid
+	if(!p || p->hops == INVALID)
+		return INVALID;
+
+	if(p->hops > 500 && debug_mode)
+		debug_printf("Cost exceeded maximum!\n");
+
+	return p->hops > 500 ? 500 : p->hops;
+}
+
+///////////////////////////////////////////////////////////////////////
+// Empty the node grid
+///////////////////////////////////////////////////////////////////////
+static void ACEND_ClearNodeGrid(void)
 {
 	int i;
-	float closest = 99999;
+
+	for(i=0;i<NODE_GRID_HASH;i++)
+	{
+		node_gridhead[i] = INVALID;
+		node_gridsearch[i] = 0;
+	}
+	for(i=0;i<MAX_NODES;i++)
+		node_gridbucket[i] = INVALID;
+	node_gridsearches = 0;
+}
+
+///////////////////////////////////////////////////////////////////////
+// Put a node into the grid, or move it if its origin changed
+///////////////////////////////////////////////////////////////////////
+void ACEND_LinkNodeGrid(int node)
+{
+	int *link, bucket;
+
+	if(node < 0 || node >= MAX_NODES)
+		return;
+
+	if(node_gridbucket[node] != INVALID)
+	{
+		for(link=&node_gridhead[node_gridbucket[node]];*link!=node;link=&node_gridnext[*link])
+			;
+		*link = node_gridnext[node];
+	}
+
+	bucket = NODE_GRID_HASHKEY((int)floor(nodes[node].origin[0]/NODE_DENSITY),
+		(int)floor(nodes[node].origin[1]/NODE_DENSITY));
+	node_gridbucket[node] = bucket;
+	node_gridnext[node] = node_gridhead[bucket];
+	node_gridhead[bucket] = node;
+}
+
+typedef struct
+{
+	float dist;
+	int node;
+} node_candidate_t;
+
+static int ACEND_CompareCandidates(const void *a, const void *b)
+{
+	const node_candidate_t *ca = a, *cb = b;
+
+	if(ca->dist < cb->dist) return -1;
+	if(ca->dist > cb->dist) return 1;
+	return ca->node - cb->node;
+}
+
+///////////////////////////////////////////////////////////////////////
+// Add node i to the candidates if it is the right type and in range
+///////////////////////////////////////////////////////////////////////
+static void ACEND_AddCandidate(edict_t *self, int i, int type, float rng, node_candidate_t *cand, int *numcand)
+{
 	float dist;
-	int node=-1;
 	vec3_t v;
+
+	if(type == NODE_ALL || type == nodes[i].type) // check node type
+	{
+		if(type == NODE_ALL && (nodes[i].type == NODE_REDBASE || nodes[i].type == NODE_BLUEBASE))
+			return; //we don't want to look for these unless specifically doing so
+
+		VectorSubtract(nodes[i].origin, self->s.origin, v); // subtract first
+
+		dist = VectorLength(v);
+
+		if(self->current_node != -1)
+		{
+			dist = dist + abs(self->current_node - i); //try to keep the bot on the current path(i.e - nodes in sequence are weighted over those out)
+		}
+
+		if(dist < rng)
+		{
+			cand[*numcand].dist = dist;
+			cand[*numcand].node = i;
+			(*numcand)++;
+		}
+	}
+}
+
+///////////////////////////////////////////////////////////////////////
+// Find the closest node to the player within a certain range
+//
+// The nodes in range are sorted by distance first, so only the ones
+// that turn out not to be reachable cost a trace.
+///////////////////////////////////////////////////////////////////////
+int ACEND_FindClosestReachableNode(edict_t *self, int range, int type)
+{
+	int i, x, y;
+	int x0, x1, y0, y1, bucket;
 	trace_t tr;
 	float rng;
 	vec3_t maxs,mins;
+	node_candidate_t cand[MAX_NODES];
+	int numcand = 0;
 
 	VectorCopy(self->mins,mins);
 	VectorCopy(self->maxs,maxs);
@@ -154,36 +606,45 @@ int ACEND_FindClosestReachableNode(edict_t *self, int range, int type)
 
 	rng = (float)(range); // square range for distance comparison (eliminate sqrt)
 
-	for(i=0;i<bot_numnodes;i++)
-	{
-		if(type == NODE_ALL || type == nodes[i].type) // check node type
-		{
-			if(type == NODE_ALL && (nodes[i].type == NODE_REDBASE || nodes[i].type == NODE_BLUEBASE))
-				continue; //we don't want to look for these unless specifically doing so
-
-			VectorSubtract(nodes[i].origin, self->s.origin, v); // subtract first
+	x0 = (int)floor((self->s.origin[0] - rng)/NODE_DENSITY);
+	x1 = (int)floor((self->s.origin[0] + rng)/NODE_DENSITY);
+	y0 = (int)floor((self->s.origin[1] - rng)/NODE_DENSITY);
+	y1 = (int)floor((self->s.origin[1] + rng)/NODE_DENSITY);
 
-			dist = VectorLength(v);
-
-			if(self->current_node != -1)
+	// big searches are quicker without the grid
+	if(!node_grid || (x1-x0+1)*(y1-y0+1) > NODE_GRID_HASH/4)
+	{
+		for(i=0;i<bot_numnodes;i++)
+			ACEND_AddCandidate(self, i, type, rng, cand, &numcand);
+	}
+	else
+	{
+		node_gridsearches++;
+		for(x=x0;x<=x1;x++)
+			for(y=y0;y<=y1;y++)
 			{
-				dist = dist + abs(self->current_node - i); //try to keep the bot on the current path(i.e - nodes in sequence are weighted over those out)
+				bucket = NODE_GRID_HASHKEY(x,y);
+				if(node_gridsearch[bucket] == node_gridsearches)
+					continue; // several columns can share a bucket
+				node_gridsearch[bucket] = node_gridsearches;
+
+				for(i=node_gridhead[bucket];i!=INVALID;i=node_gridnext[i])
+					if(i < bot_numnodes)
+						ACEND_AddCandidate(self, i, type, rng, cand, &numcand);
 			}
+	}
 
-			if(dist < closest && dist < rng)
-			{
-				// make sure it is visible
-				tr = gi.trace (self->s.origin, mins, maxs, nodes[i].origin, self, MASK_SOLID);
-				if(tr.fraction == 1.0)
-				{
-					node = i;
-					closest = dist;
-				}
-			}
-		}
+	qsort(cand, numcand, sizeof(cand[0]), ACEND_CompareCandidates);
+
+	for(i=0;i<numcand;i++)
+	{
+		// make sure it is visible
+		tr = gi.trace (self->s.origin, mins, maxs, nodes[cand[i].node].origin, self, MASK_SOLID);
+		if(tr.fraction == 1.0)
+			return cand[i].node;
 	}
 
-	return node;
+	return -1;
 }
 
 ///////////////////////////////////////////////////////////////////////
@@ -296,7 +757,7 @@ qboolean ACEND_FollowPath(edict_t *self)
 		else
 		{
 			self->current_node = self->next_node;
-			self->next_node = path_table[self->current_node][self->goal_node];
+			self->next_node = ACEND_NextNode(self->current_node,self->goal_node);
 		}
 	}
 
@@ -317,7 +778,8 @@ void ACEND_InitNodes(void)
 	bot_numnodes = 1;
 	numitemnodes = 1;
 	memset(nodes,0,sizeof(node_t) * MAX_NODES);
-	memset(path_table,INVALID,sizeof(short int)*MAX_NODES*MAX_NODES);
+	ACEND_ClearLinks();
+	ACEND_ClearNodeGrid();
 	memset(node_showents,0,sizeof(edict_t *)*MAX_NODES);
 
 }
@@ -367,6 +829,7 @@ void ACEND_ShowNode(int node)
 void ACEND_DrawPath()
 {
 	int current_node, goal_node, next_node;
+	int hops = 0;
 	
 	if (!debug_mode)
 	    return;
@@ -374,10 +837,11 @@ void ACEND_DrawPath()
 	current_node = show_path_from;
 	goal_node = show_path_to;
 
-	next_node = path_table[current_node][goal_node];
+	next_node = ACEND_NextNode(current_node,goal_node);
 
 	// Now set up and display the path
-	while(current_node != goal_node && current_node != -1)
+	while(current_node != goal_node && current_node != -1 && next_node != -1
+		&& hops++ < bot_numnodes)
 	{
 		gi.WriteByte (svc_temp_entity);
 		gi.WriteByte (TE_REDLASER);
@@ -385,7 +849,7 @@ void ACEND_DrawPath()
 		gi.WritePosition (nodes[next_node].origin);
 		gi.multicast (nodes[current_node].origin, MULTICAST_PVS);
 		current_node = next_node;
-		next_node = path_table[current_node][goal_node];
+		next_node = ACEND_NextNode(current_node,goal_node);
 	}
 }
 
@@ -442,6 +906,7 @@ int ACEND_AddNode(edict_t *self, int type)
 			ACEND_ShowNode(bot_numnodes);
 		}
 
+		ACEND_LinkNodeGrid(bot_numnodes);
 		bot_numnodes++;
 		return bot_numnodes-1; // return the node added
 
@@ -461,6 +926,7 @@ int ACEND_AddNode(edict_t *self, int type)
 		if(debug_mode)
 			ACEND_ShowNode(bot_numnodes);
 
+		ACEND_LinkNodeGrid(bot_numnodes);
 		bot_numnodes++;
 
 		nodes[bot_numnodes].origin[0] = nodes[bot_numnodes-1].origin[0];
@@ -478,6 +944,7 @@ int ACEND_AddNode(edict_t *self, int type)
 			ACEND_ShowNode(bot_numnodes);
 		}
 
+		ACEND_LinkNodeGrid(bot_numnodes);
 		bot_numnodes++;
 
 		return bot_numnodes -1;
@@ -505,6 +972,7 @@ int ACEND_AddNode(edict_t *self, int type)
 		ACEND_ShowNode(bot_numnodes);
 	}
 
+	ACEND_LinkNodeGrid(bot_numnodes);
 	bot_numnodes++;
 
 	return bot_numnodes-1; // return the node added
@@ -515,23 +983,15 @@ int ACEND_AddNode(edict_t *self, int type)
 ///////////////////////////////////////////////////////////////////////
 void ACEND_UpdateNodeEdge(int from, int to)
 {
-	int i;
-
 	if(from == -1 || to == -1 || from == to)
 		return; // safety
 
 	// Add the link
-	path_table[from][to] = to;
+	if(!ACEND_AddLink(from,to))
+		return;
 
-	// Now for the self-referencing part, linear time for each link added
-	for(i=0;i<bot_numnodes;i++)
-		if(path_table[i][from] != INVALID)
-		{
-			if(i == to)
-				path_table[i][to] = INVALID; // make sure we terminate
-			else
-				path_table[i][to] = path_table[i][from];
-		}
+	// Any cached route may now have a shorter alternative
+	ACEND_FlushPathCache();
 
 	if(debug_mode)
 		debug_printf("Link %d -> %d\n", from, to);
@@ -542,52 +1002,67 @@ void ACEND_UpdateNodeEdge(int from, int to)
 ///////////////////////////////////////////////////////////////////////
 void ACEND_RemoveNodeEdge(edict_t *self, int from, int to)
 {
-	int i;
+	int *link, l;
 
 	if(debug_mode)
 		debug_printf("%s: Removing Edge %d -> %d\n", self->client->pers.netname, from, to);
 
-	path_table[from][to] = INVALID; // set to invalid
+	if(from < 0 || from >= MAX_NODES)
+		return;
 
-	// Make sure this gets updated in our path array
-	for(i=0;i<bot_numnodes;i++)
-		if(path_table[from][i] == to)
-			path_table[from][i] = INVALID;
+	for(link=&node_firstlink[from];*link!=INVALID;link=&node_links[*link].next)
+	{
+		if(node_links[*link].to != to)
+			continue;
+
+		l = *link;
+		*link = node_links[l].next;
+		node_links[l].next = node_freelinks;
+		node_freelinks = l;
+		num_node_links--;
+
+		// Make sure no cached route still uses it
+		ACEND_FlushPathCache();
+		return;
+	}
 }
 
 ///////////////////////////////////////////////////////////////////////
-// This function will resolve all paths that are incomplete
-// usually called before saving to disk
+// Move a node, keeping its grid bucket and link costs right
 ///////////////////////////////////////////////////////////////////////
-void ACEND_ResolveAllPaths()
+void ACEND_MoveNode(int node, vec3_t origin)
 {
-	int i, from, to;
-	int num=0;
+	int i, l;
+	vec3_t v;
 
-	safe_bprintf(PRINT_HIGH,"Resolving all paths...");
+	if(node < 0 || node >= bot_numnodes)
+		return;
+
+	VectorCopy(origin,nodes[node].origin);
+	ACEND_LinkNodeGrid(node);
 
-	for(from=0;from<bot_numnodes;from++)
-	for(to=0;to<bot_numnodes;to++)
+	for(i=0;i<bot_numnodes;i++)
 	{
-		// update unresolved paths
-		// Not equal to itself, not equal to -1 and equal to the last link
-		if(from != to && path_table[from][to] == to)
+		for(l=node_firstlink[i];l!=INVALID;l=node_links[l].next)
 		{
-			num++;
-
-			// Now for the self-referencing part linear time for each link added
-			for(i=0;i<bot_numnodes;i++)
-				if(path_table[i][from] != -1)
-				{
-					if(i == to)
-						path_table[i][to] = -1; // make sure we terminate
-					else
-						path_table[i][to] = path_table[i][from];
-				}
+			if(i != node && node_links[l].to != node)
+				continue;
+			VectorSubtract(nodes[node_links[l].to].origin,nodes[i].origin,v);
+			node_links[l].cost = VectorLength(v);
 		}
 	}
 
-	safe_bprintf(PRINT_MEDIUM,"done (%d updated)\n",num);
+	// Cached routes were planned with the old costs
+	ACEND_FlushPathCache();
+}
+
+///////////////////////////////////////////////////////////////////////
+// Routes are searched for as they are needed now, so there is nothing
+// left to resolve; just report on the graph
+///////////////////////////////////////////////////////////////////////
+void ACEND_ResolveAllPaths()
+{
+	safe_bprintf(PRINT_MEDIUM,"%d nodes, %d links\n",bot_numnodes,num_node_links);
 }
 
 ///////////////////////////////////////////////////////////////////////
@@ -597,14 +1072,21 @@ void ACEND_ResolveAllPaths()
 // release, I took out the compressed format option. Most levels will
 // save out to a node file around 50-200k, so compression is not really
 // a big deal.
+//
+// Version 2 stores the links themselves rather than the version 1
+// next-hop table of bot_numnodes * bot_numnodes shorts:
+//	int version, numnodes, numlinks
+//	node_t nodes[numnodes]
+//	short from, to; [numlinks]
 ///////////////////////////////////////////////////////////////////////
 void ACEND_SaveNodes()
 {
 	FILE *pOut;
 	char filename[MAX_OSPATH];
 	char relative_path[MAX_QPATH];
-	int i,j;
-	int version = 1, dummy_num_items = 0;
+	int i, l, n;
+	int header[3];
+	short *links;
 	size_t sz;
 
 	// Resolve paths
@@ -624,32 +1106,63 @@ void ACEND_SaveNodes()
 		return;
 	}
 
-	sz = fwrite(&version,sizeof(int),1,pOut); // write version
-	sz = fwrite(&bot_numnodes,sizeof(int),1,pOut); // write count
-	sz = fwrite (&dummy_num_items, sizeof (int), 1, pOut); // facts count always 0 now
+	links = gi.TagMalloc(num_node_links*2*sizeof(short), TAG_GAME);
+	n = 0;
+	for(i=0;i<bot_numnodes;i++)
+		for(l=node_firstlink[i];l!=INVALID;l=node_links[l].next)
+		{
+			links[n++] = i;
+			links[n++] = node_links[l].to;
+		}
+
+	header[0] = 2; // version
+	header[1] = bot_numnodes;
+	header[2] = n/2;
 
+	sz = fwrite(header,sizeof(header),1,pOut);
 	sz = fwrite(nodes,sizeof(node_t),bot_numnodes,pOut); // write nodes
-
-	for(i=0;i<bot_numnodes;i++)
-		for(j=0;j<bot_numnodes;j++)
-			sz = fwrite(&path_table[i][j],sizeof(short int),1,pOut); // write count
+	sz = fwrite(links,sizeof(short),n,pOut); // write links
 
 	fclose(pOut);
+	gi.TagFree(links);
 
 	safe_bprintf(PRINT_MEDIUM,"done.\n");
 }
 
+///////////////////////////////////////////////////////////////////////
+// Rebuild the links from a version 1 next-hop table. Every next hop
+// stored for a node is a node it links to directly.
+///////////////////////////////////////////////////////////////////////
+static void ACEND_ConvertPathTable(short *path_table, int numnodes)
+{
+	int i, j, next;
+
+	for(i=0;i<numnodes;i++)
+		for(j=0;j<numnodes;j++)
+		{
+			next = path_table[i*numnodes+j];
+			if(next >= 0 && next < numnodes && next != i)
+				ACEND_AddLink(i,next);
+		}
+}
+
 ///////////////////////////////////////////////////////////////////////
 // Read from disk file
+//
+// The whole file is read with one call and then picked apart. Version 1
+// files are converted, and written out again as version 2 the next time
+// the nodes are saved.
 ///////////////////////////////////////////////////////////////////////
 void ACEND_LoadNodes(void)
 {
 	FILE *pIn;
-	int i,j;
+	int i;
 	char relative_path[MAX_QPATH];
 	char filename[MAX_OSPATH];
-	int version;
-	size_t sz;
+	int version, numnodes, numlinks;
+	long length;
+	byte *buf = NULL;
+	short *links;
 
 	strcpy( relative_path, "botinfo/nav/" );
 	strcat( relative_path, level.mapname );
@@ -660,45 +1173,80 @@ void ACEND_LoadNodes(void)
 		gi.dprintf("ACEND_LoadNodes: not found: %s\n", relative_path );
 	}
 
-	if((pIn = fopen(filename, "rb" )) == NULL)
-    {
+	if((pIn = fopen(filename, "rb" )) != NULL)
+	{
+		fseek(pIn, 0, SEEK_END);
+		length = ftell(pIn);
+		fseek(pIn, 0, SEEK_SET);
+
+		if(length >= (long)(3*sizeof(int)))
+		{
+			buf = gi.TagMalloc(length, TAG_GAME);
+			if(fread(buf, length, 1, pIn) != 1)
+			{
+				gi.TagFree(buf);
+				buf = NULL;
+			}
+		}
+		fclose(pIn);
+	}
+
+	version = numnodes = numlinks = 0;
+	if(buf)
+	{
+		memcpy(&version, buf, sizeof(int));
+		memcpy(&numnodes, buf+sizeof(int), sizeof(int));
+		memcpy(&numlinks, buf+2*sizeof(int), sizeof(int)); // unused facts count in version 1
+
+		if(numnodes < 1 || numnodes > MAX_NODES)
+			version = 0;
+		else if(version == 1 && length < (long)(3*sizeof(int) + numnodes*sizeof(node_t) + numnodes*numnodes*sizeof(short)))
+			version = 0;
+		else if(version == 2 && (numlinks < 0 || numlinks > MAX_NODE_LINKS
+			|| length < (long)(3*sizeof(int) + numnodes*sizeof(node_t) + numlinks*2*sizeof(short))))
+			version = 0;
+	}
+
+	if(version != 1 && version != 2)
+	{
+		if(buf)
+			gi.TagFree(buf);
+
 		// Create item table
 		gi.dprintf("ACE: No node file found, creating new one...");
 		ACEIT_BuildItemNodeTable(false);
 		safe_bprintf(PRINT_MEDIUM, "done.\n");
-		return;
+		return; // bail
 	}
 
-	// determine version
-	sz = fread(&version,sizeof(int),1,pIn); // read version
+	gi.dprintf("ACE: Loading node table...");
+
+	bot_numnodes = numnodes;
+	memcpy(nodes, buf+3*sizeof(int), numnodes*sizeof(node_t));
+	for(i=0;i<numnodes;i++)
+		ACEND_LinkNodeGrid(i);
 
 	if(version == 1)
 	{
-		gi.dprintf("ACE: Loading node table...");
-
-		sz = fread(&bot_numnodes,sizeof(int),1,pIn); // read count
-		// skip facts count (num_items) - we don't read these anymore
-		sz = fseek (pIn, sizeof (int), SEEK_CUR);
-		sz = fread(nodes,sizeof(node_t),bot_numnodes,pIn); 
-
-		for(i=0;i<bot_numnodes;i++)
-			for(j=0;j<bot_numnodes;j++)
-				sz = fread(&path_table[i][j],sizeof(short int),1,pIn); // write count
-		
-		fclose(pIn);
+		ACEND_ConvertPathTable((short *)(buf+3*sizeof(int)+numnodes*sizeof(node_t)), numnodes);
+		gi.dprintf("converted from version 1, %d links...", num_node_links);
 	}
 	else
 	{
-		// Create item table
-		gi.dprintf("ACE: No node file found, creating new one...");
-		ACEIT_BuildItemNodeTable(false);
-		safe_bprintf(PRINT_MEDIUM, "done.\n");
-		return; // bail
+		links = (short *)(buf+3*sizeof(int)+numnodes*sizeof(node_t));
+		for(i=0;i<numlinks;i++)
+		{
+			if(links[2*i] < 0 || links[2*i] >= numnodes || links[2*i+1] < 0
+				|| links[2*i+1] >= numnodes || links[2*i] == links[2*i+1])
+				continue;
+			ACEND_AddLink(links[2*i],links[2*i+1]);
+		}
 	}
 
+	gi.TagFree(buf);
+
 	gi.dprintf("done.\n");
 
 	ACEIT_BuildItemNodeTable(true);
 
 }
-
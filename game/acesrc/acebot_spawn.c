@@ -1226,7 +1226,7 @@ static void remove_bot( edict_t *bot )
 
 	bot->inuse = false;
 	bot->solid = SOLID_NOT;
-	bot->classname = "disconnected";
+	G_SetClassname (bot, "disconnected");
 
 	bot->s.modelindex = 0;
 	bot->s.modelindex2= 0;
@@ -75,7 +75,7 @@ void DeathcamStart (edict_t *ent)
      VectorCopy (ent->s.origin, chasecam->s.origin);
 	 VectorCopy (ent->s.origin, chasecam->death_origin);
 
-     chasecam->classname = "chasecam";
+     G_SetClassname (chasecam, "chasecam");
      chasecam->nextthink = level.time + 0.100;
      chasecam->think = DeathcamTrack;
 	 ent->client->chasecam = chasecam;
@@ -395,7 +395,7 @@ void FoundTarget (edict_t *self)
 
 
 	// clear the targetname, that point is ours!
-	self->movetarget->targetname = NULL;
+	G_SetTargetname (self->movetarget, NULL);
 	self->monsterinfo.pausetime = 0;
 
 	// run for it
@@ -37,6 +37,9 @@ qboolean CanDamage (edict_t *targ, edict_t *inflictor)
 {
 	vec3_t	dest;
 	trace_t	trace;
+	vec3_t	starts[4], ends[4];
+	trace_t	traces[4];
+	int		i;
 
 // bmodels need special checking because their origin is 0,0,0
 	if (targ->movetype == MOVETYPE_PUSH)
@@ -55,34 +58,27 @@ qboolean CanDamage (edict_t *targ, edict_t *inflictor)
 	if (trace.fraction == 1.0)
 		return true;
 
-	VectorCopy (targ->s.origin, dest);
-	dest[0] += 15.0;
-	dest[1] += 15.0;
-	trace = gi.trace (inflictor->s.origin, vec3_origin, vec3_origin, dest, inflictor, MASK_SOLID);
-	if (trace.fraction == 1.0)
-		return true;
-
-	VectorCopy (targ->s.origin, dest);
-	dest[0] += 15.0;
-	dest[1] -= 15.0;
-	trace = gi.trace (inflictor->s.origin, vec3_origin, vec3_origin, dest, inflictor, MASK_SOLID);
-	if (trace.fraction == 1.0)
-		return true;
-
-	VectorCopy (targ->s.origin, dest);
-	dest[0] -= 15.0;
-	dest[1] += 15.0;
-	trace = gi.trace (inflictor->s.origin, vec3_origin, vec3_origin, dest, inflictor, MASK_SOLID);
-	if (trace.fraction == 1.0)
-		return true;
-
-	VectorCopy (targ->s.origin, dest);
-	dest[0] -= 15.0;
-	dest[1] -= 15.0;
-	trace = gi.trace (inflictor->s.origin, vec3_origin, vec3_origin, dest, inflictor, MASK_SOLID);
-	if (trace.fraction == 1.0)
-		return true;
-
+	// the four corners, traced together
+	for (i = 0; i < 4; i++)
+	{
+		VectorCopy (inflictor->s.origin, starts[i]);
+		VectorCopy (targ->s.origin, ends[i]);
+	}
+	ends[0][0] += 15.0;
+	ends[0][1] += 15.0;
+	ends[1][0] += 15.0;
+	ends[1][1] -= 15.0;
+	ends[2][0] -= 15.0;
+	ends[2][1] += 15.0;
+	ends[3][0] -= 15.0;
+	ends[3][1] -= 15.0;
+
+	gi.tracebatch (4, starts, vec3_origin, vec3_origin, ends, inflictor, MASK_SOLID, traces);
+	for (i = 0; i < 4; i++)
+	{
+		if (traces[i].fraction == 1.0)
+			return true;
+	}
 
 	return false;
 }
@@ -165,7 +165,7 @@ void SpawnMinderaser(edict_t *ent)
 	VectorCopy(ent->s.origin, minderaser->s.origin);
 	minderaser->spawnflags = DROPPED_PLAYER_ITEM;
 	minderaser->model = "models/weapons/g_minderaser/tris.iqm";
-	minderaser->classname = "weapon_minderaser";
+	G_SetClassname (minderaser, "weapon_minderaser");
 	minderaser->item = FindItem ("Minderaser");
 	minderaser->s.effects = minderaser->item->world_model_flags;
 	minderaser->s.renderfx = RF_GLOW;
@@ -843,7 +843,7 @@ edict_t *Drop_Item (edict_t *ent, gitem_t *item)
 
 	dropped = G_Spawn();
 
-	dropped->classname = item->classname;
+	G_SetClassname (dropped, item->classname);
 	dropped->item = item;
 	dropped->spawnflags = DROPPED_ITEM;
 	dropped->s.effects = item->world_model_flags;
@@ -911,7 +911,7 @@ edict_t *Throw_Item (edict_t *ent, gitem_t *item)
 
 	dropped = G_Spawn();
 
-	dropped->classname = item->classname;
+	G_SetClassname (dropped, item->classname);
 	dropped->item = item;
 	dropped->spawnflags = DROPPED_ITEM;
 	dropped->s.renderfx = RF_GLOW;
@@ -1680,7 +1680,7 @@ void SP_item_health (edict_t *self)
 		return;
 	}
 	self->model = "models/items/healing/medium/tris.iqm";
-	self->classname = "Health";
+	G_SetClassname (self, "Health");
 	self->count = 10;
 	SpawnItem (self, FindItem ("Health"));
 	gi.soundindex ("items/n_health.wav");
@@ -1698,7 +1698,7 @@ void SP_item_health_small (edict_t *self)
 
 	self->model = "models/items/healing/small/tris.iqm";
 	self->count = 5;
-	self->classname = "Health";
+	G_SetClassname (self, "Health");
 	SpawnItem (self, FindItem ("Health"));
 	self->style = HEALTH_IGNORE_MAX;
 	gi.soundindex ("items/s_health.wav");
@@ -1715,7 +1715,7 @@ void SP_item_health_large (edict_t *self)
 	}
 
 	self->model = "models/items/healing/large/tris.iqm";
-	self->classname = "Health";
+	G_SetClassname (self, "Health");
 	self->count = 25;
 	SpawnItem (self, FindItem ("Health"));
 	gi.soundindex ("items/l_health.wav");
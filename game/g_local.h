@@ -737,6 +737,8 @@ extern cvar_t	*g_votesame;
 
 //call voting
 extern cvar_t	*g_callvote;
+extern cvar_t	*g_findstats;
+extern cvar_t	*g_findradius;
 
 //forced autobalanced teams
 extern cvar_t	*g_autobalance;
@@ -852,7 +854,17 @@ void Leave_vehicle(edict_t *ent, gitem_t *item);
 qboolean	KillBox (edict_t *ent);
 void	G_ProjectSource (const vec3_t point, const vec3_t distance, const vec3_t forward, const vec3_t right, vec3_t result);
 edict_t *G_Find (edict_t *from, int fieldofs, const char *match);
+void	G_ClearEdictIndex (void);
+void	G_InstallLinkHooks (void);
+void	G_ClearLooseEdicts (void);
+void	G_SyncEdictIndex (void);
+void	G_QueueEdict (edict_t *ent);
+void	G_SetClassname (edict_t *ent, char *classname);
+void	G_SetTargetname (edict_t *ent, char *targetname);
+extern int	find_indexed, find_scanned;
 edict_t *findradius (edict_t *from, vec3_t org, float rad);
+edict_t *findradius_scan (edict_t *from, vec3_t org, float rad);
+edict_t *findradius_query (edict_t *from, vec3_t org, float rad);
 edict_t *G_PickTarget (const char *targetname);
 void	G_UseTargets (edict_t *ent, edict_t *activator);
 void	G_SetMovedir (vec3_t angles, vec3_t movedir);
@@ -137,6 +137,9 @@ cvar_t	*g_votesame;
 //call voting
 cvar_t	*g_callvote;
 
+cvar_t	*g_findstats;
+cvar_t	*g_findradius;
+
 //reward point threshold
 cvar_t	*g_reward;
 
@@ -296,6 +299,7 @@ and global variables
 game_export_t *GetGameAPI (game_import_t *import)
 {
 	gi = *import;
+	G_InstallLinkHooks ();
 
 	globals.apiversion = GAME_API_VERSION;
 	globals.Init = InitGame;
@@ -372,7 +376,7 @@ edict_t *CreateTargetChangeLevel(char *map)
 	edict_t *ent;
 
 	ent = G_Spawn ();
-	ent->classname = "target_changelevel";
+	G_SetClassname (ent, "target_changelevel");
 	Com_sprintf(level.nextmap, sizeof(level.nextmap), "%s", map);
 	ent->map = level.nextmap;
 	return ent;
@@ -1693,6 +1697,10 @@ void G_RunFrame (void)
 	level.framenum++;
 	level.time = level.framenum*FRAMETIME;
 
+	if (g_findstats->integer && (find_indexed || find_scanned))
+		gi.dprintf ("G_Find: %i from the name index, %i scans\n", find_indexed, find_scanned);
+	find_indexed = find_scanned = 0;
+
 	/*
 	 * update bot info in first client always, and in other active clients
 	 */
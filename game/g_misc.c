@@ -146,7 +146,7 @@ void ThrowGib (edict_t *self, char *gibname, int damage, int type, int effects)
 
 	gib = G_Spawn();
 
-	gib->classname = "g_gib";
+	G_SetClassname (gib, "g_gib");
 
 	VectorScale (self->size, 1, size);
 	VectorAdd (self->absmin, size, origin);
@@ -257,7 +257,7 @@ void ThrowDebris (edict_t *self, char *modelname, float speed, vec3_t origin)
 	chunk->nextthink = level.time + 5 + random()*5;
 	chunk->s.frame = 0;
 	chunk->flags = 0;
-	chunk->classname = "debris";
+	G_SetClassname (chunk, "debris");
 	chunk->takedamage = DAMAGE_YES;
 	chunk->die = debris_die;
 	gi.linkentity (chunk);
@@ -284,7 +284,7 @@ void ThrowDebris2 (edict_t *self, char *modelname, float speed, vec3_t origin)
 	chunk->nextthink = level.time + 5 + random()*5;
 	chunk->s.frame = 0;
 	chunk->flags = 0;
-	chunk->classname = "debris";
+	G_SetClassname (chunk, "debris");
 	chunk->takedamage = DAMAGE_YES;
 	chunk->die = debris_die;
 	gi.linkentity (chunk);
@@ -1381,7 +1381,7 @@ void SP_misc_aliencomputer (edict_t *ent)
 	ent->die = computer_die;
 	ent->think = computer_think;
 	ent->nextthink = level.time + TENFPS;
-	ent->classname = "alien computer";
+	G_SetClassname (ent, "alien computer");
 	ent->ctype = 0;
 
 	gi.linkentity (ent);
@@ -1408,7 +1408,7 @@ void SP_misc_humancomputer (edict_t *ent)
 	ent->die = computer_die;
 	ent->think = computer_think;
 	ent->nextthink = level.time + TENFPS;
-	ent->classname = "human computer";
+	G_SetClassname (ent, "human computer");
 	ent->ctype = 1;
 
 	gi.linkentity (ent);
@@ -1504,7 +1504,7 @@ void SP_misc_alienpowersrc (edict_t *ent)
 	ent->die = powersrc_die;
 	ent->think = powersrc_think;
 	ent->nextthink = level.time + TENFPS;
-	ent->classname = "alien powersrc";
+	G_SetClassname (ent, "alien powersrc");
 	ent->ctype = 0;
 
 	gi.linkentity (ent);
@@ -1531,7 +1531,7 @@ void SP_misc_humanpowersrc (edict_t *ent)
 	ent->die = powersrc_die;
 	ent->think = powersrc_think;
 	ent->nextthink = level.time + TENFPS;
-	ent->classname = "human powersrc";
+	G_SetClassname (ent, "human powersrc");
 	ent->ctype = 1;
 
 	gi.linkentity (ent);
@@ -1626,7 +1626,7 @@ void SP_misc_alienammodepot (edict_t *ent)
 	ent->die = ammodepot_die;
 	ent->think = ammodepot_think;
 	ent->nextthink = level.time + TENFPS;
-	ent->classname = "alien ammodepot";
+	G_SetClassname (ent, "alien ammodepot");
 	ent->ctype = 0;
 
 	gi.linkentity (ent);
@@ -1653,7 +1653,7 @@ void SP_misc_humanammodepot (edict_t *ent)
 	ent->die = ammodepot_die;
 	ent->think = ammodepot_think;
 	ent->nextthink = level.time + TENFPS;
-	ent->classname = "human ammodepot";
+	G_SetClassname (ent, "human ammodepot");
 	ent->ctype = 1;
 
 	gi.linkentity (ent);
@@ -1759,7 +1759,7 @@ void SP_misc_alienbackupgen (edict_t *ent)
 	ent->die = backupgen_die;
 	ent->think = backupgen_think;
 	ent->nextthink = level.time + TENFPS;
-	ent->classname = "alien backupgen";
+	G_SetClassname (ent, "alien backupgen");
 	ent->ctype = 0;
 
 	gi.linkentity (ent);
@@ -1786,7 +1786,7 @@ void SP_misc_humanbackupgen (edict_t *ent)
 	ent->die = backupgen_die;
 	ent->think = backupgen_think;
 	ent->nextthink = level.time + TENFPS;
-	ent->classname = "human backupgen";
+	G_SetClassname (ent, "human backupgen");
 	ent->ctype = 1;
 
 	gi.linkentity (ent);
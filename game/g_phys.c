@@ -955,6 +955,10 @@ G_RunEntity
 */
 void G_RunEntity (edict_t *ent, float timespan)
 {
+	int		caller;
+
+	caller = gi.tracecaller (ent->is_bot ? TRACE_BOTS : TRACE_PHYSICS);
+
 	if (ent->prethink)
 		ent->prethink (ent);
 
@@ -987,4 +991,6 @@ void G_RunEntity (edict_t *ent, float timespan)
 	default:
 		gi.error ("SV_Physics: bad movetype %i", (int)ent->movetype);
 	}
+
+	gi.tracecaller (caller);
 }
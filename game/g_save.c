@@ -279,6 +279,11 @@ void InitGame (void)
 	g_antilagprojectiles = gi.cvar ("g_antilagprojectiles", "1", CVAR_GAMEINFO | CVARDOC_BOOL);
 	g_antilagdebug = gi.cvar("g_antilagdebug", "0", 0 /*CVAR_SERVERINFO*/);
 
+	g_findstats = gi.cvar ("g_findstats", "0", CVARDOC_BOOL);
+	gi.cvar_describe (g_findstats, "print how many G_Find calls each frame used the name index and how many scanned every edict.");
+	g_findradius = gi.cvar ("g_findradius", "1", CVARDOC_BOOL);
+	gi.cvar_describe (g_findradius, "answer findradius from the server's area nodes instead of checking every edict. 0 goes back to the full scan, see radiusbench.");
+
 	// change anytime vars
 	dmflags = gi.cvar ("dmflags", "0", CVAR_SERVERINFO);
 	fraglimit = gi.cvar ("fraglimit", "0", CVAR_SERVERINFO);
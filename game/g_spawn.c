@@ -285,6 +285,8 @@ void ED_ParseField (char *key, char *value, edict_t *ent)
 			default:
 				break;
 			}
+			if (b == (byte *)ent)
+				G_QueueEdict (ent);
 			return;
 		}
 	}
@@ -431,6 +433,8 @@ void SpawnEntities (char *mapname, const char *entities, char *spawnpoint)
 	
 	memset (&level, 0, sizeof(level));
 	memset (g_edicts, 0, game.maxentities * sizeof (g_edicts[0]));
+	G_ClearEdictIndex ();
+	G_ClearLooseEdicts ();
 
 	strncpy (level.mapname, mapname, sizeof(level.mapname)-1);
 
@@ -508,6 +512,8 @@ void SpawnEntities (char *mapname, const char *entities, char *spawnpoint)
 	G_FindTeams ();
 
 	PlayerTrail_Init ();
+
+	G_SyncEdictIndex ();
 }
 
 
@@ -239,7 +239,7 @@ void spawn_spider (edict_t *owner, vec3_t origin, vec3_t angle)
 	self->s.modelindex = gi.modelindex("models/objects/spider/tris.iqm");
 	self->s.modelindex3 = gi.modelindex("models/objects/spider/helmet.iqm");
 
-	self->classname = "proj_spider";
+	G_SetClassname (self, "proj_spider");
 
 	VectorSet (self->mins, -16, -16, 0);
 	VectorSet (self->maxs, 16, 16, 24);
@@ -339,7 +339,7 @@ void fire_spider (edict_t *self, vec3_t start, vec3_t aimdir, int speed)
     spider->think = spider_think;
    
 	spider->s.sound = gi.soundindex ("weapons/electroball.wav");
-	spider->classname = "proj_spider";
+	G_SetClassname (spider, "proj_spider");
 
 	gi.linkentity (spider);
 }
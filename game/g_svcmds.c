@@ -311,6 +311,177 @@ void SVCmd_WriteIP_f (void)
 
 }
 
+/*
+=================
+Svcmd_BotBench_f
+
+sv botbench [maxbots] [frames]
+
+Adds bots four at a time up to maxbots, and at each count times the game
+frames twice: once finding nodes through the node grid and once scanning
+every node. The level runs on while it does, so use an empty server.
+=================
+*/
+void G_RunFrame (void);
+
+static void Svcmd_BotBench_f (void)
+{
+	int		maxbots, frames, numbots, i, pass;
+	unsigned long long	start, usec[2];
+	char	name[PLAYERNAME_SIZE];
+	qboolean	saved_grid = node_grid;
+
+	maxbots = gi.argc() > 2 ? atoi (gi.argv(2)) : 32;
+	frames = gi.argc() > 3 ? atoi (gi.argv(3)) : 100;
+	if (frames < 1)
+		frames = 1;
+
+	safe_cprintf (NULL, PRINT_HIGH, "bots  grid us/frame  scan us/frame\n");
+
+	numbots = 0;
+	for (;;)
+	{
+		for (pass = 0; pass < 2; pass++)
+		{
+			node_grid = !pass;
+			start = gi.Sys_Microseconds ();
+			for (i = 0; i < frames; i++)
+				G_RunFrame ();
+			usec[pass] = gi.Sys_Microseconds () - start;
+		}
+		safe_cprintf (NULL, PRINT_HIGH, "%4i  %13.1f  %13.1f\n", numbots,
+				(double)usec[0] / frames, (double)usec[1] / frames);
+
+		if (numbots >= maxbots)
+			break;
+		for (i = 0; i < 4 && numbots < maxbots; i++)
+		{
+			Com_sprintf (name, sizeof(name), "benchbot%i", numbots);
+			if (!ACESP_SpawnBot (name, "martianenforcer/default", NULL))
+				break;
+			numbots++;
+		}
+		if (i < 4 && numbots < maxbots)
+		{
+			safe_cprintf (NULL, PRINT_HIGH, "No more free client slots.\n");
+			break;
+		}
+	}
+
+	node_grid = saved_grid;
+
+	for (i = 0; i < numbots; i++)
+	{
+		Com_sprintf (name, sizeof(name), "benchbot%i", i);
+		ACESP_RemoveBot (name);
+	}
+}
+
+/*
+=================
+Svcmd_RadiusBench_f
+
+sv radiusbench [explosions] [entities]
+
+Scatters boxes around the level's entities until there are that many
+solid entities, then runs a 256 unit findradius at each of a set of blast
+points, once with findradius_scan and once with findradius_query. Every
+box is linked, so both passes have to find the same entities.
+=================
+*/
+#define	BENCH_BLASTS	1024
+#define	BENCH_RADIUS	256
+
+static void Svcmd_RadiusBench_f (void)
+{
+	static vec3_t	blasts[BENCH_BLASTS];
+	static edict_t	*anchors[MAX_EDICTS];
+	int		explosions, entities, numanchors, numsolid, numadded, i, j, pass;
+	int		found[2];
+	unsigned long long	start, usec[2];
+	edict_t	*ent, *added;
+	edict_t	*(*find) (edict_t *from, vec3_t org, float rad);
+
+	explosions = gi.argc() > 2 ? atoi (gi.argv(2)) : 10000;
+	entities = gi.argc() > 3 ? atoi (gi.argv(3)) : 512;
+	if (explosions < 1)
+		explosions = 1;
+
+	numanchors = numsolid = 0;
+	for (i = 1; i < globals.num_edicts; i++)
+	{
+		ent = &g_edicts[i];
+		if (!ent->inuse)
+			continue;
+		anchors[numanchors++] = ent;
+		if (ent->solid != SOLID_NOT)
+			numsolid++;
+	}
+	if (!numanchors)
+	{
+		safe_cprintf (NULL, PRINT_HIGH, "radiusbench needs a map running.\n");
+		return;
+	}
+
+	numadded = 0;
+	added = NULL;
+	while (numsolid + numadded < entities)
+	{
+		if (globals.num_edicts >= game.maxentities - 64)
+		{	// leave room for the level, G_Spawn errors out when full
+			safe_cprintf (NULL, PRINT_HIGH, "No more free edicts.\n");
+			break;
+		}
+		ent = G_Spawn ();
+		G_SetClassname (ent, "bench_box");
+		ent->solid = SOLID_BBOX;
+		VectorSet (ent->mins, -16, -16, -16);
+		VectorSet (ent->maxs, 16, 16, 16);
+		VectorCopy (anchors[rand() % numanchors]->s.origin, ent->s.origin);
+		for (j = 0; j < 3; j++)
+			ent->s.origin[j] += crandom() * 512;
+		ent->owner = added;		// chain them up for removal
+		added = ent;
+		gi.linkentity (ent);
+		numadded++;
+	}
+
+	for (i = 0; i < BENCH_BLASTS; i++)
+	{
+		VectorCopy (anchors[rand() % numanchors]->s.origin, blasts[i]);
+		for (j = 0; j < 3; j++)
+			blasts[i][j] += crandom() * 128;
+	}
+
+	for (pass = 0; pass < 2; pass++)
+	{
+		find = pass ? findradius_query : findradius_scan;
+		found[pass] = 0;
+		start = gi.Sys_Microseconds ();
+		for (i = 0; i < explosions; i++)
+		{
+			ent = NULL;
+			while ((ent = find (ent, blasts[i % BENCH_BLASTS], BENCH_RADIUS)) != NULL)
+				found[pass]++;
+		}
+		usec[pass] = gi.Sys_Microseconds () - start;
+	}
+
+	safe_cprintf (NULL, PRINT_HIGH, "%i explosions, %i edicts, %i solid, %.1f hits each\n",
+			explosions, globals.num_edicts, numsolid + numadded, (double)found[0] / explosions);
+	safe_cprintf (NULL, PRINT_HIGH, "scan %.3f us/explosion, area nodes %.3f us/explosion\n",
+			(double)usec[0] / explosions, (double)usec[1] / explosions);
+	if (found[0] != found[1])
+		safe_cprintf (NULL, PRINT_HIGH, "MISMATCH: scan found %i, area nodes %i\n", found[0], found[1]);
+
+	while (added)
+	{
+		ent = added;
+		added = ent->owner;
+		G_FreeEdict (ent);
+	}
+}
+
 /*
 =================
 ServerCommand
@@ -395,6 +566,12 @@ void	ServerCommand (void)
 	else if(Q_strcasecmp (cmd, "savenodes") == 0)
     	ACEND_SaveNodes();
 
+	else if (Q_strcasecmp (cmd, "botbench") == 0)
+		Svcmd_BotBench_f ();
+
+	else if (Q_strcasecmp (cmd, "radiusbench") == 0)
+		Svcmd_RadiusBench_f ();
+
 // ACEBOT_END
 	else
 		safe_cprintf (NULL, PRINT_HIGH, "Unknown server command \"%s\"\n", cmd);
@@ -353,7 +353,7 @@ void use_target_spawner (edict_t *self, edict_t *other, edict_t *activator)
 	edict_t	*ent;
 
 	ent = G_Spawn();
-	ent->classname = self->target;
+	G_SetClassname (ent, self->target);
 	ent->spawnflags = self->spawnflags;
 	ent->deathtarget = self->deathtarget;
 
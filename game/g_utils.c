@@ -34,6 +34,202 @@ void G_ProjectSource (const vec3_t point, const vec3_t distance, const vec3_t fo
 }
 
 
+/*
+=============================================================================
+
+EDICT NAME INDEX
+
+G_Find by classname or targetname, and so G_PickTarget and G_UseTargets,
+walk a hash chain of the edicts with that name instead of every edict.
+Each edict is filed under the string pointer its field held at the time.
+Nothing may assign those fields directly: G_SetClassname and
+G_SetTargetname queue the edict, as do G_InitEdict, G_FreeEdict and
+ED_ParseField, and the queue is filed before each lookup. Edicts stay
+filed while they are free, the lookup skips those. A hit is always
+compared again before it is returned.
+
+=============================================================================
+*/
+
+#define	EDICT_HASH_SIZE		256		// must be a power of two
+#define	NUM_EDICT_INDEXES	2
+
+typedef struct
+{
+	int		fieldofs;
+	short	head[EDICT_HASH_SIZE];	// chains are in edict order, -1 ends
+	short	next[MAX_EDICTS];
+	short	bucket[MAX_EDICTS];		// -1 when not filed
+	char	*filed[MAX_EDICTS];		// the field when it was filed
+} edictindex_t;
+
+static edictindex_t	edictindex[NUM_EDICT_INDEXES];
+static qboolean		edictindex_valid;
+static short		edictqueue[MAX_EDICTS];
+static qboolean		edictqueued[MAX_EDICTS];
+static int			edictqueuelen;
+
+int		find_indexed, find_scanned;		// this frame, for g_findstats
+
+static int G_NameHash (const char *s)
+{
+	unsigned	hash;
+	int			c;
+
+	hash = 0;
+	while ((c = *s++) != 0)
+	{
+		if (c >= 'A' && c <= 'Z')
+			c += 'a' - 'A';
+		hash = hash * 31 + c;
+	}
+	return (hash ^ (hash >> 8)) & (EDICT_HASH_SIZE - 1);
+}
+
+static void G_UnfileEdict (edictindex_t *index, int num)
+{
+	short	*link;
+
+	if (index->bucket[num] < 0)
+		return;
+
+	for (link = &index->head[index->bucket[num]]; *link != num; link = &index->next[*link])
+		;
+	*link = index->next[num];
+	index->bucket[num] = -1;
+	index->filed[num] = NULL;
+}
+
+static void G_FileEdict (edictindex_t *index, edict_t *ent)
+{
+	int		num = ent - g_edicts;
+	char	*s;
+	short	*link;
+
+	s = *(char **) ((byte *)ent + index->fieldofs);
+	if (s == index->filed[num])
+		return;
+
+	G_UnfileEdict (index, num);
+	if (!s)
+		return;
+
+	index->bucket[num] = G_NameHash (s);
+	index->filed[num] = s;
+	for (link = &index->head[index->bucket[num]]; *link >= 0 && *link < num; link = &index->next[*link])
+		;
+	index->next[num] = *link;
+	*link = num;
+}
+
+static void G_ResyncEdictIndex (edictindex_t *index)
+{
+	int		i;
+
+	for (i = 0; i < globals.num_edicts; i++)
+		G_FileEdict (index, &g_edicts[i]);
+}
+
+static void G_FlushEdictQueue (void)
+{
+	int		i, num;
+
+	for (i = 0; i < edictqueuelen; i++)
+	{
+		num = edictqueue[i];
+		G_FileEdict (&edictindex[0], &g_edicts[num]);
+		G_FileEdict (&edictindex[1], &g_edicts[num]);
+		edictqueued[num] = false;
+	}
+	edictqueuelen = 0;
+}
+
+/*
+=============
+G_ClearEdictIndex
+
+Empties the index for a new level, G_Find scans until it is synced
+=============
+*/
+void G_ClearEdictIndex (void)
+{
+	edictindex_t	*index;
+	int				i, j;
+
+	edictindex[0].fieldofs = FOFS(classname);
+	edictindex[1].fieldofs = FOFS(targetname);
+	for (i = 0; i < NUM_EDICT_INDEXES; i++)
+	{
+		index = &edictindex[i];
+		for (j = 0; j < EDICT_HASH_SIZE; j++)
+			index->head[j] = -1;
+		for (j = 0; j < MAX_EDICTS; j++)
+		{
+			index->bucket[j] = -1;
+			index->filed[j] = NULL;
+		}
+	}
+
+	memset (edictqueued, 0, sizeof(edictqueued));
+	edictqueuelen = 0;
+	edictindex_valid = false;
+}
+
+/*
+=============
+G_SyncEdictIndex
+
+Refiles every edict whose classname or targetname changed
+=============
+*/
+void G_SyncEdictIndex (void)
+{
+	int		i;
+
+	for (i = 0; i < NUM_EDICT_INDEXES; i++)
+		G_ResyncEdictIndex (&edictindex[i]);
+
+	memset (edictqueued, 0, sizeof(edictqueued));
+	edictqueuelen = 0;
+	edictindex_valid = true;
+}
+
+/*
+=============
+G_QueueEdict
+
+The edict's names may have changed, file it again before the next lookup
+=============
+*/
+void G_QueueEdict (edict_t *ent)
+{
+	int		num = ent - g_edicts;
+
+	if (edictqueued[num])
+		return;
+	edictqueued[num] = true;
+	edictqueue[edictqueuelen++] = num;
+}
+
+/*
+=============
+G_SetClassname / G_SetTargetname
+
+Assign the indexed fields
+=============
+*/
+void G_SetClassname (edict_t *ent, char *classname)
+{
+	ent->classname = classname;
+	G_QueueEdict (ent);
+}
+
+void G_SetTargetname (edict_t *ent, char *targetname)
+{
+	ent->targetname = targetname;
+	G_QueueEdict (ent);
+}
+
 /*
 =============
 G_Find
@@ -44,11 +240,51 @@ the matching string at fieldofs (use the FOFS() macro) in the structure.
 Searches beginning at the edict after from, or the beginning if NULL
 NULL will be returned if the end of the list is reached.
 
+Classname and targetname searches go through the name index.
 =============
 */
 edict_t *G_Find (edict_t *from, int fieldofs, const char *match)
 {
 	char	*s;
+	edictindex_t	*index;
+	edict_t	*ent;
+	int		i, n, num, bucket;
+
+	index = NULL;
+	for (i = 0; i < NUM_EDICT_INDEXES && edictindex_valid; i++)
+	{
+		if (edictindex[i].fieldofs == fieldofs)
+			index = &edictindex[i];
+	}
+
+	if (index)
+	{
+		G_FlushEdictQueue ();
+		find_indexed++;
+
+		num = from ? from - g_edicts : -1;
+		bucket = G_NameHash (match);
+		if (from && index->bucket[num] == bucket)
+			n = index->next[num];
+		else
+		{
+			for (n = index->head[bucket]; n >= 0 && n <= num; n = index->next[n])
+				;
+		}
+
+		for ( ; n >= 0; n = index->next[n])
+		{
+			ent = &g_edicts[n];
+			if (!ent->inuse)
+				continue;
+			s = *(char **) ((byte *)ent + fieldofs);
+			if (s && !Q_strcasecmp (s, match))
+				return ent;
+		}
+		return NULL;
+	}
+
+	find_scanned++;
 
 	if (!from)
 		from = g_edicts;
@@ -70,40 +306,266 @@ edict_t *G_Find (edict_t *from, int fieldofs, const char *match)
 }
 
 
+static qboolean G_InRadius (edict_t *ent, vec3_t org, float rad)
+{
+	vec3_t	eorg;
+	int		j;
+
+	if (!ent->inuse)
+		return false;
+	if (ent->solid == SOLID_NOT)
+		return false;
+	for (j=0 ; j<3 ; j++)
+		eorg[j] = org[j] - (ent->s.origin[j] + (ent->mins[j] + ent->maxs[j])*0.5);
+	return VectorLength(eorg) <= rad;
+}
+
 /*
 =================
-findradius
-
-Returns entities that have origins within a spherical area
+findradius_scan
 
-findradius (origin, radius)
+The original findradius, checking every edict after from
 =================
 */
-edict_t *findradius (edict_t *from, vec3_t org, float rad)
+edict_t *findradius_scan (edict_t *from, vec3_t org, float rad)
 {
-	vec3_t	eorg;
-	int		j;
-
 	if (!from)
 		from = g_edicts;
 	else
 		from++;
 	for ( ; from < &g_edicts[globals.num_edicts]; from++)
 	{
-		if (!from->inuse)
-			continue;
-		if (from->solid == SOLID_NOT)
-			continue;
+		if (G_InRadius (from, org, rad))
+			return from;
+	}
+
+	return NULL;
+}
+
+/*
+=================
+G_InstallLinkHooks
+
+findradius_query has to know which edicts the area nodes don't hold and
+how far linked edicts move, so gi.linkentity and gi.unlinkentity come
+through here. The loose edicts are the ones in use that aren't in the
+area nodes: spawned and not linked yet, unlinked, or linked while solid
+but kept out of the nodes, like the world.
+=================
+*/
+static void		(*sv_linkentity) (edict_t *ent);
+static void		(*sv_unlinkentity) (edict_t *ent);
+
+static edict_t	*loose_edicts[MAX_EDICTS];
+static int		loose_pos[MAX_EDICTS];	// index in loose_edicts + 1, 0 if not there
+static int		num_loose_edicts;
+
+static float	link_move[2];			// furthest move between links, last frame and this one
+static int		link_moveframe;
+
+static void G_AddLooseEdict (edict_t *ent)
+{
+	int		num = ent - g_edicts;
+
+	if (loose_pos[num])
+		return;
+	loose_edicts[num_loose_edicts++] = ent;
+	loose_pos[num] = num_loose_edicts;
+}
+
+static void G_RemoveLooseEdict (edict_t *ent)
+{
+	int		num = ent - g_edicts;
+	int		pos = loose_pos[num] - 1;
+
+	if (pos < 0)
+		return;
+	loose_edicts[pos] = loose_edicts[--num_loose_edicts];
+	loose_pos[loose_edicts[pos] - g_edicts] = pos + 1;
+	loose_pos[num] = 0;
+}
+
+static void G_AgeLinkMoves (void)
+{
+	if (level.framenum == link_moveframe)
+		return;
+	link_move[0] = level.framenum == link_moveframe + 1 ? link_move[1] : 0;
+	link_move[1] = 0;
+	link_moveframe = level.framenum;
+}
+
+static void G_LinkEntity (edict_t *ent)
+{
+	vec3_t		oldmins, oldmaxs;
+	qboolean	wasinnodes = ent->area.prev != NULL;
+	float		move;
+	int			j;
+
+	VectorCopy (ent->absmin, oldmins);
+	VectorCopy (ent->absmax, oldmaxs);
+
+	sv_linkentity (ent);
+
+	if (ent->area.prev || ent->solid == SOLID_NOT)
+		G_RemoveLooseEdict (ent);
+	else
+		G_AddLooseEdict (ent);
+
+	if (wasinnodes && ent->area.prev)
+	{
+		G_AgeLinkMoves ();
 		for (j=0 ; j<3 ; j++)
-			eorg[j] = org[j] - (from->s.origin[j] + (from->mins[j] + from->maxs[j])*0.5);
-		if (VectorLength(eorg) > rad)
-			continue;
-		return from;
+		{
+			move = fabs (ent->absmin[j] - oldmins[j]);
+			if (move > link_move[1])
+				link_move[1] = move;
+			move = fabs (ent->absmax[j] - oldmaxs[j]);
+			if (move > link_move[1])
+				link_move[1] = move;
+		}
+	}
+}
+
+static void G_UnlinkEntity (edict_t *ent)
+{
+	sv_unlinkentity (ent);
+
+	if (ent->inuse)
+		G_AddLooseEdict (ent);
+}
+
+void G_InstallLinkHooks (void)
+{
+	sv_linkentity = gi.linkentity;
+	sv_unlinkentity = gi.unlinkentity;
+	gi.linkentity = G_LinkEntity;
+	gi.unlinkentity = G_UnlinkEntity;
+}
+
+/*
+=================
+G_ClearLooseEdicts
+
+For a new level, when nothing is linked
+=================
+*/
+void G_ClearLooseEdicts (void)
+{
+	memset (loose_pos, 0, sizeof(loose_pos));
+	num_loose_edicts = 0;
+	link_move[0] = link_move[1] = 0;
+
+	// the server never puts the world in the area nodes
+	G_AddLooseEdict (g_edicts);
+}
+
+/*
+=================
+findradius_query
+
+findradius through the server's area nodes, the default unless
+g_findradius is 0. The candidates come from one gi.RadiusEdicts query at
+the start of a search, plus the loose edicts, and each following call
+hands out the next one. A splash costs the area nodes it touches instead
+of every edict. A call that doesn't continue the last search, such as a
+nested search started by something the outer one damaged, queries again
+and picks up after from. Entities are checked again as they are handed
+out, as the scan did.
+
+An edict's place in the area nodes is where it was last linked, and it
+may have moved since. The query is padded by the furthest any edict
+moved between two links this frame or last, and filtered on the current
+origins. An edict that has jumped further than that without being
+unlinked first is only a candidate where it was linked.
+
+The list is taken at the first call, so an edict linked into range by
+something the search itself damaged is missed, where the scan would find
+it if its number came later.
+=================
+*/
+static edict_t	*radius_list[MAX_EDICTS];
+static int		radius_count, radius_pos;
+static vec3_t	radius_org;
+static float	radius_rad;
+
+static int G_EdictOrder (const void *a, const void *b)
+{
+	const edict_t	*e1 = *(const edict_t **)a;
+	const edict_t	*e2 = *(const edict_t **)b;
+
+	return e1 < e2 ? -1 : e1 > e2;
+}
+
+edict_t *findradius_query (edict_t *from, vec3_t org, float rad)
+{
+	int			lo, hi, mid, i;
+	qboolean	loose;
+	edict_t		*ent;
+	float		pad;
+
+	if (!from || radius_pos >= radius_count || radius_list[radius_pos] != from
+		|| rad != radius_rad || !VectorCompare (org, radius_org))
+	{
+		G_AgeLinkMoves ();
+		pad = link_move[0] > link_move[1] ? link_move[0] : link_move[1];
+		radius_count = gi.RadiusEdicts (org, rad + pad, radius_list, MAX_EDICTS);
+		VectorCopy (org, radius_org);
+		radius_rad = rad;
+
+		loose = false;
+		for (i = 0; i < num_loose_edicts && radius_count < MAX_EDICTS; i++)
+		{
+			ent = loose_edicts[i];
+			if (ent->area.prev || !G_InRadius (ent, org, rad))
+				continue;
+			radius_list[radius_count++] = ent;
+			loose = true;
+		}
+		if (loose)
+			qsort (radius_list, radius_count, sizeof(radius_list[0]), G_EdictOrder);
+
+		// the list is in edict order, so skip to the first one after from
+		lo = 0;
+		hi = radius_count;
+		while (from && lo < hi)
+		{
+			mid = (lo + hi) / 2;
+			if (radius_list[mid] <= from)
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+		radius_pos = lo - 1;
+	}
+
+	while (++radius_pos < radius_count)
+	{
+		if (G_InRadius (radius_list[radius_pos], org, rad))
+			return radius_list[radius_pos];
 	}
 
 	return NULL;
 }
 
+/*
+=================
+findradius
+
+Returns entities that have origins within a spherical area
+
+findradius (origin, radius)
+
+Goes through the area nodes unless g_findradius is 0, see
+findradius_query for how that can differ from scanning every edict.
+=================
+*/
+edict_t *findradius (edict_t *from, vec3_t org, float rad)
+{
+	if (g_findradius->integer)
+		return findradius_query (from, org, rad);
+	return findradius_scan (from, org, rad);
+}
+
 
 /*
 =============
@@ -185,7 +647,7 @@ void G_UseTargets (edict_t *ent, edict_t *activator)
 	{
 	// create a temp object to fire at a later time
 		t = G_Spawn();
-		t->classname = "DelayedUse";
+		G_SetClassname (t, "DelayedUse");
 		t->nextthink = level.time + ent->delay;
 		t->think = Think_Delay;
 		t->activator = activator;
@@ -348,6 +810,9 @@ void G_InitEdict (edict_t *e)
 	e->gravity = 1.0;
 	e->s.number = e - g_edicts;
 	e->item = NULL;
+	G_QueueEdict (e);
+	if (!e->area.prev)
+		G_AddLooseEdict (e);
 }
 
 /*
@@ -403,10 +868,12 @@ void G_FreeEdict (edict_t *ed)
 		return;
 	}
 
+	G_RemoveLooseEdict (ed);
 	memset (ed, 0, sizeof(*ed));
 	ed->classname = "freed";
 	ed->freetime = level.time;
 	ed->inuse = false;
+	G_QueueEdict (ed);
 }
 
 
@@ -296,7 +296,7 @@ void SpawnJetpack(edict_t *ent)
 	VectorCopy(ent->s.origin, jetpack->s.origin);
 	jetpack->spawnflags = DROPPED_PLAYER_ITEM;
 	jetpack->model = "vehicles/jetpack/tris.iqm";
-	jetpack->classname = "item_jetpack";
+	G_SetClassname (jetpack, "item_jetpack");
 	jetpack->item = FindItem ("Jetpack");
 	jetpack->s.effects = jetpack->item->world_model_flags;
 	jetpack->s.effects |= EF_ROTATE;
@@ -74,92 +74,87 @@ fire_lead
 This is an internal support routine used for bullet/pellet based weapons.
 =================
 */
-static void fire_lead (edict_t *self, vec3_t start, vec3_t aimdir, int damage, int kick, int te_impact, int hspread, int vspread, int mod, int silentHit)
+
+// where a round fired along aimdir with this spread ends up
+static void fire_lead_aim (vec3_t start, vec3_t aimdir, int hspread, int vspread, vec3_t end)
 {
-	trace_t		tr;
 	vec3_t		dir;
 	vec3_t		forward, right, up;
-	vec3_t		end;
 	float		r;
 	float		u;
-	vec3_t		water_start;
-	qboolean	water = false;
-	int			content_mask = MASK_SHOT | MASK_WATER;
 
-	G_DoTimeShiftFor (self);
+	vectoangles (aimdir, dir);
+	AngleVectors (dir, forward, right, up);
 
-	self->client->resp.weapon_shots[3]++;
+	r = crandom()*hspread;
+	u = crandom()*vspread;
+	VectorMA (start, 8192, forward, end);
+	VectorMA (end, r, right, end);
+	VectorMA (end, u, up, end);
+}
 
-	tr = gi.trace (self->s.origin, NULL, NULL, start, self, MASK_SHOT);
-	if (!(tr.fraction < 1.0))
-	{
-		vectoangles (aimdir, dir);
-		AngleVectors (dir, forward, right, up);
+// Everything after the round's first trace. With clear set, tr is the trace
+// from start to end and water says whether start was under water, otherwise
+// tr is the blocked trace from the shooter to the muzzle.
+static void fire_lead_finish (edict_t *self, vec3_t start, vec3_t aimdir, vec3_t end, trace_t tr, qboolean clear, qboolean water, int damage, int kick, int te_impact, int hspread, int vspread, int mod, int silentHit)
+{
+	vec3_t		dir;
+	vec3_t		forward, right, up;
+	float		r;
+	float		u;
+	vec3_t		water_start;
 
-		r = crandom()*hspread;
-		u = crandom()*vspread;
-		VectorMA (start, 8192, forward, end);
-		VectorMA (end, r, right, end);
-		VectorMA (end, u, up, end);
+	if (water)
+		VectorCopy (start, water_start);
 
-		if (gi.pointcontents (start) & MASK_WATER)
-		{
-			water = true;
-			VectorCopy (start, water_start);
-			content_mask &= ~MASK_WATER;
-		}
+	// see if we hit water
+	if (clear && (tr.contents & MASK_WATER))
+	{
+		int		color;
 
-		tr = gi.trace (start, NULL, NULL, end, self, content_mask);
+		water = true;
+		VectorCopy (tr.endpos, water_start);
 
-		// see if we hit water
-		if (tr.contents & MASK_WATER)
+		if (!VectorCompare (start, tr.endpos))
 		{
-			int		color;
-
-			water = true;
-			VectorCopy (tr.endpos, water_start);
-
-			if (!VectorCompare (start, tr.endpos))
+			if (tr.contents & CONTENTS_WATER)
 			{
-				if (tr.contents & CONTENTS_WATER)
-				{
-					if (strcmp(tr.surface->name, "*brwater") == 0)
-						color = SPLASH_BROWN_WATER;
-					else
-						color = SPLASH_BLUE_WATER;
-				}
-				else if (tr.contents & CONTENTS_SLIME)
-					color = SPLASH_SLIME;
-				else if (tr.contents & CONTENTS_LAVA)
-					color = SPLASH_LAVA;
+				if (strcmp(tr.surface->name, "*brwater") == 0)
+					color = SPLASH_BROWN_WATER;
 				else
-					color = SPLASH_UNKNOWN;
-
-				if (color != SPLASH_UNKNOWN)
-				{
-					gi.WriteByte (svc_temp_entity);
-					gi.WriteByte (TE_SPLASH);
-					gi.WriteByte (8);
-					gi.WritePosition (tr.endpos);
-					gi.WriteDir (tr.plane.normal);
-					gi.WriteByte (color);
-					gi.multicast (tr.endpos, MULTICAST_PVS);
-				}
+					color = SPLASH_BLUE_WATER;
+			}
+			else if (tr.contents & CONTENTS_SLIME)
+				color = SPLASH_SLIME;
+			else if (tr.contents & CONTENTS_LAVA)
+				color = SPLASH_LAVA;
+			else
+				color = SPLASH_UNKNOWN;
 
-				// change bullet's course when it enters water
-				VectorSubtract (end, start, dir);
-				vectoangles (dir, dir);
-				AngleVectors (dir, forward, right, up);
-				r = crandom()*hspread*2;
-				u = crandom()*vspread*2;
-				VectorMA (water_start, 8192, forward, end);
-				VectorMA (end, r, right, end);
-				VectorMA (end, u, up, end);
+			if (color != SPLASH_UNKNOWN)
+			{
+				gi.WriteByte (svc_temp_entity);
+				gi.WriteByte (TE_SPLASH);
+				gi.WriteByte (8);
+				gi.WritePosition (tr.endpos);
+				gi.WriteDir (tr.plane.normal);
+				gi.WriteByte (color);
+				gi.multicast (tr.endpos, MULTICAST_PVS);
 			}
 
-			// re-trace ignoring water this time
-			tr = gi.trace (water_start, NULL, NULL, end, self, MASK_SHOT);
+			// change bullet's course when it enters water
+			VectorSubtract (end, start, dir);
+			vectoangles (dir, dir);
+			AngleVectors (dir, forward, right, up);
+			r = crandom()*hspread*2;
+			u = crandom()*vspread*2;
+			VectorMA (water_start, 8192, forward, end);
+			VectorMA (end, r, right, end);
+			VectorMA (end, u, up, end);
 		}
+
+		// re-trace ignoring water this time
+		tr = gi.trace (water_start, NULL, NULL, end, self, MASK_SHOT);
 	}
 
 	// send gun puff / flash
@@ -213,6 +208,36 @@ static void fire_lead (edict_t *self, vec3_t start, vec3_t aimdir, int damage, i
 		gi.WritePosition (tr.endpos);
 		gi.multicast (pos, MULTICAST_PVS);
 	}
+}
+
+static void fire_lead (edict_t *self, vec3_t start, vec3_t aimdir, int damage, int kick, int te_impact, int hspread, int vspread, int mod, int silentHit)
+{
+	trace_t		tr;
+	vec3_t		end;
+	qboolean	clear;
+	qboolean	water = false;
+	int			content_mask = MASK_SHOT | MASK_WATER;
+
+	G_DoTimeShiftFor (self);
+
+	self->client->resp.weapon_shots[3]++;
+
+	tr = gi.trace (self->s.origin, NULL, NULL, start, self, MASK_SHOT);
+	clear = !(tr.fraction < 1.0);
+	if (clear)
+	{
+		fire_lead_aim (start, aimdir, hspread, vspread, end);
+
+		if (gi.pointcontents (start) & MASK_WATER)
+		{
+			water = true;
+			content_mask &= ~MASK_WATER;
+		}
+
+		tr = gi.trace (start, NULL, NULL, end, self, content_mask);
+	}
+
+	fire_lead_finish (self, start, aimdir, end, tr, clear, water, damage, kick, te_impact, hspread, vspread, mod, silentHit);
 
 	G_UndoTimeShiftFor (self);
 }
@@ -239,12 +264,58 @@ fire_shotgun
 Shoots shotgun pellets.  Used by shotgun and super shotgun.
 =================
 */
+#define MAX_PELLET_BATCH	32
+
 void fire_shotgun (edict_t *self, vec3_t start, vec3_t aimdir, int damage, int kick, int hspread, int vspread, int count, int mod)
 {
-	int		i;
+	vec3_t		starts[MAX_PELLET_BATCH], ends[MAX_PELLET_BATCH];
+	trace_t		tr, results[MAX_PELLET_BATCH];
+	qboolean	water = false;
+	int			content_mask = MASK_SHOT | MASK_WATER;
+	int			i, n, pellet;
+
+	G_DoTimeShiftFor (self);
 
-	for (i = 0; i < count; i++)
-		fire_lead (self, start, aimdir, damage, kick, TE_GUNSHOT, hspread, vspread, mod, i);
+	// every pellet leaves the same muzzle
+	tr = gi.trace (self->s.origin, NULL, NULL, start, self, MASK_SHOT);
+	if (tr.fraction < 1.0)
+	{
+		for (pellet = 0; pellet < count; pellet++)
+		{
+			self->client->resp.weapon_shots[3]++;
+			fire_lead_finish (self, start, aimdir, start, tr, false, false, damage, kick, TE_GUNSHOT, hspread, vspread, mod, pellet);
+		}
+		G_UndoTimeShiftFor (self);
+		return;
+	}
+
+	if (gi.pointcontents (start) & MASK_WATER)
+	{
+		water = true;
+		content_mask &= ~MASK_WATER;
+	}
+
+	// the pellets' first traces go out together, so they all see the
+	// world as it was before any of them hit
+	for (pellet = 0; pellet < count; pellet += n)
+	{
+		n = count - pellet < MAX_PELLET_BATCH ? count - pellet : MAX_PELLET_BATCH;
+		for (i = 0; i < n; i++)
+		{
+			VectorCopy (start, starts[i]);
+			fire_lead_aim (start, aimdir, hspread, vspread, ends[i]);
+		}
+
+		gi.tracebatch (n, starts, NULL, NULL, ends, self, content_mask, results);
+
+		for (i = 0; i < n; i++)
+		{
+			self->client->resp.weapon_shots[3]++;
+			fire_lead_finish (self, start, aimdir, ends[i], results[i], true, water, damage, kick, TE_GUNSHOT, hspread, vspread, mod, pellet + i);
+		}
+	}
+
+	G_UndoTimeShiftFor (self);
 }
 
 
@@ -422,7 +493,7 @@ void fire_blasterball (edict_t *self, vec3_t start, vec3_t dir, int damage, int
 	bolt->think = G_FreeEdict;
 	bolt->dmg = damage;
 
-	bolt->classname = "bolt";
+	G_SetClassname (bolt, "bolt");
 
 	gi.linkentity (bolt);
 
@@ -581,7 +652,7 @@ void fire_rocket (edict_t *self, vec3_t start, vec3_t dir, int damage, int speed
 	rocket->radius_dmg = radius_damage;
 	rocket->dmg_radius = damage_radius;
 	rocket->s.sound = gi.soundindex ("weapons/rockfly.wav");
-	rocket->classname = "rocket";
+	G_SetClassname (rocket, "rocket");
 
 	gi.linkentity (rocket);
 	
@@ -726,7 +797,7 @@ void fire_blaster_beam (edict_t *self, vec3_t start, vec3_t aimdir, int damage,
 		bomb->s.modelindex = 0;
 		bomb->owner = self;
 		bomb->think = G_FreeEdict;
-		bomb->classname = "bomb";
+		G_SetClassname (bomb, "bomb");
 		gi.linkentity (bomb);
 		T_RadiusDamage(bomb, self, 50, NULL, 200, MOD_VAPORALTFIRE, 0);
 		G_FreeEdict (bomb);
@@ -869,7 +940,7 @@ void fire_hover_beam (edict_t *self, vec3_t start, vec3_t aimdir, int damage, in
 		bomb->s.modelindex = 0;
 		bomb->owner = self;
 		bomb->think = G_FreeEdict;
-		bomb->classname = "bomb";
+		G_SetClassname (bomb, "bomb");
 		gi.linkentity (bomb);
 		T_RadiusDamage(bomb, self, damage*5.0, NULL, 200, MOD_DISRUPTOR, -1);
 
@@ -1017,7 +1088,7 @@ void fire_disruptor (edict_t *self, vec3_t start, vec3_t aimdir, int damage, int
 	bomb->s.modelindex = 0;
 	bomb->owner = self;
 	bomb->think = G_FreeEdict;
-	bomb->classname = "bomb";
+	G_SetClassname (bomb, "bomb");
 	gi.linkentity (bomb);
 	T_RadiusDamage(bomb, self, 95, NULL, 50, MOD_PLASMA_SPLASH, -1);
 	G_FreeEdict (bomb);
@@ -1098,7 +1169,7 @@ void fire_vaporizer (edict_t *self, vec3_t start, vec3_t aimdir, int damage, int
 	bomb->s.modelindex = 0;
 	bomb->owner = self;
 	bomb->think = G_FreeEdict;
-	bomb->classname = "bomb";
+	G_SetClassname (bomb, "bomb");
 	gi.linkentity (bomb);
 	T_RadiusDamage(bomb, self, 150, NULL, 150, MOD_VAPORIZER, 7); //ridiculously powerful!
 	G_FreeEdict (bomb);
@@ -1198,7 +1269,7 @@ void fire_homingrocket (edict_t *self, vec3_t start, vec3_t dir, int damage, int
 	rocket->radius_dmg = radius_damage;
 	rocket->dmg_radius = damage_radius;
 	rocket->s.sound = gi.soundindex ("weapons/rockfly.wav");
-	rocket->classname = "rocket";
+	G_SetClassname (rocket, "rocket");
 
 	gi.linkentity (rocket);
 }
@@ -1379,7 +1450,7 @@ void fire_minderaser (edict_t *self, vec3_t start, vec3_t dir, float timer)
 	spud->think = minderaser_think;
 
 	spud->s.sound = gi.soundindex ("weapons/seeker.wav"); 
-	spud->classname = "seeker"; //to do - make sure bots know to run like hell away from these things
+	G_SetClassname (spud, "seeker"); //to do - make sure bots know to run like hell away from these things
 
 	gi.linkentity (spud);
 }
@@ -1683,7 +1754,7 @@ void fire_smartgrenade (edict_t *self, vec3_t start, vec3_t aimdir, int damage,
 	floater->radius_dmg = radius_damage;
 	floater->dmg_radius = damage_radius;
 	floater->s.sound = gi.soundindex ("weapons/electroball.wav");
-	floater->classname = "grenade";
+	G_SetClassname (floater, "grenade");
 	floater->nade_timer = 0;
 
 	gi.linkentity (floater);
@@ -1717,7 +1788,7 @@ void fire_prox (edict_t *self, vec3_t start, vec3_t aimdir, int damage, int spee
     prox->dmg = damage;
 	prox->radius_dmg = radius_damage;
 	prox->dmg_radius = damage_radius;
-	prox->classname = "mine";
+	G_SetClassname (prox, "mine");
 	prox->takedamage = DAMAGE_YES;
 	prox->health = 20;
 	prox->die = prox_die;
@@ -1825,7 +1896,7 @@ void fire_bomb (edict_t *self, vec3_t start, vec3_t aimdir, int damage, int spee
 	bomb->radius_dmg = radius_damage;
 	bomb->dmg_radius = damage_radius;
 	bomb->s.sound = gi.soundindex ("vehicles/flybomb.wav"); //get a new sound
-	bomb->classname = "grenade";
+	G_SetClassname (bomb, "grenade");
 
 	gi.linkentity (bomb);
 }
@@ -1903,7 +1974,7 @@ void burn_person(edict_t *target, edict_t *owner, int damage)
 	flame->FlameDelay = level.time + 0.8;
 	flame->think = Fire_Think;
 	flame->FlameDamage = damage+2;
-	flame->classname = "fire";
+	G_SetClassname (flame, "fire");
 	flame->s.sound = gi.soundindex ("weapons/grenlb1b.wav"); 
 	gi.linkentity (flame);
 
@@ -1968,7 +2039,7 @@ void fire_flamethrower(edict_t *self, vec3_t start, vec3_t dir, int damage, int
 	flame->radius_dmg = damage;
 	flame->FlameDamage = damage;
 	flame->dmg_radius = damage_radius;
-	flame->classname = "flame";
+	G_SetClassname (flame, "flame");
 
 	gi.linkentity (flame);
 
@@ -2056,7 +2127,7 @@ void fire_fireball (edict_t *self, vec3_t start, vec3_t aimdir, int damage, int
 	fireball->dmg_radius = damage_radius;
 	fireball->FlameDamage = damage;
 	//fireball->s.sound = gi.soundindex ("weapons/grenlf1a.wav");
-	fireball->classname = "flame";
+	G_SetClassname (fireball, "flame");
 
 	gi.linkentity (fireball);
 }
@@ -2260,14 +2331,14 @@ void fire_tacticalbomb (edict_t *self, vec3_t start, vec3_t aimdir, int speed)
 	{
 		bomb->s.modelindex = gi.modelindex ("models/tactical/human_bomb.iqm"); 
 		bomb->touch = hbomb_touch;
-		bomb->classname = "hbomb";
+		G_SetClassname (bomb, "hbomb");
 		bomb->ctype = 1;
 	}
 	else
 	{
 		bomb->s.modelindex = gi.modelindex ("models/tactical/alien_bomb.iqm");
 		bomb->touch = abomb_touch;
-		bomb->classname = "abomb";
+		G_SetClassname (bomb, "abomb");
 		bomb->ctype = 0;
 	}
 	bomb->owner = self;
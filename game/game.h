@@ -20,7 +20,7 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 // game.h -- game module information visible to server
 
-#define	GAME_API_VERSION	3
+#define	GAME_API_VERSION	4
 
 // edict->svflags
 
@@ -39,6 +39,18 @@ typedef enum
 	SOLID_BSP			// bsp clip, touch on edge
 } solid_t;
 
+// who is tracing, for the server's per-caller trace profile; see
+// gi.tracecaller
+typedef enum
+{
+	TRACE_OTHER,
+	TRACE_PMOVE,
+	TRACE_PHYSICS,
+	TRACE_WEAPONS,
+	TRACE_BOTS,
+	NUM_TRACE_CALLERS
+} tracecaller_t;
+
 //===============================================================
 
 // link_t is only used for entity area links now
@@ -201,6 +213,20 @@ typedef struct
 	qboolean (*FullPath)(char *full_path, size_t pathsize, const char *relative_path);
 	void (*FullWritePath)(char *full_path, size_t pathsize,	const char *relative_path);
 
+	// gi.trace for count rays of the same size, results[i] is what
+	// trace (starts[i], mins, maxs, ends[i], ...) would return
+	void	(*tracebatch) (int count, vec3_t *starts, vec3_t mins, vec3_t maxs, vec3_t *ends, edict_t *passent, int contentmask, trace_t *results);
+	// charges the traces that follow to a tracecaller_t, returns the
+	// previous caller so it can be restored
+	int		(*tracecaller) (int caller);
+
+	// solid and trigger entities whose centers are within radius of org,
+	// sorted by edict number, from the area nodes instead of every edict
+	int		(*RadiusEdicts) (vec3_t org, float radius, edict_t **list, int maxcount);
+
+	// monotonic clock for the bench commands, not for game time
+	unsigned long long (*Sys_Microseconds) (void);
+
 } game_import_t;
 
 //
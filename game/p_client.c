@@ -1603,7 +1603,7 @@ void InitBodyQue (void)
 	for (i=0; i<BODY_QUEUE_SIZE ; i++)
 	{
 		ent = G_Spawn();
-		ent->classname = "bodyque";
+		G_SetClassname (ent, "bodyque");
 	}
 }
 
@@ -2252,7 +2252,7 @@ void PutClientInServer (edict_t *ent)
 
 	Respawn_Player_ClearEnt (ent);
 	
-	ent->classname = ent->is_bot ? "bot" : "player";
+	G_SetClassname (ent, ent->is_bot ? "bot" : "player");
 
 	if (!ent->is_bot)
 	{
@@ -3123,7 +3123,7 @@ void ClientDisconnect (edict_t *ent)
 	ent->s.sound = 0;
 	ent->solid = SOLID_NOT;
 	ent->inuse = false;
-	ent->classname = "disconnected";
+	G_SetClassname (ent, "disconnected");
 	ent->client->pers.connected = false;
 
 	playernum = ent-g_edicts-1;
@@ -3398,6 +3398,7 @@ void ClientThink (edict_t *ent, usercmd_t *ucmd)
 	edict_t	*other;
 	int		i, j, mostvotes, n_candidates;
 	int		map_candidates[4];
+	int		caller;
 	pmove_t	pm;
 	qboolean sproing, haste;
 	vec3_t addspeed, forward, up, right;
@@ -3696,7 +3697,9 @@ void ClientThink (edict_t *ent, usercmd_t *ucmd)
 		}
 
 		// perform a pmove
+		caller = gi.tracecaller (TRACE_PMOVE);
 		gi.Pmove (&pm);
+		gi.tracecaller (caller);
 
 		// save results of pmove
 		client->ps.pmove = pm.s;
@@ -141,7 +141,7 @@ void PlaceWinnerOnVictoryPad(edict_t *winner, int offset)
 	pad->s.renderfx = (RF_FULLBRIGHT | RF_GLOW | RF_NOSHADOWS);
 	pad->s.modelindex = gi.modelindex("models/objects/dmspot/tris.iqm");
 	pad->think = NULL;
-	pad->classname = "pad";
+	G_SetClassname (pad, "pad");
 	gi.linkentity (pad);
 
 	movedir[0] = movedir[1] = 0;
@@ -184,7 +184,7 @@ void PlaceWinnerOnVictoryPad(edict_t *winner, int offset)
 
 	VectorCopy (level.intermission_origin, chasecam->s.origin);
 
-    chasecam->classname = "chasecam";
+    G_SetClassname (chasecam, "chasecam");
     chasecam->think = NULL;
 	winner->client->chasecam = chasecam;
     winner->client->oldplayer = G_Spawn();
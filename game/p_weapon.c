@@ -70,7 +70,7 @@ void PlayerNoise(edict_t *who, vec3_t where, int type)
 	if (!who->mynoise)
 	{
 		noise = G_Spawn();
-		noise->classname = "player_noise";
+		G_SetClassname (noise, "player_noise");
 		VectorSet (noise->mins, -8, -8, -8);
 		VectorSet (noise->maxs, 8, 8, 8);
 		noise->owner = who;
@@ -78,7 +78,7 @@ void PlayerNoise(edict_t *who, vec3_t where, int type)
 		who->mynoise = noise;
 
 		noise = G_Spawn();
-		noise->classname = "player_noise";
+		G_SetClassname (noise, "player_noise");
 		VectorSet (noise->mins, -8, -8, -8);
 		VectorSet (noise->maxs, 8, 8, 8);
 		noise->owner = who;
@@ -404,6 +404,9 @@ Called by ClientBeginServerFrame and ClientThink
 */
 void Think_Weapon (edict_t *ent)
 {
+	int		caller;
+
+	caller = gi.tracecaller (TRACE_WEAPONS);
 
 	if ( (((ent->client->latched_buttons|ent->client->buttons) & BUTTON_ATTACK) || ((ent->client->latched_buttons|ent->client->buttons) & BUTTON_ATTACK2)) &&
 		level.framenum - ent->client->last_fire_frame >= round(0.1/FRAMETIME))
@@ -430,6 +433,8 @@ void Think_Weapon (edict_t *ent)
 		}
 		ent->client->last_weap_think_frame = level.framenum;
 	}
+
+	gi.tracecaller (caller);
 }
 
 
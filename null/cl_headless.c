@@ -0,0 +1,522 @@
+/*
+Copyright (C) 1997-2001 Id Software, Inc.
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+// cl_headless.c -- null renderer, sound, input and video for the headless
+// client, which runs the whole client simulation without a display so
+// timedemos can be profiled on machines with no GPU
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "client/client.h"
+#include "ref_gl/r_image.h"
+
+/*
+==============================================================================
+
+VIDEO AND INPUT
+
+==============================================================================
+*/
+
+viddef_t	viddef;
+qboolean	vid_restart = false;
+cvar_t		*vid_ref;
+cvar_t		*m_accel;
+
+// the refresh cvars the client reads directly
+cvar_t		*gl_dynamic;
+cvar_t		*r_shaders;
+cvar_t		*r_lefthand;
+cvar_t		*r_minimap;
+cvar_t		*r_minimap_style;
+
+void VID_Init (void)
+{
+	vid_ref = Cvar_Get ("vid_ref", "null", CVAR_NOSET);
+
+	r_shaders = Cvar_Get ("r_shaders", "1", CVAR_ARCHIVE|CVARDOC_BOOL);
+	gl_dynamic = Cvar_Get ("gl_dynamic", "1", CVAR_ARCHIVE);
+	r_lefthand = Cvar_Get ("hand", "0", CVAR_USERINFO | CVAR_ARCHIVE | CVARDOC_INT);
+	r_minimap = Cvar_Get ("r_minimap", "0", CVAR_ARCHIVE|CVARDOC_BOOL);
+	r_minimap_style = Cvar_Get ("r_minimap_style", "1", CVAR_ARCHIVE);
+
+	Swap_Init ();
+
+	viddef.width = Cvar_Get ("vid_width", "1024", CVAR_ARCHIVE)->integer;
+	viddef.height = Cvar_Get ("vid_height", "768", CVAR_ARCHIVE)->integer;
+}
+
+void VID_Shutdown (void)
+{
+}
+
+void VID_CheckChanges (void)
+{
+	vid_restart = false;
+}
+
+void HandleEvents (void)
+{
+}
+
+void IN_Init (void)
+{
+}
+
+void IN_Shutdown (void)
+{
+}
+
+void IN_Commands (void)
+{
+}
+
+void IN_Frame (void)
+{
+}
+
+void IN_JoyMove (usercmd_t *cmd)
+{
+}
+
+void IN_Activate (qboolean active)
+{
+}
+
+char *Sys_GetClipboardData (void)
+{
+	return NULL;
+}
+
+/*
+==============================================================================
+
+SOUND
+
+==============================================================================
+*/
+
+void S_Init (void)
+{
+}
+
+void S_Shutdown (void)
+{
+}
+
+void S_StartSound (vec3_t origin, int entnum, int entchannel, struct sfx_s *sfx, float fvol,  float attenuation, float timeofs)
+{
+}
+
+void S_StartLocalSound (const char *s)
+{
+}
+
+void S_StartMusic (char *s)
+{
+}
+
+void S_StartMenuMusic (void)
+{
+}
+
+void S_StartMapMusic (void)
+{
+}
+
+void S_RawSamples (int samples, int rate, int width, int channels, byte *data)
+{
+}
+
+void S_StopAllSounds (void)
+{
+}
+
+void S_Update (vec3_t origin, vec3_t v_forward, vec3_t v_right, vec3_t v_up)
+{
+}
+
+void S_Activate (qboolean active)
+{
+}
+
+void S_BeginRegistration (void)
+{
+}
+
+struct sfx_s *S_RegisterSound (char *sample)
+{
+	return NULL;
+}
+
+void S_EndRegistration (void)
+{
+}
+
+struct sfx_s *S_FindName (const char *name, qboolean create)
+{
+	return NULL;
+}
+
+void S_UpdateDopplerFactor (void)
+{
+}
+
+/*
+==============================================================================
+
+TEXT
+
+Every font is one null font, which draws nothing.
+
+==============================================================================
+*/
+
+float	FNT_colors[ 8 ][ 4 ] =
+{
+	{0.0, 0.0, 0.0, 1.0},
+	{1.0, 0.0, 0.0, 1.0},
+	{0.0, 1.0, 0.0, 1.0},
+	{1.0, 1.0, 0.0, 1.0},
+	{0.0, 0.0, 1.0, 1.0},
+	{0.0, 1.0, 1.0, 1.0},
+	{1.0, 0.0, 1.0, 1.0},
+	{1.0, 1.0, 1.0, 1.0},
+};
+
+static void FNT_Null_RawPrint (FNT_font_t font, const char *text, unsigned int text_length,
+	qboolean r2l, float x, float y, const float color[4])
+{
+}
+
+static void FNT_Null_BoundedPrint (FNT_font_t font, const char *text, unsigned int cmode,
+	unsigned int align, FNT_window_t box, const float *color)
+{
+	box->width = box->height = 0;
+}
+
+static void FNT_Null_WrappedPrint (FNT_font_t font, const char *text, unsigned int cmode,
+	unsigned int align, unsigned int indent, FNT_window_t box, const float *color)
+{
+	box->width = box->height = 0;
+}
+
+static int FNT_Null_PredictSize (FNT_font_t font, const char *text, qboolean color)
+{
+	return 0;
+}
+
+static struct FNT_font_s fnt_null =
+{
+	"null", NULL, 8, 8, 8,
+	FNT_Null_RawPrint, FNT_Null_BoundedPrint, FNT_Null_WrappedPrint, FNT_Null_PredictSize
+};
+
+void FNT_AutoInit (FNT_auto_t auto_font, const char *default_face, int default_size,
+	unsigned int auto_lines, unsigned int min_size, unsigned int max_size)
+{
+	auto_font->next = auto_font->previous = auto_font;
+	Q_strncpyz2 (auto_font->face, default_face, sizeof(auto_font->face));
+	auto_font->font = &fnt_null;
+}
+
+void FNT_AutoRegister (FNT_auto_t auto_font)
+{
+	auto_font->font = &fnt_null;
+}
+
+FNT_font_t FNT_AutoGet (FNT_auto_t auto_font)
+{
+	return &fnt_null;
+}
+
+/*
+==============================================================================
+
+REFRESH
+
+Models and images are handed out by name, so the client sees the same
+pointers it would from the real renderer and takes the same paths through
+cl_ents.c and cl_fx.c. Frames are dropped after the client has built them.
+
+==============================================================================
+*/
+
+struct model_s
+{
+	char		name[MAX_QPATH];
+};
+
+#define	MAX_NULLMODELS	1024
+#define	MAX_NULLIMAGES	2048
+
+static struct model_s	r_nullmodels[MAX_NULLMODELS];
+static int				r_numnullmodels;
+static image_t			r_nullimages[MAX_NULLIMAGES];
+static int				r_numnullimages;
+
+unsigned	r_weather;
+float		rs_realtime;
+float		r_frametime;
+vec3_t		vpn;
+vec3_t		r_origin;
+int			r_drawing_fbeffect;
+int			r_fbFxType;
+float		r_fbeffectTime;
+vec3_t		r_explosionOrigin;
+qboolean	r_gotFlag;
+qboolean	r_lostFlag;
+char		map_music[MAX_OSPATH];
+char		map_music_sec[MAX_OSPATH];
+
+int			c_brush_polys, c_alias_polys, c_flares, c_grasses, c_beams, c_vbo_batches;
+
+image_t		*r_particletexture, *r_smoketexture, *r_fireballtexture;
+image_t		*r_firestreamtexture, *r_firestream3ptexture, *r_explosiontexture;
+image_t		*r_explosion1texture, *r_explosion2texture, *r_explosion3texture;
+image_t		*r_explosion4texture, *r_explosion5texture, *r_explosion6texture;
+image_t		*r_explosion7texture, *r_bloodtexture, *r_blood2texture;
+image_t		*r_blood3texture, *r_blood4texture, *r_blood5texture, *r_pufftexture;
+image_t		*r_bflashtexture, *r_cflashtexture, *r_fflashtexture, *r_pflashtexture;
+image_t		*r_leaderfieldtexture, *r_deathfieldtexture, *r_deathfieldtexture2;
+image_t		*r_hittexture, *r_bubbletexture, *r_shottexture, *r_bullettexture;
+image_t		*r_bulletnormal, *r_sayicontexture, *r_flaretexture, *r_beamstart;
+image_t		*r_beam2texture, *r_beam3texture, *r_dis1texture, *r_dis2texture;
+image_t		*r_dis3texture, *r_voltagetexture, *r_raintexture, *r_leaftexture;
+image_t		*r_trashtexture, *r_splashtexture, *r_splash2texture;
+image_t		*r_lavasplashtexture, *r_flagtexture, *r_logotexture;
+image_t		*r_doubledamage, *r_invulnerability;
+
+static image_t *R_NullImage (const char *name)
+{
+	image_t	*image;
+	int		i;
+
+	for (i = 0; i < r_numnullimages; i++)
+		if (!strcmp (r_nullimages[i].name, name))
+			return &r_nullimages[i];
+
+	if (r_numnullimages == MAX_NULLIMAGES)
+		return &r_nullimages[MAX_NULLIMAGES-1];
+
+	image = &r_nullimages[r_numnullimages++];
+	Q_strncpyz2 (image->name, name, sizeof(image->name));
+	image->width = image->height = 1;
+	image->upload_width = image->upload_height = 1;
+	return image;
+}
+
+static void R_NullParticleImages (void)
+{
+	image_t	**images[] =
+	{
+		&r_particletexture, &r_smoketexture, &r_fireballtexture,
+		&r_firestreamtexture, &r_firestream3ptexture, &r_explosiontexture,
+		&r_explosion1texture, &r_explosion2texture, &r_explosion3texture,
+		&r_explosion4texture, &r_explosion5texture, &r_explosion6texture,
+		&r_explosion7texture, &r_bloodtexture, &r_blood2texture,
+		&r_blood3texture, &r_blood4texture, &r_blood5texture, &r_pufftexture,
+		&r_bflashtexture, &r_cflashtexture, &r_fflashtexture, &r_pflashtexture,
+		&r_leaderfieldtexture, &r_deathfieldtexture, &r_deathfieldtexture2,
+		&r_hittexture, &r_bubbletexture, &r_shottexture, &r_bullettexture,
+		&r_bulletnormal, &r_sayicontexture, &r_flaretexture, &r_beamstart,
+		&r_beam2texture, &r_beam3texture, &r_dis1texture, &r_dis2texture,
+		&r_dis3texture, &r_voltagetexture, &r_raintexture, &r_leaftexture,
+		&r_trashtexture, &r_splashtexture, &r_splash2texture,
+		&r_lavasplashtexture, &r_flagtexture, &r_logotexture,
+		&r_doubledamage, &r_invulnerability
+	};
+	int		i;
+
+	for (i = 0; i < sizeof(images)/sizeof(images[0]); i++)
+		*images[i] = R_NullImage ("particles/null");
+}
+
+struct model_s *R_RegisterModel (char *name)
+{
+	struct model_s	*mod;
+	int				i;
+
+	if (!name || !name[0])
+		return NULL;
+
+	for (i = 0; i < r_numnullmodels; i++)
+		if (!strcmp (r_nullmodels[i].name, name))
+			return &r_nullmodels[i];
+
+	if (r_numnullmodels == MAX_NULLMODELS)
+		return &r_nullmodels[MAX_NULLMODELS-1];
+
+	mod = &r_nullmodels[r_numnullmodels++];
+	Q_strncpyz2 (mod->name, name, sizeof(mod->name));
+	return mod;
+}
+
+struct model_s *Mod_ForName (char *name, qboolean crash)
+{
+	return R_RegisterModel (name);
+}
+
+struct image_s *R_RegisterSkin (char *name)
+{
+	return R_NullImage (name);
+}
+
+struct image_s *R_RegisterPic (const char *name)
+{
+	return R_NullImage (name);
+}
+
+void R_BeginRegistration (char *map)
+{
+	R_NullParticleImages ();
+}
+
+void R_EndRegistration (void)
+{
+}
+
+void R_RegisterBasePlayerModels (void)
+{
+}
+
+void R_RegisterCustomPlayerModels (void)
+{
+}
+
+void R_SetSky (char *name, float rotate, vec3_t axis)
+{
+}
+
+void R_BeginFrame (float camera_separation)
+{
+}
+
+void R_RenderFrame (refdef_t *fd)
+{
+	rs_realtime = fd->time;
+	VectorCopy (fd->vieworg, r_origin);
+	AngleVectors (fd->viewangles, vpn, NULL, NULL);
+}
+
+void R_RenderFramePlayerSetup (refdef_t *fd)
+{
+}
+
+void R_EndFrame (void)
+{
+}
+
+void R_TransformVectorToScreen (refdef_t *rd, vec3_t in, vec2_t out)
+{
+	out[0] = out[1] = -1;
+}
+
+void R_ApplyForceToRagdolls (vec3_t origin, float force)
+{
+}
+
+void RS_LoadScript (char *script)
+{
+}
+
+void RS_LoadSpecialScripts (void)
+{
+}
+
+void RS_ScanPathForScripts (void)
+{
+}
+
+void RS_FreeUnmarked (void)
+{
+}
+
+void RS_FreeAllScripts (void)
+{
+}
+
+/*
+==============================================================================
+
+DRAWING
+
+==============================================================================
+*/
+
+float *RGBA (float r, float g, float b, float a)
+{
+	static float ret[4];
+
+	ret[0] = r;
+	ret[1] = g;
+	ret[2] = b;
+	ret[3] = a;
+
+	return ret;
+}
+
+qboolean Draw_PicExists (const char *name)
+{
+	return false;
+}
+
+void Draw_GetPicSize (int *w, int *h, const char *name)
+{
+	*w = *h = 1;
+}
+
+void Draw_Pic (float x, float y, const char *name)
+{
+}
+
+void Draw_ScaledPic (float x, float y, float scale, const char *pic)
+{
+}
+
+void Draw_AngledScaledPic (float x, float y, float scale, const char *pic, qboolean isNum)
+{
+}
+
+void Draw_StretchPic (float x, float y, float w, float h, const char *name)
+{
+}
+
+void Draw_AlphaStretchTilingPic (float x, float y, float w, float h, const char *name, float alphaval)
+{
+}
+
+void Draw_AlphaStretchPic (float x, float y, float w, float h, const char *name, float alphaval)
+{
+}
+
+void Draw_AlphaStretchPlayerIcon (int x, int y, int w, int h, const char *pic, float alphaval)
+{
+}
+
+void Draw_Fill (float x, float y, float w, float h, const float rgba[])
+{
+}
+
+void Draw_Fill_CutCorners (float x, float y, float w, float h, const float rgba[], float radius, int corners)
+{
+}
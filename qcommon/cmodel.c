@@ -26,6 +26,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "qcommon.h"
 
 #include <float.h>
+#include <limits.h>
 
 typedef struct
 {
@@ -58,7 +59,6 @@ typedef struct
 	int			contents;
 	int			numsides;
 	int			firstbrushside;
-	int			checkcount;		// to avoid repeated testings (FIXME: not threadsafe!)
 } cbrush_t;
 
 typedef struct
@@ -69,9 +69,8 @@ typedef struct
 	int		floodvalid;
 } carea_t;
 
-int			checkcount;
-
 char		map_name[MAX_QPATH];
+static unsigned	last_checksum;	// of map_name
 
 int			numbrushsides;
 cbrushside_t map_brushsides[MAX_MAP_BRUSHSIDES];
@@ -102,6 +101,16 @@ int			numvisibility;
 byte		map_visibility[MAX_MAP_VISIBILITY];
 dvis_t		*map_vis = (dvis_t *)map_visibility;
 
+// every PVS and PHS row decompressed up front, when it fits in
+// cm_vismatrix kilobytes; NULL means rows are decompressed on demand
+cvar_t		*cm_vismatrix;
+byte		*vis_matrix;
+static void	*vis_matrix_alloc;
+static int	vis_rowstride;		// multiple of a cache line
+static byte	vis_zerorow[MAX_MAP_LEAFS/8];
+
+void CM_DecompressVis (byte *in, byte *out);
+
 int			numentitychars;
 char		map_entitystring[MAX_MAP_ENTSTRING];
 
@@ -137,7 +146,6 @@ typedef struct
 	vec3_t		mins, maxs;
 	int			neighbors[3];	// neighbors[i] shares verts i and (i+1)%3
 	char		neighbors_whichedge[3];
-	int			checkcount;		// to avoid repeated testings (FIXME: not threadsafe!)
 } cterraintri_t;
 
 // Terrain models are divided up into axis-aligned 3D grids of cube-shaped 
@@ -759,6 +767,52 @@ static void CMod_LoadVisibility (lump_t *l)
 	}
 }
 
+/*
+=================
+CM_FreeVisMatrix
+=================
+*/
+static void CM_FreeVisMatrix (void)
+{
+	if (vis_matrix_alloc)
+		Z_Free (vis_matrix_alloc);
+	vis_matrix_alloc = NULL;
+	vis_matrix = NULL;
+}
+
+/*
+=================
+CM_BuildVisMatrix
+
+Decompresses every PVS row followed by every PHS row, each row padded
+out to a 64 byte boundary, unless that would take more than cm_vismatrix
+kilobytes.
+=================
+*/
+static void CM_BuildVisMatrix (void)
+{
+	int		i;
+	int		size;
+
+	CM_FreeVisMatrix ();
+
+	vis_rowstride = (((numclusters+7)>>3) + 63) & ~63;
+	size = 2 * numclusters * vis_rowstride;
+	if (!numvisibility || size > cm_vismatrix->integer * 1024)
+		return;
+
+	vis_matrix_alloc = Z_Malloc (size + 63);
+	vis_matrix = (byte *)(((size_t)vis_matrix_alloc + 63) & ~(size_t)63);
+
+	for (i=0 ; i<numclusters ; i++)
+	{
+		CM_DecompressVis (map_visibility + map_vis->bitofs[i][DVIS_PVS],
+			vis_matrix + i*vis_rowstride);
+		CM_DecompressVis (map_visibility + map_vis->bitofs[i][DVIS_PHS],
+			vis_matrix + (numclusters+i)*vis_rowstride);
+	}
+}
+
 
 /*
 =================
@@ -1455,7 +1509,6 @@ cmodel_t *CM_LoadBSP (char *name, qboolean clientload, unsigned *checksum)
 	unsigned int	i, j;
 	dheader_t		header;
 	int				length;
-	static unsigned	last_checksum;
 	int				bsp_lump_order[HEADER_LUMPS] = 
 	{
 		LUMP_PLANES, LUMP_LEAFS, LUMP_VERTEXES, LUMP_NODES, 
@@ -1467,6 +1520,8 @@ cmodel_t *CM_LoadBSP (char *name, qboolean clientload, unsigned *checksum)
 	};
 
 	map_noareas = Cvar_Get ("map_noareas", "0", 0);
+	cm_vismatrix = Cvar_Get ("cm_vismatrix", "32768", CVARDOC_INT);
+	Cvar_Describe (cm_vismatrix, "Memory budget in kilobytes for keeping the map's PVS and PHS fully decompressed, which makes visibility checks much cheaper. Maps that need more than this decompress rows as needed. Takes effect on the next map load.");
 
 	// Don't need to load the map twice on local servers.
 	if (  !strcmp (map_name, name) && (clientload || !Cvar_VariableValue ("flushmap")) )
@@ -1481,6 +1536,7 @@ cmodel_t *CM_LoadBSP (char *name, qboolean clientload, unsigned *checksum)
 	}
 
 	// free old stuff
+	CM_FreeVisMatrix ();
 	numplanes = 0;
 	numnodes = 0;
 	numleafs = 0;
@@ -1503,7 +1559,7 @@ cmodel_t *CM_LoadBSP (char *name, qboolean clientload, unsigned *checksum)
 	// load the file
 	//
 
-	length = FS_LoadFile (name, (void **)&buf);
+	length = FS_MapFile (name, (void **)&buf);
 	if (!buf)
 		Com_Error (ERR_DROP, "Could not load %s", name);
 
@@ -1538,7 +1594,9 @@ cmodel_t *CM_LoadBSP (char *name, qboolean clientload, unsigned *checksum)
 	CMod_LoadVisibility (&header.lumps[LUMP_VISIBILITY]);
 	CMod_LoadEntityString (&header.lumps[LUMP_ENTITIES]);
 
-	FS_FreeFile (buf);
+	FS_UnmapFile (buf);
+
+	CM_BuildVisMatrix ();
 
 	CM_InitBoxHull ();
 
@@ -1578,6 +1636,20 @@ cmodel_t *CM_LoadBSP (char *name, qboolean clientload, unsigned *checksum)
 	return &map_cmodels[0];
 }
 
+/*
+==================
+CM_MapChecksum
+
+The checksum of the BSP currently loaded as map_name, 0 if there is none.
+==================
+*/
+unsigned CM_MapChecksum (void)
+{
+	if (!map_name[0])
+		return 0;
+	return last_checksum;
+}
+
 cmodel_t *CM_LoadMap (char *name, qboolean clientload, unsigned *checksum) {
 	char        *buf;
 	const char	*line;
@@ -1924,12 +1996,15 @@ CM_BoxLeafnums
 Fills in a list of all the leafs touched
 =============
 */
-int		leaf_count, leaf_maxcount;
-int		*leaf_list;
-float	*leaf_mins, *leaf_maxs;
-int		leaf_topnode;
+typedef struct
+{
+	int		count, maxcount;
+	int		*list;
+	float	*mins, *maxs;
+	int		topnode;
+} leafquery_t;
 
-static void CM_BoxLeafnums_r (int nodenum)
+static void CM_BoxLeafnums_r (leafquery_t *q, int nodenum)
 {
 	cplane_t	*plane;
 	cnode_t		*node;
@@ -1939,50 +2014,54 @@ static void CM_BoxLeafnums_r (int nodenum)
 	{
 		if (nodenum < 0)
 		{
-			if (leaf_count >= leaf_maxcount)
+			if (q->count >= q->maxcount)
 			{
 //				Com_Printf ("CM_BoxLeafnums_r: overflow\n");
 				return;
 			}
-			leaf_list[leaf_count++] = -1 - nodenum;
+			q->list[q->count++] = -1 - nodenum;
 			return;
 		}
 
 		node = &map_nodes[nodenum];
 		plane = node->plane;
-//		s = BoxOnPlaneSide (leaf_mins, leaf_maxs, plane);
-		s = BOX_ON_PLANE_SIDE(leaf_mins, leaf_maxs, plane);
+//		s = BoxOnPlaneSide (q->mins, q->maxs, plane);
+		s = BOX_ON_PLANE_SIDE(q->mins, q->maxs, plane);
 		if (s == 1)
 			nodenum = node->children[0];
 		else if (s == 2)
 			nodenum = node->children[1];
 		else
 		{	// go down both
-			if (leaf_topnode == -1)
-				leaf_topnode = nodenum;
-			CM_BoxLeafnums_r (node->children[0]);
+			if (q->topnode == -1)
+				q->topnode = nodenum;
+			CM_BoxLeafnums_r (q, node->children[0]);
 			nodenum = node->children[1];
 		}
 
 	}
 }
 
+// the query state lives on the stack, so this is safe to call from
+// more than one thread at a time
 static int	CM_BoxLeafnums_headnode (vec3_t mins, vec3_t maxs, int *list, int listsize, int headnode, int *topnode)
 {
-	leaf_list = list;
-	leaf_count = 0;
-	leaf_maxcount = listsize;
-	leaf_mins = mins;
-	leaf_maxs = maxs;
+	leafquery_t	q;
+
+	q.list = list;
+	q.count = 0;
+	q.maxcount = listsize;
+	q.mins = mins;
+	q.maxs = maxs;
 
-	leaf_topnode = -1;
+	q.topnode = -1;
 
-	CM_BoxLeafnums_r (headnode);
+	CM_BoxLeafnums_r (&q, headnode);
 
 	if (topnode)
-		*topnode = leaf_topnode;
+		*topnode = q.topnode;
 
-	return leaf_count;
+	return q.count;
 }
 
 int	CM_BoxLeafnums (vec3_t mins, vec3_t maxs, int *list, int listsize, int *topnode)
@@ -2058,17 +2137,98 @@ BOX TRACING
 // 1/32 epsilon to keep floating point happy
 #define	DIST_EPSILON	(0.03125f)
 
-static vec3_t		trace_start, trace_end;
-static vec3_t		trace_mins, trace_maxs;
-static vec3_t		trace_extents;
+// Everything a trace in progress needs, so traces on different threads
+// don't step on each other. The map itself is only ever read while tracing.
+struct cm_trace_ctx_s
+{
+	vec3_t		start, end;
+	vec3_t		mins, maxs;
+	vec3_t		extents;
+
+	trace_t		trace;
+	int			contents;
+	// optimized case: no extents
+	qboolean	ispoint;
+	// optimized case: stop at any intersection point at all
+	// otherwise, look for the *closest* intersection point
+	qboolean	fast;
+
+	// to avoid repeated testings: a brush or terrain triangle has already
+	// been checked by the current trace if its stamp equals checkcount
+	int			checkcount;
+	int			brushstamps[MAX_MAP_BRUSHES+1];	// +1 for the box brush
+	int			*tristamps;
+	int			numtristamps;
+
+	// work done by every trace on this context, for profiling
+	cm_tracecounts_t	counts;
+};
+
+// context used by the plain CM_BoxTrace family, one per thread
+static THREADLOCAL cm_trace_ctx_t	*cm_threadctx;
+
+cm_trace_ctx_t *CM_CreateTraceContext (void)
+{
+	cm_trace_ctx_t	*ctx;
+
+	// not Z_Malloc, contexts may be created on any thread
+	ctx = calloc (1, sizeof(*ctx));
+	if (!ctx)
+		Sys_Error ("CM_CreateTraceContext: out of memory");
+	return ctx;
+}
+
+void CM_FreeTraceContext (cm_trace_ctx_t *ctx)
+{
+	if (!ctx)
+		return;
+	free (ctx->tristamps);
+	free (ctx);
+}
+
+static cm_trace_ctx_t *CM_ThreadTraceContext (void)
+{
+	if (!cm_threadctx)
+		cm_threadctx = CM_CreateTraceContext ();
+	return cm_threadctx;
+}
+
+void CM_ThreadTraceCounts (cm_tracecounts_t *counts)
+{
+	*counts = CM_ThreadTraceContext ()->counts;
+}
+
+/*
+==================
+CM_BeginTrace
+
+Starts a new round of visit stamps, growing the terrain stamps if a map
+with more triangles was loaded since the context was last used.
+==================
+*/
+static void CM_BeginTrace (cm_trace_ctx_t *ctx)
+{
+	int numtris;
 
-static trace_t		trace_trace;
-static int			trace_contents;
-// optimized case: no extents
-static qboolean		trace_ispoint;
-// optimized case: stop at any intersection point at all
-// otherwise, look for the *closest* intersection point
-static qboolean		trace_fast;
+	numtris = CM_NumTriangles ();
+	if (ctx->numtristamps < numtris)
+	{
+		free (ctx->tristamps);
+		ctx->tristamps = calloc (numtris, sizeof(int));
+		if (!ctx->tristamps)
+			Sys_Error ("CM_BeginTrace: out of memory");
+		ctx->numtristamps = numtris;
+		ctx->checkcount = 0;
+		memset (ctx->brushstamps, 0, sizeof(ctx->brushstamps));
+	}
+
+	if (++ctx->checkcount == INT_MAX)
+	{
+		memset (ctx->brushstamps, 0, sizeof(ctx->brushstamps));
+		memset (ctx->tristamps, 0, ctx->numtristamps*sizeof(int));
+		ctx->checkcount = 1;
+	}
+}
 
 static float CM_OffsetPlaneDist (const cplane_t *plane, const vec3_t mins, const vec3_t maxs)
 {
@@ -2128,7 +2288,7 @@ static float CM_OffsetPlaneDist (const cplane_t *plane, const vec3_t mins, const
 }
 
 static void CM_ClipBoxToBrush( vec3_t mins, vec3_t maxs, vec3_t p1, vec3_t p2,
-		trace_t *trace, cbrush_t *brush )
+		qboolean ispoint, trace_t *trace, cbrush_t *brush )
 {
 	int           i;
 	cplane_t     *plane, *clipplane;
@@ -2156,7 +2316,7 @@ static void CM_ClipBoxToBrush( vec3_t mins, vec3_t maxs, vec3_t p1, vec3_t p2,
 	{
 		side = &map_brushsides[brush->firstbrushside+i];
 		plane = side->plane;
-		if (trace_ispoint)
+		if (ispoint)
 			dist = plane->dist; // special point case
 		else
 			dist = CM_OffsetPlaneDist (plane, mins, maxs);
@@ -2220,7 +2380,7 @@ static void CM_ClipBoxToBrush( vec3_t mins, vec3_t maxs, vec3_t p1, vec3_t p2,
 	}
 }
 
-static qboolean CM_ClipBoxToTerrainTri (const vec3_t mins, const vec3_t maxs, const vec3_t p1, const vec3_t p2, trace_t *trace, const cterraintri_t *tri)
+static qboolean CM_ClipBoxToTerrainTri (const vec3_t mins, const vec3_t maxs, const vec3_t p1, const vec3_t p2, qboolean ispoint, trace_t *trace, const cterraintri_t *tri)
 {
 	static csurface_t placeholder_surface; // no flags, no value
 	int           i;
@@ -2242,7 +2402,7 @@ static qboolean CM_ClipBoxToTerrainTri (const vec3_t mins, const vec3_t maxs, co
 	{
 		plane = &tri->allplanes[i];
 	
-		if (trace_ispoint)
+		if (ispoint)
 			dist = plane->dist; // special point case
 		else
 			dist = CM_OffsetPlaneDist (plane, mins, maxs);
@@ -2419,7 +2579,7 @@ static void CM_TestBoxInTerrainTri (const vec3_t mins, const vec3_t maxs, const
 CM_TraceToLeaf
 ================
 */
-static void CM_TraceToLeaf (int leafnum)
+static void CM_TraceToLeaf (cm_trace_ctx_t *ctx, int leafnum)
 {
 	int			k;
 	int			brushnum;
@@ -2427,23 +2587,24 @@ static void CM_TraceToLeaf (int leafnum)
 	cbrush_t	*b;
 
 	leaf = &map_leafs[leafnum];
-	if ( !(leaf->contents & trace_contents))
+	if ( !(leaf->contents & ctx->contents))
 		return;
 	// trace line against all brushes in the leaf
 	for (k=0 ; k<leaf->numleafbrushes ; k++)
 	{
 		brushnum = map_leafbrushes[leaf->firstleafbrush+k];
 		b = &map_brushes[brushnum];
-		if (b->checkcount == checkcount)
+		if (ctx->brushstamps[brushnum] == ctx->checkcount)
 			continue;	// already checked this brush in another leaf
-		b->checkcount = checkcount;
+		ctx->brushstamps[brushnum] = ctx->checkcount;
 
-		if ( !(b->contents & trace_contents))
+		if ( !(b->contents & ctx->contents))
 			continue;
-		CM_ClipBoxToBrush (trace_mins, trace_maxs, trace_start, trace_end, &trace_trace, b);
-		if (!trace_trace.fraction)
+		ctx->counts.brushes++;
+		CM_ClipBoxToBrush (ctx->mins, ctx->maxs, ctx->start, ctx->end, ctx->ispoint, &ctx->trace, b);
+		if (!ctx->trace.fraction)
 			return;
-		if (trace_fast && trace_trace.fraction != 1.0f)
+		if (ctx->fast && ctx->trace.fraction != 1.0f)
 			return;
 	}
 
@@ -2455,7 +2616,7 @@ static void CM_TraceToLeaf (int leafnum)
 CM_TestInLeaf
 ================
 */
-static void CM_TestInLeaf (int leafnum)
+static void CM_TestInLeaf (cm_trace_ctx_t *ctx, int leafnum)
 {
 	int			k;
 	int			brushnum;
@@ -2463,21 +2624,22 @@ static void CM_TestInLeaf (int leafnum)
 	cbrush_t	*b;
 
 	leaf = &map_leafs[leafnum];
-	if ( !(leaf->contents & trace_contents))
+	if ( !(leaf->contents & ctx->contents))
 		return;
 	// trace line against all brushes in the leaf
 	for (k=0 ; k<leaf->numleafbrushes ; k++)
 	{
 		brushnum = map_leafbrushes[leaf->firstleafbrush+k];
 		b = &map_brushes[brushnum];
-		if (b->checkcount == checkcount)
+		if (ctx->brushstamps[brushnum] == ctx->checkcount)
 			continue;	// already checked this brush in another leaf
-		b->checkcount = checkcount;
+		ctx->brushstamps[brushnum] = ctx->checkcount;
 
-		if ( !(b->contents & trace_contents))
+		if ( !(b->contents & ctx->contents))
 			continue;
-		CM_TestBoxInBrush (trace_mins, trace_maxs, trace_start, &trace_trace, b);
-		if (!trace_trace.fraction)
+		ctx->counts.brushes++;
+		CM_TestBoxInBrush (ctx->mins, ctx->maxs, ctx->start, &ctx->trace, b);
+		if (!ctx->trace.fraction)
 			return;
 	}
 
@@ -2489,7 +2651,7 @@ static void CM_TestInLeaf (int leafnum)
 CM_RecursiveHullCheck
 ==================
 */
-static void CM_RecursiveHullCheck (int num, float p1f, float p2f, vec3_t p1, const vec3_t p2)
+static void CM_RecursiveHullCheck (cm_trace_ctx_t *ctx, int num, float p1f, float p2f, vec3_t p1, const vec3_t p2)
 {
 	cnode_t		*node;
 	cplane_t	*plane;
@@ -2507,17 +2669,18 @@ re_test:
 	// if < 0, we are in a leaf node
 	if (num < 0)
 	{
-		CM_TraceToLeaf (-1-num);
+		CM_TraceToLeaf (ctx, -1-num);
 		return;
 	}
 
 	node = map_nodes + num;
+	ctx->counts.nodes++;
 	
-	if (!(node->contents & trace_contents))
+	if (!(node->contents & ctx->contents))
 		return; // This volume contains no leafs we're interested in
 	
-	// TODO: add bbox and gap stuff to BoxHull, change to trace_ispoint
-	if (	trace_fast &&
+	// TODO: add bbox and gap stuff to BoxHull, change to ctx->ispoint
+	if (	ctx->fast &&
 			node->containsgap && 
 			p1[0] < node->emptymaxs[0] && p2[0] < node->emptymaxs[0] &&
 			p1[1] < node->emptymaxs[1] && p2[1] < node->emptymaxs[1] &&
@@ -2537,24 +2700,24 @@ re_test:
 	{
 		t1 = p1[plane->type] - plane->dist;
 		t2 = p2[plane->type] - plane->dist;
-		offset = trace_extents[plane->type];
+		offset = ctx->extents[plane->type];
 	}
 	else
 	{
 		t1 = DotProduct (plane->normal, p1) - plane->dist;
 		t2 = DotProduct (plane->normal, p2) - plane->dist;
-		if (trace_ispoint)
+		if (ctx->ispoint)
 			offset = 0;
 		else
-			offset = fabs(trace_extents[0]*plane->normal[0]) +
-				fabs(trace_extents[1]*plane->normal[1]) +
-				fabs(trace_extents[2]*plane->normal[2]);
+			offset = fabs(ctx->extents[0]*plane->normal[0]) +
+				fabs(ctx->extents[1]*plane->normal[1]) +
+				fabs(ctx->extents[2]*plane->normal[2]);
 	}
 
 
 #if 0
-CM_RecursiveHullCheck (node->children[0], p1f, p2f, p1, p2);
-CM_RecursiveHullCheck (node->children[1], p1f, p2f, p1, p2);
+CM_RecursiveHullCheck (ctx, node->children[0], p1f, p2f, p1, p2);
+CM_RecursiveHullCheck (ctx, node->children[1], p1f, p2f, p1, p2);
 return;
 #endif
 
@@ -2614,9 +2777,9 @@ return;
 	VectorCopy (p1, p1_copy);
 
 	// this is the only case where the function actually recurses
-	CM_RecursiveHullCheck (node->children[side], p1f, midf, p1_copy, mid);
+	CM_RecursiveHullCheck (ctx, node->children[side], p1f, midf, p1_copy, mid);
 
-	if (trace_fast && trace_trace.fraction != 1.0f)
+	if (ctx->fast && ctx->trace.fraction != 1.0f)
 		return;		// already hit anything at all
 
 	// go past the node
@@ -2627,7 +2790,7 @@ return;
 
 	p1f += (p2f - p1f)*frac2;
 	
-	if (trace_trace.fraction <= p1f)
+	if (ctx->trace.fraction <= p1f)
 		return;		// already hit something nearer
 
 	p1[0] += frac2 * p_delta[0];
@@ -2688,15 +2851,15 @@ static void CM_TerrainGridSwath (const cterrainmodel_t *mod, const vec3_t mincoo
 // Returns -1 for no intersection, otherwise it returns the index within 
 // terrain_models where the intersection was found (used by
 // CM_TerrainLightPoint.)
-static int CM_TerrainTrace (const vec3_t p1, const vec3_t end)
+static int CM_TerrainTrace (cm_trace_ctx_t *ctx, const vec3_t p1, const vec3_t end)
 {
 	vec3_t		p2;
 	int			i, j, k, x, y, z;
 	vec3_t		dir;
 	int			ret = -1;
 	
-	VectorSubtract (trace_end, trace_start, dir);
-	VectorMA (p1, trace_trace.fraction, dir, p2);
+	VectorSubtract (ctx->end, ctx->start, dir);
+	VectorMA (p1, ctx->trace.fraction, dir, p2);
 	
 	for (i = 0; i < numterrainmodels; i++)
 	{
@@ -2704,7 +2867,7 @@ static int CM_TerrainTrace (const vec3_t p1, const vec3_t end)
 		int mingrid[3], maxgrid[3], griddir[3];
 		cterrainmodel_t	*mod = &terrain_models[i];
 		
-		if (!bbox_in_trace (mod->mins, mod->maxs, p1, p2, trace_mins, trace_maxs))
+		if (!bbox_in_trace (mod->mins, mod->maxs, p1, p2, ctx->mins, ctx->maxs))
 			continue;
 		
 		for (k = 0; k < 3; k++)
@@ -2714,8 +2877,8 @@ static int CM_TerrainTrace (const vec3_t p1, const vec3_t end)
 				mincoords[k] = p2[k];
 			if (p2[k] > maxcoords[k])
 				maxcoords[k] = p2[k];
-			mincoords[k] += trace_mins[k];
-			maxcoords[k] += trace_maxs[k];
+			mincoords[k] += ctx->mins[k];
+			maxcoords[k] += ctx->maxs[k];
 		}
 		
 		// We iterate through the grid layers, rows, and columns in order from
@@ -2735,40 +2898,42 @@ static int CM_TerrainTrace (const vec3_t p1, const vec3_t end)
 					if (grid->numtris == 0)
 						continue;
 					
-					// TODO: eventually make this trace_ispoint when we can
+					// TODO: eventually make this ctx->ispoint when we can
 					// be confident that this works
-					if (	trace_fast &&
+					if (	ctx->fast &&
 							DotProduct (p1, grid->boundingplane.normal) > grid->boundingplane.dist &&
 							DotProduct (p2, grid->boundingplane.normal) > grid->boundingplane.dist)
 						continue;
 					
 					if (grid->numtris > 2)
 					{
-						if (!bbox_in_trace (grid->mins, grid->maxs, p1, p2, trace_mins, trace_maxs))
+						if (!bbox_in_trace (grid->mins, grid->maxs, p1, p2, ctx->mins, ctx->maxs))
 							continue;
 					
-						if (trace_ispoint && !RayIntersectsBBox (p1, dir, grid->mins, grid->maxs, &tmp))
+						if (ctx->ispoint && !RayIntersectsBBox (p1, dir, grid->mins, grid->maxs, &tmp))
 							continue;
 					}
 		
 					for (j = 0; j < grid->numtris; j++)
 					{
 						cterraintri_t	*tri = grid->tris[j];
+						int				trinum = mod->firsttriangle + (tri - mod->tris);
 			
 						// order the tests from least expensive to most
 						
-						if (tri->checkcount == checkcount) 
+						if (ctx->tristamps[trinum] == ctx->checkcount)
 							continue; // already checked this triangle in another cell
-						tri->checkcount = checkcount;
+						ctx->tristamps[trinum] = ctx->checkcount;
 						
-						if (!CM_ClipBoxToTerrainTri (trace_mins, trace_maxs, trace_start, trace_end, &trace_trace, tri))
+						ctx->counts.terraintris++;
+						if (!CM_ClipBoxToTerrainTri (ctx->mins, ctx->maxs, ctx->start, ctx->end, ctx->ispoint, &ctx->trace, tri))
 							continue;
 						
 						// At this point, we've found a new closest intersection point
-						VectorMA (p1, trace_trace.fraction, dir, p2);
+						VectorMA (p1, ctx->trace.fraction, dir, p2);
 						ret = i;
 						
-						if (trace_fast)
+						if (ctx->fast)
 							goto done;
 					}
 					
@@ -2778,7 +2943,7 @@ static int CM_TerrainTrace (const vec3_t p1, const vec3_t end)
 					// Thus, if we've found any intersections in the previous
 					// grid cell, there won't be any closer intersections in
 					// the next one, so we can stop the tracing right here.
-					if (trace_ispoint && ret == i)
+					if (ctx->ispoint && ret == i)
 						goto done_with_this_model;
 				}
 			}
@@ -2796,26 +2961,28 @@ void CM_TerrainLightPoint (vec3_t in_point, vec3_t out_point, vec3_t out_color)
 	float s, t;
 	vec4_t out_color_withalpha;
 	cterrainmodel_t	*mod;
+	cm_trace_ctx_t	*ctx = CM_ThreadTraceContext ();
 	
-	memset (&trace_trace, 0, sizeof(trace_trace));
-	trace_trace.fraction = 1;
+	CM_BeginTrace (ctx);
 	
-	VectorCopy (in_point, trace_start);
-	trace_start[2] += 2048;
-	VectorCopy (in_point, trace_end);
-	trace_end[2] -= 2048;
+	memset (&ctx->trace, 0, sizeof(ctx->trace));
+	ctx->trace.fraction = 1;
 	
-	trace_ispoint = true;
-	trace_fast = false;
-	checkcount++;
-	VectorClear (trace_extents);
+	VectorCopy (in_point, ctx->start);
+	ctx->start[2] += 2048;
+	VectorCopy (in_point, ctx->end);
+	ctx->end[2] -= 2048;
+	
+	ctx->ispoint = true;
+	ctx->fast = false;
+	VectorClear (ctx->extents);
 	
 	out_color[0] = out_color[1] = out_color[2] = 1.0f;
 	
-	modnum = CM_TerrainTrace (trace_start, trace_end);
+	modnum = CM_TerrainTrace (ctx, ctx->start, ctx->end);
 	
-	VectorCopy (trace_start, out_point);
-	out_point[2] = trace_start[2] - 4096.0 * trace_trace.fraction;
+	VectorCopy (ctx->start, out_point);
+	out_point[2] = ctx->start[2] - 4096.0 * ctx->trace.fraction;
 	
 	if (modnum == -1)
 		return;
@@ -2824,7 +2991,7 @@ void CM_TerrainLightPoint (vec3_t in_point, vec3_t out_point, vec3_t out_color)
 	
 	if (mod->lightmaptex == NULL)
 	{
-		out_point[2] = trace_end[2];
+		out_point[2] = ctx->end[2];
 		return;
 	}
 	
@@ -2842,35 +3009,39 @@ void CM_TerrainLightPoint (vec3_t in_point, vec3_t out_point, vec3_t out_color)
 /*
 ==================
 CM_BoxTrace
+
+The sweep descends from topnode, which is headnode unless the caller
+already knows the whole sweep lies on one side of every plane above it.
 ==================
 */
-static trace_t	CM_BoxTrace_Core (const vec3_t start, const vec3_t end,
+static trace_t	CM_BoxTrace_Core (cm_trace_ctx_t *ctx,
+								  const vec3_t start, const vec3_t end,
 								  vec3_t mins, vec3_t maxs,
-								  int headnode, int brushmask,
+								  int headnode, int topnode, int brushmask,
 								  qboolean enable_terrain)
 {
 	int		i, j, x, y, z;
 	vec3_t	local_start, local_end;
 
-	checkcount++;		// for multi-check avoidance
+	CM_BeginTrace (ctx);	// for multi-check avoidance
 
 	c_traces++;			// for statistics, may be zeroed
 
 	// fill in a default trace
-	memset (&trace_trace, 0, sizeof(trace_trace));
-	trace_trace.fraction = 1;
-	trace_trace.surface = &(nullsurface.c);
+	memset (&ctx->trace, 0, sizeof(ctx->trace));
+	ctx->trace.fraction = 1;
+	ctx->trace.surface = &(nullsurface.c);
 
 	if (!numnodes)	// map not loaded
-		return trace_trace;
+		return ctx->trace;
 	
-	trace_fast = false;
+	ctx->fast = false;
 
-	trace_contents = brushmask;
-	VectorCopy (start, trace_start);
-	VectorCopy (end, trace_end);
-	VectorCopy (mins, trace_mins);
-	VectorCopy (maxs, trace_maxs);
+	ctx->contents = brushmask;
+	VectorCopy (start, ctx->start);
+	VectorCopy (end, ctx->end);
+	VectorCopy (mins, ctx->mins);
+	VectorCopy (maxs, ctx->maxs);
 	
 	if ( !(start == end) &&
 			(start[0] != end[0] || start[1] != end[1] || start[2] != end[2]) )
@@ -2879,34 +3050,34 @@ static trace_t	CM_BoxTrace_Core (const vec3_t start, const vec3_t end,
 				( mins[0] == 0.0f && mins[1] == 0.0f && mins[2] == 0.0f &&
 				maxs[0] == 0.0f && maxs[1] == 0.0f && maxs[2] == 0.0f ))
 		{ // point special case
-			trace_ispoint = true;
-			VectorClear (trace_extents);
+			ctx->ispoint = true;
+			VectorClear (ctx->extents);
 		}
 		else
 		{ // general axis-aligned box case
-			trace_ispoint = false;
-			trace_extents[0] = -mins[0] > maxs[0] ? -mins[0] : maxs[0];
-			trace_extents[1] = -mins[1] > maxs[1] ? -mins[1] : maxs[1];
-			trace_extents[2] = -mins[2] > maxs[2] ? -mins[2] : maxs[2];
+			ctx->ispoint = false;
+			ctx->extents[0] = -mins[0] > maxs[0] ? -mins[0] : maxs[0];
+			ctx->extents[1] = -mins[1] > maxs[1] ? -mins[1] : maxs[1];
+			ctx->extents[2] = -mins[2] > maxs[2] ? -mins[2] : maxs[2];
 		}
 		//
 		// general sweeping through world
 		//
 		VectorCopy (start, local_start); // so the function can modify these in-place
 		VectorCopy (end, local_end);
-		CM_RecursiveHullCheck (headnode, 0, 1, local_start, local_end);
+		CM_RecursiveHullCheck (ctx, topnode, 0, 1, local_start, local_end);
 		
 		if (enable_terrain)
-			CM_TerrainTrace (start, end);
+			CM_TerrainTrace (ctx, start, end);
 		
-		if (trace_trace.fraction == 1)
+		if (ctx->trace.fraction == 1)
 		{
-			VectorCopy (end, trace_trace.endpos);
+			VectorCopy (end, ctx->trace.endpos);
 		}
 		else
 		{
 			for (i=0 ; i<3 ; i++)
-				trace_trace.endpos[i] = start[i] + trace_trace.fraction * (end[i] - start[i]);
+				ctx->trace.endpos[i] = start[i] + ctx->trace.fraction * (end[i] - start[i]);
 		}
 	}
 	else
@@ -2916,7 +3087,7 @@ static trace_t	CM_BoxTrace_Core (const vec3_t start, const vec3_t end,
 		vec3_t	c1, c2;
 		int		topnode;
 		
-		VectorCopy (start, trace_trace.endpos);
+		VectorCopy (start, ctx->trace.endpos);
 
 		VectorAdd (start, mins, c1);
 		VectorAdd (start, maxs, c2);
@@ -2929,16 +3100,16 @@ static trace_t	CM_BoxTrace_Core (const vec3_t start, const vec3_t end,
 		numleafs = CM_BoxLeafnums_headnode (c1, c2, leafs, 1024, headnode, &topnode);
 		for (i=0 ; i<numleafs ; i++)
 		{
-			CM_TestInLeaf (leafs[i]);
-			if (trace_trace.allsolid)
-				return trace_trace;
+			CM_TestInLeaf (ctx, leafs[i]);
+			if (ctx->trace.allsolid)
+				return ctx->trace;
 		}
 		
-		if (!(CONTENTS_SOLID & trace_contents))
-			return trace_trace;
+		if (!(CONTENTS_SOLID & ctx->contents))
+			return ctx->trace;
 		
 		if (!enable_terrain)
-		    return trace_trace;
+		    return ctx->trace;
 		
 		for (i = 0; i < numterrainmodels; i++)
 		{
@@ -2974,10 +3145,11 @@ static trace_t	CM_BoxTrace_Core (const vec3_t start, const vec3_t end,
 						{
 							cterraintri_t	*tri = grid->tris[j];
 							
-							CM_TestBoxInTerrainTri (trace_mins, trace_maxs, trace_start, &trace_trace, tri);
+							ctx->counts.terraintris++;
+							CM_TestBoxInTerrainTri (ctx->mins, ctx->maxs, ctx->start, &ctx->trace, tri);
 							
-							if (trace_trace.allsolid)
-								return trace_trace;
+							if (ctx->trace.allsolid)
+								return ctx->trace;
 						}
 skip_grid:;
 					}
@@ -2987,14 +3159,125 @@ skip_mod:;
 		}
 	}
 
-	return trace_trace;
+	return ctx->trace;
 }
 
 trace_t		CM_BoxTrace (const vec3_t start, const vec3_t end,
 						  vec3_t mins, vec3_t maxs,
 						  int headnode, int brushmask)
 {
-	return CM_BoxTrace_Core (start, end, mins, maxs, headnode, brushmask, true);
+	return CM_BoxTrace_Core (CM_ThreadTraceContext (), start, end, mins, maxs, headnode, headnode, brushmask, true);
+}
+
+trace_t		CM_BoxTraceCtx (cm_trace_ctx_t *ctx,
+						  const vec3_t start, const vec3_t end,
+						  vec3_t mins, vec3_t maxs,
+						  int headnode, int brushmask)
+{
+	return CM_BoxTrace_Core (ctx, start, end, mins, maxs, headnode, headnode, brushmask, true);
+}
+
+/*
+==================
+CM_BoxTraceBatch
+
+Rays are taken in packets of TRACE_PACKET. Each packet walks down from
+headnode once with the box enclosing all of its sweeps, and every ray in
+it starts its own hull check from the node where that box first straddles
+a plane. The box is grown by the hull extents plus a unit, so the rays
+would have taken the same path down to that node themselves and the
+results are the same as tracing them one at a time.
+==================
+*/
+#define	TRACE_PACKET	16
+
+typedef struct
+{
+	int			count;
+	vec3_t		*starts, *ends;
+	float		*mins, *maxs;
+	int			headnode;
+	int			brushmask;
+	trace_t		*results;
+} tracebatch_t;
+
+static int CM_BoxTopnode (const vec3_t mins, const vec3_t maxs, int headnode)
+{
+	int			num, side;
+	cnode_t		*node;
+
+	num = headnode;
+	while (num >= 0)
+	{
+		node = &map_nodes[num];
+		side = BoxOnPlaneSide (mins, maxs, node->plane);
+		if (side == 1)
+			num = node->children[0];
+		else if (side == 2)
+			num = node->children[1];
+		else
+			break;
+	}
+
+	return num;
+}
+
+static void CM_TracePacket (void *data, int index, int worker)
+{
+	tracebatch_t	*batch = data;
+	cm_trace_ctx_t	*ctx = CM_ThreadTraceContext ();
+	int				i, j, first, last, topnode;
+	vec3_t			extents, pmins, pmaxs;
+
+	first = index*TRACE_PACKET;
+	last = first + TRACE_PACKET;
+	if (last > batch->count)
+		last = batch->count;
+
+	for (j=0 ; j<3 ; j++)
+		extents[j] = (-batch->mins[j] > batch->maxs[j] ? -batch->mins[j] : batch->maxs[j]) + 1;
+
+	VectorCopy (batch->starts[first], pmins);
+	VectorCopy (batch->starts[first], pmaxs);
+	for (i=first ; i<last ; i++)
+	{
+		AddPointToBounds (batch->starts[i], pmins, pmaxs);
+		AddPointToBounds (batch->ends[i], pmins, pmaxs);
+	}
+	VectorSubtract (pmins, extents, pmins);
+	VectorAdd (pmaxs, extents, pmaxs);
+
+	if (numnodes)
+		topnode = CM_BoxTopnode (pmins, pmaxs, batch->headnode);
+	else
+		topnode = batch->headnode;	// map not loaded, traces return at once
+
+	for (i=first ; i<last ; i++)
+		batch->results[i] = CM_BoxTrace_Core (ctx, batch->starts[i],
+			batch->ends[i], batch->mins, batch->maxs, batch->headnode,
+			topnode, batch->brushmask, true);
+}
+
+void CM_BoxTraceBatch (int count, vec3_t *starts, vec3_t *ends,
+						vec3_t mins, vec3_t maxs, int headnode,
+						int brushmask, trace_t *results, int numworkers)
+{
+	tracebatch_t	batch;
+
+	if (count <= 0)
+		return;
+
+	batch.count = count;
+	batch.starts = starts;
+	batch.ends = ends;
+	batch.mins = mins ? mins : vec3_origin;
+	batch.maxs = maxs ? maxs : vec3_origin;
+	batch.headnode = headnode;
+	batch.brushmask = brushmask;
+	batch.results = results;
+
+	Com_ParallelFor (numworkers, (count+TRACE_PACKET-1)/TRACE_PACKET,
+		CM_TracePacket, &batch);
 }
 
 // Returns true if there is nothing blocking the path from start to end.
@@ -3002,29 +3285,34 @@ trace_t		CM_BoxTrace (const vec3_t start, const vec3_t end,
 // standard BoxTrace. If start == end, will always return true.
 qboolean CM_FastTrace (const vec3_t start, const vec3_t end, int headnode, int brushmask)
 {
-	vec3_t	local_start, local_end;
+	return CM_FastTraceCtx (CM_ThreadTraceContext (), start, end, headnode, brushmask);
+}
 
-	checkcount++;		// for multi-check avoidance
+qboolean CM_FastTraceCtx (cm_trace_ctx_t *ctx, const vec3_t start, const vec3_t end, int headnode, int brushmask)
+{
+	vec3_t	local_start, local_end;
 
 	c_traces++;			// for statistics, may be zeroed
 
 	if (!numnodes)	// map not loaded
 		return true;
 	
+	CM_BeginTrace (ctx);	// for multi-check avoidance
+	
 	// fill in a default trace
-	memset (&trace_trace, 0, sizeof(trace_trace));
-	trace_trace.fraction = 1;
-	trace_trace.surface = &(nullsurface.c);
+	memset (&ctx->trace, 0, sizeof(ctx->trace));
+	ctx->trace.fraction = 1;
+	ctx->trace.surface = &(nullsurface.c);
 	
-	trace_fast = true;
-
-	trace_contents = brushmask;
-	VectorCopy (start, trace_start);
-	VectorCopy (end, trace_end);
-	VectorClear (trace_mins);
-	VectorClear (trace_maxs);
-	trace_ispoint = true;
-	VectorClear (trace_extents);
+	ctx->fast = true;
+
+	ctx->contents = brushmask;
+	VectorCopy (start, ctx->start);
+	VectorCopy (end, ctx->end);
+	VectorClear (ctx->mins);
+	VectorClear (ctx->maxs);
+	ctx->ispoint = true;
+	VectorClear (ctx->extents);
 	
 	if ( !(start == end) &&
 			(start[0] != end[0] || start[1] != end[1] || start[2] != end[2]) )
@@ -3035,16 +3323,16 @@ qboolean CM_FastTrace (const vec3_t start, const vec3_t end, int headnode, int b
 		//
 		VectorCopy (start, local_start); // so the function can modify these in-place
 		VectorCopy (end, local_end);
-		CM_RecursiveHullCheck (headnode, 0, 1, local_start, local_end);
+		CM_RecursiveHullCheck (ctx, headnode, 0, 1, local_start, local_end);
 		
-		CM_TerrainTrace (start, end);
+		CM_TerrainTrace (ctx, start, end);
 		
-		ret = trace_trace.fraction == 1.0f;
+		ret = ctx->trace.fraction == 1.0f;
 		
 		if (fasttrace_verify->integer)
 		{
-			CM_BoxTrace (start, end, vec3_origin, vec3_origin, headnode, brushmask);
-			assert (ret == (trace_trace.fraction == 1.0f));
+			CM_BoxTraceCtx (ctx, start, end, vec3_origin, vec3_origin, headnode, brushmask);
+			assert (ret == (ctx->trace.fraction == 1.0f));
 		}
 		
 		return ret;
@@ -3075,6 +3363,16 @@ trace_t		CM_TransformedBoxTrace (vec3_t start, vec3_t end,
 						  vec3_t mins, vec3_t maxs,
 						  int headnode, int brushmask,
 						  vec3_t origin, vec3_t angles)
+{
+	return CM_TransformedBoxTraceCtx (CM_ThreadTraceContext (), start, end,
+			mins, maxs, headnode, brushmask, origin, angles);
+}
+
+trace_t		CM_TransformedBoxTraceCtx (cm_trace_ctx_t *ctx,
+						  vec3_t start, vec3_t end,
+						  vec3_t mins, vec3_t maxs,
+						  int headnode, int brushmask,
+						  vec3_t origin, vec3_t angles)
 {
 	trace_t		trace;
 	vec3_t		start_l, end_l;
@@ -3110,7 +3408,7 @@ trace_t		CM_TransformedBoxTrace (vec3_t start, vec3_t end,
 	}
 
 	// sweep the box through the model
-	trace = CM_BoxTrace_Core (start_l, end_l, mins, maxs, headnode, brushmask, false);
+	trace = CM_BoxTrace_Core (ctx, start_l, end_l, mins, maxs, headnode, headnode, brushmask, false);
 
 	if (rotated && trace.fraction != 1.0)
 	{
@@ -3197,9 +3495,19 @@ void CM_DecompressVis (byte *in, byte *out)
 byte	pvsrow[MAX_MAP_LEAFS/8];
 byte	phsrow[MAX_MAP_LEAFS/8];
 
+// With the vis matrix the returned row stays valid until the next map
+// load; otherwise only until the next call.
 byte	*CM_ClusterPVS (int cluster)
 {
 	static int old_cluster = -1;
+
+	if (vis_matrix)
+	{
+		if (cluster == -1)
+			return vis_zerorow;
+		return vis_matrix + cluster*vis_rowstride;
+	}
+
 	if (cluster == old_cluster)
 		return pvsrow;
 	old_cluster = cluster;
@@ -3214,6 +3522,14 @@ byte	*CM_ClusterPVS (int cluster)
 byte	*CM_ClusterPHS (int cluster)
 {
 	static int old_cluster = -1;
+
+	if (vis_matrix)
+	{
+		if (cluster == -1)
+			return vis_zerorow;
+		return vis_matrix + (numclusters+cluster)*vis_rowstride;
+	}
+
 	if (cluster == old_cluster)
 		return phsrow;
 	old_cluster = cluster;
@@ -3225,6 +3541,67 @@ byte	*CM_ClusterPHS (int cluster)
 	return phsrow;
 }
 
+/*
+===================
+CM_ClusterVisible
+
+True if cluster b is in the PVS of cluster a. Constant time when the
+vis matrix was built; otherwise it goes through CM_ClusterPVS and is no
+more thread safe than that.
+===================
+*/
+qboolean CM_ClusterVisible (int a, int b)
+{
+	byte	*row;
+
+	if (a == -1 || b == -1)
+		return false;
+	if (vis_matrix)
+		row = vis_matrix + a*vis_rowstride;
+	else
+		row = CM_ClusterPVS (a);
+	return (row[b>>3] & (1<<(b&7))) != 0;
+}
+
+/*
+===================
+CM_ClusterHearable
+
+Same as CM_ClusterVisible, for the PHS.
+===================
+*/
+qboolean CM_ClusterHearable (int a, int b)
+{
+	byte	*row;
+
+	if (a == -1 || b == -1)
+		return false;
+	if (vis_matrix)
+		row = vis_matrix + (numclusters+a)*vis_rowstride;
+	else
+		row = CM_ClusterPHS (a);
+	return (row[b>>3] & (1<<(b&7))) != 0;
+}
+
+/*
+===================
+CM_CopyClusterPVS
+
+Like CM_ClusterPVS, but decompresses into a buffer supplied by the caller
+instead of a shared static row, so it can be used from job threads.
+out must hold at least (CM_NumClusters()+7)>>3 bytes.
+===================
+*/
+void CM_CopyClusterPVS (int cluster, byte *out)
+{
+	if (vis_matrix && cluster != -1)
+		memcpy (out, vis_matrix + cluster*vis_rowstride, (numclusters+7)>>3);
+	else if (cluster == -1)
+		memset (out, 0, (numclusters+7)>>3);
+	else
+		CM_DecompressVis (map_visibility + map_vis->bitofs[cluster][DVIS_PVS], out);
+}
+
 
 /*
 ===============================================================================
@@ -3419,42 +3796,15 @@ Also checks portalareas so that doors block sight
 */
 qboolean CM_inPVS (vec3_t p1, vec3_t p2)
 {
-	int		leafnum;
-	int		cluster;
-	int		area1, area2;
-	byte	*mask;
-
-	leafnum = CM_PointLeafnum (p1);
-	cluster = CM_LeafCluster (leafnum);
-	area1 = CM_LeafArea (leafnum);
-	mask = CM_ClusterPVS (cluster);
-
-	leafnum = CM_PointLeafnum (p2);
-	cluster = CM_LeafCluster (leafnum);
-	area2 = CM_LeafArea (leafnum);
-	if ( mask && (!(mask[cluster>>3] & (1<<(cluster&7)) ) ) )
-		return false;
-	if (!CM_AreasConnected (area1, area2))
-		return false;		// a door blocks sight
-	return true;
+	return CM_inPVS_leafs (CM_PointLeafnum (p1), CM_PointLeafnum (p2));
 }
 
 //similar to CM_inPVS but with leafnums
 qboolean CM_inPVS_leafs (int leafnum1, int leafnum2)
 {
-	int		cluster;
-	int		area1, area2;
-	byte	*mask;
-
-	cluster = CM_LeafCluster (leafnum1);
-	area1 = CM_LeafArea (leafnum1);
-	mask = CM_ClusterPVS (cluster);
-
-	cluster = CM_LeafCluster (leafnum2);
-	area2 = CM_LeafArea (leafnum2);
-	if ( mask && (!(mask[cluster>>3] & (1<<(cluster&7)) ) ) )
+	if (!CM_ClusterVisible (CM_LeafCluster (leafnum1), CM_LeafCluster (leafnum2)))
 		return false;
-	if (!CM_AreasConnected (area1, area2))
+	if (!CM_AreasConnected (CM_LeafArea (leafnum1), CM_LeafArea (leafnum2)))
 		return false;		// a door blocks sight
 	return true;
 }
@@ -3468,27 +3818,358 @@ Also checks portalareas so that doors block sound
 */
 qboolean CM_inPHS (vec3_t p1, vec3_t p2)
 {
-	int		leafnum;
-	int		cluster;
-	int		area1, area2;
-	byte	*mask;
-
-	leafnum = CM_PointLeafnum (p1);
-	cluster = CM_LeafCluster (leafnum);
-	area1 = CM_LeafArea (leafnum);
-	mask = CM_ClusterPHS (cluster);
-
-	leafnum = CM_PointLeafnum (p2);
-	cluster = CM_LeafCluster (leafnum);
-	area2 = CM_LeafArea (leafnum);
-	if ( mask && (!(mask[cluster>>3] & (1<<(cluster&7)) ) ) )
+	int		leafnum1, leafnum2;
+
+	leafnum1 = CM_PointLeafnum (p1);
+	leafnum2 = CM_PointLeafnum (p2);
+	if (!CM_ClusterHearable (CM_LeafCluster (leafnum1), CM_LeafCluster (leafnum2)))
 		return false;		// more than one bounce away
-	if (!CM_AreasConnected (area1, area2))
+	if (!CM_AreasConnected (CM_LeafArea (leafnum1), CM_LeafArea (leafnum2)))
 		return false;		// a door blocks hearing
 
 	return true;
 }
 
+/*
+=================
+CM_VisBench_f
+
+Times random cluster visibility queries on the current map, with and
+without the vis matrix.
+=================
+*/
+void CM_VisBench_f (void)
+{
+	int			i, pass, count, visible;
+	int			*pairs;
+	byte		*saved;
+	unsigned long long	start, usec;
+
+	if (numclusters < 2 || !numvisibility)
+	{
+		Com_Printf ("No map with visibility data loaded.\n");
+		return;
+	}
+
+	count = Cmd_Argc () > 1 ? atoi (Cmd_Argv (1)) : 1000000;
+	if (count < 1)
+		count = 1;
+
+	// same pairs for both runs
+	pairs = Z_Malloc (2*count*sizeof(*pairs));
+	for (i=0 ; i<2*count ; i++)
+		pairs[i] = rand () % numclusters;
+
+	saved = vis_matrix;
+	if (!saved)
+		Com_Printf ("vis matrix not built (%i KB needed, cm_vismatrix is %i)\n",
+			(2*numclusters*((((numclusters+7)>>3)+63)&~63)+1023)/1024,
+			cm_vismatrix->integer);
+
+	Com_Printf ("%s: %i clusters, %i queries\n", map_name, numclusters, count);
+	for (pass=0 ; pass<2 ; pass++)
+	{
+		if (pass == 1 && !saved)
+			break;
+		vis_matrix = pass ? saved : NULL;
+
+		visible = 0;
+		start = Sys_Microseconds ();
+		for (i=0 ; i<count ; i++)
+			visible += CM_ClusterVisible (pairs[2*i], pairs[2*i+1]);
+		usec = Sys_Microseconds () - start;
+		if (!usec)
+			usec = 1;
+
+		Com_Printf ("%-12s %10.0f queries/s (%i visible)\n",
+			pass ? "matrix:" : "decompress:",
+			count * 1000000.0 / usec, visible);
+	}
+	vis_matrix = saved;
+
+	Z_Free (pairs);
+}
+
+/*
+=================
+CM_TraceStress_f
+
+Runs the same random traces through the world once on the main thread and
+again spread over job threads, and checks that every result matches.
+=================
+*/
+#define	STRESS_BATCH	64
+
+typedef struct
+{
+	vec3_t		start, end;
+	vec3_t		mins, maxs;
+	int			brushmask;
+} stresstrace_t;
+
+typedef struct
+{
+	stresstrace_t	*traces;
+	trace_t			*results;
+	int				count;
+} stressjob_t;
+
+static void CM_TraceStressJob (void *data, int index, int worker)
+{
+	stressjob_t	*job = data;
+	int			i, last;
+
+	last = (index+1)*STRESS_BATCH;
+	if (last > job->count)
+		last = job->count;
+	for (i=index*STRESS_BATCH ; i<last ; i++)
+	{
+		stresstrace_t *t = &job->traces[i];
+		job->results[i] = CM_BoxTrace (t->start, t->end, t->mins, t->maxs,
+			0, t->brushmask);
+	}
+}
+
+static qboolean CM_SameTrace (trace_t *a, trace_t *b)
+{
+	return a->allsolid == b->allsolid && a->startsolid == b->startsolid
+		&& a->fraction == b->fraction && VectorCompare (a->endpos, b->endpos)
+		&& VectorCompare (a->plane.normal, b->plane.normal)
+		&& a->plane.dist == b->plane.dist && a->surface == b->surface
+		&& a->contents == b->contents;
+}
+
+void CM_TraceStress_f (void)
+{
+	int				i, j, count, numworkers, mismatches;
+	stresstrace_t	*traces, *t;
+	trace_t			*serial;
+	stressjob_t		job;
+	cmodel_t		*world;
+	unsigned long long	start, serialusec, parallelusec;
+
+	if (!numnodes || !numcmodels)
+	{
+		Com_Printf ("No map loaded.\n");
+		return;
+	}
+
+	count = Cmd_Argc () > 1 ? atoi (Cmd_Argv (1)) : 100000;
+	if (count < 1)
+		count = 1;
+	numworkers = Cmd_Argc () > 2 ? atoi (Cmd_Argv (2)) : Sys_NumProcessors () - 1;
+	if (numworkers < 1)
+		numworkers = 1;
+	if (numworkers > MAX_JOB_WORKERS)
+		numworkers = MAX_JOB_WORKERS;
+
+	// a fixed seed so a mismatch can be reproduced
+	srand (count);
+	world = &map_cmodels[0];
+	traces = Z_Malloc (count*sizeof(*traces));
+	for (i=0 ; i<count ; i++)
+	{
+		t = &traces[i];
+		for (j=0 ; j<3 ; j++)
+		{
+			t->start[j] = world->mins[j] + (world->maxs[j] - world->mins[j]) * frand ();
+			t->end[j] = world->mins[j] + (world->maxs[j] - world->mins[j]) * frand ();
+		}
+		switch (i % 4)
+		{
+		case 0:		// line of sight
+			break;
+		case 1:		// player hull
+			VectorSet (t->mins, -16, -16, -24);
+			VectorSet (t->maxs, 16, 16, 32);
+			break;
+		case 2:		// short step, the common case for movement
+			VectorSet (t->mins, -16, -16, -24);
+			VectorSet (t->maxs, 16, 16, 32);
+			for (j=0 ; j<3 ; j++)
+				t->end[j] = t->start[j] + crand () * 64;
+			break;
+		case 3:		// position test
+			VectorSet (t->mins, -16, -16, -24);
+			VectorSet (t->maxs, 16, 16, 32);
+			VectorCopy (t->start, t->end);
+			break;
+		}
+		t->brushmask = (i & 4) ? MASK_SHOT : MASK_PLAYERSOLID;
+	}
+
+	serial = Z_Malloc (count*sizeof(*serial));
+	start = Sys_Microseconds ();
+	for (i=0 ; i<count ; i++)
+	{
+		t = &traces[i];
+		serial[i] = CM_BoxTrace (t->start, t->end, t->mins, t->maxs, 0, t->brushmask);
+	}
+	serialusec = Sys_Microseconds () - start;
+
+	job.traces = traces;
+	job.count = count;
+	job.results = Z_Malloc (count*sizeof(*job.results));
+	start = Sys_Microseconds ();
+	Com_ParallelFor (numworkers, (count+STRESS_BATCH-1)/STRESS_BATCH,
+		CM_TraceStressJob, &job);
+	parallelusec = Sys_Microseconds () - start;
+
+	mismatches = 0;
+	for (i=0 ; i<count ; i++)
+	{
+		if (CM_SameTrace (&serial[i], &job.results[i]))
+			continue;
+		if (!mismatches)
+			Com_Printf ("trace %i differs: fraction %f vs %f\n", i,
+				serial[i].fraction, job.results[i].fraction);
+		mismatches++;
+	}
+
+	if (!serialusec)
+		serialusec = 1;
+	if (!parallelusec)
+		parallelusec = 1;
+	Com_Printf ("%s: %i traces\n", map_name, count);
+	Com_Printf ("serial:      %10.0f traces/s\n", count * 1000000.0 / serialusec);
+	Com_Printf ("%2i workers:  %10.0f traces/s\n", numworkers+1, count * 1000000.0 / parallelusec);
+	Com_Printf ("%i mismatches\n", mismatches);
+
+	Z_Free (job.results);
+	Z_Free (serial);
+	Z_Free (traces);
+}
+
+/*
+=================
+CM_TraceBench_f
+
+Reports traces per second for point, box and terrain traces, one at a time
+and through CM_BoxTraceBatch. The rays come in fans of TRACE_PACKET from a
+shared origin, the way visibility checks and spread weapons issue them.
+With a map name it loads that map first, so a dedicated server can run it
+from the command line without starting a game.
+=================
+*/
+static void CM_TraceBenchCase (const char *name, int count, int numworkers,
+		const vec3_t boundmins, const vec3_t boundmaxs, float length,
+		vec3_t mins, vec3_t maxs)
+{
+	int			i, j, pass, mismatches;
+	vec3_t		*starts, *ends, dir;
+	trace_t		*single, *batched;
+	unsigned long long	start, usec[3];
+
+	starts = Z_Malloc (count*sizeof(*starts));
+	ends = Z_Malloc (count*sizeof(*ends));
+	for (i=0 ; i<count ; i++)
+	{
+		if (i % TRACE_PACKET == 0)
+		{
+			for (j=0 ; j<3 ; j++)
+				starts[i][j] = boundmins[j] + (boundmaxs[j] - boundmins[j]) * frand ();
+		}
+		else
+			VectorCopy (starts[i-1], starts[i]);
+		VectorSet (dir, crand (), crand (), crand ());
+		VectorNormalize (dir);
+		VectorMA (starts[i], length, dir, ends[i]);
+	}
+
+	single = Z_Malloc (count*sizeof(*single));
+	batched = Z_Malloc (count*sizeof(*batched));
+
+	start = Sys_Microseconds ();
+	for (i=0 ; i<count ; i++)
+		single[i] = CM_BoxTrace (starts[i], ends[i], mins, maxs, 0, MASK_PLAYERSOLID);
+	usec[0] = Sys_Microseconds () - start;
+
+	mismatches = 0;
+	for (pass=1 ; pass<3 ; pass++)
+	{
+		start = Sys_Microseconds ();
+		CM_BoxTraceBatch (count, starts, ends, mins, maxs, 0, MASK_PLAYERSOLID,
+			batched, pass == 1 ? 0 : numworkers);
+		usec[pass] = Sys_Microseconds () - start;
+
+		for (i=0 ; i<count ; i++)
+			if (!CM_SameTrace (&single[i], &batched[i]))
+				mismatches++;
+	}
+
+	for (i=0 ; i<3 ; i++)
+		if (!usec[i])
+			usec[i] = 1;
+	Com_Printf ("%-8s %12.0f %12.0f %12.0f %s\n", name,
+		count * 1000000.0 / usec[0], count * 1000000.0 / usec[1],
+		count * 1000000.0 / usec[2], mismatches ? "MISMATCH" : "");
+
+	Z_Free (batched);
+	Z_Free (single);
+	Z_Free (ends);
+	Z_Free (starts);
+}
+
+void CM_TraceBench_f (void)
+{
+	int			i, count, numworkers;
+	unsigned	checksum;
+	vec3_t		hullmins = {-16, -16, -24};
+	vec3_t		hullmaxs = {16, 16, 32};
+	vec3_t		terrmins, terrmaxs;
+
+	if (Cmd_Argc () > 3)
+	{
+		if (Com_ServerState ())
+		{
+			Com_Printf ("Can't load a map for tracebench while a server is running.\n");
+			return;
+		}
+		CM_LoadMap (Cmd_Argv (3), false, &checksum);
+	}
+
+	if (!numnodes || !numcmodels)
+	{
+		Com_Printf ("usage: tracebench [traces] [threads] [map]\n");
+		Com_Printf ("No map loaded.\n");
+		return;
+	}
+
+	count = Cmd_Argc () > 1 ? atoi (Cmd_Argv (1)) : 100000;
+	if (count < TRACE_PACKET)
+		count = TRACE_PACKET;
+	numworkers = Cmd_Argc () > 2 ? atoi (Cmd_Argv (2)) : Sys_NumProcessors () - 1;
+	if (numworkers < 0)
+		numworkers = 0;
+	if (numworkers > MAX_JOB_WORKERS)
+		numworkers = MAX_JOB_WORKERS;
+
+	// the same rays for every run
+	srand (count);
+
+	Com_Printf ("%s: %i traces per case\n", map_name, count);
+	Com_Printf ("%-8s %12s %12s %12s\n", "traces/s", "single", "batch", va("%i threads", numworkers+1));
+	CM_TraceBenchCase ("point", count, numworkers, map_cmodels[0].mins,
+		map_cmodels[0].maxs, 512, vec3_origin, vec3_origin);
+	CM_TraceBenchCase ("box", count, numworkers, map_cmodels[0].mins,
+		map_cmodels[0].maxs, 512, hullmins, hullmaxs);
+
+	if (!numterrainmodels)
+	{
+		Com_Printf ("%-8s no terrain on this map\n", "terrain");
+		return;
+	}
+	VectorCopy (terrain_models[0].mins, terrmins);
+	VectorCopy (terrain_models[0].maxs, terrmaxs);
+	for (i=1 ; i<numterrainmodels ; i++)
+	{
+		AddPointToBounds (terrain_models[i].mins, terrmins, terrmaxs);
+		AddPointToBounds (terrain_models[i].maxs, terrmins, terrmaxs);
+	}
+	CM_TraceBenchCase ("terrain", count, numworkers, terrmins, terrmaxs,
+		512, hullmins, hullmaxs);
+}
+
 /*
 =================
 Functions related to exporting collision geometry to other parts of the code,
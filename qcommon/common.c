@@ -27,6 +27,10 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 #include <setjmp.h>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 //zlib currently not needed server-side (FOR NOW!)
 //Also, due to the ld flags for zlib not being used server side, it won't
 //compile without this workaround.
@@ -48,6 +52,9 @@ extern void S_StartMenuMusic( void );
 
 extern void CL_Disconnect(void);
 
+static qboolean Com_InJobThread (void);
+static void Com_DeferPrint (const char *msg);
+
 int		com_argc;
 char	*com_argv[MAX_NUM_ARGVS+1];
 
@@ -134,6 +141,12 @@ void Com_Printf (char *fmt, ...)
 	vsnprintf(msg, sizeof(msg), fmt, argptr);
 	va_end (argptr);
 
+	if (Com_InJobThread ())
+	{	// hold it until the job batch is finished
+		Com_DeferPrint (msg);
+		return;
+	}
+
 	if (rd_target)
 	{
 		if ((strlen (msg) + strlen(rd_buffer)) > (rd_buffersize - 1))
@@ -581,22 +594,15 @@ void MSG_ReadDir (sizebuf_t *sb, vec3_t dir)
 
 /*
 ==================
-MSG_WriteDeltaEntity
+MSG_EntityDeltaBits
 
-Writes part of a packetentities message.
-Can delta from either a baseline or a previous packet_entity
+The U_* bits MSG_WriteDeltaEntity would send for this delta
 ==================
 */
-void MSG_WriteDeltaEntity (entity_state_t *from, entity_state_t *to, sizebuf_t *msg, qboolean force, qboolean newentity)
+static int MSG_EntityDeltaBits (entity_state_t *from, entity_state_t *to, qboolean newentity)
 {
 	int		bits;
 
-	if (!to->number)
-		Com_Error (ERR_FATAL, "Unset entity number");
-	if (to->number >= MAX_EDICTS)
-		Com_Error (ERR_FATAL, "Entity number >= MAX_EDICTS");
-
-// send an update
 	bits = 0;
 
 	if (to->number >= 256)
@@ -676,6 +682,29 @@ void MSG_WriteDeltaEntity (entity_state_t *from, entity_state_t *to, sizebuf_t *
 	if (newentity || (to->renderfx & RF_BEAM))
 		bits |= U_OLDORIGIN;
 
+	return bits;
+}
+
+/*
+==================
+MSG_WriteDeltaEntity
+
+Writes part of a packetentities message.
+Can delta from either a baseline or a previous packet_entity
+==================
+*/
+void MSG_WriteDeltaEntity (entity_state_t *from, entity_state_t *to, sizebuf_t *msg, qboolean force, qboolean newentity)
+{
+	int		bits;
+
+	if (!to->number)
+		Com_Error (ERR_FATAL, "Unset entity number");
+	if (to->number >= MAX_EDICTS)
+		Com_Error (ERR_FATAL, "Entity number >= MAX_EDICTS");
+
+// send an update
+	bits = MSG_EntityDeltaBits (from, to, newentity);
+
 	//
 	// write the message
 	//
@@ -781,6 +810,221 @@ void MSG_WriteDeltaEntity (entity_state_t *from, entity_state_t *to, sizebuf_t *
 		MSG_WriteShort (msg, to->solid);
 }
 
+/*
+==================
+MSG_PlayerstateDeltaBits
+
+The PS_* bits for a playerstate delta, apart from PS_WEAPONINDEX
+==================
+*/
+static int MSG_PlayerstateDeltaBits (player_state_t *ops, player_state_t *ps)
+{
+	int		pflags;
+
+	pflags = 0;
+
+	if (ps->pmove.pm_type != ops->pmove.pm_type)
+		pflags |= PS_M_TYPE;
+
+	if (ps->pmove.origin[0] != ops->pmove.origin[0]
+		|| ps->pmove.origin[1] != ops->pmove.origin[1]
+		|| ps->pmove.origin[2] != ops->pmove.origin[2] )
+		pflags |= PS_M_ORIGIN;
+
+	if (ps->pmove.velocity[0] != ops->pmove.velocity[0]
+		|| ps->pmove.velocity[1] != ops->pmove.velocity[1]
+		|| ps->pmove.velocity[2] != ops->pmove.velocity[2] )
+		pflags |= PS_M_VELOCITY;
+
+	if (ps->pmove.pm_time != ops->pmove.pm_time)
+		pflags |= PS_M_TIME;
+
+	if (ps->pmove.pm_flags != ops->pmove.pm_flags)
+		pflags |= PS_M_FLAGS;
+
+	if (ps->pmove.gravity != ops->pmove.gravity)
+		pflags |= PS_M_GRAVITY;
+
+	if (ps->pmove.delta_angles[0] != ops->pmove.delta_angles[0]
+		|| ps->pmove.delta_angles[1] != ops->pmove.delta_angles[1]
+		|| ps->pmove.delta_angles[2] != ops->pmove.delta_angles[2] )
+		pflags |= PS_M_DELTA_ANGLES;
+
+
+	if (ps->viewoffset[0] != ops->viewoffset[0]
+		|| ps->viewoffset[1] != ops->viewoffset[1]
+		|| ps->viewoffset[2] != ops->viewoffset[2] )
+		pflags |= PS_VIEWOFFSET;
+
+	if (ps->viewangles[0] != ops->viewangles[0]
+		|| ps->viewangles[1] != ops->viewangles[1]
+		|| ps->viewangles[2] != ops->viewangles[2] )
+		pflags |= PS_VIEWANGLES;
+
+	if (ps->kick_angles[0] != ops->kick_angles[0]
+		|| ps->kick_angles[1] != ops->kick_angles[1]
+		|| ps->kick_angles[2] != ops->kick_angles[2] )
+		pflags |= PS_KICKANGLES;
+
+	if (ps->blend[0] != ops->blend[0]
+		|| ps->blend[1] != ops->blend[1]
+		|| ps->blend[2] != ops->blend[2]
+		|| ps->blend[3] != ops->blend[3] )
+		pflags |= PS_BLEND;
+
+	if (ps->fov != ops->fov)
+		pflags |= PS_FOV;
+
+	if (ps->rdflags != ops->rdflags)
+		pflags |= PS_RDFLAGS;
+
+	if (ps->gunframe != ops->gunframe
+		|| (int)(ops->gunoffset[0]*4) != (int)(ps->gunoffset[0]*4)
+		|| (int)(ops->gunoffset[1]*4) != (int)(ps->gunoffset[1]*4)
+		|| (int)(ops->gunoffset[2]*4) != (int)(ps->gunoffset[2]*4)
+		|| (int)(ops->gunangles[0]*4) != (int)(ps->gunangles[0]*4)
+		|| (int)(ops->gunangles[1]*4) != (int)(ps->gunangles[1]*4)
+		|| (int)(ops->gunangles[2]*4) != (int)(ps->gunangles[2]*4) )
+		pflags |= PS_WEAPONFRAME;
+
+	return pflags;
+}
+
+/*
+==================
+MSG_WriteDeltaPlayerstate
+
+Writes the body of an svc_playerinfo. from is NULL for a full update.
+==================
+*/
+void MSG_WriteDeltaPlayerstate (player_state_t *from, player_state_t *to, sizebuf_t *msg)
+{
+	int				i;
+	int				pflags;
+	player_state_t	*ps, *ops;
+	player_state_t	dummy;
+	int				statbits;
+
+	ps = to;
+	if (!from)
+	{
+		memset (&dummy, 0, sizeof(dummy));
+		ops = &dummy;
+	}
+	else
+		ops = from;
+
+	//
+	// determine what needs to be sent
+	//
+	pflags = MSG_PlayerstateDeltaBits (ops, ps);
+
+	pflags |= PS_WEAPONINDEX;
+
+	//
+	// write it
+	//
+	MSG_WriteShort (msg, pflags);
+
+	//
+	// write the pmove_state_t
+	//
+	if (pflags & PS_M_TYPE)
+		MSG_WriteByte (msg, ps->pmove.pm_type);
+
+	if (pflags & PS_M_ORIGIN)
+	{
+		MSG_WriteSizeInt (msg, coord_bytes, ps->pmove.origin[0]);
+		MSG_WriteSizeInt (msg, coord_bytes, ps->pmove.origin[1]);
+		MSG_WriteSizeInt (msg, coord_bytes, ps->pmove.origin[2]);
+	}
+
+	if (pflags & PS_M_VELOCITY)
+	{
+		MSG_WriteShort (msg, ps->pmove.velocity[0]);
+		MSG_WriteShort (msg, ps->pmove.velocity[1]);
+		MSG_WriteShort (msg, ps->pmove.velocity[2]);
+	}
+
+	if (pflags & PS_M_TIME)
+		MSG_WriteByte (msg, ps->pmove.pm_time);
+
+	if (pflags & PS_M_FLAGS)
+		MSG_WriteByte (msg, ps->pmove.pm_flags);
+
+	if (pflags & PS_M_GRAVITY)
+		MSG_WriteShort (msg, ps->pmove.gravity);
+
+	if (pflags & PS_M_DELTA_ANGLES)
+	{
+		MSG_WriteShort (msg, ps->pmove.delta_angles[0]);
+		MSG_WriteShort (msg, ps->pmove.delta_angles[1]);
+		MSG_WriteShort (msg, ps->pmove.delta_angles[2]);
+	}
+
+	//
+	// write the rest of the player_state_t
+	//
+	if (pflags & PS_VIEWOFFSET)
+	{
+		MSG_WriteChar (msg, ps->viewoffset[0]*4);
+		MSG_WriteChar (msg, ps->viewoffset[1]*4);
+		MSG_WriteChar (msg, ps->viewoffset[2]*4);
+	}
+
+	if (pflags & PS_VIEWANGLES)
+	{
+		MSG_WriteAngle16 (msg, ps->viewangles[0]);
+		MSG_WriteAngle16 (msg, ps->viewangles[1]);
+		MSG_WriteAngle16 (msg, ps->viewangles[2]);
+	}
+
+	if (pflags & PS_KICKANGLES)
+	{
+		MSG_WriteChar (msg, ps->kick_angles[0]*4);
+		MSG_WriteChar (msg, ps->kick_angles[1]*4);
+		MSG_WriteChar (msg, ps->kick_angles[2]*4);
+	}
+
+	if (pflags & PS_WEAPONINDEX)
+	{
+		MSG_WriteByte (msg, ps->gunindex);
+	}
+
+	if (pflags & PS_WEAPONFRAME)
+	{
+		MSG_WriteByte (msg, ps->gunframe);
+		MSG_WriteChar (msg, ps->gunoffset[0]*4);
+		MSG_WriteChar (msg, ps->gunoffset[1]*4);
+		MSG_WriteChar (msg, ps->gunoffset[2]*4);
+		MSG_WriteChar (msg, ps->gunangles[0]*4);
+		MSG_WriteChar (msg, ps->gunangles[1]*4);
+		MSG_WriteChar (msg, ps->gunangles[2]*4);
+	}
+
+	if (pflags & PS_BLEND)
+	{
+		MSG_WriteByte (msg, ps->blend[0]*255);
+		MSG_WriteByte (msg, ps->blend[1]*255);
+		MSG_WriteByte (msg, ps->blend[2]*255);
+		MSG_WriteByte (msg, ps->blend[3]*255);
+	}
+	if (pflags & PS_FOV)
+		MSG_WriteByte (msg, ps->fov);
+	if (pflags & PS_RDFLAGS)
+		MSG_WriteByte (msg, ps->rdflags);
+
+	// send stats
+	statbits = 0;
+	for (i=0 ; i<MAX_STATS ; i++)
+		if (ps->stats[i] != ops->stats[i])
+			statbits |= 1<<i;
+	MSG_WriteLong (msg, statbits);
+	for (i=0 ; i<MAX_STATS ; i++)
+		if (statbits & (1<<i) )
+			MSG_WriteShort (msg, ps->stats[i]);
+}
+
 
 //============================================================
 
@@ -1001,129 +1245,1048 @@ void MSG_ReadDeltaUsercmd (sizebuf_t *msg_read, usercmd_t *from, usercmd_t *move
 	move->lightlevel = MSG_ReadByte (msg_read);
 }
 
+/*
+=================
+MSG_ReadEntityBits
 
-void MSG_ReadData (sizebuf_t *msg_read, void *data, int len)
+Returns the entity number and the header bits
+=================
+*/
+int MSG_ReadEntityBits (sizebuf_t *msg_read, unsigned *bits)
 {
-	int		i;
-
-	for (i=0 ; i<len ; i++)
-		((byte *)data)[i] = MSG_ReadByte (msg_read);
-}
+	unsigned	b, total;
+	int			number;
 
+	total = MSG_ReadByte (msg_read);
+	if (total & U_MOREBITS1)
+	{
+		b = MSG_ReadByte (msg_read);
+		total |= b<<8;
+	}
+	if (total & U_MOREBITS2)
+	{
+		b = MSG_ReadByte (msg_read);
+		total |= b<<16;
+	}
+	if (total & U_MOREBITS3)
+	{
+		b = MSG_ReadByte (msg_read);
+		total |= b<<24;
+	}
 
-//===========================================================================
+	if (total & U_NUMBER16)
+		number = MSG_ReadShort (msg_read);
+	else
+		number = MSG_ReadByte (msg_read);
 
-void SZ_Init (sizebuf_t *buf, byte *data, int length)
-{
-	memset (buf, 0, sizeof(*buf));
-	buf->data = data;
-	buf->maxsize = length;
-}
+	*bits = total;
 
-#ifdef	BUFFER_DEBUG
-void SZ_SetName(sizebuf_t * buf, const char * name, qboolean print_it)
-{
-	strncpy(buf->name, name, sizeof(buf->name) - 1);
-	if ( print_it )
-		Com_DPrintf("SZ_SetName: buffer '%s' (address = 0x%.12x) initialised\n", buf->name, buf);
+	return number;
 }
-#endif	//BUFFER_DEBUG
 
-void SZ_Clear (sizebuf_t *buf)
-{
-	buf->cursize = 0;
-	buf->overflowed = false;
-}
+/*
+==================
+MSG_ReadDeltaEntity
 
-void *SZ_GetSpace (sizebuf_t *buf, int length)
+Can go from either a baseline or a previous packet_entity
+==================
+*/
+void MSG_ReadDeltaEntity (sizebuf_t *msg_read, entity_state_t *from, entity_state_t *to, int number, int bits)
 {
-	void	*data;
+	// set everything to the state we are delta'ing from
+	*to = *from;
 
-	if (buf->cursize + length > buf->maxsize)
-	{
-		if (!buf->allowoverflow)
-			Com_Error (ERR_FATAL, "SZ_GetSpace: overflow without allowoverflow set");
+	VectorCopy (from->origin, to->old_origin);
+	to->number = number;
 
-		if (length > buf->maxsize)
-			Com_Error (ERR_FATAL, "SZ_GetSpace: %i is > full buffer size", length);
+	if (bits & U_MODEL)
+		to->modelindex = MSG_ReadByte (msg_read);
+	if (bits & U_MODEL2)
+		to->modelindex2 = MSG_ReadByte (msg_read);
+	if (bits & U_MODEL3)
+		to->modelindex3 = MSG_ReadByte (msg_read);
+	if (bits & U_MODEL4)
+		to->modelindex4 = MSG_ReadByte (msg_read);
 
-#ifdef	BUFFER_DEBUG
-		Com_Printf ("SZ_GetSpace (%s at 0x%.12x): overflow\n", buf->name, buf);
-#else	//BUFFER_DEBUG
-		Com_Printf ("SZ_GetSpace: overflow\n");
-#endif	//BUFFER_DEBUG
-		SZ_Clear (buf);
-		buf->overflowed = true;
-	}
+	if (bits & U_FRAME8)
+		to->frame = MSG_ReadByte (msg_read);
+	if (bits & U_FRAME16)
+		to->frame = MSG_ReadShort (msg_read);
 
-	data = buf->data + buf->cursize;
-	buf->cursize += length;
+	if ((bits & U_SKIN8) && (bits & U_SKIN16))		//used for laser colors
+		to->skinnum = MSG_ReadLong(msg_read);
+	else if (bits & U_SKIN8)
+		to->skinnum = MSG_ReadByte(msg_read);
+	else if (bits & U_SKIN16)
+		to->skinnum = MSG_ReadShort(msg_read);
 
-	return data;
-}
+	if ( (bits & (U_EFFECTS8|U_EFFECTS16)) == (U_EFFECTS8|U_EFFECTS16) )
+		to->effects = MSG_ReadLong(msg_read);
+	else if (bits & U_EFFECTS8)
+		to->effects = MSG_ReadByte(msg_read);
+	else if (bits & U_EFFECTS16)
+		to->effects = MSG_ReadShort(msg_read);
 
-void SZ_Write (sizebuf_t *buf, void *data, int length)
-{
-	memcpy (SZ_GetSpace(buf,length),data,length);
-}
+	if ( (bits & (U_RENDERFX8|U_RENDERFX16)) == (U_RENDERFX8|U_RENDERFX16) )
+		to->renderfx = MSG_ReadLong(msg_read);
+	else if (bits & U_RENDERFX8)
+		to->renderfx = MSG_ReadByte(msg_read);
+	else if (bits & U_RENDERFX16)
+		to->renderfx = MSG_ReadShort(msg_read);
 
-void SZ_Print (sizebuf_t *buf, char *data)
-{
-	int		len;
+	if (bits & U_ORIGIN1)
+		to->origin[0] = MSG_ReadCoord (msg_read);
+	if (bits & U_ORIGIN2)
+		to->origin[1] = MSG_ReadCoord (msg_read);
+	if (bits & U_ORIGIN3)
+		to->origin[2] = MSG_ReadCoord (msg_read);
 
-	len = strlen(data)+1;
+	if (bits & U_ANGLE1)
+		to->angles[0] = MSG_ReadAngle(msg_read);
+	if (bits & U_ANGLE2)
+		to->angles[1] = MSG_ReadAngle(msg_read);
+	if (bits & U_ANGLE3)
+		to->angles[2] = MSG_ReadAngle(msg_read);
 
-	if (buf->cursize)
-	{
-		if (buf->data[buf->cursize-1])
-			memcpy ((byte *)SZ_GetSpace(buf, len),data,len); // no trailing 0
-		else
-			memcpy ((byte *)SZ_GetSpace(buf, len-1)-1,data,len); // write over trailing 0
-	}
-	else
-		memcpy ((byte *)SZ_GetSpace(buf, len),data,len);
-}
+	if (bits & U_OLDORIGIN)
+		MSG_ReadPos (msg_read, to->old_origin);
 
+	if (bits & U_SOUND)
+		to->sound = MSG_ReadByte (msg_read);
 
-//============================================================================
+	if (bits & U_EVENT)
+		to->event = MSG_ReadByte (msg_read);
+	else
+		to->event = 0;
 
+	if (bits & U_SOLID)
+		to->solid = MSG_ReadShort (msg_read);
+}
 
 /*
-================
-COM_CheckParm
+==================
+MSG_ReadDeltaPlayerstate
 
-Returns the position (1 to argc-1) in the program's argument list
-where the given parameter apears, or 0 if not present
-================
+Reads the body of an svc_playerinfo over state, which holds the
+playerstate being delta'd from
+==================
 */
-int COM_CheckParm (char *parm)
+void MSG_ReadDeltaPlayerstate (sizebuf_t *msg_read, player_state_t *state)
 {
-	int		i;
+	int			flags;
+	int			i;
+	int			statbits;
 
-	for (i=1 ; i<com_argc ; i++)
+	flags = MSG_ReadShort (msg_read);
+
+	//
+	// parse the pmove_state_t
+	//
+	if (flags & PS_M_TYPE)
+		state->pmove.pm_type = MSG_ReadByte (msg_read);
+
+	if (flags & PS_M_ORIGIN)
 	{
-		if (!strcmp (parm,com_argv[i]))
-			return i;
+		state->pmove.origin[0] = MSG_ReadSizeInt (msg_read, coord_bytes);
+		state->pmove.origin[1] = MSG_ReadSizeInt (msg_read, coord_bytes);
+		state->pmove.origin[2] = MSG_ReadSizeInt (msg_read, coord_bytes);
 	}
 
-	return 0;
-}
+	if (flags & PS_M_VELOCITY)
+	{
+		state->pmove.velocity[0] = MSG_ReadShort (msg_read);
+		state->pmove.velocity[1] = MSG_ReadShort (msg_read);
+		state->pmove.velocity[2] = MSG_ReadShort (msg_read);
+	}
 
-int COM_Argc (void)
-{
-	return com_argc;
-}
+	if (flags & PS_M_TIME)
+		state->pmove.pm_time = MSG_ReadByte (msg_read);
 
-char *COM_Argv (int arg)
-{
-	if (arg < 0 || arg >= com_argc || !com_argv[arg])
-		return "";
-	return com_argv[arg];
-}
+	if (flags & PS_M_FLAGS)
+		state->pmove.pm_flags = MSG_ReadByte (msg_read);
 
-void COM_ClearArgv (int arg)
-{
-	if (arg < 0 || arg >= com_argc || !com_argv[arg])
+	if (flags & PS_M_GRAVITY)
+		state->pmove.gravity = MSG_ReadShort (msg_read);
+
+	if (flags & PS_M_DELTA_ANGLES)
+	{
+		state->pmove.delta_angles[0] = MSG_ReadShort (msg_read);
+		state->pmove.delta_angles[1] = MSG_ReadShort (msg_read);
+		state->pmove.delta_angles[2] = MSG_ReadShort (msg_read);
+	}
+
+	//
+	// parse the rest of the player_state_t
+	//
+	if (flags & PS_VIEWOFFSET)
+	{
+		state->viewoffset[0] = MSG_ReadChar (msg_read) * 0.25;
+		state->viewoffset[1] = MSG_ReadChar (msg_read) * 0.25;
+		state->viewoffset[2] = MSG_ReadChar (msg_read) * 0.25;
+	}
+
+	if (flags & PS_VIEWANGLES)
+	{
+		state->viewangles[0] = MSG_ReadAngle16 (msg_read);
+		state->viewangles[1] = MSG_ReadAngle16 (msg_read);
+		state->viewangles[2] = MSG_ReadAngle16 (msg_read);
+	}
+
+	if (flags & PS_KICKANGLES)
+	{
+		state->kick_angles[0] = MSG_ReadChar (msg_read) * 0.25;
+		state->kick_angles[1] = MSG_ReadChar (msg_read) * 0.25;
+		state->kick_angles[2] = MSG_ReadChar (msg_read) * 0.25;
+	}
+
+	if (flags & PS_WEAPONINDEX)
+	{
+		state->gunindex = MSG_ReadByte (msg_read);
+	}
+
+	if (flags & PS_WEAPONFRAME)
+	{
+		state->gunframe = MSG_ReadByte (msg_read);
+		state->gunoffset[0] = MSG_ReadChar (msg_read)*0.25;
+		state->gunoffset[1] = MSG_ReadChar (msg_read)*0.25;
+		state->gunoffset[2] = MSG_ReadChar (msg_read)*0.25;
+		state->gunangles[0] = MSG_ReadChar (msg_read)*0.25;
+		state->gunangles[1] = MSG_ReadChar (msg_read)*0.25;
+		state->gunangles[2] = MSG_ReadChar (msg_read)*0.25;
+	}
+
+	if (flags & PS_BLEND)
+	{
+		state->blend[0] = MSG_ReadByte (msg_read)/255.0;
+		state->blend[1] = MSG_ReadByte (msg_read)/255.0;
+		state->blend[2] = MSG_ReadByte (msg_read)/255.0;
+		state->blend[3] = MSG_ReadByte (msg_read)/255.0;
+	}
+
+	if (flags & PS_FOV)
+		state->fov = MSG_ReadByte (msg_read);
+
+	if (flags & PS_RDFLAGS)
+		state->rdflags = MSG_ReadByte (msg_read);
+
+	// parse stats
+	statbits = MSG_ReadLong (msg_read);
+	for (i=0 ; i<MAX_STATS ; i++)
+		if (statbits & (1<<i) )
+			state->stats[i] = MSG_ReadShort(msg_read);
+}
+
+
+void MSG_ReadData (sizebuf_t *msg_read, void *data, int len)
+{
+	int		i;
+
+	for (i=0 ; i<len ; i++)
+		((byte *)data)[i] = MSG_ReadByte (msg_read);
+}
+
+/*
+==============================================================================
+
+BIT PACKED FRAMES
+
+Clients on PROTOCOL_PACKED get the playerstate and packetentities of each
+frame as a bit stream. The fields are quantised exactly as the byte
+protocol quantises them, so both decode to the same state. Each field is
+written with only the bits its value needs. Positions and velocities are
+sent as a 16 bit wrapped delta from the value the client already holds.
+Values that vary in size get a two bit prefix that picks one of four
+widths. The stream is padded to a byte at the end, so the rest of the
+message stays byte aligned.
+
+==============================================================================
+*/
+
+void MSG_BeginWritingBits (bitmsg_t *bm, sizebuf_t *msg)
+{
+	bm->msg = msg;
+	bm->bits = 0;
+	bm->numbits = 0;
+}
+
+void MSG_WriteBits (bitmsg_t *bm, unsigned value, int numbits)
+{
+	if (numbits < 32)
+		value &= (1u << numbits) - 1;
+	bm->bits |= (unsigned long long)value << bm->numbits;
+	bm->numbits += numbits;
+	while (bm->numbits >= 8)
+	{
+		MSG_WriteByte (bm->msg, (int)(bm->bits & 255));
+		bm->bits >>= 8;
+		bm->numbits -= 8;
+	}
+}
+
+// pads the stream out to the next byte
+void MSG_EndWritingBits (bitmsg_t *bm)
+{
+	if (bm->numbits)
+		MSG_WriteByte (bm->msg, (int)(bm->bits & 255));
+	bm->bits = 0;
+	bm->numbits = 0;
+}
+
+// reading never touches bytes past the last bit asked for, so the
+// message is left byte aligned after the last read
+void MSG_BeginReadingBits (bitmsg_t *bm, sizebuf_t *msg)
+{
+	bm->msg = msg;
+	bm->bits = 0;
+	bm->numbits = 0;
+}
+
+unsigned MSG_ReadBits (bitmsg_t *bm, int numbits)
+{
+	unsigned	value;
+	sizebuf_t	*msg = bm->msg;
+
+	while (bm->numbits < numbits)
+	{
+		if (msg->readcount >= msg->cursize)
+		{	// past the end, the caller checks readcount
+			msg->readcount = msg->cursize + 1;
+			return 0;
+		}
+		bm->bits |= (unsigned long long)msg->data[msg->readcount++] << bm->numbits;
+		bm->numbits += 8;
+	}
+
+	value = (unsigned)(bm->bits & ((1ull << numbits) - 1));
+	bm->bits >>= numbits;
+	bm->numbits -= numbits;
+
+	return value;
+}
+
+// the two bit prefix picks the first width that holds the value
+static const int	msg_numberwidths[4] = {0, 3, 6, 10};	// entity number steps
+static const int	msg_deltawidths[4] = {4, 8, 12, 16};	// 16 bit deltas
+static const int	msg_framewidths[4] = {2, 5, 9, 32};		// frame steps
+static const int	msg_valuewidths[4] = {4, 8, 16, 32};	// skins, effects, renderfx
+
+static void MSG_WriteClassBits (bitmsg_t *bm, unsigned value, const int *widths)
+{
+	int		c;
+
+	for (c = 0; c < 3; c++)
+		if (value < (1u << widths[c]))
+			break;
+	MSG_WriteBits (bm, c, 2);
+	MSG_WriteBits (bm, value, widths[c]);
+}
+
+static unsigned MSG_ReadClassBits (bitmsg_t *bm, const int *widths)
+{
+	return MSG_ReadBits (bm, widths[MSG_ReadBits (bm, 2)]);
+}
+
+// signed values are zigzag coded so small steps either way stay small
+static void MSG_WriteSignedClassBits (bitmsg_t *bm, int value, const int *widths)
+{
+	MSG_WriteClassBits (bm, ((unsigned)value << 1) ^ (unsigned)(value >> 31), widths);
+}
+
+static int MSG_ReadSignedClassBits (bitmsg_t *bm, const int *widths)
+{
+	unsigned	u;
+
+	u = MSG_ReadClassBits (bm, widths);
+	return (int)(u >> 1) ^ -(int)(u & 1);
+}
+
+// a 16 bit quantity as a wrapped delta from the old value
+static void MSG_WriteDelta16 (bitmsg_t *bm, int from, int to)
+{
+	MSG_WriteSignedClassBits (bm, (short)(to - from), msg_deltawidths);
+}
+
+static int MSG_ReadDelta16 (bitmsg_t *bm, int from)
+{
+	return (short)(from + MSG_ReadSignedClassBits (bm, msg_deltawidths));
+}
+
+// the 1/8 unit value MSG_WriteCoord would send
+#define	PACKED_COORD(f)		((short)(int)((f)*8))
+
+// header flags in the order they are sent, the first eight are sent for
+// every entity, the rest after a single bit saying whether any are set.
+// only one of each 8/16 pair is used, to mean the field is present
+static const int	msg_entitybits[] =
+{
+	U_ORIGIN1, U_ORIGIN2, U_ORIGIN3, U_ANGLE1, U_ANGLE2, U_ANGLE3, U_FRAME8, U_EVENT,
+	U_MODEL, U_MODEL2, U_MODEL3, U_MODEL4, U_SKIN8, U_EFFECTS8, U_RENDERFX8,
+	U_SOLID, U_SOUND, U_OLDORIGIN
+};
+#define	NUM_ENTITYBITS		(sizeof(msg_entitybits)/sizeof(msg_entitybits[0]))
+#define	NUM_COMMONBITS		8
+
+/*
+==================
+MSG_WritePackedEntity
+
+The bit packed version of MSG_WriteDeltaEntity. lastnum is the number of
+the entity written before this one in the same packetentities, 0 for the
+first. Returns false if nothing was written.
+==================
+*/
+qboolean MSG_WritePackedEntity (bitmsg_t *bm, entity_state_t *from, entity_state_t *to, int lastnum, qboolean force, qboolean newentity)
+{
+	int			bits, i;
+	unsigned	mask;
+
+	if (!to->number)
+		Com_Error (ERR_FATAL, "Unset entity number");
+	if (to->number >= MAX_EDICTS)
+		Com_Error (ERR_FATAL, "Entity number >= MAX_EDICTS");
+
+	bits = MSG_EntityDeltaBits (from, to, newentity) & ~U_NUMBER16;
+	if (!bits && !force)
+		return false;
+
+	// fold the 8/16 pairs into "present"
+	if (bits & U_FRAME16)
+		bits |= U_FRAME8;
+	if (bits & U_SKIN16)
+		bits |= U_SKIN8;
+	if (bits & U_EFFECTS16)
+		bits |= U_EFFECTS8;
+	if (bits & U_RENDERFX16)
+		bits |= U_RENDERFX8;
+
+	mask = 0;
+	for (i = 0; i < NUM_ENTITYBITS; i++)
+		if (bits & msg_entitybits[i])
+			mask |= 1 << i;
+
+	MSG_WriteBits (bm, 1, 1);		// an entity follows
+	MSG_WriteClassBits (bm, to->number - lastnum - 1, msg_numberwidths);
+	MSG_WriteBits (bm, 0, 1);		// not a remove
+	MSG_WriteBits (bm, mask, NUM_COMMONBITS);
+	MSG_WriteBits (bm, (mask >> NUM_COMMONBITS) != 0, 1);
+	if (mask >> NUM_COMMONBITS)
+		MSG_WriteBits (bm, mask >> NUM_COMMONBITS, NUM_ENTITYBITS - NUM_COMMONBITS);
+
+	if (bits & U_MODEL)
+		MSG_WriteBits (bm, to->modelindex, 8);
+	if (bits & U_MODEL2)
+		MSG_WriteBits (bm, to->modelindex2, 8);
+	if (bits & U_MODEL3)
+		MSG_WriteBits (bm, to->modelindex3, 8);
+	if (bits & U_MODEL4)
+		MSG_WriteBits (bm, to->modelindex4, 8);
+
+	if (bits & U_FRAME8)
+		MSG_WriteSignedClassBits (bm, (int)((unsigned)to->frame - (unsigned)from->frame), msg_framewidths);
+	if (bits & U_SKIN8)
+		MSG_WriteClassBits (bm, (unsigned)to->skinnum, msg_valuewidths);
+	if (bits & U_EFFECTS8)
+		MSG_WriteClassBits (bm, to->effects, msg_valuewidths);
+	if (bits & U_RENDERFX8)
+		MSG_WriteClassBits (bm, (unsigned)to->renderfx, msg_valuewidths);
+
+	if (bits & U_ORIGIN1)
+		MSG_WriteDelta16 (bm, PACKED_COORD(from->origin[0]), PACKED_COORD(to->origin[0]));
+	if (bits & U_ORIGIN2)
+		MSG_WriteDelta16 (bm, PACKED_COORD(from->origin[1]), PACKED_COORD(to->origin[1]));
+	if (bits & U_ORIGIN3)
+		MSG_WriteDelta16 (bm, PACKED_COORD(from->origin[2]), PACKED_COORD(to->origin[2]));
+
+	if (bits & U_ANGLE1)
+		MSG_WriteBits (bm, (int)(to->angles[0]*256/360), 8);
+	if (bits & U_ANGLE2)
+		MSG_WriteBits (bm, (int)(to->angles[1]*256/360), 8);
+	if (bits & U_ANGLE3)
+		MSG_WriteBits (bm, (int)(to->angles[2]*256/360), 8);
+
+	// old_origin is close to the new origin, which the client has by now
+	if (bits & U_OLDORIGIN)
+	{
+		for (i = 0; i < 3; i++)
+			MSG_WriteDelta16 (bm, PACKED_COORD(to->origin[i]), PACKED_COORD(to->old_origin[i]));
+	}
+
+	if (bits & U_SOUND)
+		MSG_WriteBits (bm, to->sound, 8);
+	if (bits & U_EVENT)
+		MSG_WriteBits (bm, to->event, 8);
+	if (bits & U_SOLID)
+		MSG_WriteBits (bm, to->solid, 16);
+
+	return true;
+}
+
+void MSG_WritePackedRemove (bitmsg_t *bm, int number, int lastnum)
+{
+	MSG_WriteBits (bm, 1, 1);
+	MSG_WriteClassBits (bm, number - lastnum - 1, msg_numberwidths);
+	MSG_WriteBits (bm, 1, 1);
+}
+
+void MSG_WritePackedEnd (bitmsg_t *bm)
+{
+	MSG_WriteBits (bm, 0, 1);
+	MSG_EndWritingBits (bm);
+}
+
+/*
+==================
+MSG_ReadPackedEntityBits
+
+Returns the entity number, 0 at the end of the packetentities. The bits
+are U_* flags, with U_REMOVE set for a removed entity.
+==================
+*/
+int MSG_ReadPackedEntityBits (bitmsg_t *bm, unsigned *bits, int lastnum)
+{
+	int			number, i;
+	unsigned	mask;
+
+	*bits = 0;
+	if (!MSG_ReadBits (bm, 1))
+		return 0;
+
+	number = lastnum + 1 + MSG_ReadClassBits (bm, msg_numberwidths);
+	if (MSG_ReadBits (bm, 1))
+	{
+		*bits = U_REMOVE;
+		return number;
+	}
+
+	mask = MSG_ReadBits (bm, NUM_COMMONBITS);
+	if (MSG_ReadBits (bm, 1))
+		mask |= MSG_ReadBits (bm, NUM_ENTITYBITS - NUM_COMMONBITS) << NUM_COMMONBITS;
+
+	for (i = 0; i < NUM_ENTITYBITS; i++)
+		if (mask & (1 << i))
+			*bits |= msg_entitybits[i];
+
+	return number;
+}
+
+/*
+==================
+MSG_ReadPackedEntity
+
+The bit packed version of MSG_ReadDeltaEntity
+==================
+*/
+void MSG_ReadPackedEntity (bitmsg_t *bm, entity_state_t *from, entity_state_t *to, int number, int bits)
+{
+	int		i;
+
+	*to = *from;
+
+	VectorCopy (from->origin, to->old_origin);
+	to->number = number;
+
+	if (bits & U_MODEL)
+		to->modelindex = MSG_ReadBits (bm, 8);
+	if (bits & U_MODEL2)
+		to->modelindex2 = MSG_ReadBits (bm, 8);
+	if (bits & U_MODEL3)
+		to->modelindex3 = MSG_ReadBits (bm, 8);
+	if (bits & U_MODEL4)
+		to->modelindex4 = MSG_ReadBits (bm, 8);
+
+	if (bits & U_FRAME8)
+		to->frame = (int)((unsigned)from->frame + (unsigned)MSG_ReadSignedClassBits (bm, msg_framewidths));
+	if (bits & U_SKIN8)
+		to->skinnum = (int)MSG_ReadClassBits (bm, msg_valuewidths);
+	if (bits & U_EFFECTS8)
+		to->effects = MSG_ReadClassBits (bm, msg_valuewidths);
+	if (bits & U_RENDERFX8)
+		to->renderfx = (int)MSG_ReadClassBits (bm, msg_valuewidths);
+
+	if (bits & U_ORIGIN1)
+		to->origin[0] = MSG_ReadDelta16 (bm, PACKED_COORD(from->origin[0])) * (1.0/8);
+	if (bits & U_ORIGIN2)
+		to->origin[1] = MSG_ReadDelta16 (bm, PACKED_COORD(from->origin[1])) * (1.0/8);
+	if (bits & U_ORIGIN3)
+		to->origin[2] = MSG_ReadDelta16 (bm, PACKED_COORD(from->origin[2])) * (1.0/8);
+
+	if (bits & U_ANGLE1)
+		to->angles[0] = (signed char)MSG_ReadBits (bm, 8) * (360.0/256);
+	if (bits & U_ANGLE2)
+		to->angles[1] = (signed char)MSG_ReadBits (bm, 8) * (360.0/256);
+	if (bits & U_ANGLE3)
+		to->angles[2] = (signed char)MSG_ReadBits (bm, 8) * (360.0/256);
+
+	if (bits & U_OLDORIGIN)
+	{
+		for (i = 0; i < 3; i++)
+			to->old_origin[i] = MSG_ReadDelta16 (bm, PACKED_COORD(to->origin[i])) * (1.0/8);
+	}
+
+	if (bits & U_SOUND)
+		to->sound = MSG_ReadBits (bm, 8);
+
+	if (bits & U_EVENT)
+		to->event = MSG_ReadBits (bm, 8);
+	else
+		to->event = 0;
+
+	if (bits & U_SOLID)
+		to->solid = (short)MSG_ReadBits (bm, 16);
+}
+
+// playerstate flags in the order they are sent, the first four are sent
+// every frame, the rest after a single bit saying whether any are set
+static const int	msg_playerbits[] =
+{
+	PS_M_ORIGIN, PS_M_VELOCITY, PS_VIEWANGLES, PS_WEAPONFRAME,
+	PS_M_TYPE, PS_M_TIME, PS_M_FLAGS, PS_M_GRAVITY, PS_M_DELTA_ANGLES,
+	PS_VIEWOFFSET, PS_KICKANGLES, PS_BLEND, PS_FOV, PS_RDFLAGS, PS_WEAPONINDEX
+};
+#define	NUM_PLAYERBITS		(sizeof(msg_playerbits)/sizeof(msg_playerbits[0]))
+#define	NUM_COMMONPLAYERBITS	4
+
+/*
+==================
+MSG_WritePackedPlayerstate
+
+The bit packed version of MSG_WriteDeltaPlayerstate. Unlike the byte
+protocol the weapon index is only sent when it changes.
+==================
+*/
+void MSG_WritePackedPlayerstate (bitmsg_t *bm, player_state_t *from, player_state_t *to)
+{
+	int				i;
+	int				pflags, statbits;
+	unsigned		mask;
+	player_state_t	*ps, *ops;
+	player_state_t	dummy;
+
+	ps = to;
+	if (!from)
+	{
+		memset (&dummy, 0, sizeof(dummy));
+		ops = &dummy;
+	}
+	else
+		ops = from;
+
+	pflags = MSG_PlayerstateDeltaBits (ops, ps);
+	if (ps->gunindex != ops->gunindex)
+		pflags |= PS_WEAPONINDEX;
+
+	mask = 0;
+	for (i = 0; i < NUM_PLAYERBITS; i++)
+		if (pflags & msg_playerbits[i])
+			mask |= 1 << i;
+
+	MSG_WriteBits (bm, mask, NUM_COMMONPLAYERBITS);
+	MSG_WriteBits (bm, (mask >> NUM_COMMONPLAYERBITS) != 0, 1);
+	if (mask >> NUM_COMMONPLAYERBITS)
+		MSG_WriteBits (bm, mask >> NUM_COMMONPLAYERBITS, NUM_PLAYERBITS - NUM_COMMONPLAYERBITS);
+
+	if (pflags & PS_M_TYPE)
+		MSG_WriteBits (bm, ps->pmove.pm_type, 8);
+
+	if (pflags & PS_M_ORIGIN)
+	{
+		for (i = 0; i < 3; i++)
+			MSG_WriteDelta16 (bm, ops->pmove.origin[i], ps->pmove.origin[i]);
+	}
+
+	if (pflags & PS_M_VELOCITY)
+	{
+		for (i = 0; i < 3; i++)
+			MSG_WriteDelta16 (bm, ops->pmove.velocity[i], ps->pmove.velocity[i]);
+	}
+
+	if (pflags & PS_M_TIME)
+		MSG_WriteBits (bm, ps->pmove.pm_time, 8);
+	if (pflags & PS_M_FLAGS)
+		MSG_WriteBits (bm, ps->pmove.pm_flags, 8);
+	if (pflags & PS_M_GRAVITY)
+		MSG_WriteBits (bm, ps->pmove.gravity, 16);
+
+	if (pflags & PS_M_DELTA_ANGLES)
+	{
+		for (i = 0; i < 3; i++)
+			MSG_WriteBits (bm, ps->pmove.delta_angles[i], 16);
+	}
+
+	if (pflags & PS_VIEWOFFSET)
+	{
+		for (i = 0; i < 3; i++)
+			MSG_WriteBits (bm, (int)(ps->viewoffset[i]*4), 8);
+	}
+
+	if (pflags & PS_VIEWANGLES)
+	{
+		for (i = 0; i < 3; i++)
+			MSG_WriteBits (bm, ANGLE2SHORT(ps->viewangles[i]), 16);
+	}
+
+	if (pflags & PS_KICKANGLES)
+	{
+		for (i = 0; i < 3; i++)
+			MSG_WriteBits (bm, (int)(ps->kick_angles[i]*4), 8);
+	}
+
+	if (pflags & PS_WEAPONINDEX)
+		MSG_WriteBits (bm, ps->gunindex, 8);
+
+	if (pflags & PS_WEAPONFRAME)
+	{
+		MSG_WriteBits (bm, ps->gunframe, 8);
+		for (i = 0; i < 3; i++)
+			MSG_WriteBits (bm, (int)(ps->gunoffset[i]*4), 8);
+		for (i = 0; i < 3; i++)
+			MSG_WriteBits (bm, (int)(ps->gunangles[i]*4), 8);
+	}
+
+	if (pflags & PS_BLEND)
+	{
+		for (i = 0; i < 4; i++)
+			MSG_WriteBits (bm, (int)(ps->blend[i]*255), 8);
+	}
+	if (pflags & PS_FOV)
+		MSG_WriteBits (bm, (int)ps->fov, 8);
+	if (pflags & PS_RDFLAGS)
+		MSG_WriteBits (bm, ps->rdflags, 8);
+
+	// stats are mostly small counts
+	statbits = 0;
+	for (i=0 ; i<MAX_STATS ; i++)
+		if (ps->stats[i] != ops->stats[i])
+			statbits |= 1<<i;
+	MSG_WriteBits (bm, statbits != 0, 1);
+	if (statbits)
+	{
+		MSG_WriteBits (bm, statbits, MAX_STATS);
+		for (i=0 ; i<MAX_STATS ; i++)
+			if (statbits & (1<<i))
+				MSG_WriteClassBits (bm, (unsigned short)ps->stats[i], msg_deltawidths);
+	}
+}
+
+/*
+==================
+MSG_ReadPackedPlayerstate
+
+The bit packed version of MSG_ReadDeltaPlayerstate
+==================
+*/
+void MSG_ReadPackedPlayerstate (bitmsg_t *bm, player_state_t *state)
+{
+	int			i;
+	int			flags, statbits;
+	unsigned	mask;
+
+	mask = MSG_ReadBits (bm, NUM_COMMONPLAYERBITS);
+	if (MSG_ReadBits (bm, 1))
+		mask |= MSG_ReadBits (bm, NUM_PLAYERBITS - NUM_COMMONPLAYERBITS) << NUM_COMMONPLAYERBITS;
+
+	flags = 0;
+	for (i = 0; i < NUM_PLAYERBITS; i++)
+		if (mask & (1 << i))
+			flags |= msg_playerbits[i];
+
+	if (flags & PS_M_TYPE)
+		state->pmove.pm_type = MSG_ReadBits (bm, 8);
+
+	if (flags & PS_M_ORIGIN)
+	{
+		for (i = 0; i < 3; i++)
+			state->pmove.origin[i] = MSG_ReadDelta16 (bm, state->pmove.origin[i]);
+	}
+
+	if (flags & PS_M_VELOCITY)
+	{
+		for (i = 0; i < 3; i++)
+			state->pmove.velocity[i] = MSG_ReadDelta16 (bm, state->pmove.velocity[i]);
+	}
+
+	if (flags & PS_M_TIME)
+		state->pmove.pm_time = MSG_ReadBits (bm, 8);
+	if (flags & PS_M_FLAGS)
+		state->pmove.pm_flags = MSG_ReadBits (bm, 8);
+	if (flags & PS_M_GRAVITY)
+		state->pmove.gravity = (short)MSG_ReadBits (bm, 16);
+
+	if (flags & PS_M_DELTA_ANGLES)
+	{
+		for (i = 0; i < 3; i++)
+			state->pmove.delta_angles[i] = (short)MSG_ReadBits (bm, 16);
+	}
+
+	if (flags & PS_VIEWOFFSET)
+	{
+		for (i = 0; i < 3; i++)
+			state->viewoffset[i] = (signed char)MSG_ReadBits (bm, 8) * 0.25;
+	}
+
+	if (flags & PS_VIEWANGLES)
+	{
+		for (i = 0; i < 3; i++)
+			state->viewangles[i] = SHORT2ANGLE((short)MSG_ReadBits (bm, 16));
+	}
+
+	if (flags & PS_KICKANGLES)
+	{
+		for (i = 0; i < 3; i++)
+			state->kick_angles[i] = (signed char)MSG_ReadBits (bm, 8) * 0.25;
+	}
+
+	if (flags & PS_WEAPONINDEX)
+		state->gunindex = MSG_ReadBits (bm, 8);
+
+	if (flags & PS_WEAPONFRAME)
+	{
+		state->gunframe = MSG_ReadBits (bm, 8);
+		for (i = 0; i < 3; i++)
+			state->gunoffset[i] = (signed char)MSG_ReadBits (bm, 8)*0.25;
+		for (i = 0; i < 3; i++)
+			state->gunangles[i] = (signed char)MSG_ReadBits (bm, 8)*0.25;
+	}
+
+	if (flags & PS_BLEND)
+	{
+		for (i = 0; i < 4; i++)
+			state->blend[i] = MSG_ReadBits (bm, 8)/255.0;
+	}
+	if (flags & PS_FOV)
+		state->fov = MSG_ReadBits (bm, 8);
+	if (flags & PS_RDFLAGS)
+		state->rdflags = MSG_ReadBits (bm, 8);
+
+	if (MSG_ReadBits (bm, 1))
+	{
+		statbits = MSG_ReadBits (bm, MAX_STATS);
+		for (i=0 ; i<MAX_STATS ; i++)
+			if (statbits & (1<<i))
+				state->stats[i] = (short)MSG_ReadClassBits (bm, msg_deltawidths);
+	}
+}
+
+/*
+=============
+MSG_WritePacketEntities
+
+Writes the body of an svc_packetentities: a delta from one entity list to
+the next, new entities coming from their baselines. from is NULL for a
+full update.
+=============
+*/
+void MSG_WritePacketEntities (sizebuf_t *msg, entitylist_t *from, entitylist_t *to, entity_state_t *baselines, int maxclients, qboolean packed)
+{
+	entity_state_t	*oldent=NULL, *newent=NULL;
+	int		oldindex, newindex;
+	int		oldnum, newnum, lastnum;
+	int		from_num_entities;
+	int		bits;
+	bitmsg_t	bm;
+
+	if (!from)
+		from_num_entities = 0;
+	else
+		from_num_entities = from->count;
+
+	if (packed)
+		MSG_BeginWritingBits (&bm, msg);
+	lastnum = 0;
+
+	newindex = 0;
+	oldindex = 0;
+	while (newindex < to->count || oldindex < from_num_entities)
+	{
+		if (newindex >= to->count)
+			newnum = 9999;
+		else
+		{
+			newent = &to->ring[(to->first+newindex)%to->ringsize];
+			newnum = newent->number;
+		}
+
+		if (oldindex >= from_num_entities)
+			oldnum = 9999;
+		else
+		{
+			oldent = &from->ring[(from->first+oldindex)%from->ringsize];
+			oldnum = oldent->number;
+		}
+
+		if (newnum == oldnum)
+		{	// delta update from old position
+			// because the force parm is false, this will not result
+			// in any bytes being emited if the entity has not changed at all
+			// note that players are always 'newentities', this updates their oldorigin always
+			// and prevents warping
+			if (!packed)
+				MSG_WriteDeltaEntity (oldent, newent, msg, false, newent->number <= maxclients);
+			else if (MSG_WritePackedEntity (&bm, oldent, newent, lastnum, false, newent->number <= maxclients))
+				lastnum = newnum;
+			oldindex++;
+			newindex++;
+			continue;
+		}
+
+		if (newnum < oldnum)
+		{	// this is a new entity, send it from the baseline
+			if (!packed)
+				MSG_WriteDeltaEntity (&baselines[newnum], newent, msg, true, true);
+			else if (MSG_WritePackedEntity (&bm, &baselines[newnum], newent, lastnum, true, true))
+				lastnum = newnum;
+			newindex++;
+			continue;
+		}
+
+		if (newnum > oldnum)
+		{	// the old entity isn't present in the new message
+			if (packed)
+			{
+				MSG_WritePackedRemove (&bm, oldnum, lastnum);
+				lastnum = oldnum;
+				oldindex++;
+				continue;
+			}
+
+			bits = U_REMOVE;
+			if (oldnum >= 256)
+				bits |= U_NUMBER16 | U_MOREBITS1;
+
+			MSG_WriteByte (msg,	bits&255 );
+			if (bits & 0x0000ff00)
+				MSG_WriteByte (msg,	(bits>>8)&255 );
+
+			if (bits & U_NUMBER16)
+				MSG_WriteShort (msg, oldnum);
+			else
+				MSG_WriteByte (msg, oldnum);
+
+			oldindex++;
+			continue;
+		}
+	}
+
+	if (packed)
+		MSG_WritePackedEnd (&bm);
+	else
+		MSG_WriteShort (msg, 0);	// end of packetentities
+}
+
+
+//===========================================================================
+
+void SZ_Init (sizebuf_t *buf, byte *data, int length)
+{
+	memset (buf, 0, sizeof(*buf));
+	buf->data = data;
+	buf->maxsize = length;
+}
+
+#ifdef	BUFFER_DEBUG
+void SZ_SetName(sizebuf_t * buf, const char * name, qboolean print_it)
+{
+	strncpy(buf->name, name, sizeof(buf->name) - 1);
+	if ( print_it )
+		Com_DPrintf("SZ_SetName: buffer '%s' (address = 0x%.12x) initialised\n", buf->name, buf);
+}
+#endif	//BUFFER_DEBUG
+
+void SZ_Clear (sizebuf_t *buf)
+{
+	buf->cursize = 0;
+	buf->overflowed = false;
+}
+
+void *SZ_GetSpace (sizebuf_t *buf, int length)
+{
+	void	*data;
+
+	if (buf->cursize + length > buf->maxsize)
+	{
+		if (!buf->allowoverflow)
+			Com_Error (ERR_FATAL, "SZ_GetSpace: overflow without allowoverflow set");
+
+		if (length > buf->maxsize)
+			Com_Error (ERR_FATAL, "SZ_GetSpace: %i is > full buffer size", length);
+
+#ifdef	BUFFER_DEBUG
+		Com_Printf ("SZ_GetSpace (%s at 0x%.12x): overflow\n", buf->name, buf);
+#else	//BUFFER_DEBUG
+		Com_Printf ("SZ_GetSpace: overflow\n");
+#endif	//BUFFER_DEBUG
+		SZ_Clear (buf);
+		buf->overflowed = true;
+	}
+
+	data = buf->data + buf->cursize;
+	buf->cursize += length;
+
+	return data;
+}
+
+void SZ_Write (sizebuf_t *buf, void *data, int length)
+{
+	memcpy (SZ_GetSpace(buf,length),data,length);
+}
+
+void SZ_Print (sizebuf_t *buf, char *data)
+{
+	int		len;
+
+	len = strlen(data)+1;
+
+	if (buf->cursize)
+	{
+		if (buf->data[buf->cursize-1])
+			memcpy ((byte *)SZ_GetSpace(buf, len),data,len); // no trailing 0
+		else
+			memcpy ((byte *)SZ_GetSpace(buf, len-1)-1,data,len); // write over trailing 0
+	}
+	else
+		memcpy ((byte *)SZ_GetSpace(buf, len),data,len);
+}
+
+
+//============================================================================
+
+
+/*
+================
+COM_CheckParm
+
+Returns the position (1 to argc-1) in the program's argument list
+where the given parameter apears, or 0 if not present
+================
+*/
+int COM_CheckParm (char *parm)
+{
+	int		i;
+
+	for (i=1 ; i<com_argc ; i++)
+	{
+		if (!strcmp (parm,com_argv[i]))
+			return i;
+	}
+
+	return 0;
+}
+
+int COM_Argc (void)
+{
+	return com_argc;
+}
+
+char *COM_Argv (int arg)
+{
+	if (arg < 0 || arg >= com_argc || !com_argv[arg])
+		return "";
+	return com_argv[arg];
+}
+
+void COM_ClearArgv (int arg)
+{
+	if (arg < 0 || arg >= com_argc || !com_argv[arg])
 		return;
 	com_argv[arg] = "";
 }
@@ -1281,24 +2444,125 @@ qboolean Com_PatternMatch (const char *string, const char *pattern)
 
 						ZONE MEMORY ALLOCATION
 
-just cleared malloc with counters now...
+Every block still carries a zhead_t with the magic number, but where the
+memory comes from depends on the block:
+
+Small blocks come from size class pools and go back on the pool's free
+list when freed, so the many little allocations made while loading a
+level don't each go through malloc.
+
+Small blocks with a nonzero tag are bumped out of arenas belonging to the
+tag instead. Z_FreeTags releases those arenas whole rather than visiting
+each block. A block freed on its own is only counted as waste until its
+arena empties out.
+
+Everything else is a plain calloc. Blocks are kept on one list per tag,
+so Z_FreeTags only walks the blocks of the tag being freed.
 
 ==============================================================================
 */
 
 #define	Z_MAGIC		0x1d1d
+#define	Z_FREED		0x1dde		// already released pool or arena block
+
+#define	Z_NUMPOOLS		6		// 64 to 2048 byte blocks, header included
+#define	Z_POOLSHIFT		6
+#define	Z_POOLCHUNK		(64*1024)
+#define	Z_FROMMALLOC	0
+#define	Z_FROMARENA		(Z_NUMPOOLS+1)
+
+#define	Z_ARENASIZE		(256*1024)
+#define	Z_ARENAMAXBLOCK	(Z_ARENASIZE/16)
+
+typedef struct zarena_s
+{
+	struct zarena_s	*prev, *next;
+	int		used;				// bytes handed out, header included
+	int		live;				// blocks not yet freed
+} zarena_t;
 
+#define	Z_ARENAHEAD		((int)(sizeof(zarena_t)+15) & ~15)
+#define	Z_ARENASPACE	(Z_ARENASIZE - Z_ARENAHEAD)
 
 typedef struct zhead_s
 {
-	struct zhead_s	*prev, *next;
+	struct zhead_s	*prev, *next;	// tag list; prev is the zarena_t for arena blocks
 	short	magic;
 	short	tag;			// for group free
-	int		size;
+	int		size;			// header included
+	int		source;			// Z_FROMMALLOC, pool number + 1, or Z_FROMARENA
+	int		request;		// size asked for, for Z_Stats_f
 } zhead_t;
 
-zhead_t		z_chain;
-int		z_count, z_bytes;
+typedef struct
+{
+	int			tag;
+	zhead_t		chain;			// malloc and pool blocks
+	zarena_t	*arena;			// newest arena, bumped from; older ones follow
+	int			count, bytes, peak;
+	int			request;		// sum of the sizes asked for
+	int			numarenas, arenawaste;	// waste: freed or skipped arena space
+} ztag_t;
+
+#define	MAX_ZTAGS	32
+
+static ztag_t	z_tags[MAX_ZTAGS];
+static int		z_numtags;
+static int		z_count, z_bytes, z_peak;
+static int		z_allocs;		// every Z_TagMalloc call, for profiling
+
+static struct
+{
+	zhead_t	*free;				// chained through next
+	int		chunks, inuse;
+} z_pools[Z_NUMPOOLS];
+
+/*
+========================
+Z_TagInfo
+========================
+*/
+static ztag_t *Z_TagInfo (int tag)
+{
+	static ztag_t	*last;
+	ztag_t	*t;
+	int		i;
+
+	if (last && last->tag == tag)
+		return last;
+
+	for (i=0, t=z_tags ; i<z_numtags ; i++, t++)
+		if (t->tag == tag)
+			return last = t;
+
+	if (z_numtags == MAX_ZTAGS)
+		Com_Error (ERR_FATAL, "Z_TagMalloc: more than %i tags in use", MAX_ZTAGS);
+
+	t = &z_tags[z_numtags++];
+	memset (t, 0, sizeof(*t));
+	t->tag = tag;
+	t->chain.next = t->chain.prev = &t->chain;
+	return last = t;
+}
+
+/*
+========================
+Z_ReleaseArena
+========================
+*/
+static void Z_ReleaseArena (ztag_t *t, zarena_t *a)
+{
+	if (a->prev)
+		a->prev->next = a->next;
+	else
+		t->arena = a->next;
+	if (a->next)
+		a->next->prev = a->prev;
+
+	t->arenawaste -= Z_ARENASPACE;	// only empty, old arenas are released
+	t->numarenas--;
+	free (a);
+}
 
 /*
 ========================
@@ -1308,29 +2572,111 @@ Z_Free
 void Z_Free (void *ptr)
 {
 	zhead_t	*z;
+	ztag_t	*t;
+	zarena_t	*a;
 
 	z = ((zhead_t *)ptr) - 1;
 
 	if (z->magic != Z_MAGIC)
 		Com_Error (ERR_FATAL, "Z_Free: bad magic");
+	z->magic = Z_FREED;
+
+	t = Z_TagInfo (z->tag);
+	t->count--;
+	t->bytes -= z->size;
+	t->request -= z->request;
+	z_count--;
+	z_bytes -= z->size;
+
+	if (z->source == Z_FROMARENA)
+	{
+		a = (zarena_t *)z->prev;
+		t->arenawaste += z->size;
+		if (!--a->live)
+		{
+			if (a == t->arena)
+			{	// still bumping from it, just start over
+				t->arenawaste -= a->used;
+				a->used = 0;
+			}
+			else
+				Z_ReleaseArena (t, a);
+		}
+		return;
+	}
 
 	z->prev->next = z->next;
 	z->next->prev = z->prev;
 
-	z_count--;
-	z_bytes -= z->size;
-	free (z);
+	if (z->source == Z_FROMMALLOC)
+	{
+		free (z);
+		return;
+	}
+
+	z_pools[z->source-1].inuse--;
+	z->next = z_pools[z->source-1].free;
+	z_pools[z->source-1].free = z;
 }
 
 
+/*
+========================
+Z_Allocations
+
+How many blocks have ever been handed out. Profilers take the difference
+across a stretch of code.
+========================
+*/
+int Z_Allocations (void)
+{
+	return z_allocs;
+}
+
 /*
 ========================
 Z_Stats_f
+
+Waste is memory held for a tag that isn't holding anything: the
+headers, rounding up to the pool or arena granularity, and arena space
+that was freed or never handed out.
 ========================
 */
 void Z_Stats_f (void)
 {
-	Com_Printf ("%i bytes in %i blocks\n", z_bytes, z_count);
+	int		i, waste, totalwaste;
+	int		pooled, poolfree;
+	ztag_t	*t;
+
+	Com_Printf ("%i bytes in %i blocks, peak %i\n", z_bytes, z_count, z_peak);
+
+	totalwaste = 0;
+	Com_Printf ("   tag   blocks      bytes       peak arenas      waste\n");
+	for (i=0, t=z_tags ; i<z_numtags ; i++, t++)
+	{
+		waste = t->bytes - t->request + t->arenawaste;
+		if (t->arena)
+			waste += Z_ARENASPACE - t->arena->used;
+		totalwaste += waste;
+		Com_Printf ("%6i %8i %10i %10i %6i %10i\n", t->tag, t->count,
+			t->bytes, t->peak, t->numarenas, waste);
+	}
+
+	pooled = poolfree = 0;
+	Com_Printf ("  pool   blocks   free chunks\n");
+	for (i=0 ; i<Z_NUMPOOLS ; i++)
+	{
+		int	blocksize = 1<<(Z_POOLSHIFT+i);
+		int	total = z_pools[i].chunks * (Z_POOLCHUNK/blocksize);
+
+		Com_Printf ("%6i %8i %6i %6i\n", blocksize, z_pools[i].inuse,
+			total - z_pools[i].inuse, z_pools[i].chunks);
+		pooled += z_pools[i].chunks * Z_POOLCHUNK;
+		poolfree += (total - z_pools[i].inuse) * blocksize;
+	}
+
+	Com_Printf ("%i bytes wasted in blocks, %i free in %i bytes of pools\n",
+		totalwaste, poolfree, pooled);
 }
 
 /*
@@ -1340,14 +2686,24 @@ Z_FreeTags
 */
 void Z_FreeTags (int tag)
 {
+	ztag_t	*t;
 	zhead_t	*z, *next;
 
-	for (z=z_chain.next ; z != &z_chain ; z=next)
+	t = Z_TagInfo (tag);
+
+	for (z=t->chain.next ; z != &t->chain ; z=next)
 	{
 		next = z->next;
-		if (z->tag == tag)
-			Z_Free ((void *)(z+1));
+		Z_Free ((void *)(z+1));
 	}
+
+	// whatever is left lives in the arenas
+	z_count -= t->count;
+	z_bytes -= t->bytes;
+	t->count = t->bytes = t->request = 0;
+	while (t->arena)
+		Z_ReleaseArena (t, t->arena);
+	t->arenawaste = 0;
 }
 
 /*
@@ -1358,22 +2714,97 @@ Z_TagMalloc
 void *Z_TagMalloc (int size, int tag)
 {
 	zhead_t	*z;
+	ztag_t	*t;
+	zarena_t	*a;
+	int		pool, i;
+	int		request = size;
 
 	size = size + sizeof(zhead_t);
-	z = malloc(size);
-	if (!z)
-		Com_Error (ERR_FATAL, "Z_Malloc: failed on allocation of %i bytes",size);
-	memset (z, 0, size);
-	z_count++;
-	z_bytes += size;
+	t = Z_TagInfo (tag);
+
+	if (tag && size <= Z_ARENAMAXBLOCK)
+	{
+		size = (size + 15) & ~15;
+		a = t->arena;
+		if (!a || a->used + size > Z_ARENASPACE)
+		{
+			if (a)	// the unused tail of the old one is lost
+				t->arenawaste += Z_ARENASPACE - a->used;
+			a = malloc (Z_ARENASIZE);
+			if (!a)
+				Com_Error (ERR_FATAL, "Z_Malloc: failed on allocation of %i bytes", Z_ARENASIZE);
+			a->prev = NULL;
+			a->next = t->arena;
+			if (a->next)
+				a->next->prev = a;
+			a->used = a->live = 0;
+			t->arena = a;
+			t->numarenas++;
+		}
+		z = (zhead_t *)((byte *)a + Z_ARENAHEAD + a->used);
+		a->used += size;
+		a->live++;
+		memset (z, 0, size);
+		z->source = Z_FROMARENA;
+		z->prev = (zhead_t *)a;
+	}
+	else if (size <= 1<<(Z_POOLSHIFT+Z_NUMPOOLS-1))
+	{
+		for (pool=0 ; size > 1<<(Z_POOLSHIFT+pool) ; pool++)
+			;
+		if (!z_pools[pool].free)
+		{	// carve up a new chunk
+			byte	*chunk = malloc (Z_POOLCHUNK);
+			int		blocksize = 1<<(Z_POOLSHIFT+pool);
+
+			if (!chunk)
+				Com_Error (ERR_FATAL, "Z_Malloc: failed on allocation of %i bytes", Z_POOLCHUNK);
+			for (i=Z_POOLCHUNK-blocksize ; i>=0 ; i-=blocksize)
+			{
+				z = (zhead_t *)(chunk + i);
+				z->next = z_pools[pool].free;
+				z_pools[pool].free = z;
+			}
+			z_pools[pool].chunks++;
+		}
+		z = z_pools[pool].free;
+		z_pools[pool].free = z->next;
+		z_pools[pool].inuse++;
+		memset (z, 0, size);
+		size = 1<<(Z_POOLSHIFT+pool);
+		z->source = pool+1;
+	}
+	else
+	{
+		z = calloc (1, size);
+		if (!z)
+			Com_Error (ERR_FATAL, "Z_Malloc: failed on allocation of %i bytes",size);
+		z->source = Z_FROMMALLOC;
+	}
+
 	z->magic = Z_MAGIC;
 	z->tag = tag;
 	z->size = size;
+	z->request = request;
 
-	z->next = z_chain.next;
-	z->prev = &z_chain;
-	z_chain.next->prev = z;
-	z_chain.next = z;
+	if (z->source != Z_FROMARENA)
+	{
+		z->next = t->chain.next;
+		z->prev = &t->chain;
+		t->chain.next->prev = z;
+		t->chain.next = z;
+	}
+
+	t->count++;
+	t->bytes += size;
+	t->request += request;
+	if (t->bytes > t->peak)
+		t->peak = t->bytes;
+	z_count++;
+	z_allocs++;
+	z_bytes += size;
+	if (z_bytes > z_peak)
+		z_peak = z_bytes;
 
 	return (void *)(z+1);
 }
@@ -1502,6 +2933,39 @@ byte	COM_BlockSequenceCRCByte (byte *base, int length, int sequence)
 	return crc;
 }
 
+/*
+====================
+Com_OrBits
+
+out |= in over numbytes bytes, for merging PVS/PHS rows. Neither
+buffer needs any particular alignment.
+====================
+*/
+void Com_OrBits (byte *out, const byte *in, int numbytes)
+{
+	int		i = 0;
+
+#ifdef __SSE2__
+	for ( ; i+16 <= numbytes ; i += 16)
+	{
+		__m128i a = _mm_loadu_si128 ((const __m128i *)(out+i));
+		__m128i b = _mm_loadu_si128 ((const __m128i *)(in+i));
+		_mm_storeu_si128 ((__m128i *)(out+i), _mm_or_si128 (a, b));
+	}
+#endif
+	for ( ; i+8 <= numbytes ; i += 8)
+	{
+		unsigned long long a, b;
+
+		memcpy (&a, out+i, 8);
+		memcpy (&b, in+i, 8);
+		a |= b;
+		memcpy (out+i, &a, 8);
+	}
+	for ( ; i < numbytes ; i++)
+		out[i] |= in[i];
+}
+
 //========================================================
 
 /*
@@ -1524,6 +2988,197 @@ float	crand(void)
 	return (float)rand() * randmax_scale - 1.0f;
 }
 
+/*
+==============================================================================
+
+PARALLEL JOBS
+
+A small pool of helper threads, started on first use, that all work on one
+batch of indices at a time. The calling thread takes part in every batch.
+
+==============================================================================
+*/
+
+static struct
+{
+	int			numthreads;				// helpers started so far
+	void		*threads[MAX_JOB_WORKERS];
+	unsigned long	threadids[MAX_JOB_WORKERS];
+	void		*lock;
+	void		*wake;					// signalled when a batch is posted
+	void		*done;					// signalled when a batch completes
+	int			generation;				// bumped for every batch
+	int			active;					// helpers taking part in this batch
+	int			pending;				// helpers still working on this batch
+	qboolean	shutdown;
+
+	jobfunc_t	func;
+	void		*data;
+	int			count;
+	int			next;					// next unclaimed index
+
+	char		print[MAXPRINTMSG];		// Com_Printf text from helpers
+} jobs;
+
+static qboolean Com_InJobThread (void)
+{
+	unsigned long	id;
+	int				i;
+
+	if (!jobs.numthreads)
+		return false;
+
+	id = Sys_ThreadId ();
+	for (i = 0; i < jobs.numthreads; i++)
+		if (jobs.threadids[i] == id)
+			return true;
+	return false;
+}
+
+static void Com_DeferPrint (const char *msg)
+{
+	Sys_LockMutex (jobs.lock);
+	Q_strcat (jobs.print, msg, sizeof(jobs.print));
+	Sys_UnlockMutex (jobs.lock);
+}
+
+static void Com_RunJobs (int worker)
+{
+	int index;
+
+	for (;;)
+	{
+		Sys_LockMutex (jobs.lock);
+		index = jobs.next;
+		if (index < jobs.count)
+			jobs.next++;
+		Sys_UnlockMutex (jobs.lock);
+
+		if (index >= jobs.count)
+			return;
+		jobs.func (jobs.data, index, worker);
+	}
+}
+
+static void Com_JobThread (void *arg)
+{
+	int worker = (int)(size_t)arg;
+	int seen = 0;
+
+	Sys_LockMutex (jobs.lock);
+	jobs.threadids[worker-1] = Sys_ThreadId ();
+	for (;;)
+	{
+		while (jobs.generation == seen && !jobs.shutdown)
+			Sys_WaitCond (jobs.wake, jobs.lock);
+		if (jobs.shutdown)
+			break;
+		seen = jobs.generation;
+		if (worker > jobs.active)
+			continue;		// not needed for this batch
+
+		Sys_UnlockMutex (jobs.lock);
+		Com_RunJobs (worker);
+		Sys_LockMutex (jobs.lock);
+
+		if (--jobs.pending == 0)
+			Sys_BroadcastCond (jobs.done);
+	}
+	Sys_UnlockMutex (jobs.lock);
+}
+
+/*
+=================
+Com_ParallelFor
+=================
+*/
+void Com_ParallelFor (int numworkers, int count, jobfunc_t func, void *data)
+{
+	int i;
+
+	if (numworkers > MAX_JOB_WORKERS)
+		numworkers = MAX_JOB_WORKERS;
+
+	if (!jobs.lock && numworkers > 0 && count > 1)
+	{
+		jobs.lock = Sys_CreateMutex ();
+		jobs.wake = Sys_CreateCond ();
+		jobs.done = Sys_CreateCond ();
+	}
+
+	// start any helpers we don't have yet
+	while (jobs.lock && jobs.numthreads < numworkers)
+	{
+		jobs.threads[jobs.numthreads] = Sys_CreateThread (Com_JobThread,
+			(void *)(size_t)(jobs.numthreads+1));
+		if (!jobs.threads[jobs.numthreads])
+		{
+			Com_DPrintf ("Com_ParallelFor: couldn't start worker %i\n", jobs.numthreads+1);
+			break;
+		}
+		jobs.numthreads++;
+	}
+	if (numworkers > jobs.numthreads)
+		numworkers = jobs.numthreads;
+	if (numworkers >= count)
+		numworkers = count - 1;
+
+	if (numworkers <= 0)
+	{
+		for (i = 0; i < count; i++)
+			func (data, i, 0);
+		return;
+	}
+
+	Sys_LockMutex (jobs.lock);
+	jobs.func = func;
+	jobs.data = data;
+	jobs.count = count;
+	jobs.next = 0;
+	jobs.active = numworkers;
+	jobs.pending = numworkers;
+	jobs.generation++;
+	Sys_BroadcastCond (jobs.wake);
+	Sys_UnlockMutex (jobs.lock);
+
+	Com_RunJobs (0);
+
+	Sys_LockMutex (jobs.lock);
+	while (jobs.pending)
+		Sys_WaitCond (jobs.done, jobs.lock);
+	jobs.func = NULL;
+	Sys_UnlockMutex (jobs.lock);
+
+	if (jobs.print[0])
+	{
+		Com_Printf ("%s", jobs.print);
+		jobs.print[0] = 0;
+	}
+}
+
+static void Com_ShutdownJobs (void)
+{
+	int i;
+
+	if (!jobs.lock)
+		return;
+
+	Sys_LockMutex (jobs.lock);
+	jobs.shutdown = true;
+	Sys_BroadcastCond (jobs.wake);
+	Sys_UnlockMutex (jobs.lock);
+
+	for (i = 0; i < jobs.numthreads; i++)
+		Sys_JoinThread (jobs.threads[i]);
+
+	Sys_DestroyCond (jobs.wake);
+	Sys_DestroyCond (jobs.done);
+	Sys_DestroyMutex (jobs.lock);
+	memset (&jobs, 0, sizeof(jobs));
+}
+
+//========================================================
+
 void Key_Init (void);
 void SCR_EndLoadingPlaque (void);
 
@@ -1553,8 +3208,6 @@ void Qcommon_Init (int argc, char **argv)
 	if (setjmp (abortframe) )
 		Sys_Error ("Error during initialization");
 
-	z_chain.next = z_chain.prev = &z_chain;
-
 	// prepare enough of the subsystems to handle
 	// cvar and command buffer management
 	COM_InitArgv (argc, argv);
@@ -1587,6 +3240,9 @@ void Qcommon_Init (int argc, char **argv)
 	// init commands and vars
 	//
     Cmd_AddCommand ("z_stats", Z_Stats_f);
+    Cmd_AddCommand ("visbench", CM_VisBench_f);
+    Cmd_AddCommand ("tracestress", CM_TraceStress_f);
+    Cmd_AddCommand ("tracebench", CM_TraceBench_f);
     Cmd_AddCommand ("error", Com_Error_f);
 
 	host_speeds = Cvar_Get ("host_speeds", "0", 0);
@@ -1790,6 +3446,7 @@ Qcommon_Shutdown
 */
 void Qcommon_Shutdown (void)
 {
+	Com_ShutdownJobs ();
 }
 
 
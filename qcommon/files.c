@@ -350,6 +350,9 @@ static void FS_init_paths( void )
 	//  this is the first directory in the search path
 	Q_strncpyz2( fs_gamedir, fs_gamesearch[0], sizeof(fs_gamedir) );
 
+	// search paths changed, rescan them all
+	FS_InvalidateIndex( NULL );
+
 }
 
 /*
@@ -412,6 +415,8 @@ void FS_CreatePath (char *path)
 		}
 	}
 
+	// callers create the file next; covers FS_FullWritePath too
+	FS_InvalidateIndex (path);
 }
 
 
@@ -449,6 +454,253 @@ static qboolean FS_CheckFile( const char * search_path )
 #endif	// HAVE_STAT
 
 
+/*
+===
+Directory index
+
+Each search path is scanned once into a hash of the relative names under it,
+so FS_FullPath and FS_ListFilesInFS answer from memory instead of stat()ing
+the name in every search path (twice when the lowercase retry kicks in).
+A search path is rescanned on next use after FS_InvalidateIndex reports a
+write under it.
+===
+*/
+#define FS_INDEX_HASH		4096		// chains per search path
+#define FS_INDEX_UNUSABLE	-2			// caller should search the disk
+
+#if defined WIN32_VARIANT
+#define FS_INDEX_NOCASE		true		// the filesystem ignores case
+#else
+#define FS_INDEX_NOCASE		false
+#endif
+
+typedef struct
+{
+	int			name;		// offset into names
+	unsigned	hash;		// of the lowercased name
+	qboolean	isdir;
+	int			next;		// hash chain, -1 ends it
+} fs_indexentry_t;
+
+typedef struct
+{
+	qboolean		valid;
+	fs_indexentry_t	*entries;
+	int				numentries, maxentries;
+	char			*names;
+	int				namesize, maxnamesize;
+	int				chains[FS_INDEX_HASH];
+} fs_index_t;
+
+typedef struct
+{
+	fs_index_t	*index;
+	char		path[MAX_OSPATH];	// directory being scanned
+	int			rootlen;			// length of the search path prefix
+} fs_indexscan_t;
+
+static fs_index_t	fs_index[GAME_SEARCH_SLOTS];
+static cvar_t		*fs_useindex;
+static void			*fs_indexmutex;
+
+static unsigned FS_IndexHash (const char *name)
+{
+	unsigned hash = 2166136261u;
+
+	while (*name)
+	{
+		hash ^= (unsigned char)tolower (*name++);
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+static void FS_IndexAdd (fs_index_t *index, const char *name, qboolean isdir)
+{
+	fs_indexentry_t	*e;
+	int				len, chain;
+
+	len = strlen (name) + 1;
+
+	if (index->numentries == index->maxentries)
+	{
+		index->maxentries = index->maxentries ? index->maxentries * 2 : 1024;
+		index->entries = realloc (index->entries, index->maxentries * sizeof(*e));
+		if (index->entries == NULL)
+			Sys_Error ("FS_IndexAdd: out of memory");
+	}
+	if (index->namesize + len > index->maxnamesize)
+	{
+		if (!index->maxnamesize)
+			index->maxnamesize = 0x8000;
+		while (index->namesize + len > index->maxnamesize)
+			index->maxnamesize *= 2;
+		index->names = realloc (index->names, index->maxnamesize);
+		if (index->names == NULL)
+			Sys_Error ("FS_IndexAdd: out of memory");
+	}
+
+	memcpy (index->names + index->namesize, name, len);
+
+	e = &index->entries[index->numentries];
+	e->name = index->namesize;
+	e->hash = FS_IndexHash (name);
+	e->isdir = isdir;
+	chain = e->hash & (FS_INDEX_HASH-1);
+	e->next = index->chains[chain];
+	index->chains[chain] = index->numentries++;
+
+	index->namesize += len;
+}
+
+static void FS_IndexScanEntry (void *arg, const char *name, qboolean isdir)
+{
+	fs_indexscan_t	*scan = (fs_indexscan_t *)arg;
+	char			*relative;
+	int				len;
+
+	len = strlen (scan->path);
+	if (len + 1 + strlen (name) >= sizeof(scan->path))
+		return;
+	scan->path[len] = '/';
+	strcpy (scan->path + len + 1, name);
+
+	// FS_FullPath rejects anything longer, so don't bother keeping it
+	relative = scan->path + scan->rootlen + 1;
+	if (strlen (relative) < MAX_QPATH)
+	{
+		FS_IndexAdd (scan->index, relative, isdir);
+		if (isdir)
+			Sys_ScanDir (scan->path, FS_IndexScanEntry, scan);
+	}
+
+	scan->path[len] = 0;
+}
+
+static void FS_BuildIndex (int slot)
+{
+	fs_index_t		*index = &fs_index[slot];
+	fs_indexscan_t	scan;
+
+	index->numentries = 0;
+	index->namesize = 0;
+	memset (index->chains, -1, sizeof(index->chains));
+
+	scan.index = index;
+	Q_strncpyz2 (scan.path, fs_gamesearch[slot], sizeof(scan.path));
+	scan.rootlen = strlen (scan.path);
+	Sys_ScanDir (scan.path, FS_IndexScanEntry, &scan);
+
+	index->valid = true;
+}
+
+/*
+===
+FS_IndexUsable
+
+The index only holds clean relative names; anything else goes to the disk.
+Called with fs_indexmutex held.
+===
+*/
+static qboolean FS_IndexUsable (const char *relative_path)
+{
+	int slot;
+
+	if (fs_useindex == NULL || !fs_useindex->integer)
+		return false;
+
+	if (!relative_path[0] || relative_path[0] == '/' || relative_path[0] == '.'
+			|| strstr (relative_path, "..") || strstr (relative_path, "//")
+			|| strchr (relative_path, '\\') || strchr (relative_path, ':'))
+		return false;
+
+	for (slot = 0; fs_gamesearch[slot][0]; slot++)
+	{
+		if (!fs_index[slot].valid)
+			FS_BuildIndex (slot);
+	}
+	return true;
+}
+
+/*
+===
+FS_IndexFind
+
+Returns the first search slot holding the file relative_path and copies its
+name as spelled on disk into realname, or -1 if no search path has it.
+Returns FS_INDEX_UNUSABLE if the index can't answer.
+===
+*/
+static int FS_IndexFind (const char *relative_path, qboolean nocase, char *realname, size_t realsize)
+{
+	fs_index_t		*index;
+	fs_indexentry_t	*e;
+	unsigned		hash;
+	int				slot, i;
+
+	if (fs_indexmutex)
+		Sys_LockMutex (fs_indexmutex);
+
+	if (!FS_IndexUsable (relative_path))
+	{
+		if (fs_indexmutex)
+			Sys_UnlockMutex (fs_indexmutex);
+		return FS_INDEX_UNUSABLE;
+	}
+
+	hash = FS_IndexHash (relative_path);
+	for (slot = 0; fs_gamesearch[slot][0]; slot++)
+	{
+		index = &fs_index[slot];
+		for (i = index->chains[hash & (FS_INDEX_HASH-1)]; i != -1; i = e->next)
+		{
+			e = &index->entries[i];
+			if (e->hash != hash || e->isdir)
+				continue;
+			if (nocase ? Q_strcasecmp (index->names + e->name, relative_path)
+					: strcmp (index->names + e->name, relative_path))
+				continue;
+			Q_strncpyz2 (realname, index->names + e->name, realsize);
+			if (fs_indexmutex)
+				Sys_UnlockMutex (fs_indexmutex);
+			return slot;
+		}
+	}
+
+	if (fs_indexmutex)
+		Sys_UnlockMutex (fs_indexmutex);
+	return -1;
+}
+
+/*
+===
+FS_InvalidateIndex
+
+Given the full path of a file or directory that was just written, forget
+what we know about the search path holding it. NULL forgets everything.
+===
+*/
+void FS_InvalidateIndex (const char *full_path)
+{
+	int slot;
+	size_t len;
+
+	if (fs_indexmutex)
+		Sys_LockMutex (fs_indexmutex);
+
+	for (slot = 0; slot < GAME_SEARCH_SLOTS; slot++)
+	{
+		len = strlen (fs_gamesearch[slot]);
+		if (full_path == NULL || (len && !strncmp (full_path, fs_gamesearch[slot], len)
+				&& (full_path[len] == '/' || full_path[len] == 0)))
+			fs_index[slot].valid = false;
+	}
+
+	if (fs_indexmutex)
+		Sys_UnlockMutex (fs_indexmutex);
+}
+
+
 /*
 ===
 FS_FullPath
@@ -463,8 +715,10 @@ Given a relative path to a file
 qboolean FS_FullPath( char *full_path, size_t pathsize, const char *relative_path )
 {
 	char search_path[MAX_OSPATH];
+	char real_path[MAX_QPATH];
 	char * to_search;
 	qboolean found = false;
+	int slot;
 
 	*full_path = 0;
 
@@ -473,14 +727,26 @@ qboolean FS_FullPath( char *full_path, size_t pathsize, const char *relative_pat
 		Com_DPrintf("FS_FullPath: relative path size error: %s\n", relative_path );
 		return false;
 	}
-	to_search = &fs_gamesearch[0][0];
 
-	while ( to_search[0] && !found )
+	slot = FS_IndexFind( relative_path, FS_INDEX_NOCASE, real_path, sizeof(real_path) );
+	if ( slot != FS_INDEX_UNUSABLE )
+	{
+		found = ( slot >= 0 );
+		if ( found )
+			Com_sprintf( search_path, sizeof(search_path), "%s/%s",
+						fs_gamesearch[slot], real_path);
+	}
+	else
 	{
-		Com_sprintf( search_path, sizeof(search_path), "%s/%s",
-					to_search, relative_path);
-		found = FS_CheckFile( search_path );
-		to_search += MAX_OSPATH;
+		to_search = &fs_gamesearch[0][0];
+
+		while ( to_search[0] && !found )
+		{
+			Com_sprintf( search_path, sizeof(search_path), "%s/%s",
+						to_search, relative_path);
+			found = FS_CheckFile( search_path );
+			to_search += MAX_OSPATH;
+		}
 	}
 
 	if ( found )
@@ -730,6 +996,36 @@ static const char *FS_TolowerPath (const char *path)
 	return buf;
 }
 
+/*
+==================
+FS_FOpenFileLower
+
+FS_FOpenFile, retrying with a lowercased path if the file isn't found.
+==================
+*/
+static int FS_FOpenFileLower (const char *path, FILE **file)
+{
+	int		len, slot;
+	char	lc_path[MAX_OSPATH];
+
+	len = FS_FOpenFile (path, file);
+
+	//-JR
+	if (!*file)
+	{
+		// the index matches any case, not just all lowercase
+		slot = FS_IndexFind( path, true, lc_path, sizeof(lc_path) );
+		if ( slot == FS_INDEX_UNUSABLE )
+			Q_strncpyz2( lc_path, FS_TolowerPath( path ), sizeof(lc_path) );
+		if ( slot != -1 && strcmp( path, lc_path ) )
+		{ // case conversion changed something
+			len = FS_FOpenFile( lc_path, file);
+		}
+	}
+
+	return len;
+}
+
 /*
 ============
 FS_LoadFile
@@ -747,19 +1043,8 @@ int FS_LoadFile (const char *path, void **buffer)
 	FILE	*h;
 	byte	*buf = NULL;
 	int		len;
-	char lc_path[MAX_OSPATH];
 
-	len = FS_FOpenFile (path, &h);
-
-	//-JR
-	if (!h)
-	{
-		Q_strncpyz2( lc_path, FS_TolowerPath( path ), sizeof(lc_path) );
-		if ( strcmp( path, lc_path ) )
-		{ // lowercase conversion changed something
-			len = FS_FOpenFile( lc_path, &h);
-		}
-	}
+	len = FS_FOpenFileLower (path, &h);
 
 	if (!h)
 	{
@@ -809,19 +1094,8 @@ int FS_LoadFile_TryStatic (const char *path, void **buffer, void *statbuffer, si
 	FILE	*h;
 	byte	*buf = NULL;
 	int		len;
-	char lc_path[MAX_OSPATH];
 
-	len = FS_FOpenFile (path, &h);
-
-	//-JR
-	if (!h)
-	{
-		Q_strncpyz2( lc_path, FS_TolowerPath( path ), sizeof(lc_path) );
-		if ( strcmp( path, lc_path ) )
-		{ // lowercase conversion changed something
-			len = FS_FOpenFile( lc_path, &h);
-		}
-	}
+	len = FS_FOpenFileLower (path, &h);
 
 	if (!h)
 	{
@@ -865,6 +1139,115 @@ void FS_FreeFile (void *buffer)
 	Z_Free (buffer);
 }
 
+/*
+============
+FS_MapFile
+
+Given relative path, map the file copy-on-write and return its length.
+Large binary loads (maps, models, textures) then page in straight from the
+OS cache instead of being copied through a zone buffer. The buffer is not
+nul-terminated. If the platform can't map the file, or the mapping table is
+full, this quietly degrades to FS_LoadFile. Release with FS_UnmapFile.
+============
+*/
+#define MAX_MAPPED_FILES	256	// downloads hold theirs for a while
+
+typedef struct
+{
+	void	*base;
+	int		length;
+} fs_mapping_t;
+
+static fs_mapping_t	fs_mappings[MAX_MAPPED_FILES];
+static void			*fs_mapmutex;
+
+int FS_MapFile (const char *path, void **buffer)
+{
+	FILE	*h;
+	void	*base;
+	int		len, i;
+
+	if (!buffer)
+		return FS_LoadFile (path, NULL);
+
+	len = FS_FOpenFileLower (path, &h);
+	if (!h)
+	{
+		*buffer = NULL;
+		return -1;
+	}
+
+	base = Sys_MapFile (h, len);
+	if (base != NULL)
+	{
+		// callers may be on worker threads
+		if (fs_mapmutex)
+			Sys_LockMutex (fs_mapmutex);
+		for (i = 0; i < MAX_MAPPED_FILES; i++)
+		{
+			if (fs_mappings[i].base == NULL)
+			{
+				fs_mappings[i].base = base;
+				fs_mappings[i].length = len;
+				break;
+			}
+		}
+		if (fs_mapmutex)
+			Sys_UnlockMutex (fs_mapmutex);
+
+		if (i == MAX_MAPPED_FILES)
+		{
+			Sys_UnmapFile (base, len);
+			base = NULL;
+		}
+	}
+
+	if (base == NULL)
+	{
+		base = Z_Malloc (len + 1);
+		((byte *)base)[len] = 0;
+		FS_Read (base, len, h);
+	}
+
+	FS_FCloseFile (h);
+
+	*buffer = base;
+	return len;
+}
+
+/*
+=============
+FS_UnmapFile
+=============
+*/
+void FS_UnmapFile (void *buffer)
+{
+	int		i, len = 0;
+
+	if (buffer == NULL)
+		return;
+
+	if (fs_mapmutex)
+		Sys_LockMutex (fs_mapmutex);
+	for (i = 0; i < MAX_MAPPED_FILES; i++)
+	{
+		if (fs_mappings[i].base == buffer)
+		{
+			len = fs_mappings[i].length;
+			fs_mappings[i].base = NULL;
+			fs_mappings[i].length = 0;
+			break;
+		}
+	}
+	if (fs_mapmutex)
+		Sys_UnlockMutex (fs_mapmutex);
+
+	if (i == MAX_MAPPED_FILES)
+		Z_Free (buffer);	// FS_MapFile fell back to a zone copy
+	else
+		Sys_UnmapFile (buffer, len);
+}
+
 /*
 =========
 FS_FileExists
@@ -1031,6 +1414,85 @@ void FS_FreeFileList (char **list, int n) // jit
 }
 
 
+/*
+ * FS_IndexListFiles
+ *
+ * Appends the relative names in the index matching findname to list, the
+ * way FS_ListFilesInFS would find them on disk. Returns the new count, or
+ * FS_INDEX_UNUSABLE if the pattern has to be expanded by the system.
+ */
+static int FS_IndexListFiles (char *findname, char ***list, int nfiles,
+		unsigned musthave, unsigned canthave)
+{
+	char		dir[MAX_QPATH];
+	char		pattern[MAX_QPATH];
+	char		*name, *base, *p, **new_list;
+	fs_index_t	*index;
+	int			slot, i, dirlen;
+
+	p = strrchr (findname, '/');
+	if (p == NULL || p - findname >= sizeof(dir))
+		return FS_INDEX_UNUSABLE;
+	dirlen = p - findname;
+	memcpy (dir, findname, dirlen);
+	dir[dirlen] = 0;
+	Q_strncpyz2 (pattern, p + 1, sizeof(pattern));
+	if (!strcmp (pattern, "*.*"))
+		strcpy (pattern, "*");
+	if (strpbrk (dir, "*?["))
+		return FS_INDEX_UNUSABLE;
+
+	if (fs_indexmutex)
+		Sys_LockMutex (fs_indexmutex);
+
+	if (!FS_IndexUsable (dir))
+	{
+		if (fs_indexmutex)
+			Sys_UnlockMutex (fs_indexmutex);
+		return FS_INDEX_UNUSABLE;
+	}
+
+	for (slot = 0; fs_gamesearch[slot][0]; slot++)
+	{
+		index = &fs_index[slot];
+		for (i = 0; i < index->numentries; i++)
+		{
+			if ((musthave & SFF_SUBDIR) && !index->entries[i].isdir)
+				continue;
+			if ((canthave & SFF_SUBDIR) && index->entries[i].isdir)
+				continue;
+
+			name = index->names + index->entries[i].name;
+			base = strrchr (name, '/');
+			if (base == NULL || base - name != dirlen)
+				continue;
+			if (FS_INDEX_NOCASE ? Q_strncasecmp (name, dir, dirlen)
+					: strncmp (name, dir, dirlen))
+				continue;
+			if (!glob_match (pattern, base + 1))
+				continue;
+
+			new_list = realloc (*list, (nfiles + 1) * sizeof(char *));
+			if (new_list == NULL)
+			{
+				Com_Printf ("WARN: SYSTEM MEMORY EXHAUSTION!\n");
+				break;
+			}
+			*list = new_list;
+			(*list)[nfiles] = strdup (name);
+#if defined WIN32_VARIANT
+			_strlwr ((*list)[nfiles]);
+#endif
+			nfiles++;
+		}
+	}
+
+	if (fs_indexmutex)
+		Sys_UnlockMutex (fs_indexmutex);
+
+	return nfiles;
+}
+
 /*
  * FS_ListFilesInFS
  *
@@ -1054,25 +1516,30 @@ FS_ListFilesInFS(char *findname, int *numfiles, unsigned musthave, unsigned cant
 	nfiles = 0;
 	list = malloc(sizeof(char *));
 
-	for ( s = 0 ; fs_gamesearch[s][0]; s++ )
-	{ // for non-empty search slots
-		Com_sprintf(path, sizeof(path), "%s/%s",fs_gamesearch[s], findname);
-		tmplist = FS_ListFiles(path, &tmpnfiles, musthave, canthave);
-		if (tmplist != NULL)
-		{
-			nfiles += tmpnfiles;
-			new_list = realloc(list, nfiles * sizeof(char *));
-			if (new_list == NULL) {
-				FS_FreeFileList (tmplist, tmpnfiles);
-				Com_Printf ("WARN: SYSTEM MEMORY EXHAUSTION!\n");
-				break;
-			}
-			list = new_list;
-			for (i = 0, j = nfiles - tmpnfiles; i < tmpnfiles; i++, j++)
-			{ // copy from full path to relative path
-				list[j] = strdup( tmplist[i] + strlen( fs_gamesearch[s] ) + 1  );
+	nfiles = FS_IndexListFiles( findname, &list, 0, musthave, canthave );
+	if ( nfiles == FS_INDEX_UNUSABLE )
+	{
+		nfiles = 0;
+		for ( s = 0 ; fs_gamesearch[s][0]; s++ )
+		{ // for non-empty search slots
+			Com_sprintf(path, sizeof(path), "%s/%s",fs_gamesearch[s], findname);
+			tmplist = FS_ListFiles(path, &tmpnfiles, musthave, canthave);
+			if (tmplist != NULL)
+			{
+				nfiles += tmpnfiles;
+				new_list = realloc(list, nfiles * sizeof(char *));
+				if (new_list == NULL) {
+					FS_FreeFileList (tmplist, tmpnfiles);
+					Com_Printf ("WARN: SYSTEM MEMORY EXHAUSTION!\n");
+					break;
+				}
+				list = new_list;
+				for (i = 0, j = nfiles - tmpnfiles; i < tmpnfiles; i++, j++)
+				{ // copy from full path to relative path
+					list[j] = strdup( tmplist[i] + strlen( fs_gamesearch[s] ) + 1  );
+				}
+				FS_FreeFileList(tmplist, tmpnfiles);
 			}
-			FS_FreeFileList(tmplist, tmpnfiles);
 		}
 	}
 
@@ -1201,11 +1668,113 @@ static void FS_Path_f (void)
 	Com_Printf ("Game data search path:\n");
 	for ( i = 0; fs_gamesearch[i][0] ; i++ )
 	{
-		Com_Printf( "%s/\n", fs_gamesearch[i] );
+		if ( fs_index[i].valid )
+			Com_Printf( "%s/ (%i indexed)\n", fs_gamesearch[i], fs_index[i].numentries );
+		else
+			Com_Printf( "%s/\n", fs_gamesearch[i] );
 	}
 
 }
 
+/*
+============
+FS_LoadBench_f
+
+ target of "loadbench <file> [count]"
+ Times FS_LoadFile against FS_MapFile (touching every page), with the
+ file evicted from the OS cache before each pass and then with it warm.
+============
+*/
+static int FS_TouchPages (const byte *buf, int len)
+{
+	int		i, sum = 0;
+
+	for (i = 0; i < len; i += 4096)
+		sum += buf[i];
+	if (len > 0)
+		sum += buf[len-1];
+	return sum;
+}
+
+static qboolean FS_DropCache (const char *path)
+{
+	FILE		*h;
+	qboolean	dropped;
+
+	FS_FOpenFileLower (path, &h);
+	if (!h)
+		return false;
+	dropped = Sys_DropFileCache (h);
+	FS_FCloseFile (h);
+	return dropped;
+}
+
+static void FS_LoadBench_f (void)
+{
+	char				*path;
+	void				*buf;
+	int					count, pass, i, len, sum = 0;
+	qboolean			cold, canDrop;
+	unsigned long long	start, usec[2][2];
+
+	if (Cmd_Argc() < 2)
+	{
+		Com_Printf ("usage: loadbench <file> [count]\n");
+		return;
+	}
+
+	path = Cmd_Argv (1);
+	count = Cmd_Argc() > 2 ? atoi (Cmd_Argv (2)) : 10;
+	if (count < 1)
+		count = 1;
+
+	len = FS_LoadFile (path, NULL);
+	if (len < 0)
+	{
+		Com_Printf ("loadbench: %s not found\n", path);
+		return;
+	}
+
+	canDrop = FS_DropCache (path);
+	if (!canDrop)
+		Com_Printf ("loadbench: can't evict the file from the OS cache, cold numbers are warm\n");
+
+	for (cold = 0; cold < 2; cold++)
+	{
+		for (pass = 0; pass < 2; pass++)
+		{
+			usec[cold][pass] = 0;
+			for (i = 0; i < count; i++)
+			{
+				if (cold)
+					FS_DropCache (path);
+
+				start = Sys_Microseconds ();
+				if (pass == 0)
+				{
+					FS_LoadFile (path, &buf);
+					sum += FS_TouchPages (buf, len);
+					FS_FreeFile (buf);
+				}
+				else
+				{
+					FS_MapFile (path, &buf);
+					sum += FS_TouchPages (buf, len);
+					FS_UnmapFile (buf);
+				}
+				usec[cold][pass] += Sys_Microseconds () - start;
+			}
+		}
+	}
+
+	Com_Printf ("%s: %i bytes, %i loads each (checksum %i)\n", path, len, count, sum);
+	Com_Printf ("       %10s %10s\n", "load", "map");
+	Com_Printf ("warm   %8.3fms %8.3fms\n",
+		usec[0][0] / (count * 1000.0), usec[0][1] / (count * 1000.0));
+	Com_Printf ("cold   %8.3fms %8.3fms\n",
+		usec[1][0] / (count * 1000.0), usec[1][1] / (count * 1000.0));
+}
+
 /*
 ================
 FS_NextPath
@@ -1256,6 +1825,15 @@ void FS_InitFilesystem (void)
 
 	Cmd_AddCommand ("path", FS_Path_f);
 	Cmd_AddCommand ("dir", FS_Dir_f );
+	Cmd_AddCommand ("loadbench", FS_LoadBench_f);
+
+	if (!fs_mapmutex)
+		fs_mapmutex = Sys_CreateMutex ();
+	if (!fs_indexmutex)
+		fs_indexmutex = Sys_CreateMutex ();
+
+	fs_useindex = Cvar_Get ("fs_index", "1", 0);
+	Cvar_Describe (fs_useindex, "Keep an in-memory index of the files in every search path, so looking files up doesn't touch the disk. Turn off when editing game data by hand while the game runs.");
 
 #if defined DEDICATED_ONLY
 	/* game from command line */
@@ -1277,6 +1855,21 @@ void FS_InitFilesystem (void)
 	fs_gamedirvar = Cvar_Get( "gamedir", "", 0 );
 	FS_init_paths();
 
+	// scan the search paths now rather than on the first lookup
+	if ( fs_useindex->integer )
+	{
+		unsigned long long start = Sys_Microseconds();
+		int i, count = 0;
+
+		for ( i = 0; fs_gamesearch[i][0]; i++ )
+		{
+			FS_BuildIndex( i );
+			count += fs_index[i].numentries;
+		}
+		Com_Printf( "Indexed %i files in %.1f ms\n", count,
+					(Sys_Microseconds() - start) / 1000.0 );
+	}
+
 #if defined HAVE_ZLIB && !defined DEDICATED_ONLY
 	Com_Printf("using zlib version %s\n", zlibVersion() );
 #endif
@@ -86,6 +86,208 @@ netadr_t	net_from;
 sizebuf_t	net_message;
 byte		net_message_buffer[MAX_MSGLEN];
 
+/*
+==============================================================================
+
+PAYLOAD CODING
+
+On a PROTOCOL_PACKED channel the server sends the payload after the header
+through an adaptive binary range coder, one bit tree over the byte values.
+Every packet starts from even odds, so a lost or reordered packet can never
+put the decoder out of step. The payload is prefixed with a byte saying
+whether it was coded, and it goes raw when coding wouldn't save anything.
+
+==============================================================================
+*/
+
+#define	PAYLOAD_RAW		0
+#define	PAYLOAD_CODED	1		// followed by the decoded length as a short
+
+#define	RC_TOP			(1u<<24)
+#define	RC_PROBBITS		11
+#define	RC_MOVEBITS		4		// adapt quickly, packets are short
+
+typedef struct
+{
+	byte				*out, *outend;
+	unsigned long long	low;
+	unsigned			range;
+	byte				cache;
+	int					cachesize;
+	qboolean			overflowed;
+} rcencoder_t;
+
+typedef struct
+{
+	byte		*in, *inend;
+	unsigned	range, code;
+	int			overrun;		// bytes read past the end
+} rcdecoder_t;
+
+static void RC_InitProbs (unsigned short *probs)
+{
+	int		i;
+
+	for (i = 0; i < 256; i++)
+		probs[i] = 1 << (RC_PROBBITS - 1);
+}
+
+static void RC_ShiftLow (rcencoder_t *rc)
+{
+	byte	temp;
+
+	if ((unsigned)rc->low < 0xFF000000u || (rc->low >> 32))
+	{
+		temp = rc->cache;
+		do
+		{
+			if (rc->out < rc->outend)
+				*rc->out++ = (byte)(temp + (byte)(rc->low >> 32));
+			else
+				rc->overflowed = true;
+			temp = 0xFF;
+		} while (--rc->cachesize);
+		rc->cache = (byte)(rc->low >> 24);
+	}
+	rc->cachesize++;
+	rc->low = (rc->low & 0x00FFFFFF) << 8;
+}
+
+static void RC_EncodeBit (rcencoder_t *rc, unsigned short *prob, int bit)
+{
+	unsigned	bound;
+
+	bound = (rc->range >> RC_PROBBITS) * *prob;
+	if (!bit)
+	{
+		rc->range = bound;
+		*prob += ((1 << RC_PROBBITS) - *prob) >> RC_MOVEBITS;
+	}
+	else
+	{
+		rc->low += bound;
+		rc->range -= bound;
+		*prob -= *prob >> RC_MOVEBITS;
+	}
+	while (rc->range < RC_TOP)
+	{
+		rc->range <<= 8;
+		RC_ShiftLow (rc);
+	}
+}
+
+static int RC_NextByte (rcdecoder_t *rc)
+{
+	if (rc->in < rc->inend)
+		return *rc->in++;
+	rc->overrun++;
+	return 0;
+}
+
+static int RC_DecodeBit (rcdecoder_t *rc, unsigned short *prob)
+{
+	unsigned	bound;
+	int			bit;
+
+	bound = (rc->range >> RC_PROBBITS) * *prob;
+	if (rc->code < bound)
+	{
+		rc->range = bound;
+		*prob += ((1 << RC_PROBBITS) - *prob) >> RC_MOVEBITS;
+		bit = 0;
+	}
+	else
+	{
+		rc->code -= bound;
+		rc->range -= bound;
+		*prob -= *prob >> RC_MOVEBITS;
+		bit = 1;
+	}
+	while (rc->range < RC_TOP)
+	{
+		rc->range <<= 8;
+		rc->code = (rc->code << 8) | RC_NextByte (rc);
+	}
+	return bit;
+}
+
+/*
+===============
+Netchan_EncodePayload
+
+Range codes length bytes of data into out. Returns the coded size, or -1
+if it didn't fit in maxsize.
+===============
+*/
+int Netchan_EncodePayload (byte *data, int length, byte *out, int maxsize)
+{
+	rcencoder_t		rc;
+	unsigned short	probs[256];
+	int				i, bit, node;
+
+	RC_InitProbs (probs);
+	rc.out = out;
+	rc.outend = out + maxsize;
+	rc.low = 0;
+	rc.range = 0xFFFFFFFF;
+	rc.cache = 0;
+	rc.cachesize = 1;
+	rc.overflowed = false;
+
+	for (i = 0; i < length; i++)
+	{
+		node = 1;
+		for (bit = 7; bit >= 0; bit--)
+		{
+			RC_EncodeBit (&rc, &probs[node], (data[i] >> bit) & 1);
+			node = (node << 1) | ((data[i] >> bit) & 1);
+		}
+		if (rc.overflowed)
+			return -1;
+	}
+
+	for (i = 0; i < 5; i++)
+		RC_ShiftLow (&rc);
+	if (rc.overflowed)
+		return -1;
+
+	return rc.out - out;
+}
+
+/*
+===============
+Netchan_DecodePayload
+
+Decodes exactly outlength bytes. Returns false if the coded data ran out
+first, which only happens to a damaged or forged packet.
+===============
+*/
+qboolean Netchan_DecodePayload (byte *data, int length, byte *out, int outlength)
+{
+	rcdecoder_t		rc;
+	unsigned short	probs[256];
+	int				i, bit, node;
+
+	RC_InitProbs (probs);
+	rc.in = data;
+	rc.inend = data + length;
+	rc.range = 0xFFFFFFFF;
+	rc.code = 0;
+	rc.overrun = 0;
+	for (i = 0; i < 5; i++)
+		rc.code = (rc.code << 8) | RC_NextByte (&rc);
+
+	for (i = 0; i < outlength; i++)
+	{
+		node = 1;
+		for (bit = 0; bit < 8; bit++)
+			node = (node << 1) | RC_DecodeBit (&rc, &probs[node]);
+		out[i] = node & 255;
+	}
+
+	return !rc.overrun;
+}
+
 /*
 ===============
 Netchan_Init
@@ -220,8 +422,10 @@ void Netchan_Transmit (netchan_t *chan, int length, byte *data)
 {
 	sizebuf_t	send;
 	byte		send_buf[MAX_MSGLEN];
+	byte		coded_buf[MAX_MSGLEN];
 	qboolean	send_reliable;
 	unsigned	w1, w2;
+	int			header, coded;
 
 // check for message overflow
 	if (chan->message.overflowed)
@@ -244,7 +448,8 @@ void Netchan_Transmit (netchan_t *chan, int length, byte *data)
 
 
 // write the packet header
-	SZ_Init (&send, send_buf, sizeof(send_buf));
+	// a coded payload needs room for its prefix
+	SZ_Init (&send, send_buf, sizeof(send_buf) - (chan->packed ? 3 : 0));
 	SZ_SetName (&send, va("Transmit buffer (%s)", NET_AdrToString(chan->remote_address)), false);
 
 	w1 = ( chan->outgoing_sequence & ~(1<<31) ) | (send_reliable<<31);
@@ -273,6 +478,30 @@ void Netchan_Transmit (netchan_t *chan, int length, byte *data)
 	else
 		Com_Printf ("Netchan_Transmit: dumped unreliable\n");
 
+// code the payload
+	header = chan->sock == NS_CLIENT ? 10 : 8;
+	if (chan->packed && chan->sock == NS_SERVER && send.cursize > header)
+	{
+		memcpy (coded_buf, send_buf, header);
+		coded = Netchan_EncodePayload (send_buf + header, send.cursize - header,
+			coded_buf + header + 3, send.cursize - header - 3);
+		if (coded > 0)
+		{
+			coded_buf[header] = PAYLOAD_CODED;
+			coded_buf[header+1] = (send.cursize - header) & 255;
+			coded_buf[header+2] = (send.cursize - header) >> 8;
+			send.data = coded_buf;
+			send.cursize = header + 3 + coded;
+		}
+		else
+		{
+			memmove (send_buf + header + 1, send_buf + header, send.cursize - header);
+			send_buf[header] = PAYLOAD_RAW;
+			send.cursize++;
+		}
+	}
+	chan->last_sentsize = send.cursize;
+
 // send the datagram
 	NET_SendPacket (chan->sock, send.cursize, send.data, chan->remote_address);
 
@@ -307,6 +536,8 @@ qboolean Netchan_Process (netchan_t *chan, sizebuf_t *msg)
 	unsigned	sequence, sequence_ack;
 	unsigned	reliable_ack, reliable_message;
 	int			qport;
+	int			length;
+	byte		decoded[MAX_MSGLEN];
 
 // get sequence numbers
 	MSG_BeginReading (msg);
@@ -353,6 +584,28 @@ qboolean Netchan_Process (netchan_t *chan, sizebuf_t *msg)
 		return false;
 	}
 
+//
+// undo the payload coding
+//
+	if (chan->packed && chan->sock == NS_CLIENT && msg->readcount < msg->cursize)
+	{
+		if (MSG_ReadByte (msg) == PAYLOAD_CODED)
+		{
+			length = MSG_ReadShort (msg) & 0xffff;
+			if (msg->readcount > msg->cursize || length > msg->maxsize - msg->readcount
+				|| !Netchan_DecodePayload (msg->data + msg->readcount, msg->cursize - msg->readcount, decoded, length))
+			{
+				if (showdrop->value)
+					Com_Printf ("%s:Bad coded packet %i\n"
+						, NET_AdrToString (chan->remote_address)
+						, sequence);
+				return false;
+			}
+			memcpy (msg->data + msg->readcount, decoded, length);
+			msg->cursize = msg->readcount + length;
+		}
+	}
+
 //
 // dropped packets don't keep the message from being used
 //
@@ -140,6 +140,7 @@ void MSG_WriteAngle (sizebuf_t *sb, float f);
 void MSG_WriteAngle16 (sizebuf_t *sb, float f);
 void MSG_WriteDeltaUsercmd (sizebuf_t *sb, struct usercmd_s *from, struct usercmd_s *cmd);
 void MSG_WriteDeltaEntity (struct entity_state_s *from, struct entity_state_s *to, sizebuf_t *msg, qboolean force, qboolean newentity);
+void MSG_WriteDeltaPlayerstate (player_state_t *from, player_state_t *to, sizebuf_t *msg);
 void MSG_WriteDir (sizebuf_t *sb, vec3_t vector);
 
 
@@ -159,11 +160,47 @@ void	MSG_ReadPos (sizebuf_t *sb, vec3_t pos);
 float	MSG_ReadAngle (sizebuf_t *sb);
 float	MSG_ReadAngle16 (sizebuf_t *sb);
 void	MSG_ReadDeltaUsercmd (sizebuf_t *sb, struct usercmd_s *from, struct usercmd_s *cmd);
+int		MSG_ReadEntityBits (sizebuf_t *sb, unsigned *bits);
+void	MSG_ReadDeltaEntity (sizebuf_t *sb, struct entity_state_s *from, struct entity_state_s *to, int number, int bits);
+void	MSG_ReadDeltaPlayerstate (sizebuf_t *sb, player_state_t *state);
 
 void	MSG_ReadDir (sizebuf_t *sb, vec3_t vector);
 
 void	MSG_ReadData (sizebuf_t *sb, void *buffer, int size);
 
+// bit streams inside a message, for PROTOCOL_PACKED frames
+typedef struct
+{
+	sizebuf_t			*msg;
+	unsigned long long	bits;		// pending bits, the oldest lowest
+	int					numbits;
+} bitmsg_t;
+
+void		MSG_BeginWritingBits (bitmsg_t *bm, sizebuf_t *msg);
+void		MSG_WriteBits (bitmsg_t *bm, unsigned value, int numbits);
+void		MSG_EndWritingBits (bitmsg_t *bm);
+void		MSG_BeginReadingBits (bitmsg_t *bm, sizebuf_t *msg);
+unsigned	MSG_ReadBits (bitmsg_t *bm, int numbits);
+
+qboolean	MSG_WritePackedEntity (bitmsg_t *bm, struct entity_state_s *from, struct entity_state_s *to, int lastnum, qboolean force, qboolean newentity);
+void		MSG_WritePackedRemove (bitmsg_t *bm, int number, int lastnum);
+void		MSG_WritePackedEnd (bitmsg_t *bm);
+int			MSG_ReadPackedEntityBits (bitmsg_t *bm, unsigned *bits, int lastnum);
+void		MSG_ReadPackedEntity (bitmsg_t *bm, struct entity_state_s *from, struct entity_state_s *to, int number, int bits);
+void		MSG_WritePackedPlayerstate (bitmsg_t *bm, player_state_t *from, player_state_t *to);
+void		MSG_ReadPackedPlayerstate (bitmsg_t *bm, player_state_t *state);
+
+// a frame's entities, a window into a ring of entity states
+typedef struct
+{
+	struct entity_state_s	*ring;
+	int						ringsize;
+	int						first;
+	int						count;
+} entitylist_t;
+
+void MSG_WritePacketEntities (sizebuf_t *msg, entitylist_t *from, entitylist_t *to, struct entity_state_s *baselines, int maxclients, qboolean packed);
+
 //============================================================================
 
 extern	qboolean	bigendien;
@@ -216,6 +253,10 @@ PROTOCOL
 
 #define	PROTOCOL_VERSION	36
 
+// opt-in revision of 36, asked for at connect: frames are bit packed
+// and server packets are range coded, everything else is unchanged
+#define	PROTOCOL_PACKED		37
+
 //=========================================
 
 #define	PORT_MASTER	27900
@@ -265,9 +306,16 @@ enum svc_ops_e
 	svc_playerinfo,				// variable
 	svc_packetentities,			// [...]
 	svc_deltapacketentities,	// [...]
-	svc_frame
+	svc_frame,
+	svc_dlstart,				// [long] size [long] offset, a windowed download follows
+	svc_dlchunk					// [long] offset [short] size [size bytes], unreliable
 };
 
+// windowed downloads send the file as unreliable chunks, and the client
+// acks them with a bitmask over the window past what it has written
+#define	DL_CHUNKSIZE		1024
+#define	DL_WINDOW_MAX		64
+
 //==============================================
 
 //
@@ -279,7 +327,8 @@ enum clc_ops_e
 	clc_nop,
 	clc_move,				// [[usercmd_t]
 	clc_userinfo,			// [[userinfo string]
-	clc_stringcmd			// [string] message
+	clc_stringcmd,			// [string] message
+	clc_dlack				// [long] bytes written [long] [long] chunks held past that
 };
 
 //==============================================
@@ -624,6 +673,11 @@ void		NET_Config (qboolean multiplayer);
 
 qboolean	NET_GetPacket (netsrc_t sock, netadr_t *net_from, sizebuf_t *net_message);
 void		NET_SendPacket (netsrc_t sock, int length, void *data, netadr_t to);
+// packets sent on sock in between may be held back and handed to the
+// system together
+void		NET_BeginSendBatch (netsrc_t sock);
+void		NET_FlushSendBatch (netsrc_t sock);
+int			NET_LocalPort (netsrc_t sock);	// 0 if the socket isn't open
 
 qboolean	NET_CompareAdr (netadr_t a, netadr_t b);
 qboolean	NET_CompareBaseAdr (netadr_t a, netadr_t b);
@@ -632,6 +686,11 @@ char		*NET_AdrToString (netadr_t a);
 qboolean	NET_StringToAdr (char *s, netadr_t *a);
 void		NET_Sleep(int msec);
 
+// dedicated server wait with microsecond resolution, returns why it woke
+#define	NET_WAKE_PACKET		1	// the server socket has a packet
+#define	NET_WAKE_CONSOLE	2	// the console has input
+int			NET_SleepMicroseconds(int usec);
+
 #define NET_IsLocalHost(x) \
 	((x)->type == NA_LOOPBACK)
 //============================================================================
@@ -672,6 +731,9 @@ typedef struct
 // message is copied to this buffer when it is first transfered
 	int			reliable_length;
 	byte		reliable_buf[MAX_MSGLEN-16];	// unacked reliable message
+
+	qboolean	packed;			// PROTOCOL_PACKED, server packets are range coded
+	int			last_sentsize;	// bytes in the last datagram sent
 } netchan_t;
 
 extern	netadr_t	net_from;
@@ -690,6 +752,10 @@ qboolean Netchan_Process (netchan_t *chan, sizebuf_t *msg);
 
 qboolean Netchan_CanReliable (netchan_t *chan);
 
+// the PROTOCOL_PACKED payload coder, exposed for benchmarking
+int Netchan_EncodePayload (byte *data, int length, byte *out, int maxsize);	// -1 if it didn't fit
+qboolean Netchan_DecodePayload (byte *data, int length, byte *out, int outlength);
+
 
 /*
 ==============================================================
@@ -705,6 +771,7 @@ CMODEL
 cmodel_t	*CM_LoadMap (char *name, qboolean clientload, unsigned *checksum);
 cmodel_t	*CM_LoadBSP (char *name, qboolean clientload, unsigned *checksum);
 cmodel_t	*CM_InlineModel (char *name);	// *1, *2, etc
+unsigned	CM_MapChecksum (void);
 
 int			CM_NumClusters (void);
 int			CM_NumInlineModels (void);
@@ -730,8 +797,49 @@ trace_t		CM_TransformedBoxTrace (vec3_t start, vec3_t end,
 						  int headnode, int brushmask,
 						  vec3_t origin, vec3_t angles);
 
+// The calls above trace with a context private to the calling thread, so
+// they may be used from job threads. The Ctx variants take the scratch
+// state explicitly for callers that want to manage it themselves. Tracing
+// must not overlap with a map load or with CM_HeadnodeForBox, which still
+// rebuilds one shared box hull.
+typedef struct cm_trace_ctx_s cm_trace_ctx_t;
+
+// running totals of the work done by the calling thread's traces; they
+// wrap, so cost a stretch of code by subtracting two readings
+typedef struct
+{
+	unsigned	nodes;			// BSP nodes descended
+	unsigned	brushes;		// brushes clipped or tested
+	unsigned	terraintris;	// terrain triangles clipped or tested
+} cm_tracecounts_t;
+void		CM_ThreadTraceCounts (cm_tracecounts_t *counts);
+
+cm_trace_ctx_t *CM_CreateTraceContext (void);
+void		CM_FreeTraceContext (cm_trace_ctx_t *ctx);
+trace_t		CM_BoxTraceCtx (cm_trace_ctx_t *ctx,
+						  const vec3_t start, const vec3_t end,
+						  vec3_t mins, vec3_t maxs,
+						  int headnode, int brushmask);
+qboolean	CM_FastTraceCtx (cm_trace_ctx_t *ctx, const vec3_t start, const vec3_t end, int headnode, int brushmask);
+trace_t		CM_TransformedBoxTraceCtx (cm_trace_ctx_t *ctx,
+						  vec3_t start, vec3_t end,
+						  vec3_t mins, vec3_t maxs,
+						  int headnode, int brushmask,
+						  vec3_t origin, vec3_t angles);
+
+// Traces count rays sharing one box size (NULL mins/maxs for points) and
+// fills results[i] exactly as CM_BoxTrace would. Rays that are close
+// together should be next to each other in the arrays: they share the
+// walk down the BSP. numworkers > 0 spreads the rays over job threads.
+void		CM_BoxTraceBatch (int count, vec3_t *starts, vec3_t *ends,
+						  vec3_t mins, vec3_t maxs, int headnode,
+						  int brushmask, trace_t *results, int numworkers);
+
 byte		*CM_ClusterPVS (int cluster);
 byte		*CM_ClusterPHS (int cluster);
+void		CM_CopyClusterPVS (int cluster, byte *out);	// thread safe
+qboolean	CM_ClusterVisible (int a, int b);
+qboolean	CM_ClusterHearable (int a, int b);
 
 int			CM_PointLeafnum (vec3_t p);
 
@@ -756,6 +864,9 @@ void		CM_ReadPortalState (FILE *f);
 qboolean 	CM_inPVS (vec3_t p1, vec3_t p2);
 qboolean	CM_inPVS_leafs (int leafnum1, int leafnum2);
 qboolean 	CM_inPHS (vec3_t p1, vec3_t p2);
+void		CM_VisBench_f (void);
+void		CM_TraceStress_f (void);
+void		CM_TraceBench_f (void);
 
 extern char map_name[MAX_QPATH];
 
@@ -900,6 +1011,26 @@ void FS_Read( void *buffer, int len, FILE *f );
  */
 void FS_FreeFile( void *buffer );
 
+/**
+ * @brief Maps a file into memory instead of copying it into the zone.
+ *
+ * The pages are copy-on-write, so loaders may byte swap in place. Unlike
+ * FS_LoadFile the buffer is NOT nul-terminated; don't use it for text.
+ * Falls back to FS_LoadFile if the file can't be mapped.
+ *
+ * @param path 
+ * @param buffer 
+ * @return file length, or -1 if not found
+ */
+int FS_MapFile (const char *path, void **buffer);
+
+/**
+ * @brief Releases a buffer returned by FS_MapFile.
+ *
+ * @param buffer 
+ */
+void FS_UnmapFile( void *buffer );
+
 /**
  * @brief
  *
@@ -907,6 +1038,16 @@ void FS_FreeFile( void *buffer );
  */
 void FS_CreatePath( char *path );
 
+/**
+ * @brief Tells the directory index a file under full_path was written.
+ *
+ * FS_CreatePath does this already; call it for files created some other
+ * way, such as renamed downloads.
+ *
+ * @param full_path absolute path, or NULL to rescan every search path
+ */
+void FS_InvalidateIndex( const char *full_path );
+
 /**
  * @brief
  *
@@ -990,6 +1131,7 @@ void		Com_SetServerState (int state);
 
 unsigned	Com_BlockChecksum (void *buffer, int length);
 byte		COM_BlockSequenceCRCByte (byte *base, int length, int sequence);
+void		Com_OrBits (byte *out, const byte *in, int numbytes);
 
 float	frand(void);	// 0 ti 1
 float	crand(void);	// -1 to 1
@@ -1015,11 +1157,21 @@ void Z_Free (void *ptr);
 void *Z_Malloc (int size);			// returns 0 filled memory
 void *Z_TagMalloc (int size, int tag);
 void Z_FreeTags (int tag);
+int Z_Allocations (void);			// running count, for profiling
 
 void Qcommon_Init (int argc, char **argv);
 void Qcommon_Frame (int msec);
 void Qcommon_Shutdown (void);
 
+// Runs func for every index in [0, count) spread over numworkers helper
+// threads plus the calling thread, and returns once all of them are done.
+// worker is 0 for the calling thread and 1..numworkers for the helpers, so
+// it can be used to pick per-thread scratch space. Job functions must not
+// call Com_Error; Com_Printf from a job is held back until the batch ends.
+#define	MAX_JOB_WORKERS	16
+typedef void (*jobfunc_t) (void *data, int index, int worker);
+void Com_ParallelFor (int numworkers, int count, jobfunc_t func, void *data);
+
 #define NUMVERTEXNORMALS	162
 extern	vec3_t	bytedirs[NUMVERTEXNORMALS];
 
@@ -1057,6 +1209,35 @@ void	Sys_Error (char *error, ...);
 void	Sys_Quit (void);
 char	*Sys_GetClipboardData( void );
 void	Sys_CopyProtect (void);
+unsigned long long Sys_Microseconds (void);	// monotonic, for timing only
+
+// threads, mutexes and condition variables; the handles are opaque
+#ifdef _MSC_VER
+#define THREADLOCAL	__declspec(thread)
+#else
+#define THREADLOCAL	__thread
+#endif
+void	*Sys_CreateThread (void (*func) (void *), void *arg);
+void	Sys_JoinThread (void *thread);
+unsigned long Sys_ThreadId (void);
+int		Sys_NumProcessors (void);
+void	*Sys_CreateMutex (void);
+void	Sys_DestroyMutex (void *mutex);
+void	Sys_LockMutex (void *mutex);
+void	Sys_UnlockMutex (void *mutex);
+void	*Sys_CreateCond (void);
+void	Sys_DestroyCond (void *cond);
+void	Sys_WaitCond (void *cond, void *mutex);
+void	Sys_BroadcastCond (void *cond);
+
+// calls func for every file and directory in path except . and ..
+qboolean Sys_ScanDir (const char *path, void (*func) (void *arg, const char *name, qboolean isdir), void *arg);
+
+// copy-on-write file mappings; NULL if the platform can't map the file
+void	*Sys_MapFile (FILE *f, int length);
+void	Sys_UnmapFile (void *base, int length);
+// evict the file from the OS page cache, for cold load measurements
+qboolean Sys_DropFileCache (FILE *f);
 
 /*
 ==============================================================
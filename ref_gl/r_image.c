@@ -714,20 +714,19 @@ void LoadJPG (char *filename, byte **pic, int *width, int *height)
 
 	crjpg_corrupted = false;
 	// Load JPEG file into memory
-	rawsize = FS_LoadFile_TryStatic	(	filename, (void **)&rawdata,
-										static_rawdata, STATIC_RAWDATA_SIZE);
+	rawsize = FS_MapFile (filename, (void **)&rawdata);
 	if (!rawdata)
 	{
 		return;
 	}
 
 	// Knightmare- check for bad data
-	if (	rawdata[6] != 'J'
+	if (	rawsize < 10
+		||	rawdata[6] != 'J'
 		||	rawdata[7] != 'F'
 		||	rawdata[8] != 'I'
 		||	rawdata[9] != 'F') {
-		if (rawdata != static_rawdata)
-			FS_FreeFile(rawdata);
+		FS_UnmapFile(rawdata);
 		return;
 	}
 
@@ -748,8 +747,7 @@ void LoadJPG (char *filename, byte **pic, int *width, int *height)
 	if(cinfo.output_components != 3)
 	{
 		jpeg_destroy_decompress(&cinfo);
-		if (rawdata != static_rawdata)
-			FS_FreeFile(rawdata);
+		FS_UnmapFile(rawdata);
 		return;
 	}
 
@@ -758,8 +756,7 @@ void LoadJPG (char *filename, byte **pic, int *width, int *height)
 	if(!rgbadata)
 	{
 		jpeg_destroy_decompress(&cinfo);
-		if (rawdata != static_rawdata)
-			FS_FreeFile(rawdata);
+		FS_UnmapFile(rawdata);
 		return;
 	}
 
@@ -778,8 +775,7 @@ void LoadJPG (char *filename, byte **pic, int *width, int *height)
 		{
 			free(rgbadata);
 			jpeg_destroy_decompress(&cinfo);
-			if (rawdata != static_rawdata)
-				FS_FreeFile(rawdata);
+			FS_UnmapFile(rawdata);
 			return;
 		}
 	}
@@ -813,8 +809,7 @@ void LoadJPG (char *filename, byte **pic, int *width, int *height)
 	jpeg_destroy_decompress(&cinfo);
 
 	// Free the raw data now that it's done being processed
-	if (rawdata != static_rawdata)
-    	FS_FreeFile(rawdata);
+	FS_UnmapFile(rawdata);
     
     if (crjpg_corrupted)
     	Com_Printf ("JPEG file %s is likely corrupted, please obtain a fresh copy.\n", filename);
@@ -349,6 +349,31 @@ do { \
 		}
 	}
 	
+	// resolve the joints that are treated specially by name now, so the
+	// animation code doesn't have to compare strings
+	mod->jointflags = (byte *)Hunk_Alloc ((header->num_joints + 3) & ~3);
+	mod->jointbind = (signed char *)Hunk_Alloc ((header->num_joints + 3) & ~3);
+	for (i = 0; i < mod->num_joints; i++)
+	{
+		const char *name = &mod->jointname[mod->joints[i].name];
+
+		mod->jointflags[i] = 0;
+		if (!strcmp (name, "Spine") || !strcmp (name, "Spine.001"))
+			mod->jointflags[i] |= IQM_JOINT_SPINE;
+		if (!strcmp (name, "hip.l") || !strcmp (name, "hip.r"))
+			mod->jointflags[i] |= IQM_JOINT_HIP;
+
+		mod->jointbind[i] = -1;
+		for (j = 0; j < RagDollBindsCount; j++)
+		{
+			if (!strcmp (name, RagDollBinds[j].name))
+			{
+				mod->jointbind[i] = j;
+				break;
+			}
+		}
+	}
+
 	// needed for bending the model in other ways besides the built-in
 	// animation.
 	mod->baseframe = (matrix3x4_t*)Hunk_Alloc (header->num_joints * sizeof(matrix3x4_t));
@@ -684,12 +709,12 @@ static int IQM_NextFrame (const entity_t *ent, const model_t *mod)
 	return outframe;
 }
 
-static inline void IQM_Bend (matrix3x4_t *temp, matrix3x4_t rmat, matrix3x4_t *basejoint, matrix3x4_t *outjoint)
+static inline void IQM_Bend (matrix3x4_t *temp, const matrix3x4_t *rmat, const matrix3x4_t *basejoint, matrix3x4_t *outjoint)
 {
 	vec3_t		basePosition, oldPosition, newPosition;
 	
 	// concatenate the rotation with the bone
-	Matrix3x4_Multiply(temp, rmat, *outjoint);
+	Matrix3x4_MultiplyFast(temp, rmat, outjoint);
 
 	// get the position of the bone in the base frame
 	VectorSet(basePosition, basejoint->a[3], basejoint->b[3], basejoint->c[3]);
@@ -711,6 +736,55 @@ static inline void IQM_Bend (matrix3x4_t *temp, matrix3x4_t rmat, matrix3x4_t *b
 	Matrix3x4_Copy(outjoint, *temp);
 }
 
+/*
+==============
+Pose cache
+
+Entities in the same animation state end up with the same bones, and an
+entity is usually animated several times a frame, for its shadow, its shell
+and so on. Poses are remembered until the end of the frame, keyed by model,
+frame pair, lerp and the pitch and roll bends.
+==============
+*/
+#define IQM_POSECACHE_SIZE	32		// must be a power of two
+
+typedef struct
+{
+	int				framecount;
+	const model_t	*mod;
+	int				frame1, frame2;
+	float			frameoffset, pitch, roll;
+	matrix3x4_t		pose[SKELETAL_MAX_BONEMATS];
+} iqmposecache_t;
+
+static iqmposecache_t	iqm_posecache[IQM_POSECACHE_SIZE];
+static qboolean		iqm_posecache_off;		// for iqmbench
+static int			iqm_posehits, iqm_posemisses;
+
+static iqmposecache_t *IQM_FindPose (const model_t *mod, int frame1, int frame2, float frameoffset, float pitch, float roll, qboolean *hit)
+{
+	iqmposecache_t	*pose;
+	unsigned	hash;
+
+	hash = (unsigned)((size_t)mod >> 4) * 31 + frame1;
+	hash = hash * 31 + frame2;
+	hash = hash * 31 + (unsigned)(frameoffset * 1024);
+	hash = hash * 31 + (unsigned)(int)(pitch * 1024);
+	hash = hash * 31 + (unsigned)(int)(roll * 1024);
+	hash ^= hash >> 16;
+	pose = &iqm_posecache[hash & (IQM_POSECACHE_SIZE-1)];
+
+	*hit = !iqm_posecache_off && pose->framecount == r_framecount && pose->mod == mod
+		&& pose->frame1 == frame1 && pose->frame2 == frame2 && pose->frameoffset == frameoffset
+		&& pose->pitch == pitch && pose->roll == roll;
+	if (*hit)
+		iqm_posehits++;
+	else
+		iqm_posemisses++;
+
+	return pose;
+}
+
 static void IQM_AnimateFrame_standard (const entity_t *ent, const model_t *mod, matrix3x4_t outframe[SKELETAL_MAX_BONEMATS])
 {
 	int frame1, frame2;
@@ -721,6 +795,10 @@ static void IQM_AnimateFrame_standard (const entity_t *ent, const model_t *mod,
 	int i;
 	float modelpitch;
 	float modelroll;
+	matrix3x4_t spinemat, hipmat, rmat;
+	vec3_t rot;
+	qboolean bend, hit;
+	iqmposecache_t *pose;
 	
 	curframe = IQM_SelectFrame (ent);
 	nextframe = IQM_NextFrame (ent, mod);
@@ -736,105 +814,98 @@ static void IQM_AnimateFrame_standard (const entity_t *ent, const model_t *mod,
 	
 	modelpitch = DEG2RAD (ent->angles[PITCH]); 
 	modelroll = DEG2RAD (ent->angles[ROLL]);
+
+	pose = IQM_FindPose (mod, frame1, frame2, frameoffset, modelpitch, modelroll, &hit);
+	if (hit)
+	{
+		memcpy (outframe, pose->pose, mod->num_joints * sizeof(matrix3x4_t));
+		return;
+	}
 	
+	// Bend the model at the waist for player pitch and roll, and rotate the
+	// legs back. The rotations are the same for every joint they apply to,
+	// and pitching then rolling about the same pivot is a single bend by
+	// the product, so they are built once here.
+	bend = modelpitch != 0 || modelroll != 0;
+	if (bend)
+	{
+		VectorSet(rot, 0, 1, 0); //remember .iqm's are 90 degrees rotated from reality, so this is the pitch axis
+		Matrix3x4GenRotate(&spinemat, modelpitch, rot);
+		Matrix3x4GenRotate(&hipmat, -modelpitch, rot);
+
+		VectorSet(rot, 1, 0, 0);
+		Matrix3x4GenRotate(&rmat, modelroll, rot);
+		Matrix3x4_MultiplyFast(&spinemat, &rmat, &spinemat);
+		Matrix3x4GenRotate(&rmat, -modelroll, rot);
+		Matrix3x4_MultiplyFast(&hipmat, &rmat, &hipmat);
+	}
+
 	// Interpolate matrixes between the two closest frames and concatenate with parent matrix if necessary.
 	// Concatenate the result with the inverse of the base pose.
 	// You would normally do animation blending and inter-frame blending here in a 3D engine.
 
 	for (i = 0; i < mod->num_joints; i++)
 	{
-		const char *currentjoint_name;
 		signed int currentjoint_parent;
-		matrix3x4_t mat, rmat, temp;
-		vec3_t rot;
-		Matrix3x4_Scale (&mat, mat1[i], 1-frameoffset);
-		Matrix3x4_Scale (&temp, mat2[i], frameoffset);
+		matrix3x4_t mat, temp;
 
-		Matrix3x4_Add (&mat, mat, temp);
+		Matrix3x4_Lerp (&mat, &mat1[i], &mat2[i], frameoffset);
 		
-		currentjoint_name = &mod->jointname[mod->joints[i].name];
 		currentjoint_parent = mod->joints[i].parent;
 
 		if (currentjoint_parent >= 0)
-			Matrix3x4_Multiply (&outframe[i], outframe[currentjoint_parent], mat);
+			Matrix3x4_MultiplyFast (&outframe[i], &outframe[currentjoint_parent], &mat);
 		else
 			Matrix3x4_Copy (&outframe[i], mat);
 
-		//bend the model at the waist for player pitch
-		if (!strcmp(currentjoint_name, "Spine") || !strcmp(currentjoint_name, "Spine.001"))
-		{
-			VectorSet(rot, 0, 1, 0); //remember .iqm's are 90 degrees rotated from reality, so this is the pitch axis
-			Matrix3x4GenRotate(&rmat, modelpitch, rot);
-			
-			IQM_Bend (&temp, rmat, &mod->baseframe[i], &outframe[i]);
-		}
-		//now rotate the legs back
-		if (!strcmp(currentjoint_name, "hip.l") || !strcmp(currentjoint_name, "hip.r"))
-		{
-			VectorSet(rot, 0, 1, 0);
-			Matrix3x4GenRotate(&rmat, -modelpitch, rot);
-			
-			IQM_Bend (&temp, rmat, &mod->baseframe[i], &outframe[i]);
-		}
+		if (!bend || !mod->jointflags[i])
+			continue;
 
-		//bend the model at the waist for player roll
-		if (!strcmp(currentjoint_name, "Spine") || !strcmp(currentjoint_name, "Spine.001"))
-		{
-			VectorSet(rot, 1, 0, 0); //remember .iqm's are 90 degrees rotated from reality, so this is the pitch axis
-			Matrix3x4GenRotate(&rmat, modelroll, rot);
-			
-			IQM_Bend (&temp, rmat, &mod->baseframe[i], &outframe[i]);
-		}
-		//now rotate the legs back
-		if (!strcmp(currentjoint_name, "hip.l") || !strcmp(currentjoint_name, "hip.r"))
-		{
-			VectorSet(rot, 1, 0, 0);
-			Matrix3x4GenRotate(&rmat, -modelroll, rot);
-			
-			IQM_Bend (&temp, rmat, &mod->baseframe[i], &outframe[i]);
-		}
+		if (mod->jointflags[i] & IQM_JOINT_SPINE)
+			IQM_Bend (&temp, &spinemat, &mod->baseframe[i], &outframe[i]);
+		if (mod->jointflags[i] & IQM_JOINT_HIP)
+			IQM_Bend (&temp, &hipmat, &mod->baseframe[i], &outframe[i]);
 	}
+
+	pose->framecount = r_framecount;
+	pose->mod = mod;
+	pose->frame1 = frame1;
+	pose->frame2 = frame2;
+	pose->frameoffset = frameoffset;
+	pose->pitch = modelpitch;
+	pose->roll = modelroll;
+	memcpy (pose->pose, outframe, mod->num_joints * sizeof(matrix3x4_t));
 }
 
 static void IQM_AnimateFrame_ragdoll (const entity_t *ent, const model_t *mod, matrix3x4_t outframe[SKELETAL_MAX_BONEMATS])
 {
 	//we only deal with one frame
 
-	//animate using the rotations from our corresponding ODE objects.
-	int i, j;
+	//animate using the rotations from our corresponding ODE objects, interpolated
+	//between simulation steps.
+	int i, parent;
+
+	for (i = 0; i < mod->num_joints; i++)
 	{
-		for (i = 0; i < mod->num_joints; i++)
+		if (mod->jointbind[i] >= 0)
 		{
-			int parent;
-
-			for (j = 0; j < RagDollBindsCount; j++)
-			{
-				if (!strcmp (&mod->jointname[mod->joints[i].name], RagDollBinds[j].name))
-				{
-					matrix3x4_t rmat;
-					RagDollObject_t *object = &ent->RagDollData->RagDollObject[RagDollBinds[j].object];
-					const dReal *odeRot = dBodyGetRotation (object->body);
-					const dReal *odePos = dBodyGetPosition (object->body);
-					Matrix3x4GenFromODE (&rmat, odeRot, odePos);
-					Matrix3x4_Multiply (&outframe[i], rmat, object->initmat);
-					goto nextjoint;
-				}
-			}
-
-			parent = mod->joints[i].parent;
-			if (parent >= 0)
-			{
-				matrix3x4_t mat;
-				// FIXME: inefficient
-				Matrix3x4_Invert (&mat, ent->RagDollData->initframe[parent]);
-				Matrix3x4_Multiply (&mat, mat, ent->RagDollData->initframe[i]);
-				Matrix3x4_Multiply (&outframe[i], outframe[parent], mat);
-			}
-			else
-				memset (&outframe[i], 0, sizeof(matrix3x4_t));
+			// the body as placed for this frame by R_SimulateAllRagdolls
+			int object = RagDollBinds[mod->jointbind[i]].object;
+			Matrix3x4_MultiplyFast (&outframe[i], &ent->RagDollData->bodymat[object], &ent->RagDollData->RagDollObject[object].initmat);
+			continue;
+		}
 
-		nextjoint:;
+		parent = mod->joints[i].parent;
+		if (parent >= 0)
+		{
+			matrix3x4_t mat;
+			// FIXME: inefficient
+			Matrix3x4_Invert (&mat, ent->RagDollData->initframe[parent]);
+			Matrix3x4_MultiplyFast (&mat, &mat, &ent->RagDollData->initframe[i]);
+			Matrix3x4_MultiplyFast (&outframe[i], &outframe[parent], &mat);
 		}
+		else
+			memset (&outframe[i], 0, sizeof(matrix3x4_t));
 	}
 }
 
@@ -845,3 +916,79 @@ void IQM_AnimateFrame (const entity_t *ent, const model_t *mod, matrix3x4_t outf
 	else
 		IQM_AnimateFrame_standard (ent, mod, outframe);
 }
+
+/*
+==============
+IQM_Bench_f
+
+iqmbench <model> [entities] [frames]
+
+Animates a crowd of copies of an IQM model without drawing them, first
+without the pose cache and then with it. The copies are spread over eight
+animation states and lean at different angles, like a server full of
+players.
+==============
+*/
+#define IQM_BENCH_MAXENTS	256
+
+void IQM_Bench_f (void)
+{
+	static entity_t		ents[IQM_BENCH_MAXENTS];
+	static matrix3x4_t	outframe[SKELETAL_MAX_BONEMATS];
+	model_t				*mod;
+	int					numents, numframes, pass, i, f, now;
+	unsigned long long	start, usec[2];
+
+	if (Cmd_Argc() < 2)
+	{
+		Com_Printf ("Usage: iqmbench <model> [entities] [frames]\n");
+		return;
+	}
+
+	mod = R_RegisterModel (Cmd_Argv(1));
+	if (!mod || mod->type != mod_iqm)
+	{
+		Com_Printf ("%s is not an IQM model\n", Cmd_Argv(1));
+		return;
+	}
+
+	numents = Cmd_Argc() > 2 ? atoi (Cmd_Argv(2)) : 32;
+	numents = numents < 1 ? 1 : numents > IQM_BENCH_MAXENTS ? IQM_BENCH_MAXENTS : numents;
+	numframes = Cmd_Argc() > 3 ? atoi (Cmd_Argv(3)) : 1000;
+	if (numframes < 1)
+		numframes = 1;
+
+	now = Sys_Milliseconds ();
+	memset (ents, 0, sizeof(ents));
+	for (i = 0; i < numents; i++)
+	{
+		int state = i & 7;
+
+		ents[i].model = mod;
+		ents[i].frame = (state * 5) % mod->num_poses;
+		ents[i].frametime = now - state * 10;
+		ents[i].angles[PITCH] = state * 4 - 14;
+		ents[i].angles[ROLL] = (state & 1) ? 5 : 0;
+	}
+
+	for (pass = 0; pass < 2; pass++)
+	{
+		iqm_posecache_off = !pass;
+		iqm_posehits = iqm_posemisses = 0;
+		start = Sys_Microseconds ();
+		for (f = 0; f < numframes; f++)
+		{
+			r_framecount++;		// the cache only holds poses for a frame
+			for (i = 0; i < numents; i++)
+				IQM_AnimateFrame (&ents[i], mod, outframe);
+		}
+		usec[pass] = Sys_Microseconds () - start;
+	}
+	iqm_posecache_off = false;
+
+	Com_Printf ("%s: %i joints, %i entities, %i frames\n", mod->name, mod->num_joints, numents, numframes);
+	Com_Printf ("%.3f usec per entity, %.3f with the pose cache (%i%% hits)\n",
+		(double)usec[0] / ((double)numents * numframes),
+		(double)usec[1] / ((double)numents * numframes),
+		iqm_posehits * 100 / (iqm_posehits + iqm_posemisses));
+}
@@ -171,11 +171,15 @@ extern	cvar_t	*r_drawsun;
 extern  cvar_t	*r_godrays;
 extern  cvar_t	*r_godray_intensity;
 extern	cvar_t	*r_optimize;
+extern	cvar_t	*r_surfcache;
 
 extern	cvar_t	*r_lightmapfiles;
 
 extern  cvar_t	*r_ragdolls;
 extern  cvar_t  *r_ragdoll_debug;
+extern  cvar_t  *r_ragdoll_thread;
+extern  cvar_t  *r_ragdoll_maxsteps;
+extern  cvar_t  *r_ragdoll_meshcache;
 
 extern	qboolean	map_fog;
 #if defined WIN32_VARIANT
@@ -300,6 +304,11 @@ extern qboolean R_CullOrigin(vec3_t origin);
 extern qboolean R_CullSphere( const vec3_t centre, const float radius, const int clipflags );
 void R_RotateForEntity (const entity_t *e);
 extern void R_MarkWorldSurfs (void);
+extern void R_MarkLeaves (void);
+extern void R_CullWorldSurfs (qboolean cached);
+extern int R_CountWorldSurfs (void);
+extern void R_FreeSurfCache (void);
+extern void R_WorldCullBench_f (void);
 void R_RenderWaterPolys (msurface_t *fa);
 extern void R_ReadFogScript(char config_file[128]);
 extern void R_ReadMusicScript(char config_file[128]);
@@ -819,6 +828,7 @@ extern qboolean Mod_INTERQUAKEMODEL_Load(model_t *mod, void *buffer);
 extern qboolean IQM_InAnimGroup(int frame, int oldframe);
 extern void IQM_DrawFrame(int skinnum, qboolean ragdoll, float shellAlpha);
 extern void IQM_AnimateFrame (const entity_t *ent, const model_t *mod, matrix3x4_t outframe[SKELETAL_MAX_BONEMATS]);
+extern void IQM_Bench_f (void);
 
 // md2
 extern void Mod_LoadMD2Model (model_t *mod, void *buffer);
@@ -153,6 +153,7 @@ cvar_t	*r_lightbeam;
 cvar_t	*r_godrays;
 cvar_t  *r_godray_intensity;
 cvar_t	*r_optimize;
+cvar_t	*r_surfcache;
 
 cvar_t	*r_lightmapfiles;
 
@@ -1227,6 +1228,150 @@ static void	R_SetGL2D (void)
 	qglColor4f (1,1,1,1);
 }
 
+/*
+=============
+R_WorldCullBench_f
+
+Replays a camera path written by timedemo_campath through R_MarkLeaves and
+the world surface culling, once walking the BSP tree and once from the
+visible surface cache, and prints the CPU time per frame for each. Nothing
+is drawn.
+=============
+*/
+typedef struct
+{
+	vec3_t	vieworg, viewangles;
+	float	fov_x, fov_y;
+	byte	areabits[MAX_MAP_AREAS/8];
+} cullbenchframe_t;
+
+void R_WorldCullBench_f (void)
+{
+	FILE				*f;
+	char				line[512], mapname[MAX_QPATH], areahex[MAX_MAP_AREAS/4+1];
+	cullbenchframe_t	*frames, *fr;
+	int					numframes, maxframes, passes, pass, rep, i, j, hex;
+	unsigned long long	start, usec[2];
+	double				surfs[2];
+	refdef_t			saved;
+
+	if (Cmd_Argc() < 2)
+	{
+		Com_Printf ("Usage: worldcullbench <campath> [passes]\n");
+		return;
+	}
+
+	if (!r_worldmodel)
+	{
+		Com_Printf ("No map loaded\n");
+		return;
+	}
+
+	f = fopen (Cmd_Argv(1), "r");
+	if (!f)
+	{
+		Com_Printf ("Couldn't open %s\n", Cmd_Argv(1));
+		return;
+	}
+
+	if (!fgets (line, sizeof(line), f) || sscanf (line, "campath %63s", mapname) != 1)
+	{
+		Com_Printf ("%s is not a camera path\n", Cmd_Argv(1));
+		fclose (f);
+		return;
+	}
+	if (strcmp (mapname, r_worldmodel->name))
+	{
+		Com_Printf ("%s was recorded on %s, not %s\n", Cmd_Argv(1), mapname, r_worldmodel->name);
+		fclose (f);
+		return;
+	}
+
+	numframes = maxframes = 0;
+	frames = NULL;
+	while (fgets (line, sizeof(line), f))
+	{
+		if (numframes == maxframes)
+		{
+			maxframes += 1024;
+			fr = (cullbenchframe_t *)realloc (frames, maxframes * sizeof(cullbenchframe_t));
+			if (!fr)
+				break;
+			frames = fr;
+		}
+		fr = &frames[numframes];
+		if (sscanf (line, "%f %f %f %f %f %f %f %f %64s",
+				&fr->vieworg[0], &fr->vieworg[1], &fr->vieworg[2],
+				&fr->viewangles[0], &fr->viewangles[1], &fr->viewangles[2],
+				&fr->fov_x, &fr->fov_y, areahex) != 9)
+			continue;
+		memset (fr->areabits, 0, sizeof(fr->areabits));
+		for (j = 0; j < MAX_MAP_AREAS/8 && areahex[j*2] && areahex[j*2+1]; j++)
+		{
+			sscanf (&areahex[j*2], "%2x", &hex);
+			fr->areabits[j] = hex;
+		}
+		numframes++;
+	}
+	fclose (f);
+
+	if (!numframes)
+	{
+		Com_Printf ("%s has no frames\n", Cmd_Argv(1));
+		free (frames);
+		return;
+	}
+
+	passes = Cmd_Argc() > 2 ? atoi (Cmd_Argv(2)) : 10;
+	if (passes < 1)
+		passes = 1;
+
+	saved = r_newrefdef;
+	memset (&r_newrefdef, 0, sizeof(r_newrefdef));
+	r_newrefdef.width = saved.width;
+	r_newrefdef.height = saved.height;
+	r_newrefdef.lightstyles = saved.lightstyles;
+
+	for (pass = 0; pass < 2; pass++)
+	{
+		R_FreeSurfCache ();		// building the cache counts too
+		usec[pass] = 0;
+		surfs[pass] = 0;
+		for (rep = 0; rep < passes; rep++)
+		{
+			for (i = 0, fr = frames; i < numframes; i++, fr++)
+			{
+				VectorCopy (fr->vieworg, r_newrefdef.vieworg);
+				VectorCopy (fr->viewangles, r_newrefdef.viewangles);
+				r_newrefdef.fov_x = fr->fov_x;
+				r_newrefdef.fov_y = fr->fov_y;
+				r_newrefdef.areabits_changed = !i || memcmp (fr->areabits, r_newrefdef.areabits, sizeof(fr->areabits));
+				r_newrefdef.areabits = fr->areabits;
+
+				R_SetupFrame ();
+				R_SetFrustum ();
+
+				start = Sys_Microseconds ();
+				R_MarkLeaves ();
+				R_CullWorldSurfs (pass);
+				usec[pass] += Sys_Microseconds () - start;
+
+				surfs[pass] += R_CountWorldSurfs ();
+			}
+		}
+	}
+
+	r_newrefdef = saved;
+	r_viewcluster = r_viewcluster2 = -1;	// mark leafs again next frame
+	free (frames);
+
+	Com_Printf ("%s: %i frames, %i passes\n", r_worldmodel->name, numframes, passes);
+	Com_Printf ("BSP walk:      %8.2f usec/frame, %.1f surfaces\n",
+		(double)usec[0] / ((double)numframes * passes), surfs[0] / ((double)numframes * passes));
+	Com_Printf ("surface cache: %8.2f usec/frame, %.1f surfaces\n",
+		(double)usec[1] / ((double)numframes * passes), surfs[1] / ((double)numframes * passes));
+}
+
 /*
 @@@@@@@@@@@@@@@@@@@@@
 R_RenderFrame
@@ -1384,6 +1529,8 @@ void R_Register( void )
 	r_godray_intensity = Cvar_Get ("r_godray_intensity", "1.0", CVAR_ARCHIVE);
 	r_optimize = Cvar_Get ("r_optimize", "1", CVAR_ARCHIVE|CVARDOC_BOOL);
 	Cvar_Describe (r_optimize, "Skip BSP recursion unless you move. Good for performance, recommend leaving it on.");
+	r_surfcache = Cvar_Get ("r_surfcache", "1", CVAR_ARCHIVE|CVARDOC_BOOL);
+	Cvar_Describe (r_surfcache, "Keep lists of the world surfaces visible from recent view clusters, so each frame only frustum culls a list instead of walking the BSP tree.");
 	
 	r_lightmapfiles = Cvar_Get("r_lightmapfiles", "1", CVAR_ARCHIVE|CVARDOC_BOOL);
 	Cvar_Describe (r_lightmapfiles, "Enables the loading of .lightmap files, with more detailed light and shadow. Turn this off if video RAM is limited.");
@@ -1395,6 +1542,12 @@ void R_Register( void )
 
 	r_ragdolls = Cvar_Get ("r_ragdolls", "1", CVAR_ARCHIVE|CVARDOC_BOOL);
 	r_ragdoll_debug = Cvar_Get("r_ragdoll_debug", "0", CVAR_ARCHIVE|CVARDOC_BOOL);
+	r_ragdoll_thread = Cvar_Get("r_ragdoll_thread", "1", CVAR_ARCHIVE|CVARDOC_BOOL);
+	Cvar_Describe (r_ragdoll_thread, "Simulate ragdolls on their own thread instead of during the frame.");
+	r_ragdoll_maxsteps = Cvar_Get("r_ragdoll_maxsteps", "8", CVAR_ARCHIVE|CVARDOC_INT);
+	Cvar_Describe (r_ragdoll_maxsteps, "Most 1/120 second ragdoll steps run to catch up after a slow frame. Any more time is skipped.");
+	r_ragdoll_meshcache = Cvar_Get("r_ragdoll_meshcache", "1", CVAR_ARCHIVE|CVARDOC_BOOL);
+	Cvar_Describe (r_ragdoll_meshcache, "Load the ragdoll collision mesh for the world from maps/<map>.odemesh, writing that file when it is missing or out of date. Takes effect on the next map load.");
 
 	sys_priority = Cvar_Get("sys_priority", "0", CVAR_ARCHIVE);
 	sys_affinity = Cvar_Get("sys_affinity", "1", CVAR_ARCHIVE);
@@ -1435,6 +1588,9 @@ void R_Register( void )
 	Cmd_AddCommand( "imagelist", GL_ImageList_f );
 	Cmd_AddCommand( "screenshot", GL_ScreenShot_f );
 	Cmd_AddCommand( "modellist", Mod_Modellist_f );
+	Cmd_AddCommand( "iqmbench", IQM_Bench_f );
+	Cmd_AddCommand( "ragdollbench", R_RagdollBench_f );
+	Cmd_AddCommand( "worldcullbench", R_WorldCullBench_f );
 	Cmd_AddCommand( "gl_strings", GL_Strings_f );
 }
 
@@ -1752,6 +1908,12 @@ R_Shutdown
 void R_Shutdown (void)
 {
 	Cmd_RemoveCommand ("modellist");
+	Cmd_RemoveCommand ("iqmbench");
+	Cmd_RemoveCommand ("ragdollbench");
+	Cmd_RemoveCommand ("worldcullbench");
+	R_FreeSurfCache ();
+
+	RGD_StopThread ();
 	Cmd_RemoveCommand ("screenshot");
 	Cmd_RemoveCommand ("imagelist");
 	Cmd_RemoveCommand ("gl_strings");
@@ -27,6 +27,12 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #include "game/q_shared.h"
 #include "r_math.h"
 
+#if defined __SSE__
+#include <xmmintrin.h>
+#elif defined __ARM_NEON
+#include <arm_neon.h>
+#endif
+
 const mat4x4_t mat4x4_identity =
 {
 	1, 0, 0, 0,
@@ -320,6 +326,86 @@ void Matrix3x4_Copy (matrix3x4_t *out, matrix3x4_t in)
 	Vector4Copy(in.c, out->c);
 }
 
+/*
+================
+Matrix3x4_MultiplyFast
+
+Matrix3x4_Multiply for the skeletal animation loops, which takes pointers
+and works a row at a time in vector registers where it can. The sums are
+done in the same order, so the results match. out may be either input.
+================
+*/
+void Matrix3x4_MultiplyFast (matrix3x4_t *out, const matrix3x4_t *mat1, const matrix3x4_t *mat2)
+{
+#if defined __SSE__
+	__m128	a = _mm_loadu_ps (mat2->a);
+	__m128	b = _mm_loadu_ps (mat2->b);
+	__m128	c = _mm_loadu_ps (mat2->c);
+	__m128	ra, rb, rc;
+
+	ra = _mm_add_ps (_mm_add_ps (_mm_mul_ps (a, _mm_set1_ps (mat1->a[0])),
+		_mm_mul_ps (b, _mm_set1_ps (mat1->a[1]))), _mm_mul_ps (c, _mm_set1_ps (mat1->a[2])));
+	ra = _mm_add_ps (ra, _mm_set_ps (mat1->a[3], 0, 0, 0));
+	rb = _mm_add_ps (_mm_add_ps (_mm_mul_ps (a, _mm_set1_ps (mat1->b[0])),
+		_mm_mul_ps (b, _mm_set1_ps (mat1->b[1]))), _mm_mul_ps (c, _mm_set1_ps (mat1->b[2])));
+	rb = _mm_add_ps (rb, _mm_set_ps (mat1->b[3], 0, 0, 0));
+	rc = _mm_add_ps (_mm_add_ps (_mm_mul_ps (a, _mm_set1_ps (mat1->c[0])),
+		_mm_mul_ps (b, _mm_set1_ps (mat1->c[1]))), _mm_mul_ps (c, _mm_set1_ps (mat1->c[2])));
+	rc = _mm_add_ps (rc, _mm_set_ps (mat1->c[3], 0, 0, 0));
+
+	_mm_storeu_ps (out->a, ra);
+	_mm_storeu_ps (out->b, rb);
+	_mm_storeu_ps (out->c, rc);
+#elif defined __ARM_NEON
+	float32x4_t	a = vld1q_f32 (mat2->a);
+	float32x4_t	b = vld1q_f32 (mat2->b);
+	float32x4_t	c = vld1q_f32 (mat2->c);
+	float32x4_t	ra, rb, rc;
+	float		ta = mat1->a[3], tb = mat1->b[3], tc = mat1->c[3];
+
+	ra = vaddq_f32 (vaddq_f32 (vmulq_n_f32 (a, mat1->a[0]), vmulq_n_f32 (b, mat1->a[1])), vmulq_n_f32 (c, mat1->a[2]));
+	rb = vaddq_f32 (vaddq_f32 (vmulq_n_f32 (a, mat1->b[0]), vmulq_n_f32 (b, mat1->b[1])), vmulq_n_f32 (c, mat1->b[2]));
+	rc = vaddq_f32 (vaddq_f32 (vmulq_n_f32 (a, mat1->c[0]), vmulq_n_f32 (b, mat1->c[1])), vmulq_n_f32 (c, mat1->c[2]));
+
+	vst1q_f32 (out->a, vsetq_lane_f32 (vgetq_lane_f32 (ra, 3) + ta, ra, 3));
+	vst1q_f32 (out->b, vsetq_lane_f32 (vgetq_lane_f32 (rb, 3) + tb, rb, 3));
+	vst1q_f32 (out->c, vsetq_lane_f32 (vgetq_lane_f32 (rc, 3) + tc, rc, 3));
+#else
+	Matrix3x4_Multiply (out, *mat1, *mat2);
+#endif
+}
+
+/*
+================
+Matrix3x4_Lerp
+
+out = mat1 * (1 - frac) + mat2 * frac, in one pass. out may be either input.
+================
+*/
+void Matrix3x4_Lerp (matrix3x4_t *out, const matrix3x4_t *mat1, const matrix3x4_t *mat2, float frac)
+{
+#if defined __SSE__
+	__m128	f1 = _mm_set1_ps (1 - frac);
+	__m128	f2 = _mm_set1_ps (frac);
+
+	_mm_storeu_ps (out->a, _mm_add_ps (_mm_mul_ps (_mm_loadu_ps (mat1->a), f1), _mm_mul_ps (_mm_loadu_ps (mat2->a), f2)));
+	_mm_storeu_ps (out->b, _mm_add_ps (_mm_mul_ps (_mm_loadu_ps (mat1->b), f1), _mm_mul_ps (_mm_loadu_ps (mat2->b), f2)));
+	_mm_storeu_ps (out->c, _mm_add_ps (_mm_mul_ps (_mm_loadu_ps (mat1->c), f1), _mm_mul_ps (_mm_loadu_ps (mat2->c), f2)));
+#elif defined __ARM_NEON
+	float	f1 = 1 - frac;
+
+	vst1q_f32 (out->a, vaddq_f32 (vmulq_n_f32 (vld1q_f32 (mat1->a), f1), vmulq_n_f32 (vld1q_f32 (mat2->a), frac)));
+	vst1q_f32 (out->b, vaddq_f32 (vmulq_n_f32 (vld1q_f32 (mat1->b), f1), vmulq_n_f32 (vld1q_f32 (mat2->b), frac)));
+	vst1q_f32 (out->c, vaddq_f32 (vmulq_n_f32 (vld1q_f32 (mat1->c), f1), vmulq_n_f32 (vld1q_f32 (mat2->c), frac)));
+#else
+	matrix3x4_t	temp;
+
+	Matrix3x4_Scale (&temp, *mat2, frac);
+	Matrix3x4_Scale (out, *mat1, 1 - frac);
+	Matrix3x4_Add (out, *out, temp);
+#endif
+}
+
 void Matrix3x4GenRotate (matrix3x4_t *out, float angle, const vec3_t axis)
 {
 	float ck = cos(angle), sk = sin(angle);
@@ -46,6 +46,8 @@ void Matrix3x4_Multiply (matrix3x4_t *out, matrix3x4_t mat1, matrix3x4_t mat2);
 void Matrix3x4_Scale (matrix3x4_t *out, matrix3x4_t in, float scale);
 void Matrix3x4_Add (matrix3x4_t *out, matrix3x4_t mat1, matrix3x4_t mat2);
 void Matrix3x4_Copy (matrix3x4_t *out, matrix3x4_t in);
+void Matrix3x4_MultiplyFast (matrix3x4_t *out, const matrix3x4_t *mat1, const matrix3x4_t *mat2);
+void Matrix3x4_Lerp (matrix3x4_t *out, const matrix3x4_t *mat1, const matrix3x4_t *mat2, float frac);
 void Matrix3x4GenRotate (matrix3x4_t *out, float angle, const vec3_t axis);
 
 void R_CalcTangent
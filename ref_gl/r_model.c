@@ -539,11 +539,21 @@ model_t *Mod_ForName (char *name, qboolean crash)
 	COM_StripExtension(mod->name, shortname);
 	strcat(shortname, ".iqm");
 
-	modfilelen = FS_LoadFile (shortname, (void**)&buf);
+	// binary models are mapped rather than copied; terrain and decal
+	// files are text and need FS_LoadFile's nul terminator
+	modfilelen = FS_MapFile (shortname, (void**)&buf);
 
 	if(!buf) //could not find iqm
 	{
-		modfilelen = FS_LoadFile (mod->name, (void**)&buf);
+		if (strstr (mod->name, ".terrain"))
+			is_terrain = true;
+		else if (strstr (mod->name, ".decal"))
+			is_decal = true;
+
+		if (is_terrain || is_decal)
+			modfilelen = FS_LoadFile (mod->name, (void**)&buf);
+		else
+			modfilelen = FS_MapFile (mod->name, (void**)&buf);
 		if (!buf)
 		{
 			if (crash)
@@ -551,10 +561,6 @@ model_t *Mod_ForName (char *name, qboolean crash)
 			memset (mod->name, 0, sizeof(mod->name));
 			return NULL;
 		}
-		if (strstr (mod->name, ".terrain"))
-			is_terrain = true;
-		else if (strstr (mod->name, ".decal"))
-			is_decal = true;
 	}
 	else
 	{
@@ -606,7 +612,10 @@ model_t *Mod_ForName (char *name, qboolean crash)
 		}
 	}
 
-	FS_FreeFile (buf);
+	if (is_terrain || is_decal)
+		FS_FreeFile (buf);
+	else
+		FS_UnmapFile (buf);
 	
 	return mod;
 }
@@ -2158,6 +2167,8 @@ void R_BeginRegistration (char *model)
 	//ODE
 	RGD_BuildWorldTrimesh ();
 
+	R_FreeSurfCache ();
+
 	//VBO
 	VB_BuildWorldVBO();
 }
@@ -341,6 +341,10 @@ typedef struct {
 // NOTE: Keep this up-to-date with the GLSL shaders.
 #define SKELETAL_MAX_BONEMATS 70
 
+// joints that IQM_AnimateFrame bends for the player's pitch and roll
+#define IQM_JOINT_SPINE		1
+#define IQM_JOINT_HIP		2
+
 typedef enum {mod_bad, mod_brush, mod_md2, mod_iqm, mod_terrain, mod_decal, num_modtypes} modtype_t;
 
 // These flags (for mod->typeFlags) encode the traits of various mesh formats.
@@ -491,6 +495,8 @@ typedef struct model_s
 	int				num_poses;
 	char			skinname[MAX_QPATH];
 	char			*jointname;
+	byte			*jointflags;	// IQM_JOINT_*, resolved from the names at load
+	signed char		*jointbind;		// index into RagDollBinds, or -1
 	//end iqm
 
 	//md2 and iqm.
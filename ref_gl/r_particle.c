@@ -63,6 +63,93 @@ static int compare_particle (const void *_a, const void *_b)
 	return 0;
 }
 
+/*
+===============
+PART_SortParticles
+
+Same order as compare_particle, but as a radix sort on a packed key:
+three linear passes instead of qsort's n log n calls through a pointer.
+The blend factors in use are GL_ZERO, GL_ONE and the 0x300 block, which
+fit in five bits without changing their order.
+===============
+*/
+#define PART_SORTBITS	11
+#define PART_SORTSIZE	(1<<PART_SORTBITS)
+
+static unsigned PART_BlendKey (int blend)
+{
+	return (blend & 0xf) | ((blend >> 4) & 0x10);
+}
+
+static void PART_SortParticles (int num_particles, particle_t **particles)
+{
+	static unsigned		keys[2][MAX_PARTICLES];
+	static particle_t	*tmp[MAX_PARTICLES];
+	static unsigned		counts[PART_SORTSIZE];
+	unsigned			*srckeys, *dstkeys, key;
+	particle_t			**src, **dst, **swap;
+	particle_t			*p;
+	int					i, shift, sum, c;
+
+	if (num_particles > MAX_PARTICLES)
+	{
+		qsort (particles, num_particles, sizeof (particle_t *), compare_particle);
+		return;
+	}
+
+	for (i = 0; i < num_particles; i++)
+	{
+		p = particles[i];
+		if (p->image == NULL)
+		{
+			keys[0][i] = 0;
+			continue;
+		}
+		if (p->image->texnum < 0 || p->image->texnum >= (1<<22)-1
+				|| PART_BlendKey (p->blendsrc) >= 32 || PART_BlendKey (p->blenddst) >= 32)
+		{	// doesn't pack, not that we've ever seen one
+			qsort (particles, num_particles, sizeof (particle_t *), compare_particle);
+			return;
+		}
+		keys[0][i] = ((p->image->texnum+1) << 10) | (PART_BlendKey (p->blendsrc) << 5)
+				| PART_BlendKey (p->blenddst);
+	}
+
+	src = particles;
+	dst = tmp;
+	srckeys = keys[0];
+	dstkeys = keys[1];
+	for (shift = 0; shift < 32; shift += PART_SORTBITS)
+	{
+		memset (counts, 0, sizeof(counts));
+		for (i = 0; i < num_particles; i++)
+			counts[(srckeys[i] >> shift) & (PART_SORTSIZE-1)]++;
+		if (counts[(srckeys[0] >> shift) & (PART_SORTSIZE-1)] == num_particles)
+			continue;	// every key has the same digit here
+
+		for (i = 0, sum = 0; i < PART_SORTSIZE; i++)
+		{
+			c = counts[i];
+			counts[i] = sum;
+			sum += c;
+		}
+		for (i = 0; i < num_particles; i++)
+		{
+			key = srckeys[i];
+			c = counts[(key >> shift) & (PART_SORTSIZE-1)]++;
+			dst[c] = src[i];
+			dstkeys[c] = key;
+		}
+
+		swap = src; src = dst; dst = swap;
+		srckeys = dstkeys;
+		dstkeys = (srckeys == keys[0]) ? keys[1] : keys[0];
+	}
+
+	if (src != particles)
+		memcpy (particles, src, num_particles * sizeof (particle_t *));
+}
+
 void PART_AddBillboardToVArray (	const vec3_t origin, const vec3_t up,
 									const vec3_t right, float sway,
 									qboolean notsideways, float sl, float sh,
@@ -132,7 +219,7 @@ void PART_DrawParticles( int num_particles, particle_t **particles, const unsign
 	
 	qglDisable (GL_CULL_FACE);
 	
-	qsort (particles, num_particles, sizeof (particle_t *), compare_particle);
+	PART_SortParticles (num_particles, particles);
 	
 	for ( p1 = particles, i=0; i < num_particles ; i++,p1++)
 	{
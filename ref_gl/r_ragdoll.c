@@ -25,6 +25,10 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #include "r_local.h"
 #include "r_ragdoll.h"
 
+#if !defined WIN32_VARIANT
+#include <unistd.h>
+#endif
+
 //This file will handle all of the ragdoll calculations, etc.
 
 //Notes:
@@ -43,6 +47,22 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 cvar_t *r_ragdolls;
 cvar_t *r_ragdoll_debug;
+cvar_t *r_ragdoll_thread;
+cvar_t *r_ragdoll_maxsteps;
+cvar_t *r_ragdoll_meshcache;
+
+// simulation clock and thread, see R_SimulateAllRagdolls
+static struct
+{
+	void				*lock;			// held for anything that touches the ODE world
+	void				*frontlock;		// held for the rest of what both threads use
+	void				*thread;
+	qboolean			stop;
+	int					maxsteps;		// r_ragdoll_maxsteps
+	int					dropped;		// steps dropped since the last frame
+	unsigned long long	simtime;		// usec, when the last step ended
+	unsigned long long	fronttime;		// simtime of the front states
+} rgd;
 
 vec3_t rightAxis, leftAxis, upAxis, downAxis, bkwdAxis, fwdAxis;
 
@@ -69,6 +89,7 @@ extern void Matrix3x4_Invert(matrix3x4_t *out, matrix3x4_t in);
 extern void Matrix3x4_Multiply(matrix3x4_t *out, matrix3x4_t mat1, matrix3x4_t mat2);
 extern void Matrix3x4_Add(matrix3x4_t *out, matrix3x4_t mat1, matrix3x4_t mat2);
 extern void Matrix3x4_Scale(matrix3x4_t *out, matrix3x4_t in, float scale);
+extern void Matrix3x4GenFromODE(matrix3x4_t *out, const dReal *rot, const dReal *trans);
 
 //routine to create ragdoll body parts between two joints
 static void RGD_addBody (const model_t *mod, int RagDollID, matrix3x4_t *bindmat, char *name, int objectID, vec3_t p1, vec3_t p2, float radius, float density)
@@ -320,7 +341,7 @@ void RGD_CreateWorldObject( void )
 	VectorSet(bkwdAxis, 0.0, 0.0, 1.0);
 	VectorSet(fwdAxis, 0.0, 0.0, -1.0);
 
-	lastODEUpdate = Sys_Milliseconds();
+	rgd.simtime = rgd.fronttime = Sys_Microseconds();
 }
 
 void RGD_DestroyWorldObject( void )
@@ -371,6 +392,99 @@ RagDollBind_t RagDollBinds[] =
 int RagDollBindsCount = (int)(sizeof(RagDollBinds)/sizeof(RagDollBinds[0]));
 
 //build and set initial position of ragdoll
+static void RGD_Lock (void)
+{
+	if (!rgd.lock)
+		rgd.lock = Sys_CreateMutex ();
+	Sys_LockMutex (rgd.lock);
+}
+
+static void RGD_Unlock (void)
+{
+	Sys_UnlockMutex (rgd.lock);
+}
+
+// Never held while waiting for rgd.lock, take that one first.
+static void RGD_LockFront (void)
+{
+	if (!rgd.frontlock)
+		rgd.frontlock = Sys_CreateMutex ();
+	Sys_LockMutex (rgd.frontlock);
+}
+
+static void RGD_UnlockFront (void)
+{
+	Sys_UnlockMutex (rgd.frontlock);
+}
+
+// Shifts the last step's body states back and records the current ones,
+// into both slots for a ragdoll that was just created.
+static void RGD_SaveStates (int RagDollID, qboolean both)
+{
+	RagDoll_t *rd = &RagDoll[RagDollID];
+	const dReal *odePos, *odeQuat;
+	int i, j;
+
+	memcpy (rd->state[0], rd->state[1], sizeof(rd->state[1]));
+
+	for (i = CHEST; i <= LEFTHAND; i++)
+	{
+		if (!rd->RagDollObject[i].body)
+			continue;
+		odePos = dBodyGetPosition (rd->RagDollObject[i].body);
+		odeQuat = dBodyGetQuaternion (rd->RagDollObject[i].body);
+		for (j = 0; j < 3; j++)
+			rd->state[1][i].pos[j] = odePos[j];
+		for (j = 0; j < 4; j++)
+			rd->state[1][i].quat[j] = odeQuat[j];
+	}
+
+	if (both)
+		memcpy (rd->state[0], rd->state[1], sizeof(rd->state[1]));
+}
+
+// Hands the last two steps over to the frame, called with both locks held.
+static void RGD_PublishStates (int RagDollID)
+{
+	RagDoll_t *rd = &RagDoll[RagDollID];
+
+	memcpy (rd->front, rd->state, sizeof(rd->front));
+}
+
+// Builds the body matrices the mesh is drawn with, frac of the way from the
+// next to last step to the last one, called with the front lock held.
+static void RGD_InterpolateBodies (int RagDollID, float frac)
+{
+	RagDoll_t *rd = &RagDoll[RagDollID];
+	const RagDollState_t *from, *to;
+	dQuaternion quat;
+	dVector3 pos;
+	dMatrix3 rot;
+	dReal sign;
+	int i, j;
+
+	for (i = CHEST; i <= LEFTHAND; i++)
+	{
+		if (!rd->RagDollObject[i].body)
+			continue;
+		from = &rd->front[0][i];
+		to = &rd->front[1][i];
+
+		// q and -q are the same rotation, go the short way round
+		sign = from->quat[0]*to->quat[0] + from->quat[1]*to->quat[1]
+			+ from->quat[2]*to->quat[2] + from->quat[3]*to->quat[3] < 0 ? -1 : 1;
+		for (j = 0; j < 4; j++)
+			quat[j] = from->quat[j] + (to->quat[j]*sign - from->quat[j]) * frac;
+		if (!dSafeNormalize4 (quat))
+			memcpy (quat, to->quat, sizeof(quat));
+		for (j = 0; j < 3; j++)
+			pos[j] = from->pos[j] + (to->pos[j] - from->pos[j]) * frac;
+
+		dRfromQ (rot, quat);
+		Matrix3x4GenFromODE (&rd->bodymat[i], rot, pos);
+	}
+}
+
 static void RGD_RagdollBody_Init (const entity_t *ent, const model_t *mod, int RagDollID, float velocity)
 {
 	//Ragdoll  positions
@@ -400,7 +514,7 @@ static void RGD_RagdollBody_Init (const entity_t *ent, const model_t *mod, int R
 	matrix3x4_t entmat, temp, bindmat[MAX_RAGDOLL_OBJECTS];
  	int bindweight[MAX_RAGDOLL_OBJECTS];
 
-	int i, j;
+	int i;
 
 	//we need some information from the current entity
 
@@ -426,18 +540,14 @@ static void RGD_RagdollBody_Init (const entity_t *ent, const model_t *mod, int R
 	memset(bindweight, 0, sizeof(bindweight));
 	for(i = 0; i < mod->num_joints; i++)
 	{
-		for(j = 0; j < RagDollBindsCount; j++)
+		if(mod->jointbind[i] >= 0)
 		{
-			if(!strcmp(&mod->jointname[mod->joints[i].name], RagDollBinds[j].name))
-			{
-				int object = RagDollBinds[j].object;
-				if (!IS_NAN (RagDoll[RagDollID].initframe[i].a[0])) {
-					Matrix3x4_Add(&bindmat[object], bindmat[object], RagDoll[RagDollID].initframe[i]);
-				}
-				bindweight[object]++;
-				break;
+			int object = RagDollBinds[mod->jointbind[i]].object;
+			if (!IS_NAN (RagDoll[RagDollID].initframe[i].a[0])) {
+				Matrix3x4_Add(&bindmat[object], bindmat[object], RagDoll[RagDollID].initframe[i]);
 			}
-		}		
+			bindweight[object]++;
+		}
 	}
 	Matrix3x4ForEntity (&entmat, ent);
 	for(i = 0; i < MAX_RAGDOLL_OBJECTS; i++)
@@ -635,6 +745,13 @@ static void RGD_RagdollBody_Init (const entity_t *ent, const model_t *mod, int R
 	RGD_addHingeJoint (mod, RagDollID, bindmat, LEFTWRIST, LEFTFOREARM,
 		LEFTHAND, L_WRIST_POS, bkwdAxis, mod->ragdoll.RagDollDims[WRIST_LOSTOP] * (float)M_PI,
 		mod->ragdoll.RagDollDims[WRIST_HISTOP] * (float)M_PI);
+
+	RGD_SaveStates (RagDollID, true);
+	RGD_LockFront ();
+	RGD_PublishStates (RagDollID);
+	RagDoll[RagDollID].setvel = false;
+	RGD_InterpolateBodies (RagDollID, 1);
+	RGD_UnlockFront ();
 }
 
 //For adding a single BSP surface(comprised of multiple triangles).
@@ -750,16 +867,334 @@ static void RGD_BuildODETerrainGeoms (void)
 }
 
 /*
-=============
-R_DrawWorldTrimesh
-=============
+==============================================================================
+
+WORLD TRIMESH CACHE
+
+Walking every surface and terrain triangle for the world trimesh is slow on
+big maps, so the welded mesh is kept in maps/<map>.odemesh and reused while
+the BSP checksum and the terrain still match. ODE has no way to save or load
+its OPCODE tree, so that is still built on each load; the cache holds what
+goes into it, plus the concave edge flags ODE would otherwise recompute.
+
+==============================================================================
 */
-void RGD_BuildWorldTrimesh (void)
+
+#define ODEMESH_IDENT	(('H'<<24)+('S'<<16)+('M'<<8)+'O')	// "OMSH", little-endian
+#define ODEMESH_VERSION	1
+#define ODEMESH_MAXVERTS	(1<<24)
+
+typedef struct
 {
-	dMatrix3 rot;
-	msurface_t *surf;	
+	int			ident;
+	int			version;
+	unsigned	checksum;		// of the BSP, from CM_MapChecksum
+	unsigned	terrainhash;	// RGD_TerrainHash
+	int			numverts;		// float[3] each
+	int			numtris;		// int[3] each
+	int			numflags;		// 0 or numtris bytes of dTRIMESHDATA_USE_FLAGS
+} odemeshheader_t;
+
+// the terrain comes from its own model files, which can change under an
+// unchanged BSP
+static unsigned RGD_TerrainHash (void)
+{
+	unsigned	hash = 2166136261u;
+	int			i, j, numvertices, numtriangles, tri[3];
+	vec3_t		v;
+	union { float f; unsigned u; } word;
 
-	RagDollTriWorld.numODEVerts = RagDollTriWorld.numODETris = 0;
+	numvertices = CM_NumVertices ();
+	numtriangles = CM_NumTriangles ();
+
+	for (i = 0; i < numvertices; i++)
+	{
+		CM_GetVertex (i, v);
+		for (j = 0; j < 3; j++)
+		{
+			word.f = v[j];
+			hash = (hash ^ word.u) * 16777619u;
+		}
+	}
+	for (i = 0; i < numtriangles; i++)
+	{
+		CM_GetTriangle (i, tri);
+		for (j = 0; j < 3; j++)
+			hash = (hash ^ (unsigned)tri[j]) * 16777619u;
+	}
+
+	return hash;
+}
+
+static qboolean RGD_ReserveWorldTrimesh (int numverts, int numtris)
+{
+	dVector3 *newVerts;
+	dTriIndex *newTris;
+
+	if (numverts > RagDollTriWorld.maxODEVerts)
+	{
+		newVerts = (dVector3 *)realloc (RagDollTriWorld.ODEVerts, numverts*sizeof(dVector3));
+		if (!newVerts) return false;
+		RagDollTriWorld.maxODEVerts = numverts;
+		RagDollTriWorld.ODEVerts = newVerts;
+	}
+	if (numtris > RagDollTriWorld.maxODETris)
+	{
+		newTris = (dTriIndex *)realloc (RagDollTriWorld.ODETris, numtris*sizeof(dTriIndex[3]));
+		if (!newTris) return false;
+		RagDollTriWorld.maxODETris = numtris;
+		RagDollTriWorld.ODETris = newTris;
+	}
+	return true;
+}
+
+// BSP coordinates are mostly whole numbers, whose floats end in a run of zero
+// bits, so mix the high bits down before the table masks off the low ones
+static unsigned RGD_HashVertex (const dReal *v)
+{
+	union { float f; unsigned u; } x, y, z;
+	unsigned h;
+
+	x.f = v[0];
+	y.f = v[1];
+	z.f = v[2];
+	h = (x.u * 73856093u) ^ (y.u * 19349663u) ^ (z.u * 83492791u);
+	h ^= h >> 16;
+	h *= 0x85ebca6bu;
+	h ^= h >> 13;
+	return h;
+}
+
+// Every BSP polygon brings its own copy of its corners. Merge the ones that
+// are exactly equal, so neighbouring triangles share edges and ODE can tell
+// which of those edges are concave, and drop the triangles that collapse.
+static void RGD_WeldWorldTrimesh (void)
+{
+	dVector3	*v = RagDollTriWorld.ODEVerts;
+	dTriIndex	*t = RagDollTriWorld.ODETris;
+	int			*hash, *chain, *remap;
+	int			hashsize, numverts, numtris, i, j;
+	unsigned	h;
+
+	if (!RagDollTriWorld.numODEVerts)
+		return;
+
+	for (hashsize = 256; hashsize < RagDollTriWorld.numODEVerts; hashsize <<= 1)
+		;
+	hash = (int *)malloc (hashsize*sizeof(int));
+	chain = (int *)malloc (RagDollTriWorld.numODEVerts*sizeof(int));
+	remap = (int *)malloc (RagDollTriWorld.numODEVerts*sizeof(int));
+	if (!hash || !chain || !remap)
+	{	// the unwelded mesh still works
+		free (hash);
+		free (chain);
+		free (remap);
+		return;
+	}
+	memset (hash, -1, hashsize*sizeof(int));
+
+	numverts = 0;
+	for (i = 0; i < RagDollTriWorld.numODEVerts; i++)
+	{
+		h = RGD_HashVertex (v[i]) & (hashsize-1);
+		for (j = hash[h]; j != -1; j = chain[j])
+		{
+			if (v[j][0] == v[i][0] && v[j][1] == v[i][1] && v[j][2] == v[i][2])
+				break;
+		}
+		if (j == -1)
+		{
+			j = numverts++;
+			v[j][0] = v[i][0];
+			v[j][1] = v[i][1];
+			v[j][2] = v[i][2];
+			chain[j] = hash[h];
+			hash[h] = j;
+		}
+		remap[i] = j;
+	}
+
+	numtris = 0;
+	for (i = 0; i < RagDollTriWorld.numODETris; i++)
+	{
+		int a = remap[t[i*3+0]], b = remap[t[i*3+1]], c = remap[t[i*3+2]];
+
+		if (a == b || b == c || a == c)
+			continue;
+		t[numtris*3+0] = a;
+		t[numtris*3+1] = b;
+		t[numtris*3+2] = c;
+		numtris++;
+	}
+
+	RagDollTriWorld.numODEVerts = numverts;
+	RagDollTriWorld.numODETris = numtris;
+
+	free (hash);
+	free (chain);
+	free (remap);
+}
+
+static qboolean RGD_ParseWorldTrimesh (byte *buf, int length, unsigned checksum, unsigned terrainhash)
+{
+	odemeshheader_t	header;
+	float			*verts;
+	int				*tris;
+	int				i;
+	unsigned		index;
+
+	if (length < (int)sizeof(header))
+		return false;
+	memcpy (&header, buf, sizeof(header));
+	for (i = 0; i < (int)(sizeof(header)/sizeof(int)); i++)
+		((int *)&header)[i] = LittleLong (((int *)&header)[i]);
+
+	if (header.ident != ODEMESH_IDENT || header.version != ODEMESH_VERSION)
+		return false;
+	if (header.checksum != checksum || header.terrainhash != terrainhash)
+		return false;
+	if (header.numverts <= 0 || header.numverts > ODEMESH_MAXVERTS ||
+		header.numtris <= 0 || header.numtris > ODEMESH_MAXVERTS ||
+		(header.numflags && header.numflags != header.numtris))
+		return false;
+	if (length != (int)(sizeof(header) + header.numverts*3*sizeof(float) +
+		header.numtris*3*sizeof(int) + header.numflags))
+		return false;
+
+	if (!RGD_ReserveWorldTrimesh (header.numverts, header.numtris))
+		return false;
+
+	verts = (float *)(buf + sizeof(header));
+	for (i = 0; i < header.numverts; i++)
+	{
+		RagDollTriWorld.ODEVerts[i][0] = LittleFloat (verts[i*3+0]);
+		RagDollTriWorld.ODEVerts[i][1] = LittleFloat (verts[i*3+1]);
+		RagDollTriWorld.ODEVerts[i][2] = LittleFloat (verts[i*3+2]);
+	}
+
+	tris = (int *)(verts + header.numverts*3);
+	for (i = 0; i < header.numtris*3; i++)
+	{
+		index = LittleLong (tris[i]);
+		if (index >= (unsigned)header.numverts)
+			return false;
+		RagDollTriWorld.ODETris[i] = index;
+	}
+
+	if (header.numflags)
+	{
+		RagDollTriWorld.useFlags = (byte *)malloc (header.numflags);
+		if (!RagDollTriWorld.useFlags)
+			return false;
+		memcpy (RagDollTriWorld.useFlags, tris + header.numtris*3, header.numflags);
+	}
+
+	RagDollTriWorld.numODEVerts = header.numverts;
+	RagDollTriWorld.numODETris = header.numtris;
+	return true;
+}
+
+static qboolean RGD_LoadWorldTrimesh (const char *name, unsigned checksum, unsigned terrainhash)
+{
+	byte		*buf;
+	int			length;
+	qboolean	loaded;
+
+	length = FS_MapFile (name, (void **)&buf);
+	if (!buf)
+		return false;
+
+	loaded = RGD_ParseWorldTrimesh (buf, length, checksum, terrainhash);
+	FS_UnmapFile (buf);
+
+	if (!loaded)
+	{	// half read, start the build from scratch
+		RagDollTriWorld.numODEVerts = RagDollTriWorld.numODETris = 0;
+		if (RagDollTriWorld.useFlags)
+			free (RagDollTriWorld.useFlags);
+		RagDollTriWorld.useFlags = NULL;
+	}
+	return loaded;
+}
+
+static void RGD_WriteWorldTrimesh (const char *name, unsigned checksum, unsigned terrainhash)
+{
+	char			path[MAX_OSPATH];
+	odemeshheader_t	header;
+	FILE			*f;
+	int				*buf;
+	int				i, count;
+	union { float f; int i; } word;
+
+	count = max (RagDollTriWorld.numODEVerts, RagDollTriWorld.numODETris) * 3;
+	buf = (int *)malloc (count*sizeof(int));
+	if (!buf)
+		return;
+
+	Com_sprintf (path, sizeof(path), "%s/%s", FS_Gamedir(), name);
+	FS_CreatePath (path);
+	f = fopen (path, "wb");
+	if (!f)
+	{
+		Com_DPrintf ("Couldn't write %s\n", path);
+		free (buf);
+		return;
+	}
+
+	header.ident = ODEMESH_IDENT;
+	header.version = ODEMESH_VERSION;
+	header.checksum = checksum;
+	header.terrainhash = terrainhash;
+	header.numverts = RagDollTriWorld.numODEVerts;
+	header.numtris = RagDollTriWorld.numODETris;
+	header.numflags = RagDollTriWorld.useFlags ? RagDollTriWorld.numODETris : 0;
+	for (i = 0; i < (int)(sizeof(header)/sizeof(int)); i++)
+		((int *)&header)[i] = LittleLong (((int *)&header)[i]);
+	fwrite (&header, sizeof(header), 1, f);
+
+	for (i = 0; i < RagDollTriWorld.numODEVerts*3; i++)
+	{
+		word.f = LittleFloat (RagDollTriWorld.ODEVerts[i/3][i%3]);
+		buf[i] = word.i;
+	}
+	fwrite (buf, sizeof(int), RagDollTriWorld.numODEVerts*3, f);
+
+	for (i = 0; i < RagDollTriWorld.numODETris*3; i++)
+		buf[i] = LittleLong (RagDollTriWorld.ODETris[i]);
+	fwrite (buf, sizeof(int), RagDollTriWorld.numODETris*3, f);
+
+	if (RagDollTriWorld.useFlags)
+		fwrite (RagDollTriWorld.useFlags, 1, RagDollTriWorld.numODETris, f);
+
+	fclose (f);
+	free (buf);
+}
+
+// keep a copy of the edge flags ODE just worked out, for the cache file
+static void RGD_SaveUseFlags (void)
+{
+	unsigned char	*flags;
+#if defined WIN32_VARIANT
+	int				size;
+
+	dGeomTriMeshDataGetBuffer (RagDollTriWorld.triMesh, &flags, &size);
+#else
+	size_t			size;
+
+	flags = (unsigned char *)dGeomTriMeshDataGet2 (RagDollTriWorld.triMesh, dTRIMESHDATA_USE_FLAGS, &size);
+#endif
+	if (!flags || (int)size != RagDollTriWorld.numODETris)
+		return;
+
+	RagDollTriWorld.useFlags = (byte *)malloc (size);
+	if (RagDollTriWorld.useFlags)
+		memcpy (RagDollTriWorld.useFlags, flags, size);
+}
+
+// the uncached path: one triangle fan per BSP polygon, then the terrain
+static void RGD_BuildWorldTrimeshSoup (void)
+{
+	msurface_t *surf;
 
 	//build bsp portion of trimesh
 	for (surf = &r_worldmodel->surfaces[r_worldmodel->firstmodelsurface]; surf < &r_worldmodel->surfaces[r_worldmodel->firstmodelsurface + r_worldmodel->nummodelsurfaces] ; surf++)
@@ -779,6 +1214,42 @@ void RGD_BuildWorldTrimesh (void)
 	
 	//add terrain meshes
 	RGD_BuildODETerrainGeoms ();
+}
+
+/*
+=============
+R_DrawWorldTrimesh
+=============
+*/
+void RGD_BuildWorldTrimesh (void)
+{
+	dMatrix3 rot;
+	char mapbase[MAX_QPATH], cachename[MAX_QPATH];
+	unsigned checksum = 0, terrainhash = 0;
+	unsigned long long start;
+	qboolean cached = false;
+
+	RGD_StopThread(); // the world geometry is about to change
+
+	RagDollTriWorld.numODEVerts = RagDollTriWorld.numODETris = 0;
+
+	start = Sys_Microseconds();
+
+	// the collision map has to be this one for its checksum and terrain
+	if (r_ragdoll_meshcache->integer && !strcmp(map_name, r_worldmodel->name))
+	{
+		checksum = CM_MapChecksum();
+		terrainhash = RGD_TerrainHash();
+		COM_StripExtension(r_worldmodel->name, mapbase);
+		Com_sprintf(cachename, sizeof(cachename), "%s.odemesh", mapbase);
+		cached = RGD_LoadWorldTrimesh(cachename, checksum, terrainhash);
+	}
+
+	if (!cached)
+	{
+		RGD_BuildWorldTrimeshSoup();
+		RGD_WeldWorldTrimesh();
+	}
 
 	dRSetIdentity(rot);
 
@@ -789,6 +1260,26 @@ void RGD_BuildWorldTrimesh (void)
 	dGeomTriMeshDataBuildSimple(RagDollTriWorld.triMesh, (dReal*)RagDollTriWorld.ODEVerts, RagDollTriWorld.numODEVerts,
 		RagDollTriWorld.ODETris, RagDollTriWorld.numODETris*3);
 
+	if (RagDollTriWorld.useFlags)
+	{
+#if defined WIN32_VARIANT
+		dGeomTriMeshDataSetBuffer(RagDollTriWorld.triMesh, RagDollTriWorld.useFlags);
+#else
+		dGeomTriMeshDataSet(RagDollTriWorld.triMesh, dTRIMESHDATA_USE_FLAGS, RagDollTriWorld.useFlags);
+#endif
+	}
+	else
+	{
+#if defined WIN32_VARIANT
+		dGeomTriMeshDataPreprocess(RagDollTriWorld.triMesh);
+#else
+		dGeomTriMeshDataPreprocess2(RagDollTriWorld.triMesh, 1U << dTRIDATAPREPROCESS_BUILD_CONCAVE_EDGES, NULL);
+#endif
+		RGD_SaveUseFlags();
+		if (checksum && RagDollTriWorld.numODETris)
+			RGD_WriteWorldTrimesh(cachename, checksum, terrainhash);
+	}
+
 	RagDollTriWorld.geom = dCreateTriMesh(RagDollSpace, RagDollTriWorld.triMesh, NULL, NULL, NULL);
 	dGeomSetData(RagDollTriWorld.geom, "surface");
 
@@ -797,8 +1288,13 @@ void RGD_BuildWorldTrimesh (void)
 
 	dGeomSetPosition(RagDollTriWorld.geom, 0, 0, 0);
 	dGeomSetRotation(RagDollTriWorld.geom, rot);
+
+	Com_DPrintf("World trimesh: %i verts, %i tris, %s in %.1f ms\n",
+		RagDollTriWorld.numODEVerts, RagDollTriWorld.numODETris,
+		cached ? "cached" : "built", (Sys_Microseconds() - start) / 1000.0);
 }
 
+
 /*
 	Callback function for the collide() method.
 
@@ -905,6 +1401,12 @@ void RGD_DestroyWorldTrimesh (void)
 	if(RagDollTriWorld.geom)
 		dGeomDestroy(RagDollTriWorld.geom);
 	RagDollTriWorld.geom = NULL;
+	if(RagDollTriWorld.triMesh)
+		dGeomTriMeshDataDestroy(RagDollTriWorld.triMesh);
+	RagDollTriWorld.triMesh = NULL;
+	if(RagDollTriWorld.useFlags)
+		free(RagDollTriWorld.useFlags);
+	RagDollTriWorld.useFlags = NULL;
 	if(RagDollTriWorld.ODEVerts)
 		free(RagDollTriWorld.ODEVerts);
 	RagDollTriWorld.ODEVerts = NULL;
@@ -915,11 +1417,168 @@ void RGD_DestroyWorldTrimesh (void)
 	RagDollTriWorld.maxODETris = 0;
 }
 
+/*
+==============================================================================
+
+SIMULATION
+
+The ragdoll world steps exactly 1/120th of a second at a time, which also
+seems to make ODE a lot less crashy. With r_ragdoll_thread set the steps
+run on their own thread, otherwise R_SimulateAllRagdolls runs the ones
+that are due each frame. After every step the body positions and
+orientations are saved along with the previous step's, and the frame is
+drawn between the two, one step behind the simulation. Anything that
+touches the ODE world holds rgd.lock, which the steps take one at a time.
+The saved states are copied to the front ones the frame draws from under
+the short front lock, and velocities the frame sets go the other way, so
+drawing never waits on a step. No more than r_ragdoll_maxsteps
+steps are run to catch up, the rest of the time is dropped, so a hitch
+can't turn into a longer one.
+
+==============================================================================
+*/
+
+static void RGD_WorldStep (void)
+{
+	dSpaceCollide(RagDollSpace, 0, &near_callback);
+#if defined WIN32_VARIANT
+	dWorldStepFast1(RagDollWorld, (float)RAGDOLL_STEP_USEC/1000000.0f, MIN_ODESTEPS);
+#else
+	/* ODE library 0.12 does not support dWorldStepFast1.
+	 * Using dWorldQuickStep. See RGD_CreateWorldObject(), above.
+	 */
+	dWorldQuickStep(RagDollWorld, (dReal)RAGDOLL_STEP_USEC/1000000.0);
+#endif
+	// Remove all temporary collision joints now that the world has been stepped
+	dJointGroupEmpty(contactGroup);
+}
+
+// Runs the steps that are due at now, on whichever thread does the
+// simulating. rgd.simtime belongs to that thread.
+static void RGD_RunSteps (unsigned long long now)
+{
+	RagDoll_t *rd;
+	int RagDollID, steps, maxsteps, dropped = 0;
+
+	RGD_LockFront ();
+	maxsteps = rgd.maxsteps;
+	RGD_UnlockFront ();
+
+	RGD_Lock ();
+	for (RagDollID = 0; RagDollID < MAX_RAGDOLLS; RagDollID++)
+	{
+		if (!RagDoll[RagDollID].destroyed)
+			break;
+	}
+	RGD_Unlock ();
+	if (RagDollID == MAX_RAGDOLLS || now < rgd.simtime)
+	{	// nothing to simulate, don't let the clock fall behind
+		rgd.simtime = now;
+		return;
+	}
+
+	steps = (now - rgd.simtime) / RAGDOLL_STEP_USEC;
+	if (steps > maxsteps)
+	{
+		dropped = steps - maxsteps;
+		steps = maxsteps;
+		rgd.simtime = now - (unsigned long long)steps * RAGDOLL_STEP_USEC;
+	}
+
+	while (steps-- > 0)
+	{
+		RGD_Lock ();
+
+		RGD_LockFront ();
+		for (RagDollID = 0; RagDollID < MAX_RAGDOLLS; RagDollID++)
+		{
+			rd = &RagDoll[RagDollID];
+			if (!rd->destroyed && rd->setvel)
+			{
+				dBodySetLinearVel (rd->RagDollObject[CHEST].body, rd->vel[0], rd->vel[1], rd->vel[2]);
+				rd->setvel = false;
+			}
+		}
+		RGD_UnlockFront ();
+
+		RGD_WorldStep ();
+		rgd.simtime += RAGDOLL_STEP_USEC;
+
+		for (RagDollID = 0; RagDollID < MAX_RAGDOLLS; RagDollID++)
+		{
+			if (!RagDoll[RagDollID].destroyed)
+				RGD_SaveStates (RagDollID, false);
+		}
+
+		RGD_LockFront ();
+		for (RagDollID = 0; RagDollID < MAX_RAGDOLLS; RagDollID++)
+		{
+			if (!RagDoll[RagDollID].destroyed)
+				RGD_PublishStates (RagDollID);
+		}
+		rgd.fronttime = rgd.simtime;
+		rgd.dropped += dropped;
+		dropped = 0;
+		RGD_UnlockFront ();
+
+		RGD_Unlock ();
+	}
+}
+
+static void RGD_SimThread (void *unused)
+{
+	unsigned long long now, next;
+	qboolean stop;
+
+	// bodies and geoms were made on the render thread
+	dAllocateODEDataForThread (dAllocateMaskAll);
+
+	for (;;)
+	{
+		RGD_LockFront ();
+		stop = rgd.stop;
+		RGD_UnlockFront ();
+		if (stop)
+			break;
+
+		RGD_RunSteps (Sys_Microseconds ());
+		next = rgd.simtime + RAGDOLL_STEP_USEC;
+
+		now = Sys_Microseconds ();
+		if (next > now)
+		{
+#if defined WIN32_VARIANT
+			Sleep ((DWORD)((next - now) / 1000));
+#else
+			usleep ((useconds_t)(next - now));
+#endif
+		}
+	}
+
+	dCleanupODEAllDataForThread ();
+}
+
+void RGD_StopThread (void)
+{
+	if (!rgd.thread)
+		return;
+
+	RGD_LockFront ();
+	rgd.stop = true;
+	RGD_UnlockFront ();
+
+	Sys_JoinThread (rgd.thread);
+	rgd.thread = NULL;
+	rgd.stop = false;
+}
+
 //This is called on every map load
 void R_ClearAllRagdolls( void )
 {
 	int RagDollID;
 
+	RGD_StopThread();
+
 	for(RagDollID = 0; RagDollID < MAX_RAGDOLLS; RagDollID++)
 	{
 		R_DestroyRagDoll(RagDollID, true);
@@ -954,7 +1613,9 @@ void RGD_AddNewRagdoll (const entity_t *ent, float velocity)
 	{
 		if (RagDoll[RagDollID].destroyed)
 		{
+			RGD_Lock ();
 			RGD_RagdollBody_Init (ent, mod, RagDollID, velocity);
+			RGD_Unlock ();
 
 			if (r_ragdoll_debug->integer == 2)
 			{
@@ -978,151 +1639,143 @@ void RGD_AddNewRagdoll (const entity_t *ent, float velocity)
 }
 
 // Iterate through the ragdoll array, detect expired ragdolls, apply ragdoll
-// forcess, lift ghosts, and do physics simulation. 
+// forcess, lift ghosts, and place the bodies for this frame. The physics
+// simulation runs here too when there's no simulation thread.
 void R_SimulateAllRagdolls ( void )
 {
 	int RagDollID;
-	int i;
+	int i, ms, dropped;
 	qboolean ragdoll_visible = false; // At least one is on screen
+	unsigned long long now;
+	float frac;
+
+	if(!r_ragdolls->integer || !r_ragdoll_thread->integer)
+		RGD_StopThread();
 
 	if(!r_ragdolls->integer)
 		return;
 
+	RGD_LockFront ();
+	rgd.maxsteps = r_ragdoll_maxsteps->integer < 1 ? 1 : r_ragdoll_maxsteps->integer;
+	RGD_UnlockFront ();
+
+	now = Sys_Microseconds();
+	if (!rgd.thread)
+		RGD_RunSteps (now);
+
+	ms = Sys_Milliseconds();
 	for(RagDollID = 0; RagDollID < MAX_RAGDOLLS; RagDollID++)
 	{
+		if(!RagDoll[RagDollID].destroyed && ms - RagDoll[RagDollID].spawnTime > RAGDOLL_DURATION)
+		{
+			RGD_Lock ();
+			R_DestroyRagDoll(RagDollID, true);
+			RGD_Unlock ();
+			if(r_ragdoll_debug->integer)
+				Com_Printf("Destroyed a ragdoll");
+		}
+	}
+
+	RGD_LockFront ();
+
+	dropped = rgd.dropped;
+	rgd.dropped = 0;
+
+	// how far the clock is past the last step
+	frac = now > rgd.fronttime ? (float)(now - rgd.fronttime) / RAGDOLL_STEP_USEC : 0;
+	if (frac > 1)
+		frac = 1;
+
+	for(RagDollID = 0; RagDollID < MAX_RAGDOLLS; RagDollID++)
+	{
+		//we handle the ragdoll's physics, then render the mesh with skeleton adjusted by ragdoll
+		//body object positions
+		matrix3x4_t *chest;
+		int		shellEffect = false;
 		float dur;
 		
 		if(RagDoll[RagDollID].destroyed)
 			continue;
 
-		dur = Sys_Milliseconds() - RagDoll[RagDollID].spawnTime;
+		dur = ms - RagDoll[RagDollID].spawnTime;
 
-		if(dur > RAGDOLL_DURATION)
-		{
-			R_DestroyRagDoll(RagDollID, true);
-			if(r_ragdoll_debug->integer)
-				Com_Printf("Destroyed a ragdoll");
-		}
-		else
-		{
-			//we handle the ragdoll's physics, then render the mesh with skeleton adjusted by ragdoll
-			//body object positions
-			const	dReal *odePos;
-			int		shellEffect = false;
+		RGD_InterpolateBodies (RagDollID, frac);
 
-			odePos = dBodyGetPosition (RagDoll[RagDollID].RagDollObject[CHEST].body);
-			VectorSet (RagDoll[RagDollID].curPos, odePos[0], odePos[1], odePos[2]);
+		chest = &RagDoll[RagDollID].bodymat[CHEST];
+		VectorSet (RagDoll[RagDollID].curPos, chest->a[3], chest->b[3], chest->c[3]);
 
-			if(dur > (RAGDOLL_DURATION - 2500))
-			{
-				dBodySetLinearVel(RagDoll[RagDollID].RagDollObject[CHEST].body, 0, 0, 50); //lift into space
+		if(dur > (RAGDOLL_DURATION - 2500))
+		{
+			VectorSet(RagDoll[RagDollID].vel, 0, 0, 50); //lift into space
+			RagDoll[RagDollID].setvel = true;
 
-				RagDollEntity[RagDollID].shellAlpha = (1 - dur/RAGDOLL_DURATION)*10.0f;
-				shellEffect = true;
-			}
+			RagDollEntity[RagDollID].shellAlpha = (1 - dur/RAGDOLL_DURATION)*10.0f;
+			shellEffect = true;
+		}
 
-			VectorCopy (RagDoll[RagDollID].curPos, RagDollEntity[RagDollID].origin);
-			RagDollEntity[RagDollID].flags = shellEffect ? RF_SHELL_GREEN : 0;
+		VectorCopy (RagDoll[RagDollID].curPos, RagDollEntity[RagDollID].origin);
+		RagDollEntity[RagDollID].flags = shellEffect ? RF_SHELL_GREEN : 0;
 
-			//apply forces from explosions
-			for(i = 0; i < MAX_FORCES; i++)
+		//apply forces from explosions
+		for(i = 0; i < MAX_FORCES; i++)
+		{
+			if(!RagDoll[RagDollID].RagDollForces[i].destroyed)
 			{
-				if(!RagDoll[RagDollID].RagDollForces[i].destroyed)
+				if(Sys_Milliseconds() - RagDoll[RagDollID].RagDollForces[i].spawnTime < 2000)
 				{
-					if(Sys_Milliseconds() - RagDoll[RagDollID].RagDollForces[i].spawnTime < 2000)
+					VectorSubtract(RagDoll[RagDollID].RagDollForces[i].org, RagDoll[RagDollID].curPos, RagDoll[RagDollID].RagDollForces[i].dir);
+					RagDoll[RagDollID].RagDollForces[i].force /= VectorLength(RagDoll[RagDollID].RagDollForces[i].dir);
+					VectorNormalize(RagDoll[RagDollID].RagDollForces[i].dir);
+					RagDoll[RagDollID].RagDollForces[i].force *= 500;
+					if(RagDoll[RagDollID].RagDollForces[i].force > 10000)
+						RagDoll[RagDollID].RagDollForces[i].force = 10000;
+
+					//add a force if it's sufficient enough to do anything
+					if(RagDoll[RagDollID].RagDollForces[i].force > 200 || RagDoll[RagDollID].RagDollForces[i].force < -200)
 					{
-						VectorSubtract(RagDoll[RagDollID].RagDollForces[i].org, RagDoll[RagDollID].curPos, RagDoll[RagDollID].RagDollForces[i].dir);
-						RagDoll[RagDollID].RagDollForces[i].force /= VectorLength(RagDoll[RagDollID].RagDollForces[i].dir);
-						VectorNormalize(RagDoll[RagDollID].RagDollForces[i].dir);
-						RagDoll[RagDollID].RagDollForces[i].force *= 500;
-						if(RagDoll[RagDollID].RagDollForces[i].force > 10000)
-							RagDoll[RagDollID].RagDollForces[i].force = 10000;
-
-						//add a force if it's sufficient enough to do anything
-						if(RagDoll[RagDollID].RagDollForces[i].force > 200 || RagDoll[RagDollID].RagDollForces[i].force < -200)
-						{
-							dBodySetLinearVel(RagDoll[RagDollID].RagDollObject[CHEST].body, -RagDoll[RagDollID].RagDollForces[i].dir[0] *
-							RagDoll[RagDollID].RagDollForces[i].force, -RagDoll[RagDollID].RagDollForces[i].dir[1] *
-							RagDoll[RagDollID].RagDollForces[i].force, -RagDoll[RagDollID].RagDollForces[i].dir[2] *
-							RagDoll[RagDollID].RagDollForces[i].force);
-						}
-						RagDoll[RagDollID].RagDollForces[i].destroyed = true; //destroy if used
+						VectorScale(RagDoll[RagDollID].RagDollForces[i].dir, -RagDoll[RagDollID].RagDollForces[i].force,
+							RagDoll[RagDollID].vel);
+						RagDoll[RagDollID].setvel = true;
 					}
-					else
-						RagDoll[RagDollID].RagDollForces[i].destroyed = true; //destroy if expired
+					RagDoll[RagDollID].RagDollForces[i].destroyed = true; //destroy if used
 				}
+				else
+					RagDoll[RagDollID].RagDollForces[i].destroyed = true; //destroy if expired
 			}
+		}
 
 
-			if(r_ragdoll_debug->integer)
+		if(r_ragdoll_debug->integer)
+		{
+			//debug - draw ragdoll bodies
+			for(i = CHEST; i <= LEFTHAND; i++)
 			{
-				//debug - draw ragdoll bodies
-				for(i = CHEST; i <= LEFTHAND; i++)
-				{
-					vec3_t org;
-					const dReal *odePos;
-
-					if(!RagDoll[RagDollID].RagDollObject[i].body)
-						continue;
-
-					odePos = dBodyGetPosition (RagDoll[RagDollID].RagDollObject[i].body);
-					VectorSet(org, odePos[0], odePos[1], odePos[2]);
-					if(i == HEAD)
-						R_DrawMark (org, 4.0f, RGBA (0, 1, 0, 1));
-					else if (i > LEFTFOOT)
-						R_DrawMark (org, 4.0f, RGBA (0, 0, 1, 1));
-					else
-						R_DrawMark (org, 4.0f, RGBA (1, 0, 0, 1));
-				}
+				vec3_t org;
+				const matrix3x4_t *bodymat = &RagDoll[RagDollID].bodymat[i];
+
+				if(!RagDoll[RagDollID].RagDollObject[i].body)
+					continue;
+
+				VectorSet(org, bodymat->a[3], bodymat->b[3], bodymat->c[3]);
+				if(i == HEAD)
+					R_DrawMark (org, 4.0f, RGBA (0, 1, 0, 1));
+				else if (i > LEFTFOOT)
+					R_DrawMark (org, 4.0f, RGBA (0, 0, 1, 1));
+				else
+					R_DrawMark (org, 4.0f, RGBA (1, 0, 0, 1));
 			}
-
-			ragdoll_visible = true;
 		}
-	}
-
-	if (ragdoll_visible) //here we handle the physics
-	{
-#if defined WIN32_VARIANT
-		int ODEIterationsPerFrame;
-		int frametime = Sys_Milliseconds() - lastODEUpdate;
-
-		//iterations need to be adjusted for framerate.
-		ODEIterationsPerFrame = frametime;
 
-		//clamp it
-		if(ODEIterationsPerFrame > MAX_ODESTEPS)
-			ODEIterationsPerFrame = MAX_ODESTEPS;
-		if(ODEIterationsPerFrame < MIN_ODESTEPS)
-			ODEIterationsPerFrame = MIN_ODESTEPS;
+		ragdoll_visible = true;
+	}
 
-		dSpaceCollide(RagDollSpace, 0, &near_callback);
-		dWorldStepFast1(RagDollWorld, (float)(frametime/1000.0f), ODEIterationsPerFrame);
+	RGD_UnlockFront ();
 
-		// Remove all temporary collision joints now that the world has been stepped
-		dJointGroupEmpty(contactGroup);
-#else
-		/* ODE library 0.12 does not support dWorldStepFast1.
-		 * Using dWorldQuickStep. See RGD_CreateWorldObject(), above.
-		 */
-		int frametime = Sys_Milliseconds() - lastODEUpdate;
-		
-#define SIM_CAP (1000/120)
-		// Simulate the ragdoll world EXACTLY 1/120th of a second at a time.
-		// This seems to make ODE a lot less crashy.
-		while (frametime > SIM_CAP)
-		{
-			dSpaceCollide(RagDollSpace, 0, &near_callback);
-			dWorldQuickStep( RagDollWorld, ((dReal)SIM_CAP)/1000.0 );
-			// Remove all temporary collision joints now that the world has been stepped
-			dJointGroupEmpty(contactGroup);
-			lastODEUpdate += SIM_CAP;
-			frametime -= SIM_CAP;
-		}
-		return;
-#endif
-	}
+	if (dropped && r_ragdoll_debug->integer)
+		Com_Printf ("Ragdolls dropped %i steps\n", dropped);
 
-	lastODEUpdate = Sys_Milliseconds();
+	if (ragdoll_visible && r_ragdoll_thread->integer && !rgd.thread)
+		rgd.thread = Sys_CreateThread (RGD_SimThread, NULL);
 }
 
 void R_ApplyForceToRagdolls(vec3_t origin, float force)
@@ -1132,6 +1785,7 @@ void R_ApplyForceToRagdolls(vec3_t origin, float force)
 	if(!r_ragdolls->integer)
 		return;
 
+	// the forces are only used on this thread, by R_SimulateAllRagdolls
 	for(RagDollID = 0; RagDollID < MAX_RAGDOLLS; RagDollID++)
 	{
 		for(i = 0; i < MAX_FORCES; i++)
@@ -1147,3 +1801,70 @@ void R_ApplyForceToRagdolls(vec3_t origin, float force)
 		}
 	}
 }
+
+/*
+==============
+R_RagdollBench_f
+
+ragdollbench [model] [steps]
+
+Drops MAX_RAGDOLLS ragdolls of an IQM model in a grid around the view on
+the loaded map, then times that many fixed steps of the ragdoll world
+back to back. Nothing is drawn.
+==============
+*/
+void R_RagdollBench_f (void)
+{
+	static entity_t ent;
+	const char *name;
+	model_t *mod;
+	int RagDollID, numsteps, i;
+	unsigned long long start, usec;
+
+	name = Cmd_Argc() > 1 ? Cmd_Argv(1) : "players/martianenforcer/tris.iqm";
+	numsteps = Cmd_Argc() > 2 ? atoi (Cmd_Argv(2)) : 1200;
+	if (numsteps < 1)
+		numsteps = 1;
+
+	if (!r_worldmodel || !RagDollWorld || !RagDollTriWorld.geom)
+	{
+		Com_Printf ("ragdollbench needs a map loaded.\n");
+		return;
+	}
+
+	mod = R_RegisterModel ((char *)name);
+	if (!mod || mod->type != mod_iqm || !mod->hasRagDoll)
+	{
+		Com_Printf ("%s is not an IQM model with a ragdoll\n", name);
+		return;
+	}
+
+	RGD_StopThread ();
+
+	memset (&ent, 0, sizeof(ent));
+	Q_strncpyz2 (ent.name, name, sizeof(ent.name));
+	ent.model = mod;
+	for (RagDollID = 0; RagDollID < MAX_RAGDOLLS; RagDollID++)
+	{
+		R_DestroyRagDoll (RagDollID, true);
+
+		VectorCopy (r_newrefdef.vieworg, ent.origin);
+		ent.origin[0] += (RagDollID % 8 - 3.5f) * 48;
+		ent.origin[1] += (RagDollID / 8 % 8 - 3.5f) * 48;
+		ent.angles[YAW] = RagDollID * 45;
+		RGD_RagdollBody_Init (&ent, mod, RagDollID, 0);
+	}
+
+	start = Sys_Microseconds ();
+	for (i = 0; i < numsteps; i++)
+		RGD_WorldStep ();
+	usec = Sys_Microseconds () - start;
+
+	Com_Printf ("%i ragdolls, %i steps: %.1f usec per step, %.0f%% of the %i usec budget\n",
+		MAX_RAGDOLLS, numsteps, (double)usec / numsteps,
+		(double)usec * 100 / ((double)numsteps * RAGDOLL_STEP_USEC), RAGDOLL_STEP_USEC);
+
+	for (RagDollID = 0; RagDollID < MAX_RAGDOLLS; RagDollID++)
+		R_DestroyRagDoll (RagDollID, true);
+	rgd.simtime = rgd.fronttime = Sys_Microseconds ();
+}
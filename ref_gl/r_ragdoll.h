@@ -28,6 +28,7 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #define MAX_ODESTEPS 120
 #define MIN_ODESTEPS 20
 #define RAGDOLL_DURATION 10000 //10 seconds
+#define RAGDOLL_STEP_USEC (1000000/120) //fixed simulation step
 
 //body id's
 #define CHEST 0
@@ -133,8 +134,6 @@ dSpaceID RagDollSpace;
 
 dJointGroupID contactGroup;
 
-int lastODEUpdate;
-
 typedef struct RagDollBind_s {
 
     const char *name;
@@ -176,9 +175,18 @@ typedef struct RagDollWorld_s {
     int numODETris, maxODETris;
 	dTriMeshDataID triMesh;
 	dGeomID geom;
+	byte *useFlags; // per triangle edge flags, must outlive triMesh
 
 } RagDollWorld_t;
 
+// where a body was after a simulation step
+typedef struct RagDollState_s {
+
+	dVector3 pos;
+	dQuaternion quat;
+
+} RagDollState_t;
+
 typedef struct RagDoll_s {
 
 	char	name[MAX_QPATH];
@@ -190,6 +198,16 @@ typedef struct RagDoll_s {
 	
 	// For grabbing the animated position of the mesh just before it goes limp
 	matrix3x4_t initframe[SKELETAL_MAX_BONEMATS];
+
+	// bodies after the last two simulation steps, the copy of them frames
+	// are drawn from, and in between them for the frame being drawn
+	RagDollState_t state[2][MAX_RAGDOLL_OBJECTS];
+	RagDollState_t front[2][MAX_RAGDOLL_OBJECTS];
+	matrix3x4_t bodymat[MAX_RAGDOLL_OBJECTS];
+
+	// chest velocity the frame set, for the next simulation step
+	qboolean setvel;
+	vec3_t vel;
 	
 	// entity information
 	float	angles[3];
@@ -220,3 +238,5 @@ void RGD_DestroyWorldObject (void);
 void RGD_AddNewRagdoll (const entity_t *ent, float velocity);
 void RGD_DestroyWorldTrimesh (void);
 void RGD_BuildWorldTrimesh (void);
+void RGD_StopThread (void);
+void R_RagdollBench_f (void);
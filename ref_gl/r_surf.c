@@ -28,6 +28,12 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 #include "r_local.h"
 
+#if defined __SSE__
+#include <xmmintrin.h>
+#elif defined __ARM_NEON
+#include <arm_neon.h>
+#endif
+
 static vec3_t	modelorg;		// relative to viewpoint
 
 vec3_t	r_worldLightVec;
@@ -1660,6 +1666,587 @@ static void BSP_RecursiveWorldNode (mnode_t *node, int clipflags)
 	BSP_RecursiveWorldNode (node->children[!side], clipflags);
 }
 
+/*
+=============================================================================
+
+VISIBLE SURFACE CACHE
+
+What R_MarkLeaves marks only changes with the view cluster and the area bits,
+so the world surfaces that can be seen from there are gathered once, sorted
+by texinfo and lightmap, and each frame only has to cull that list against
+the frustum four surfaces at a time. A surface is kept along with the sides
+of its plane it was marked from, which stands in for the back face culling
+BSP_RecursiveWorldNode gets from its visframe check. Translucent surfaces
+have to be chained back to front, so they are walked through a copy of the
+BSP tree cut down to the nodes they hang from.
+
+=============================================================================
+*/
+
+#define SURFCACHE_ENTRIES	8
+
+// per group of four surfaces, one float for each in every row
+#define SC_MINX		0
+#define SC_MINY		4
+#define SC_MINZ		8
+#define SC_MAXX		12
+#define SC_MAXY		16
+#define SC_MAXZ		20
+#define SC_NORMALX	24		// plane the viewer has to be in front of
+#define SC_NORMALY	28
+#define SC_NORMALZ	32
+#define SC_DIST		36
+#define SC_GROUPSIZE	40
+
+typedef struct
+{
+	mnode_t		*node;
+	int			children[2];	// into nodes, -1 for none
+	int			firstsurf, numsurfs;	// into alphasurfs
+} surfcachenode_t;
+
+typedef struct
+{
+	int				cluster, cluster2;	// as marked, -1 when everything was
+	byte			areabits[MAX_MAP_AREAS/8];
+	int				sequence;			// registration_sequence it was built in
+	int				lastused;			// r_framecount
+
+	int				numsurfs;
+	msurface_t		**surfs;			// sorted by texinfo and lightmap
+	float			*groups;			// SC_GROUPSIZE floats per four surfs
+
+	int				numnodes, rootnode;
+	surfcachenode_t	*nodes;
+	int				numalphasurfs;
+	msurface_t		**alphasurfs;
+	byte			*alphasides;		// 1 if marked from children[0], 2 from [1]
+} surfcache_t;
+
+typedef struct
+{
+	msurface_t	*surf;
+	int			sides;
+} surfcachesort_t;
+
+static surfcache_t	sc_cache[SURFCACHE_ENTRIES];
+static int			r_markedcluster = -2, r_markedcluster2 = -2;	// set by R_MarkLeaves
+
+// scratch space while building an entry, sized for the world
+static byte			*sc_marks;			// see BSP_BuildSurfCacheNode
+static surfcachesort_t	*sc_surfs;
+static msurface_t	**sc_alphasurfs;
+static byte			*sc_alphasides;
+static surfcachenode_t	*sc_nodes;
+static int			sc_numsurfs, sc_numalphasurfs, sc_numnodes, sc_size[2];
+
+static void BSP_FreeSurfCacheEntry (surfcache_t *cache)
+{
+	free (cache->surfs);
+	free (cache->groups);
+	free (cache->nodes);
+	free (cache->alphasurfs);
+	free (cache->alphasides);
+	memset (cache, 0, sizeof(*cache));
+	cache->cluster = cache->cluster2 = -2;
+}
+
+/*
+================
+R_FreeSurfCache
+================
+*/
+void R_FreeSurfCache (void)
+{
+	int i;
+
+	for (i = 0; i < SURFCACHE_ENTRIES; i++)
+		BSP_FreeSurfCacheEntry (&sc_cache[i]);
+
+	free (sc_marks);
+	free (sc_surfs);
+	free (sc_alphasurfs);
+	free (sc_alphasides);
+	free (sc_nodes);
+	sc_marks = sc_alphasides = NULL;
+	sc_surfs = NULL;
+	sc_alphasurfs = NULL;
+	sc_nodes = NULL;
+	sc_size[0] = sc_size[1] = 0;
+}
+
+/*
+================
+BSP_BuildSurfCacheNode
+
+Visits the same nodes and leafs as BSP_RecursiveWorldNode minus the frustum
+culling. Leafs set bit 1 in sc_marks for their surfaces. The node a surface
+lies on moves that bit to 2 after its front child, so it ends up with 2 if it
+was marked from the front and 1 if from the back. Returns the index of the
+cut-down node, -1 if no translucent surface is under it.
+================
+*/
+static int BSP_BuildSurfCacheNode (mnode_t *node)
+{
+	int			c, i, front, back, firstalpha, surfnum;
+	msurface_t	*surf, **mark;
+	mleaf_t		*pleaf;
+	byte		sides;
+
+	if (node->contents == CONTENTS_SOLID)
+		return -1;
+
+	if (node->visframe != r_visframecount)
+		return -1;
+
+	if (node->contents != -1)
+	{
+		pleaf = (mleaf_t *)node;
+
+		if (! (c = pleaf->nummarksurfaces) )
+			return -1;
+
+		if (! (r_newrefdef.areabits[pleaf->area>>3] & (1<<(pleaf->area&7)) ) )
+			return -1;
+
+		for (mark = pleaf->firstmarksurface; c; c--, mark++)
+			sc_marks[*mark - r_worldmodel->surfaces] |= 1;
+		return -1;
+	}
+
+	front = BSP_BuildSurfCacheNode (node->children[0]);
+
+	for (i = 0; i < node->numsurfaces; i++)
+	{
+		surfnum = node->firstsurface + i;
+		if (sc_marks[surfnum] & 1)
+			sc_marks[surfnum] = 2;
+	}
+
+	back = BSP_BuildSurfCacheNode (node->children[1]);
+
+	firstalpha = sc_numalphasurfs;
+	for (i = 0, surf = r_worldmodel->surfaces + node->firstsurface; i < node->numsurfaces; i++, surf++)
+	{
+		surfnum = node->firstsurface + i;
+		sides = sc_marks[surfnum];
+		sc_marks[surfnum] = 0;
+
+		if (!sides || (surf->texinfo->flags & SURF_SKY))
+			continue;
+
+		// 1 if the viewer has to be on the front of the plane, 2 the back
+		sides = ((sides & 2) ? 1 : 0) | ((sides & 1) ? 2 : 0);
+
+		if (SurfaceIsTranslucent(surf) && !SurfaceIsAlphaMasked (surf))
+		{
+			sc_alphasurfs[sc_numalphasurfs] = surf;
+			sc_alphasides[sc_numalphasurfs] = sides;
+			sc_numalphasurfs++;
+		}
+		else
+		{
+			sc_surfs[sc_numsurfs].surf = surf;
+			sc_surfs[sc_numsurfs].sides = sides;
+			sc_numsurfs++;
+		}
+	}
+
+	if (front == -1 && back == -1 && firstalpha == sc_numalphasurfs)
+		return -1;
+
+	sc_nodes[sc_numnodes].node = node;
+	sc_nodes[sc_numnodes].children[0] = front;
+	sc_nodes[sc_numnodes].children[1] = back;
+	sc_nodes[sc_numnodes].firstsurf = firstalpha;
+	sc_nodes[sc_numnodes].numsurfs = sc_numalphasurfs - firstalpha;
+	return sc_numnodes++;
+}
+
+static int BSP_SurfCacheCompare (const void *a, const void *b)
+{
+	const msurface_t *s1 = ((const surfcachesort_t *)a)->surf;
+	const msurface_t *s2 = ((const surfcachesort_t *)b)->surf;
+
+	if (s1->texinfo->equiv != s2->texinfo->equiv)
+		return s1->texinfo->equiv < s2->texinfo->equiv ? -1 : 1;
+	if (s1->lightmaptexturenum != s2->lightmaptexturenum)
+		return s1->lightmaptexturenum - s2->lightmaptexturenum;
+	return s1 < s2 ? -1 : s1 > s2;
+}
+
+static void BSP_SetSurfCacheSlot (float *group, int slot, msurface_t *surf, byte sides)
+{
+	int		i;
+	float	sign;
+
+	if (!surf)
+	{	// padding, always fails the side test
+		for (i = 0; i < SC_GROUPSIZE; i += 4)
+			group[i+slot] = 0;
+		group[SC_DIST+slot] = 1;
+		return;
+	}
+
+	if (surf->iflags & ISURF_DRAWTURB)
+	{	// warped surfaces have no bounds, BSP_RecursiveWorldNode doesn't cull them either
+		for (i = 0; i < 3; i++)
+		{
+			group[SC_MINX+i*4+slot] = -99999;
+			group[SC_MAXX+i*4+slot] = 99999;
+		}
+	}
+	else
+	{
+		for (i = 0; i < 3; i++)
+		{
+			group[SC_MINX+i*4+slot] = surf->mins[i];
+			group[SC_MAXX+i*4+slot] = surf->maxs[i];
+		}
+	}
+
+	if (sides == 3)
+	{	// marked from both sides, seen from either
+		group[SC_NORMALX+slot] = group[SC_NORMALY+slot] = group[SC_NORMALZ+slot] = 0;
+		group[SC_DIST+slot] = -1;
+		return;
+	}
+
+	sign = (sides == 1) ? 1 : -1;
+	for (i = 0; i < 3; i++)
+		group[SC_NORMALX+i*4+slot] = sign * surf->plane->normal[i];
+	group[SC_DIST+slot] = sign * surf->plane->dist;
+}
+
+/*
+================
+BSP_BuildSurfCache
+
+Fills in an entry for what R_MarkLeaves has marked. Returns false if there
+wasn't the memory, and the caller should fall back on BSP_RecursiveWorldNode.
+================
+*/
+static qboolean BSP_BuildSurfCache (surfcache_t *cache)
+{
+	int		i, j, numgroups;
+
+	if (sc_size[0] < r_worldmodel->numsurfaces || sc_size[1] < r_worldmodel->numnodes)
+	{
+		R_FreeSurfCache ();
+		sc_marks = (byte *)calloc (r_worldmodel->numsurfaces, 1);
+		sc_surfs = (surfcachesort_t *)malloc (r_worldmodel->numsurfaces * sizeof(surfcachesort_t));
+		sc_alphasurfs = (msurface_t **)malloc (r_worldmodel->numsurfaces * sizeof(msurface_t *));
+		sc_alphasides = (byte *)malloc (r_worldmodel->numsurfaces);
+		sc_nodes = (surfcachenode_t *)malloc (r_worldmodel->numnodes * sizeof(surfcachenode_t));
+		if (!sc_marks || !sc_surfs || !sc_alphasurfs || !sc_alphasides || !sc_nodes)
+		{
+			R_FreeSurfCache ();
+			return false;
+		}
+		sc_size[0] = r_worldmodel->numsurfaces;
+		sc_size[1] = r_worldmodel->numnodes;
+	}
+
+	memset (sc_marks, 0, r_worldmodel->numsurfaces);
+	sc_numsurfs = sc_numalphasurfs = sc_numnodes = 0;
+	cache->rootnode = BSP_BuildSurfCacheNode (r_worldmodel->nodes);
+
+	qsort (sc_surfs, sc_numsurfs, sizeof(sc_surfs[0]), BSP_SurfCacheCompare);
+
+	numgroups = (sc_numsurfs + 3) / 4;
+	cache->surfs = (msurface_t **)malloc (max (sc_numsurfs, 1) * sizeof(msurface_t *));
+	cache->groups = (float *)malloc (max (numgroups, 1) * SC_GROUPSIZE * sizeof(float));
+	cache->nodes = (surfcachenode_t *)malloc (max (sc_numnodes, 1) * sizeof(surfcachenode_t));
+	cache->alphasurfs = (msurface_t **)malloc (max (sc_numalphasurfs, 1) * sizeof(msurface_t *));
+	cache->alphasides = (byte *)malloc (max (sc_numalphasurfs, 1));
+	if (!cache->surfs || !cache->groups || !cache->nodes || !cache->alphasurfs || !cache->alphasides)
+	{
+		BSP_FreeSurfCacheEntry (cache);
+		return false;
+	}
+
+	cache->numsurfs = sc_numsurfs;
+	for (i = 0; i < sc_numsurfs; i++)
+		cache->surfs[i] = sc_surfs[i].surf;
+	for (i = 0; i < numgroups; i++)
+	{
+		for (j = 0; j < 4; j++)
+		{
+			if (i*4+j < sc_numsurfs)
+				BSP_SetSurfCacheSlot (cache->groups + i*SC_GROUPSIZE, j, sc_surfs[i*4+j].surf, sc_surfs[i*4+j].sides);
+			else
+				BSP_SetSurfCacheSlot (cache->groups + i*SC_GROUPSIZE, j, NULL, 0);
+		}
+	}
+
+	cache->numnodes = sc_numnodes;
+	memcpy (cache->nodes, sc_nodes, sc_numnodes * sizeof(surfcachenode_t));
+	cache->numalphasurfs = sc_numalphasurfs;
+	memcpy (cache->alphasurfs, sc_alphasurfs, sc_numalphasurfs * sizeof(msurface_t *));
+	memcpy (cache->alphasides, sc_alphasides, sc_numalphasurfs);
+
+	return true;
+}
+
+/*
+================
+BSP_FindSurfCache
+
+Returns the entry for what R_MarkLeaves has marked and the current area
+bits, building it over the least recently used one if there isn't one.
+================
+*/
+static surfcache_t *BSP_FindSurfCache (void)
+{
+	surfcache_t	*cache, *oldest;
+	int			i, areabytes;
+
+	areabytes = (r_worldmodel->num_areas + 7) / 8;
+	if (areabytes > MAX_MAP_AREAS/8)
+		areabytes = MAX_MAP_AREAS/8;
+
+	oldest = NULL;
+	for (i = 0, cache = sc_cache; i < SURFCACHE_ENTRIES; i++, cache++)
+	{
+		if (cache->sequence == registration_sequence && cache->surfs &&
+			cache->cluster == r_markedcluster && cache->cluster2 == r_markedcluster2 &&
+			!memcmp (cache->areabits, r_newrefdef.areabits, areabytes))
+		{
+			cache->lastused = r_framecount;
+			return cache;
+		}
+
+		// empty and older map entries go first
+		if (!oldest || (oldest->sequence == registration_sequence &&
+			(cache->sequence != registration_sequence || cache->lastused < oldest->lastused)))
+			oldest = cache;
+	}
+
+	cache = oldest;
+	BSP_FreeSurfCacheEntry (cache);
+	if (!BSP_BuildSurfCache (cache))
+		return NULL;
+
+	cache->cluster = r_markedcluster;
+	cache->cluster2 = r_markedcluster2;
+	memcpy (cache->areabits, r_newrefdef.areabits, areabytes);
+	cache->sequence = registration_sequence;
+	cache->lastused = r_framecount;
+	return cache;
+}
+
+/*
+================
+BSP_CullSurfGroup
+
+Returns a bit for each of the four surfaces in the group which is in front
+of its plane and not outside any of the planes.
+================
+*/
+static int BSP_CullSurfGroup (const float *group, const cplane_t *planes, int numplanes)
+{
+	int			i;
+	const int	*ofs;
+	static const int	offsets[8][3] =
+	{	// which of mins or maxs is furthest along the normal, by signbits
+		{SC_MAXX, SC_MAXY, SC_MAXZ}, {SC_MINX, SC_MAXY, SC_MAXZ},
+		{SC_MAXX, SC_MINY, SC_MAXZ}, {SC_MINX, SC_MINY, SC_MAXZ},
+		{SC_MAXX, SC_MAXY, SC_MINZ}, {SC_MINX, SC_MAXY, SC_MINZ},
+		{SC_MAXX, SC_MINY, SC_MINZ}, {SC_MINX, SC_MINY, SC_MINZ}
+	};
+#if defined __SSE__
+	__m128	d, visible;
+
+	d = _mm_mul_ps (_mm_loadu_ps (group+SC_NORMALX), _mm_set1_ps (modelorg[0]));
+	d = _mm_add_ps (d, _mm_mul_ps (_mm_loadu_ps (group+SC_NORMALY), _mm_set1_ps (modelorg[1])));
+	d = _mm_add_ps (d, _mm_mul_ps (_mm_loadu_ps (group+SC_NORMALZ), _mm_set1_ps (modelorg[2])));
+	visible = _mm_cmpge_ps (d, _mm_loadu_ps (group+SC_DIST));
+
+	for (i = 0; i < numplanes; i++)
+	{
+		ofs = offsets[planes[i].signbits & 7];
+		d = _mm_mul_ps (_mm_set1_ps (planes[i].normal[0]), _mm_loadu_ps (group+ofs[0]));
+		d = _mm_add_ps (d, _mm_mul_ps (_mm_set1_ps (planes[i].normal[1]), _mm_loadu_ps (group+ofs[1])));
+		d = _mm_add_ps (d, _mm_mul_ps (_mm_set1_ps (planes[i].normal[2]), _mm_loadu_ps (group+ofs[2])));
+		visible = _mm_and_ps (visible, _mm_cmpge_ps (d, _mm_set1_ps (planes[i].dist)));
+	}
+
+	return _mm_movemask_ps (visible);
+#elif defined __ARM_NEON
+	static const uint32_t	bits[4] = {1, 2, 4, 8};
+	float32x4_t	d;
+	uint32x4_t	visible;
+	uint32x2_t	sum;
+
+	d = vmulq_n_f32 (vld1q_f32 (group+SC_NORMALX), modelorg[0]);
+	d = vaddq_f32 (d, vmulq_n_f32 (vld1q_f32 (group+SC_NORMALY), modelorg[1]));
+	d = vaddq_f32 (d, vmulq_n_f32 (vld1q_f32 (group+SC_NORMALZ), modelorg[2]));
+	visible = vcgeq_f32 (d, vld1q_f32 (group+SC_DIST));
+
+	for (i = 0; i < numplanes; i++)
+	{
+		ofs = offsets[planes[i].signbits & 7];
+		d = vmulq_n_f32 (vld1q_f32 (group+ofs[0]), planes[i].normal[0]);
+		d = vaddq_f32 (d, vmulq_n_f32 (vld1q_f32 (group+ofs[1]), planes[i].normal[1]));
+		d = vaddq_f32 (d, vmulq_n_f32 (vld1q_f32 (group+ofs[2]), planes[i].normal[2]));
+		visible = vandq_u32 (visible, vcgeq_f32 (d, vdupq_n_f32 (planes[i].dist)));
+	}
+
+	visible = vandq_u32 (visible, vld1q_u32 (bits));
+	sum = vadd_u32 (vget_low_u32 (visible), vget_high_u32 (visible));
+	return vget_lane_u32 (vpadd_u32 (sum, sum), 0);
+#else
+	int		j, mask = 0;
+
+	for (j = 0; j < 4; j++)
+	{
+		if (group[SC_NORMALX+j]*modelorg[0] + group[SC_NORMALY+j]*modelorg[1] + group[SC_NORMALZ+j]*modelorg[2] < group[SC_DIST+j])
+			continue;
+		for (i = 0; i < numplanes; i++)
+		{
+			ofs = offsets[planes[i].signbits & 7];
+			if (planes[i].normal[0]*group[ofs[0]+j] + planes[i].normal[1]*group[ofs[1]+j] + planes[i].normal[2]*group[ofs[2]+j] < planes[i].dist)
+				break;
+		}
+		if (i == numplanes)
+			mask |= 1<<j;
+	}
+
+	return mask;
+#endif
+}
+
+// front to back through the cut-down tree, like BSP_RecursiveWorldNode
+static void BSP_AddCachedAlphaSurfs (surfcache_t *cache, int num)
+{
+	surfcachenode_t	*cnode;
+	cplane_t		*plane;
+	msurface_t		*surf;
+	float			dot;
+	int				i, side;
+
+	if (num == -1)
+		return;
+
+	cnode = &cache->nodes[num];
+	plane = cnode->node->plane;
+
+	switch (plane->type)
+	{
+	case PLANE_X:
+		dot = modelorg[0];
+		break;
+	case PLANE_Y:
+		dot = modelorg[1];
+		break;
+	case PLANE_Z:
+		dot = modelorg[2];
+		break;
+	default:
+		dot = DotProduct (modelorg, plane->normal);
+		break;
+	}
+
+	side = dot < plane->dist;
+
+	BSP_AddCachedAlphaSurfs (cache, cnode->children[side]);
+
+	for (i = cnode->firstsurf; i < cnode->firstsurf + cnode->numsurfs; i++)
+	{
+		if (!(cache->alphasides[i] & (1<<side)))
+			continue;
+
+		surf = cache->alphasurfs[i];
+		if (!r_nocull->integer && !( surf->iflags & ISURF_DRAWTURB ) &&
+			R_CullBox_ClipFlags (surf->mins, surf->maxs, 15))
+			continue;
+
+		BSP_AddToTextureChain( surf, false );
+	}
+
+	BSP_AddCachedAlphaSurfs (cache, cnode->children[!side]);
+}
+
+/*
+================
+BSP_AddCachedWorldSurfs
+
+Chains the same surfaces as BSP_RecursiveWorldNode would, give or take a few
+the frustum can't see. Returns false if there is no cache entry to do it with.
+================
+*/
+static qboolean BSP_AddCachedWorldSurfs (void)
+{
+	surfcache_t	*cache;
+	int			g, i, mask;
+
+	if (gl_lockpvs->integer)
+		return false;	// the marks no longer go with the view cluster
+
+	cache = BSP_FindSurfCache ();
+	if (!cache)
+		return false;
+
+	// backwards, so each texture chain comes out in lightmap order
+	for (g = (cache->numsurfs + 3) / 4 - 1; g >= 0; g--)
+	{
+		mask = BSP_CullSurfGroup (cache->groups + g*SC_GROUPSIZE, frustum, r_nocull->integer ? 0 : 4);
+		for (i = 3; i >= 0; i--)
+		{
+			if (mask & (1<<i))
+				BSP_AddToTextureChain (cache->surfs[g*4+i], false);
+		}
+	}
+
+	BSP_AddCachedAlphaSurfs (cache, cache->rootnode);
+
+	return true;
+}
+
+/*
+================
+R_CullWorldSurfs
+
+Fills the world texture chains for the current view
+================
+*/
+void R_CullWorldSurfs (qboolean cached)
+{
+	currentmodel = r_worldmodel;
+	VectorCopy (r_newrefdef.vieworg, modelorg);
+
+	BSP_ClearWorldTextureChains ();
+	if (!cached || !BSP_AddCachedWorldSurfs ())
+		BSP_RecursiveWorldNode (r_worldmodel->nodes, 15);
+}
+
+/*
+================
+R_CountWorldSurfs
+
+How many surfaces R_CullWorldSurfs chained
+================
+*/
+int R_CountWorldSurfs (void)
+{
+	int			i, count = 0;
+	msurface_t	*s;
+
+	for (i = 0; i < r_worldmodel->num_unique_texinfos; i++)
+	{
+		for (s = r_worldmodel->unique_texinfo[i]->standard_surfaces.worldchain; s; s = s->texturechain)
+			count++;
+		for (s = r_worldmodel->unique_texinfo[i]->dynamic_surfaces.worldchain; s; s = s->texturechain)
+			count++;
+	}
+	for (s = r_warp_surfaces.worldchain; s; s = s->texturechain)
+		count++;
+	for (s = r_alpha_surfaces.worldchain; s; s = s->texturechain)
+		count++;
+
+	return count;
+}
+
 /*
 =============
 R_CalcWorldLights - this is the fallback for non deluxmapped bsp's
@@ -1771,6 +2358,7 @@ void R_MarkLeaves (void)
 			r_worldmodel->leafs[i].visframe = r_visframecount;
 		for (i=0 ; i<r_worldmodel->numnodes ; i++)
 			r_worldmodel->nodes[i].visframe = r_visframecount;
+		r_markedcluster = r_markedcluster2 = -1;
 		return;
 	}
 
@@ -1793,6 +2381,8 @@ void R_MarkLeaves (void)
 	}
 	
 	r_visframecount++;
+	r_markedcluster = r_viewcluster;
+	r_markedcluster2 = r_viewcluster2;
 	
 	minleaf = minleaf_allareas;
 	maxleaf = maxleaf_allareas;
@@ -1913,8 +2503,7 @@ void R_MarkWorldSurfs (void)
 	
 	if (do_bsp)
 	{
-		BSP_ClearWorldTextureChains ();
-		BSP_RecursiveWorldNode (r_worldmodel->nodes, 15);
+		R_CullWorldSurfs (r_surfcache->integer);
 		
 		old_visframecount = r_visframecount;
 		VectorCopy (r_origin, old_origin);
@@ -65,9 +65,17 @@ typedef struct
 	qboolean	timedemo;		// don't time sync
 	size_t		demosize;		// in bytes
 	size_t		demo_ofs;		// in bytes
-	byte		*demobuf;		// full demo file contents
+	byte		*demobuf;		// full demo file contents, inflated
+	int			*demoindex;		// [time, offset] pairs in demobuf, see the demo writer
+	int			numdemoindex;
+	byte		*democslog;		// configstring records in demobuf, for demoseek
+	int			democslogsize;
 } server_t;
 
+// server demo files, see the demo writer in sv_ents.c
+#define	DEMO_ZMAGIC		(('1'<<24)+('Z'<<16)+('M'<<8)+'D')	// "DMZ1", blocks of deflated stream
+#define	DEMO_IMAGIC		(('2'<<24)+('X'<<16)+('D'<<8)+'I')	// "IDX2", ends the index
+
 #define EDICT_NUM(n) ((edict_t *)((byte *)ge->edicts + ge->edict_size*(n)))
 #define NUM_FOR_EDICT(e) ( ((byte *)(e)-(byte *)ge->edicts ) / ge->edict_size)
 
@@ -101,6 +109,15 @@ typedef struct
 #define	LATENCY_COUNTS	16
 #define	RATE_MESSAGES	10
 
+// a file being downloaded, mapped once however many clients are fetching it
+typedef struct
+{
+	char			name[MAX_OSPATH];
+	byte			*data;
+	int				size;
+	int				refcount;
+} sv_dlfile_t;
+
 typedef struct client_s
 {
 	client_state_t	state;
@@ -124,6 +141,14 @@ typedef struct client_s
 	char			name[PLAYERNAME_SIZE]; // extracted from userinfo, high bits masked
 	int				messagelevel;		// for filtering printed messages
 
+	// where SV_Multicast last found the client, so the leaf lookup is
+	// only redone after the client moves
+	qboolean		multicast_cached;
+	int				multicast_spawncount;
+	vec3_t			multicast_origin;
+	int				multicast_cluster;
+	int				multicast_area;
+
 	// The datagram is written to by sound calls, prints, temp ents, etc.
 	// It can be harmlessly overflowed.
 	sizebuf_t		datagram;
@@ -131,15 +156,20 @@ typedef struct client_s
 
 	client_frame_t	frames[UPDATE_BACKUP];	// updates can be delta'd from here
 
-	byte			*download;			// file being downloaded
+	sv_dlfile_t		*download;			// file being downloaded
 	int				downloadsize;		// total bytes (can't use EOF because of paks)
-	int				downloadcount;		// bytes sent
+	int				downloadcount;		// bytes sent, or acked when windowed
+	qboolean		downloadwindowed;	// chunks go out unreliably, see SV_SendDownloads
+	int				downloadstart;		// offset of the first chunk
+	unsigned long long	downloadmask;	// chunks past downloadcount the client holds
+	int				downloadsent[DL_WINDOW_MAX];	// svs.realtime each chunk in the window went out
 
 	int				lastmessage;		// sv.framenum when packet was last received
 	int				lastconnect;
 
 	int				challenge;			// challenge of this user, randomly generated
 
+	int				protocol;			// PROTOCOL_VERSION or PROTOCOL_PACKED
 	netchan_t		netchan;
 	
 	//speed cheat detection; these numbers get reset every 12 seconds.
@@ -154,6 +184,18 @@ typedef struct client_s
 // getting kicked off by the server operator
 // a program error, like an overflowed reliable buffer
 
+// one client's share of the work when frames are built on the job threads
+typedef struct
+{
+	client_t		*client;
+	edict_t			*clent;				// whose view the client sees, NULL if none
+	int				num_entities;
+	short			entities[MAX_EDICTS];	// edict numbers visible this frame
+	int				tested, accepted;	// for sv_speeds
+	sizebuf_t		msg;				// the encoded frame
+	byte			msg_buf[MAX_MSGLEN];
+} sv_framejob_t;
+
 //=============================================================================
 
 // MAX_CHALLENGES is made large to prevent a denial
@@ -183,6 +225,7 @@ typedef struct
 	int			num_client_entities;		// maxclients->value*UPDATE_BACKUP*MAX_PACKET_ENTITIES
 	int			next_client_entities;		// next client_entity to use
 	entity_state_t	*client_entities;		// [num_client_entities]
+	sv_framejob_t	*frame_jobs;			// [maxclients->value], for sv_parallelframes
 
 	int			last_heartbeat;
 
@@ -230,6 +273,14 @@ extern	cvar_t		*sv_noreload;			// don't reload level state when reentering
 extern	cvar_t		*sv_airaccelerate;		// don't reload level state when reentering
 											// development tool
 extern	cvar_t		*sv_enforcetime;
+extern	cvar_t		*sv_parallelframes;		// job threads used to build client frames
+extern	cvar_t		*sv_paralleltraces;		// job threads used by SV_TraceBatch
+extern	cvar_t		*sv_traceprofile;		// per-caller trace accounting
+extern	cvar_t		*sv_packedprotocol;		// accept PROTOCOL_PACKED clients
+extern	cvar_t		*sv_dlwindow;			// chunks in flight per windowed download
+extern	cvar_t		*sv_dlrate;				// bytes/sec shared by all windowed downloads
+extern	cvar_t		*sv_democompress;		// deflate level for serverrecord, 0 for none
+extern	cvar_t		*sv_speeds;
 
 extern	client_t	*sv_client;
 extern	edict_t		*sv_player;
@@ -242,6 +293,7 @@ extern  int			sv_numbots;
 //
 void SV_FinalMessage (char *message, qboolean reconnect);
 void SV_DropClient (client_t *drop);
+void SV_ReadPackets (void);
 
 int SV_ModelIndex (char *name);
 int SV_SoundIndex (char *name);
@@ -303,6 +355,8 @@ void SV_BroadcastCommand (char *fmt, ...);
 //
 void SV_Nextserver (void);
 void SV_ExecuteClientMessage (client_t *cl);
+void SV_CloseDownload (client_t *cl);
+void SV_SendDownloads (void);
 
 //
 // sv_ccmds.c
@@ -314,7 +368,14 @@ void SV_Status_f (void);
 //
 void SV_WriteFrameToClient (client_t *client, sizebuf_t *msg);
 void SV_RecordDemoMessage (void);
+void SV_DemoBeginWriting (FILE *f);
+void SV_DemoWrite (sizebuf_t *msg, int time);
+void SV_DemoConfigstring (int index, const char *val, int time);
+void SV_DemoEndWriting (void);
+void SV_BuildVisibilityBuckets (void);
+void SV_VisibilityStats (void);
 void SV_BuildClientFrame (client_t *client);
+void SV_BuildFramesParallel (sv_framejob_t *jobs, int count, int numworkers);
 
 
 void SV_Error (char *error, ...);
@@ -358,6 +419,10 @@ int SV_AreaEdicts (vec3_t mins, vec3_t maxs, edict_t **list, int maxcount, int a
 // returns the number of pointers filled in
 // ??? does this always return the world?
 
+int SV_RadiusEdicts (vec3_t org, float radius, edict_t **list, int maxcount);
+// fills in a table of the solid and trigger edicts whose centers are
+// within radius of org, in edict order, like a full findradius scan
+
 //===================================================================
 
 //
@@ -379,5 +444,17 @@ trace_t SV_Trace (vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end, edict_t *p
 
 // passedict is explicitly excluded from clipping checks (normally NULL)
 
+// SV_Trace for a batch of rays with the same size and passedict, results
+// are identical to tracing them one at a time
+void SV_TraceBatch (int count, vec3_t *starts, vec3_t mins, vec3_t maxs, vec3_t *ends, edict_t *passedict, int contentmask, trace_t *results);
+
+// per-caller trace accounting, for sv_traceprofile
+int SV_TraceCaller (int caller);
+void SV_TraceProfile_f (void);
+void SV_WriteTraceProfile (void);
+
+// server frame duration and jitter histograms
+void SV_TickStats_f (void);
+
 //trace without worrying about entities
 trace_t SV_Trace2 (vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end, edict_t *passedict, int contentmask);
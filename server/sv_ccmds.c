@@ -24,7 +24,6 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 #include "server.h"
 
-static size_t szr; // just for quieting unused result warnings
 
 /*
 ===============================================================================
@@ -514,7 +513,7 @@ void SV_ServerRecord_f (void)
 	char	name[MAX_OSPATH];
 	char	buf_data[32768];
 	sizebuf_t	buf;
-	int		len;
+	FILE	*f;
 	int		i;
 
 	if (Cmd_Argc() != 2)
@@ -542,12 +541,13 @@ void SV_ServerRecord_f (void)
 
 	Com_Printf ("recording to %s.\n", name);
 	FS_CreatePath (name);
-	svs.demofile = fopen (name, "wb");
-	if (!svs.demofile)
+	f = fopen (name, "wb");
+	if (!f)
 	{
 		Com_Printf ("ERROR: couldn't open.\n");
 		return;
 	}
+	SV_DemoBeginWriting (f);
 
 	// setup a buffer to catch all multicasts
 	SZ_Init (&svs.demo_multicast, svs.demo_multicast_buf, sizeof(svs.demo_multicast_buf));
@@ -580,13 +580,12 @@ void SV_ServerRecord_f (void)
 			MSG_WriteByte (&buf, svc_configstring);
 			MSG_WriteShort (&buf, i);
 			MSG_WriteString (&buf, sv.configstrings[i]);
+			SV_DemoConfigstring (i, sv.configstrings[i], -1);
 		}
 
 	// write it to the demo file
 	Com_DPrintf ("signon message length: %i\n", buf.cursize);
-	len = LittleLong (buf.cursize);
-	szr = fwrite (&len, 4, 1, svs.demofile);
-	szr = fwrite (buf.data, buf.cursize, 1, svs.demofile);
+	SV_DemoWrite (&buf, -1);
 
 	// the rest of the demo file will be individual frames
 }
@@ -606,11 +605,121 @@ void SV_ServerStop_f (void)
 		Com_Printf ("Not doing a serverrecord.\n");
 		return;
 	}
-	fclose (svs.demofile);
-	svs.demofile = NULL;
+	SV_DemoEndWriting ();
 	Com_Printf ("Recording completed.\n");
 }
 
+/*
+==============
+SV_DemoSeekSend
+==============
+*/
+static void SV_DemoSeekSend (sizebuf_t *msg)
+{
+	client_t	*cl;
+	int			i;
+
+	for (i=0, cl = svs.clients ; i<maxclients->value; i++, cl++)
+		if (cl->state)
+			Netchan_Transmit (&cl->netchan, msg->cursize, msg->data);
+	SZ_Clear (msg);
+}
+
+/*
+==============
+SV_DemoSeekConfigstrings
+
+Sends everyone watching the configstrings as they were at time, from the
+demo's configstring log. Only the ones changed after the signon can be
+out of date on the client. Precaches are never taken back, since the
+client can't register an empty name.
+==============
+*/
+static void SV_DemoSeekConfigstrings (int time)
+{
+	static char		*value[MAX_CONFIGSTRINGS];
+	static qboolean	changed[MAX_CONFIGSTRINGS];
+	sizebuf_t	msg;
+	byte		msg_buf[MAX_MSGLEN];
+	byte		*rec;
+	char		*s;
+	int			ofs, rectime, index, len, i;
+
+	memset (value, 0, sizeof(value));
+	memset (changed, 0, sizeof(changed));
+	for (ofs = 0; ofs < sv.democslogsize; ofs += 8 + ((len + 3) & ~3))
+	{	// SV_LoadDemoIndex has checked every record
+		rec = sv.democslog + ofs;
+		rectime = LittleLong (((int32_t *)rec)[0]);
+		index = LittleLong (((int32_t *)rec)[1]);
+		s = (char *)rec + 8;
+		len = strlen (s) + 1;
+		if (rectime <= time)
+			value[index] = s;
+		if (rectime >= 0)
+			changed[index] = true;
+	}
+
+	// in packets about as big as the demo frames
+	SZ_Init (&msg, msg_buf, sizeof(msg_buf));
+	for (i = 0; i < MAX_CONFIGSTRINGS; i++)
+	{
+		if (!changed[i])
+			continue;
+		s = value[i] ? value[i] : "";
+		if (!s[0] && i >= CS_MODELS && i < CS_LIGHTS)
+			continue;
+		if (msg.cursize && msg.cursize + strlen (s) + 4 > MAX_MSGLEN/2)
+			SV_DemoSeekSend (&msg);
+		MSG_WriteByte (&msg, svc_configstring);
+		MSG_WriteShort (&msg, i);
+		MSG_WriteString (&msg, s);
+	}
+	if (msg.cursize)
+		SV_DemoSeekSend (&msg);
+}
+
+/*
+==============
+SV_DemoSeek_f
+
+Jumps a playing server demo to a time, using the demo's index
+==============
+*/
+void SV_DemoSeek_f (void)
+{
+	int		start, target, i;
+
+	if (Cmd_Argc() != 2)
+	{
+		Com_Printf ("demoseek <seconds>\n");
+		return;
+	}
+	if (sv.state != ss_demo || !sv.demobuf)
+	{
+		Com_Printf ("No demo is playing.\n");
+		return;
+	}
+	if (!sv.numdemoindex)
+	{
+		Com_Printf ("This demo has no index.\n");
+		return;
+	}
+
+	// the last indexed frame at or before the time
+	start = LittleLong (sv.demoindex[0]);
+	target = start + (int)(atof (Cmd_Argv(1)) * 1000);
+	for (i = 1; i < sv.numdemoindex; i++)
+		if (LittleLong (sv.demoindex[i*2]) > target)
+			break;
+	i--;
+
+	// the offsets were checked when the demo was loaded
+	sv.demo_ofs = LittleLong (sv.demoindex[i*2+1]);
+	SV_DemoSeekConfigstrings (LittleLong (sv.demoindex[i*2]));
+	Com_Printf ("demo at %.1f seconds\n", (LittleLong (sv.demoindex[i*2]) - start) / 1000.0);
+}
+
 
 /*
 ===============
@@ -646,6 +755,268 @@ void SV_ServerCommand_f (void)
 	ge->ServerCommand();
 }
 
+/*
+===============
+SV_FrameBench_f
+
+framebench [viewers] [iterations] [threads]
+
+Builds and encodes full (non-delta) frames for a number of virtual
+clients looking through the eyes of the players and bots on the current
+map, once on the main thread and once on the job threads, then reports
+the time per server frame for each and whether the encoded frames match.
+===============
+*/
+void SV_FrameBench_f (void)
+{
+	int				viewers, iterations, numworkers;
+	int				i, v, numeyes;
+	edict_t			*ent, *eyes[MAX_CLIENTS];
+	client_t		*fake;
+	sv_framejob_t	*jobs;
+	byte			*serialbuf;
+	int				*serialsize;
+	sizebuf_t		msg;
+	entity_state_t	*saved_entities;
+	int				saved_num, saved_next;
+	unsigned long long	start, serial_us, parallel_us;
+	int				mismatches;
+
+	if (sv.state != ss_game)
+	{
+		Com_Printf ("No map running.\n");
+		return;
+	}
+
+	viewers = Cmd_Argc() > 1 ? atoi (Cmd_Argv(1)) : 32;
+	iterations = Cmd_Argc() > 2 ? atoi (Cmd_Argv(2)) : 100;
+	numworkers = Cmd_Argc() > 3 ? atoi (Cmd_Argv(3)) : Sys_NumProcessors() - 1;
+	if (viewers < 1 || iterations < 1)
+	{
+		Com_Printf ("Usage: framebench [viewers] [iterations] [threads]\n");
+		return;
+	}
+
+	numeyes = 0;
+	for (i=1 ; i<=maxclients->integer ; i++)
+	{
+		ent = EDICT_NUM(i);
+		if (ent->inuse && ent->client)
+			eyes[numeyes++] = ent;
+	}
+	if (!numeyes)
+	{
+		Com_Printf ("Need at least one player or bot on the map to look from.\n");
+		return;
+	}
+
+	fake = Z_Malloc (sizeof(client_t)*viewers);
+	jobs = Z_Malloc (sizeof(sv_framejob_t)*viewers);
+	serialbuf = Z_Malloc (MAX_MSGLEN*viewers);
+	serialsize = Z_Malloc (sizeof(int)*viewers);
+	for (v=0 ; v<viewers ; v++)
+	{
+		fake[v].state = cs_spawned;
+		fake[v].edict = eyes[v % numeyes];
+		fake[v].lastframe = -1;
+	}
+
+	// don't disturb the delta history of the real clients
+	saved_entities = svs.client_entities;
+	saved_num = svs.num_client_entities;
+	saved_next = svs.next_client_entities;
+	svs.num_client_entities = viewers*UPDATE_BACKUP*64;
+	svs.client_entities = Z_Malloc (sizeof(entity_state_t)*svs.num_client_entities);
+	svs.next_client_entities = 0;
+
+	start = Sys_Microseconds ();
+	for (i=0 ; i<iterations ; i++)
+	{
+		SV_BuildVisibilityBuckets ();
+		for (v=0 ; v<viewers ; v++)
+		{
+			SZ_Init (&msg, serialbuf + v*MAX_MSGLEN, MAX_MSGLEN);
+			msg.allowoverflow = true;
+			SV_BuildClientFrame (&fake[v]);
+			SV_WriteFrameToClient (&fake[v], &msg);
+			serialsize[v] = msg.overflowed ? -1 : msg.cursize;
+		}
+	}
+	serial_us = Sys_Microseconds () - start;
+
+	mismatches = 0;
+	start = Sys_Microseconds ();
+	for (i=0 ; i<iterations ; i++)
+	{
+		SV_BuildVisibilityBuckets ();
+		for (v=0 ; v<viewers ; v++)
+		{
+			jobs[v].client = &fake[v];
+			SZ_Init (&jobs[v].msg, jobs[v].msg_buf, MAX_MSGLEN);
+			jobs[v].msg.allowoverflow = true;
+		}
+		SV_BuildFramesParallel (jobs, viewers, numworkers);
+	}
+	parallel_us = Sys_Microseconds () - start;
+
+	for (v=0 ; v<viewers ; v++)
+	{
+		if ((jobs[v].msg.overflowed ? -1 : jobs[v].msg.cursize) != serialsize[v]
+			|| (serialsize[v] > 0 && memcmp (jobs[v].msg_buf, serialbuf + v*MAX_MSGLEN, serialsize[v])))
+			mismatches++;
+	}
+
+	Z_Free (svs.client_entities);
+	svs.client_entities = saved_entities;
+	svs.num_client_entities = saved_num;
+	svs.next_client_entities = saved_next;
+
+	Com_Printf ("%i viewers, %i edicts, %i frames\n", viewers, ge->num_edicts, iterations);
+	Com_Printf ("serial:   %8.3f ms/frame\n", serial_us / (1000.0 * iterations));
+	Com_Printf ("%2i jobs:  %8.3f ms/frame\n", numworkers, parallel_us / (1000.0 * iterations));
+	if (mismatches)
+		Com_Printf ("WARNING: %i of %i frames differ from the serial build\n", mismatches, viewers);
+	else
+		Com_Printf ("all frames identical\n");
+	SV_VisibilityStats ();
+
+	Z_Free (serialsize);
+	Z_Free (serialbuf);
+	Z_Free (jobs);
+	Z_Free (fake);
+}
+
+/*
+===============
+SV_NetBench_f
+
+netbench [clients] [frames]
+
+Load generator for the packet path. Free client slots are taken over by
+fake connected clients whose other ends live on this server's own client
+socket. Every frame each of them sends a move sized packet over loopback
+UDP, the server reads them with SV_ReadPackets and answers each with a
+snapshot sized packet in one send batch. Reports the packet rates and the
+time the server spent per frame reading and sending.
+===============
+*/
+#define	NETBENCH_MOVE		40
+#define	NETBENCH_SNAPSHOT	400
+
+void SV_NetBench_f (void)
+{
+	int				numclients, frames;
+	int				i, f, n, *slots;
+	netchan_t		*chans;
+	client_t		*cl;
+	netadr_t		serveradr, clientadr, from;
+	sizebuf_t		msg;
+	byte			msgbuf[MAX_MSGLEN];
+	byte			move[NETBENCH_MOVE], snapshot[NETBENCH_SNAPSHOT];
+	int				replies, received;
+	unsigned long long	start, read_us, send_us;
+
+	if (sv.state != ss_game || !dedicated->integer)
+	{
+		Com_Printf ("netbench needs a dedicated server running a map.\n");
+		return;
+	}
+	if (!NET_LocalPort (NS_SERVER) || !NET_LocalPort (NS_CLIENT))
+	{
+		Com_Printf ("netbench needs the UDP sockets open.\n");
+		return;
+	}
+
+	numclients = Cmd_Argc() > 1 ? atoi (Cmd_Argv(1)) : maxclients->integer;
+	frames = Cmd_Argc() > 2 ? atoi (Cmd_Argv(2)) : 1000;
+	if (numclients < 1 || frames < 1)
+	{
+		Com_Printf ("Usage: netbench [clients] [frames]\n");
+		return;
+	}
+
+	memset (&serveradr, 0, sizeof(serveradr));
+	serveradr.type = NA_IP;
+	serveradr.ip[0] = 127;
+	serveradr.ip[3] = 1;
+	clientadr = serveradr;
+	serveradr.port = BigShort ((short)NET_LocalPort (NS_SERVER));
+	clientadr.port = BigShort ((short)NET_LocalPort (NS_CLIENT));
+
+	slots = Z_Malloc (sizeof(int)*maxclients->integer);
+	chans = Z_Malloc (sizeof(netchan_t)*maxclients->integer);
+	n = 0;
+	for (i=0, cl=svs.clients ; i<maxclients->integer && n<numclients ; i++, cl++)
+	{
+		if (cl->state != cs_free || EDICT_NUM(i+1)->inuse)
+			continue;		// in use, or held by a bot
+
+		// the other end uses a made up qport, like a client behind NAT
+		memset (cl, 0, sizeof(*cl));
+		cl->state = cs_connected;
+		cl->edict = EDICT_NUM(i+1);
+		cl->lastmessage = svs.realtime;
+		strcpy (cl->name, "netbench");
+		Netchan_Setup (NS_SERVER, &cl->netchan, clientadr, 0x4000 + i);
+		Netchan_Setup (NS_CLIENT, &chans[n], serveradr, 0x4000 + i);
+		slots[n++] = i;
+	}
+	if (!n)
+	{
+		Com_Printf ("No free client slots.\n");
+		Z_Free (chans);
+		Z_Free (slots);
+		return;
+	}
+
+	memset (move, clc_nop, sizeof(move));
+	memset (snapshot, 0, sizeof(snapshot));
+	SZ_Init (&msg, msgbuf, sizeof(msgbuf));
+
+	read_us = send_us = 0;
+	replies = 0;
+	for (f=0 ; f<frames ; f++)
+	{
+		for (i=0 ; i<n ; i++)
+			Netchan_Transmit (&chans[i], sizeof(move), move);
+
+		start = Sys_Microseconds ();
+		SV_ReadPackets ();
+		read_us += Sys_Microseconds () - start;
+
+		start = Sys_Microseconds ();
+		NET_BeginSendBatch (NS_SERVER);
+		for (i=0 ; i<n ; i++)
+			Netchan_Transmit (&svs.clients[slots[i]].netchan, sizeof(snapshot), snapshot);
+		NET_FlushSendBatch (NS_SERVER);
+		send_us += Sys_Microseconds () - start;
+
+		while (NET_GetPacket (NS_CLIENT, &from, &msg))
+			replies++;
+	}
+
+	received = 0;
+	for (i=0 ; i<n ; i++)
+	{
+		cl = &svs.clients[slots[i]];
+		received += cl->netchan.incoming_sequence;
+		memset (cl, 0, sizeof(*cl));	// back to cs_free
+	}
+
+	if (!read_us)
+		read_us = 1;
+	if (!send_us)
+		send_us = 1;
+	Com_Printf ("%i clients, %i frames, net_mmsg %i\n", n, frames, (int)Cvar_VariableValue ("net_mmsg"));
+	Com_Printf ("read: %8.3f ms/frame %10.0f packets/s (%i of %i arrived)\n",
+		read_us / (1000.0 * frames), received * 1000000.0 / read_us, received, n*frames);
+	Com_Printf ("send: %8.3f ms/frame %10.0f packets/s (%i of %i arrived)\n",
+		send_us / (1000.0 * frames), n * frames * 1000000.0 / send_us, replies, n*frames);
+
+	Z_Free (chans);
+	Z_Free (slots);
+}
+
 //===========================================================
 
 /*
@@ -674,9 +1045,15 @@ void SV_InitOperatorCommands (void)
 
 	Cmd_AddCommand ("serverrecord", SV_ServerRecord_f);
 	Cmd_AddCommand ("serverstop", SV_ServerStop_f);
+	Cmd_AddCommand ("demoseek", SV_DemoSeek_f);
 
 	Cmd_AddCommand ("killserver", SV_KillServer_f);
 
 	Cmd_AddCommand ("sv", SV_ServerCommand_f);
+
+	Cmd_AddCommand ("framebench", SV_FrameBench_f);
+	Cmd_AddCommand ("netbench", SV_NetBench_f);
+	Cmd_AddCommand ("traceprofile", SV_TraceProfile_f);
+	Cmd_AddCommand ("tickstats", SV_TickStats_f);
 }
 
@@ -42,13 +42,9 @@ SV_EmitPacketEntities
 Writes a delta update of an entity_state_t list to the message.
 =============
 */
-void SV_EmitPacketEntities (client_frame_t *from, client_frame_t *to, sizebuf_t *msg)
+void SV_EmitPacketEntities (client_frame_t *from, client_frame_t *to, sizebuf_t *msg, qboolean packed)
 {
-	entity_state_t	*oldent=NULL, *newent=NULL;
-	int		oldindex, newindex;
-	int		oldnum, newnum;
-	int		from_num_entities;
-	int		bits;
+	entitylist_t	oldlist, newlist;
 
 #if 0
 	if (numprojs)
@@ -57,71 +53,20 @@ void SV_EmitPacketEntities (client_frame_t *from, client_frame_t *to, sizebuf_t
 #endif
 		MSG_WriteByte (msg, svc_packetentities);
 
-	if (!from)
-		from_num_entities = 0;
-	else
-		from_num_entities = from->num_entities;
-
-	newindex = 0;
-	oldindex = 0;
-	while (newindex < to->num_entities || oldindex < from_num_entities)
+	if (from)
 	{
-		if (newindex >= to->num_entities)
-			newnum = 9999;
-		else
-		{
-			newent = &svs.client_entities[(to->first_entity+newindex)%svs.num_client_entities];
-			newnum = newent->number;
-		}
-
-		if (oldindex >= from_num_entities)
-			oldnum = 9999;
-		else
-		{
-			oldent = &svs.client_entities[(from->first_entity+oldindex)%svs.num_client_entities];
-			oldnum = oldent->number;
-		}
-
-		if (newnum == oldnum)
-		{	// delta update from old position
-			// because the force parm is false, this will not result
-			// in any bytes being emited if the entity has not changed at all
-			// note that players are always 'newentities', this updates their oldorigin always
-			// and prevents warping
-			MSG_WriteDeltaEntity (oldent, newent, msg, false, newent->number <= maxclients->value);
-			oldindex++;
-			newindex++;
-			continue;
-		}
-
-		if (newnum < oldnum)
-		{	// this is a new entity, send it from the baseline
-			MSG_WriteDeltaEntity (&sv.baselines[newnum], newent, msg, true, true);
-			newindex++;
-			continue;
-		}
-
-		if (newnum > oldnum)
-		{	// the old entity isn't present in the new message
-			bits = U_REMOVE;
-			if (oldnum >= 256)
-				bits |= U_NUMBER16 | U_MOREBITS1;
-
-			MSG_WriteByte (msg,	bits&255 );
-			if (bits & 0x0000ff00)
-				MSG_WriteByte (msg,	(bits>>8)&255 );
-
-			if (bits & U_NUMBER16)
-				MSG_WriteShort (msg, oldnum);
-			else
-				MSG_WriteByte (msg, oldnum);
-
-			oldindex++;
-			continue;
-		}
+		oldlist.ring = svs.client_entities;
+		oldlist.ringsize = svs.num_client_entities;
+		oldlist.first = from->first_entity;
+		oldlist.count = from->num_entities;
 	}
 
-	MSG_WriteShort (msg, 0);	// end of packetentities
+	newlist.ring = svs.client_entities;
+	newlist.ringsize = svs.num_client_entities;
+	newlist.first = to->first_entity;
+	newlist.count = to->num_entities;
+
+	MSG_WritePacketEntities (msg, from ? &oldlist : NULL, &newlist, sv.baselines, maxclients->value, packed);
 }
 
 
@@ -132,197 +77,20 @@ SV_WritePlayerstateToClient
 
 =============
 */
-void SV_WritePlayerstateToClient (client_frame_t *from, client_frame_t *to, sizebuf_t *msg)
+void SV_WritePlayerstateToClient (client_frame_t *from, client_frame_t *to, sizebuf_t *msg, qboolean packed)
 {
-	int				i;
-	int				pflags;
-	player_state_t	*ps, *ops;
-	player_state_t	dummy;
-	int				statbits;
-
-	ps = &to->ps;
-	if (!from)
-	{
-		memset (&dummy, 0, sizeof(dummy));
-		ops = &dummy;
-	}
-	else
-		ops = &from->ps;
-
-	//
-	// determine what needs to be sent
-	//
-	pflags = 0;
-
-	if (ps->pmove.pm_type != ops->pmove.pm_type)
-		pflags |= PS_M_TYPE;
-
-	if (ps->pmove.origin[0] != ops->pmove.origin[0]
-		|| ps->pmove.origin[1] != ops->pmove.origin[1]
-		|| ps->pmove.origin[2] != ops->pmove.origin[2] )
-		pflags |= PS_M_ORIGIN;
-
-	if (ps->pmove.velocity[0] != ops->pmove.velocity[0]
-		|| ps->pmove.velocity[1] != ops->pmove.velocity[1]
-		|| ps->pmove.velocity[2] != ops->pmove.velocity[2] )
-		pflags |= PS_M_VELOCITY;
-
-	if (ps->pmove.pm_time != ops->pmove.pm_time)
-		pflags |= PS_M_TIME;
-
-	if (ps->pmove.pm_flags != ops->pmove.pm_flags)
-		pflags |= PS_M_FLAGS;
-
-	if (ps->pmove.gravity != ops->pmove.gravity)
-		pflags |= PS_M_GRAVITY;
-
-	if (ps->pmove.delta_angles[0] != ops->pmove.delta_angles[0]
-		|| ps->pmove.delta_angles[1] != ops->pmove.delta_angles[1]
-		|| ps->pmove.delta_angles[2] != ops->pmove.delta_angles[2] )
-		pflags |= PS_M_DELTA_ANGLES;
-
-
-	if (ps->viewoffset[0] != ops->viewoffset[0]
-		|| ps->viewoffset[1] != ops->viewoffset[1]
-		|| ps->viewoffset[2] != ops->viewoffset[2] )
-		pflags |= PS_VIEWOFFSET;
-
-	if (ps->viewangles[0] != ops->viewangles[0]
-		|| ps->viewangles[1] != ops->viewangles[1]
-		|| ps->viewangles[2] != ops->viewangles[2] )
-		pflags |= PS_VIEWANGLES;
-
-	if (ps->kick_angles[0] != ops->kick_angles[0]
-		|| ps->kick_angles[1] != ops->kick_angles[1]
-		|| ps->kick_angles[2] != ops->kick_angles[2] )
-		pflags |= PS_KICKANGLES;
-
-	if (ps->blend[0] != ops->blend[0]
-		|| ps->blend[1] != ops->blend[1]
-		|| ps->blend[2] != ops->blend[2]
-		|| ps->blend[3] != ops->blend[3] )
-		pflags |= PS_BLEND;
-
-	if (ps->fov != ops->fov)
-		pflags |= PS_FOV;
-
-	if (ps->rdflags != ops->rdflags)
-		pflags |= PS_RDFLAGS;
-
-	if (ps->gunframe != ops->gunframe
-		|| (int)(ops->gunoffset[0]*4) != (int)(ps->gunoffset[0]*4)
-		|| (int)(ops->gunoffset[1]*4) != (int)(ps->gunoffset[1]*4)
-		|| (int)(ops->gunoffset[2]*4) != (int)(ps->gunoffset[2]*4)
-		|| (int)(ops->gunangles[0]*4) != (int)(ps->gunangles[0]*4)
-		|| (int)(ops->gunangles[1]*4) != (int)(ps->gunangles[1]*4)
-		|| (int)(ops->gunangles[2]*4) != (int)(ps->gunangles[2]*4) )
-		pflags |= PS_WEAPONFRAME;
-
-	pflags |= PS_WEAPONINDEX;
-
-	//
-	// write it
-	//
-	MSG_WriteByte (msg, svc_playerinfo);
-	MSG_WriteShort (msg, pflags);
+	bitmsg_t	bm;
 
-	//
-	// write the pmove_state_t
-	//
-	if (pflags & PS_M_TYPE)
-		MSG_WriteByte (msg, ps->pmove.pm_type);
-
-	if (pflags & PS_M_ORIGIN)
-	{
-		MSG_WriteSizeInt (msg, coord_bytes, ps->pmove.origin[0]);
-		MSG_WriteSizeInt (msg, coord_bytes, ps->pmove.origin[1]);
-		MSG_WriteSizeInt (msg, coord_bytes, ps->pmove.origin[2]);
-	}
-
-	if (pflags & PS_M_VELOCITY)
-	{
-		MSG_WriteShort (msg, ps->pmove.velocity[0]);
-		MSG_WriteShort (msg, ps->pmove.velocity[1]);
-		MSG_WriteShort (msg, ps->pmove.velocity[2]);
-	}
-
-	if (pflags & PS_M_TIME)
-		MSG_WriteByte (msg, ps->pmove.pm_time);
-
-	if (pflags & PS_M_FLAGS)
-		MSG_WriteByte (msg, ps->pmove.pm_flags);
-
-	if (pflags & PS_M_GRAVITY)
-		MSG_WriteShort (msg, ps->pmove.gravity);
-
-	if (pflags & PS_M_DELTA_ANGLES)
-	{
-		MSG_WriteShort (msg, ps->pmove.delta_angles[0]);
-		MSG_WriteShort (msg, ps->pmove.delta_angles[1]);
-		MSG_WriteShort (msg, ps->pmove.delta_angles[2]);
-	}
-
-	//
-	// write the rest of the player_state_t
-	//
-	if (pflags & PS_VIEWOFFSET)
-	{
-		MSG_WriteChar (msg, ps->viewoffset[0]*4);
-		MSG_WriteChar (msg, ps->viewoffset[1]*4);
-		MSG_WriteChar (msg, ps->viewoffset[2]*4);
-	}
-
-	if (pflags & PS_VIEWANGLES)
-	{
-		MSG_WriteAngle16 (msg, ps->viewangles[0]);
-		MSG_WriteAngle16 (msg, ps->viewangles[1]);
-		MSG_WriteAngle16 (msg, ps->viewangles[2]);
-	}
-
-	if (pflags & PS_KICKANGLES)
-	{
-		MSG_WriteChar (msg, ps->kick_angles[0]*4);
-		MSG_WriteChar (msg, ps->kick_angles[1]*4);
-		MSG_WriteChar (msg, ps->kick_angles[2]*4);
-	}
-
-	if (pflags & PS_WEAPONINDEX)
-	{
-		MSG_WriteByte (msg, ps->gunindex);
-	}
+	MSG_WriteByte (msg, svc_playerinfo);
 
-	if (pflags & PS_WEAPONFRAME)
+	if (packed)
 	{
-		MSG_WriteByte (msg, ps->gunframe);
-		MSG_WriteChar (msg, ps->gunoffset[0]*4);
-		MSG_WriteChar (msg, ps->gunoffset[1]*4);
-		MSG_WriteChar (msg, ps->gunoffset[2]*4);
-		MSG_WriteChar (msg, ps->gunangles[0]*4);
-		MSG_WriteChar (msg, ps->gunangles[1]*4);
-		MSG_WriteChar (msg, ps->gunangles[2]*4);
+		MSG_BeginWritingBits (&bm, msg);
+		MSG_WritePackedPlayerstate (&bm, from ? &from->ps : NULL, &to->ps);
+		MSG_EndWritingBits (&bm);
 	}
-
-	if (pflags & PS_BLEND)
-	{
-		MSG_WriteByte (msg, ps->blend[0]*255);
-		MSG_WriteByte (msg, ps->blend[1]*255);
-		MSG_WriteByte (msg, ps->blend[2]*255);
-		MSG_WriteByte (msg, ps->blend[3]*255);
-	}
-	if (pflags & PS_FOV)
-		MSG_WriteByte (msg, ps->fov);
-	if (pflags & PS_RDFLAGS)
-		MSG_WriteByte (msg, ps->rdflags);
-
-	// send stats
-	statbits = 0;
-	for (i=0 ; i<MAX_STATS ; i++)
-		if (ps->stats[i] != ops->stats[i])
-			statbits |= 1<<i;
-	MSG_WriteLong (msg, statbits);
-	for (i=0 ; i<MAX_STATS ; i++)
-		if (statbits & (1<<i) )
-			MSG_WriteShort (msg, ps->stats[i]);
+	else
+		MSG_WriteDeltaPlayerstate (from ? &from->ps : NULL, &to->ps, msg);
 }
 
 
@@ -368,10 +136,10 @@ void SV_WriteFrameToClient (client_t *client, sizebuf_t *msg)
 	SZ_Write (msg, frame->areabits, frame->areabytes);
 
 	// delta encode the playerstate
-	SV_WritePlayerstateToClient (oldframe, frame, msg);
+	SV_WritePlayerstateToClient (oldframe, frame, msg, client->protocol == PROTOCOL_PACKED);
 
 	// delta encode the entities
-	SV_EmitPacketEntities (oldframe, frame, msg);
+	SV_EmitPacketEntities (oldframe, frame, msg, client->protocol == PROTOCOL_PACKED);
 }
 
 
@@ -385,6 +153,51 @@ Build a client frame structure
 
 byte		fatpvs[65536/8];	// 32767 is MAX_MAP_LEAFS
 
+/*
+============
+Fat PVS cache
+
+Most clients sit in the same few clusters from one frame to the next, so
+the merged rows are kept, keyed by the sorted list of clusters around the
+view point. Job threads share it, so it is guarded by a mutex once the
+parallel frame builder has created one.
+============
+*/
+#define	FATPVS_CACHE	32
+#define	FATPVS_MAXKEY	8		// bigger cluster sets are always rebuilt
+
+typedef struct
+{
+	int		spawncount;			// 0 when unused
+	int		numkeys;
+	int		keys[FATPVS_MAXKEY];
+	unsigned	lastused;
+	byte	bits[65536/8];
+} fatpvs_t;
+
+static struct
+{
+	void		*lock;
+	unsigned	sequence;
+	int			hits, misses;	// for sv_speeds
+	fatpvs_t	entries[FATPVS_CACHE];
+} sv_fatcache;
+
+static fatpvs_t *SV_FindFatPVS (int *keys, int numkeys)
+{
+	fatpvs_t	*f;
+	int			i;
+
+	for (i=0, f=sv_fatcache.entries ; i<FATPVS_CACHE ; i++, f++)
+	{
+		if (f->spawncount != svs.spawncount + 1 || f->numkeys != numkeys)
+			continue;
+		if (!memcmp (f->keys, keys, numkeys*sizeof(*keys)))
+			return f;
+	}
+	return NULL;
+}
+
 /*
 ============
 SV_FatPVS
@@ -393,13 +206,14 @@ The client will interpolate the view position,
 so we can't use a single PVS point
 ===========
 */
-void SV_FatPVS (vec3_t org)
+static void SV_FatPVS (vec3_t org, byte *out)
 {
 	int		leafs[64];
-	int		i, j, count;
-	int		longs;
-	byte	*src;
+	int		i, j, k, count;
+	int		bytes;
+	byte	src[65536/8];
 	vec3_t	mins, maxs;
+	fatpvs_t	*f, *oldest;
 
 	for (i=0 ; i<3 ; i++)
 	{
@@ -407,62 +221,104 @@ void SV_FatPVS (vec3_t org)
 		maxs[i] = org[i] + 8;
 	}
 
+	bytes = (CM_NumClusters()+7)>>3;
+
 	count = CM_BoxLeafnums (mins, maxs, leafs, 64, NULL);
 	if (count < 1)
-		Com_Error (ERR_FATAL, "SV_FatPVS: count < 1");
-	longs = (CM_NumClusters()+31)>>5;
+	{	// can't happen with a map loaded; don't Com_Error from a job thread
+		memset (out, 0, bytes);
+		return;
+	}
 
-	// convert leafs to clusters
+	// convert leafs to a sorted list of distinct clusters
+	k = 0;
 	for (i=0 ; i<count ; i++)
-		leafs[i] = CM_LeafCluster(leafs[i]);
+	{
+		int cluster = CM_LeafCluster(leafs[i]);
+
+		for (j=k ; j>0 && leafs[j-1] > cluster ; j--)
+			;
+		if (j > 0 && leafs[j-1] == cluster)
+			continue;		// already have the cluster we want
+		memmove (leafs+j+1, leafs+j, (k-j)*sizeof(*leafs));
+		leafs[j] = cluster;
+		k++;
+	}
+	count = k;
+
+	if (count <= FATPVS_MAXKEY)
+	{
+		if (sv_fatcache.lock)
+			Sys_LockMutex (sv_fatcache.lock);
+		f = SV_FindFatPVS (leafs, count);
+		if (f)
+		{
+			f->lastused = ++sv_fatcache.sequence;
+			sv_fatcache.hits++;
+			memcpy (out, f->bits, bytes);
+		}
+		else
+			sv_fatcache.misses++;
+		if (sv_fatcache.lock)
+			Sys_UnlockMutex (sv_fatcache.lock);
+		if (f)
+			return;
+	}
 
-	memcpy (fatpvs, CM_ClusterPVS(leafs[0]), longs<<2);
+	CM_CopyClusterPVS (leafs[0], out);
 	// or in all the other leaf bits
 	for (i=1 ; i<count ; i++)
 	{
-		for (j=0 ; j<i ; j++)
-			if (leafs[i] == leafs[j])
+		CM_CopyClusterPVS (leafs[i], src);
+		Com_OrBits (out, src, bytes);
+	}
+
+	if (count > FATPVS_MAXKEY)
+		return;
+
+	if (sv_fatcache.lock)
+		Sys_LockMutex (sv_fatcache.lock);
+	if (!SV_FindFatPVS (leafs, count))
+	{	// another thread may have just added it
+		oldest = sv_fatcache.entries;
+		for (i=0, f=sv_fatcache.entries ; i<FATPVS_CACHE ; i++, f++)
+		{
+			if (f->spawncount != svs.spawncount + 1)
+			{
+				oldest = f;
 				break;
-		if (j != i)
-			continue;		// already have the cluster we want
-		src = CM_ClusterPVS(leafs[i]);
-		for (j=0 ; j<longs ; j++)
-			((long *)fatpvs)[j] |= ((long *)src)[j];
+			}
+			if (f->lastused < oldest->lastused)
+				oldest = f;
+		}
+		oldest->spawncount = svs.spawncount + 1;
+		oldest->numkeys = count;
+		memcpy (oldest->keys, leafs, count*sizeof(*leafs));
+		oldest->lastused = ++sv_fatcache.sequence;
+		memcpy (oldest->bits, out, bytes);
 	}
+	if (sv_fatcache.lock)
+		Sys_UnlockMutex (sv_fatcache.lock);
 }
 
 
 /*
 =============
-SV_BuildClientFrame
+SV_FrameViewer
 
-Decides which entities are going to be visible to the client, and
-copies off the playerstat and areabits.
+Returns the edict whose view the client sees (itself, or whoever it is
+following in ghost mode), or NULL if the client isn't in the game yet.
 =============
 */
-void SV_BuildClientFrame (client_t *client)
+static edict_t *SV_FrameViewer (client_t *client)
 {
-	int		e, i;
-	vec3_t	org;
-	edict_t	*ent;
-	edict_t	*clent;
-	edict_t	*orig_clent;
-	client_frame_t	*frame;
-	entity_state_t	*state;
-	int		l;
-	int		clientarea, clientcluster;
-	int		leafnum;
-	int		c_fullsend;
-	byte	*clientphs;
-	byte	*bitvector;
-	
+	int			i;
 	client_t	*redir_client;
 	int			redir_num;
-	
-	orig_clent = client->edict;
-	if (!orig_clent->client)
-		return;		// not in game yet
-		
+
+	if (!client->edict->client)
+		return NULL;		// not in game yet
+
 	redir_num = client->edict->redirect_number;
 	if (redir_num != client->edict->s.number)
 	{
@@ -474,10 +330,26 @@ void SV_BuildClientFrame (client_t *client)
 	}
 	else
 		redir_client = client;
-	
-	clent = redir_client->edict;
-	if (!clent->client)
-		return;		// not in game yet
+
+	if (!redir_client->edict->client)
+		return NULL;		// not in game yet
+
+	return redir_client->edict;
+}
+
+
+/*
+=============
+SV_BeginClientFrame
+
+Copies off the playerstate and areabits and finds the view position.
+=============
+*/
+static client_frame_t *SV_BeginClientFrame (client_t *client, edict_t *clent, vec3_t org, int *clientarea)
+{
+	int		i;
+	int		leafnum;
+	client_frame_t	*frame;
 
 	// this is the frame we are creating
 	frame = &client->frames[sv.framenum & UPDATE_MASK];
@@ -489,16 +361,15 @@ void SV_BuildClientFrame (client_t *client)
 		org[i] = clent->client->ps.pmove.origin[i]*0.125 + clent->client->ps.viewoffset[i];
 
 	leafnum = CM_PointLeafnum (org);
-	clientarea = CM_LeafArea (leafnum);
-	clientcluster = CM_LeafCluster (leafnum);
+	*clientarea = CM_LeafArea (leafnum);
 
 	// calculate the visible areas
-	frame->areabytes = CM_WriteAreaBits (frame->areabits, clientarea);
+	frame->areabytes = CM_WriteAreaBits (frame->areabits, *clientarea);
 
 	// grab the current player_state_t
 	frame->ps = clent->client->ps;
-	
-	if (client != redir_client)
+
+	if (client->edict != clent)
 	{
 		//some adjustments for ghost mode
 		if (frame->ps.pmove.pm_type != PM_DEAD)
@@ -506,102 +377,302 @@ void SV_BuildClientFrame (client_t *client)
 		frame->ps.fov = client->edict->client->ps.fov;
 	}
 
+	return frame;
+}
 
-	SV_FatPVS (org);
-	clientphs = CM_ClusterPHS (clientcluster);
 
-	// build up the list of visible entities
-	frame->num_entities = 0;
-	frame->first_entity = svs.next_client_entities;
+/*
+=============================================================================
+
+Entity visibility buckets
 
-	c_fullsend = 0;
+Once per frame every entity that could be sent is filed under each PVS
+cluster it touches. A client then only has to look at the entities filed
+under the clusters in its fat PVS, rather than testing every edict.
 
+=============================================================================
+*/
+
+static struct
+{
+	int		numclusters;
+	int		first[MAX_MAP_LEAFS+1];		// into ents, by cluster
+	short	ents[MAX_EDICTS*MAX_ENT_CLUSTERS];
+	int		numheadnode;				// too many clusters, test by headnode
+	short	headnode[MAX_EDICTS];
+} sv_buckets;
+
+// sv_speeds counters, reset every frame
+static int		sv_vis_clients, sv_vis_tested, sv_vis_accepted;
+
+// ignore ents without visible models unless they have an effect
+static qboolean SV_EntityHasVisuals (edict_t *ent)
+{
+	if (ent->svflags & SVF_NOCLIENT)
+		return false;
+
+	if (!ent->s.modelindex && !ent->s.effects && !ent->s.sound
+		&& !ent->s.event)
+		return false;
+
+	return true;
+}
+
+/*
+=============
+SV_BuildVisibilityBuckets
+
+Must be called before building client frames whenever entities may
+have been relinked.
+=============
+*/
+void SV_BuildVisibilityBuckets (void)
+{
+	int		e, i, c;
+	edict_t	*ent;
+	int		*first = sv_buckets.first;
+
+	sv_buckets.numclusters = CM_NumClusters ();
+	sv_buckets.numheadnode = 0;
+	memset (first, 0, (sv_buckets.numclusters+1)*sizeof(*first));
+
+	// count, then fill, so each cluster's list is in edict order
 	for (e=1 ; e<ge->num_edicts ; e++)
 	{
 		ent = EDICT_NUM(e);
+		if (!SV_EntityHasVisuals (ent))
+			continue;
+		if (ent->num_clusters == -1)
+		{
+			sv_buckets.headnode[sv_buckets.numheadnode++] = e;
+			continue;
+		}
+		for (i=0 ; i<ent->num_clusters ; i++)
+		{
+			c = ent->clusternums[i];
+			if (c >= 0 && c < sv_buckets.numclusters)
+				first[c+1]++;
+		}
+	}
+
+	for (c=0 ; c<sv_buckets.numclusters ; c++)
+		first[c+1] += first[c];
 
-		// ignore ents without visible models
-		if (ent->svflags & SVF_NOCLIENT)
+	for (e=1 ; e<ge->num_edicts ; e++)
+	{
+		ent = EDICT_NUM(e);
+		if (ent->num_clusters == -1 || !SV_EntityHasVisuals (ent))
 			continue;
+		for (i=0 ; i<ent->num_clusters ; i++)
+		{
+			c = ent->clusternums[i];
+			if (c >= 0 && c < sv_buckets.numclusters)
+				sv_buckets.ents[first[c]++] = e;
+		}
+	}
 
-		// ignore ents without visible models unless they have an effect
-		if (!ent->s.modelindex && !ent->s.effects && !ent->s.sound
-			&& !ent->s.event)
+	// filling advanced every start to the next cluster's; shift back
+	for (c=sv_buckets.numclusters ; c>0 ; c--)
+		first[c] = first[c-1];
+	first[0] = 0;
+
+	sv_vis_clients = sv_vis_tested = sv_vis_accepted = 0;
+	sv_fatcache.hits = sv_fatcache.misses = 0;
+}
+
+/*
+=============
+SV_FindVisibleEntities
+
+Fills list with the numbers of the entities that go into the frame of a
+client viewing from org, in increasing order. Returns the count, and
+adds the number of entities that had to be looked at to *tested.
+=============
+*/
+static int SV_FindVisibleEntities (edict_t *clent, int clientarea, vec3_t org, byte *bitvector, short *list, int *tested)
+{
+	byte	mark[MAX_EDICTS/8];
+	int		i, c, e, bits;
+	int		count;
+	edict_t	*ent;
+
+	memset (mark, 0, sizeof(mark));
+
+	// gather everything filed under a potentially visible cluster
+	for (i=0 ; i<(sv_buckets.numclusters+7)>>3 ; i++)
+	{
+		bits = bitvector[i];
+		if (!bits)
 			continue;
+		for (c=i<<3 ; bits ; c++, bits>>=1)
+		{
+			if (!(bits & 1))
+				continue;
+			if (c >= sv_buckets.numclusters)
+				break;
+			for (e=sv_buckets.first[c] ; e<sv_buckets.first[c+1] ; e++)
+				mark[sv_buckets.ents[e]>>3] |= 1<<(sv_buckets.ents[e]&7);
+		}
+	}
 
-		// ignore if not touching a PV leaf
-		if (ent != clent)
+	// too many leafs for individual check, go by headnode
+	for (i=0 ; i<sv_buckets.numheadnode ; i++)
+	{
+		e = sv_buckets.headnode[i];
+		(*tested)++;
+		if (CM_HeadnodeVisible (EDICT_NUM(e)->headnode, bitvector))
+			mark[e>>3] |= 1<<(e&7);
+	}
+
+	// the client's own entity always goes in
+	if (SV_EntityHasVisuals (clent))
+	{
+		e = NUM_FOR_EDICT(clent);
+		mark[e>>3] |= 1<<(e&7);
+	}
+
+	count = 0;
+	for (i=0 ; i<(ge->num_edicts+7)>>3 ; i++)
+	{
+		bits = mark[i];
+		if (!bits)
+			continue;
+		for (e=i<<3 ; bits ; e++, bits>>=1)
 		{
-			// check area
-			if (!CM_AreasConnected (clientarea, ent->areanum))
-			{	// doors can legally straddle two areas, so
-				// we may need to check another one
-				if (!ent->areanum2
-					|| !CM_AreasConnected (clientarea, ent->areanum2))
-					continue;		// blocked by a door
-			}
+			if (!(bits & 1))
+				continue;
+			ent = EDICT_NUM(e);
 
-			// FIXME: if an ent has a model and a sound, but isn't
-			// in the PVS, only the PHS, clear the model
-			if (ent->s.sound)
+			if (ent != clent)
 			{
-				bitvector = fatpvs;	//clientphs;
-			}
-			else
-				bitvector = fatpvs;
-
-			if (ent->num_clusters == -1)
-			{	// too many leafs for individual check, go by headnode
-				if (!CM_HeadnodeVisible (ent->headnode, bitvector))
-					continue;
-				c_fullsend++;
-			}
-			else
-			{	// check individual leafs
-				for (i=0 ; i < ent->num_clusters ; i++)
-				{
-					l = ent->clusternums[i];
-					if (bitvector[l >> 3] & (1 << (l&7) ))
-						break;
+				(*tested)++;
+
+				// check area
+				if (!CM_AreasConnected (clientarea, ent->areanum))
+				{	// doors can legally straddle two areas, so
+					// we may need to check another one
+					if (!ent->areanum2
+						|| !CM_AreasConnected (clientarea, ent->areanum2))
+						continue;		// blocked by a door
 				}
-				if (i == ent->num_clusters)
-					continue;		// not visible
-			}
-
-			if (!ent->s.modelindex)
-			{	// don't send sounds if they will be attenuated away
-				vec3_t	delta;
-				float	len;
 
-				VectorSubtract (org, ent->s.origin, delta);
-				len = VectorLength (delta);
-				if (len > 400)
-					continue;
+				// FIXME: if an ent has a model and a sound, but isn't
+				// in the PVS, only the PHS, clear the model
+				if (!ent->s.modelindex)
+				{	// don't send sounds if they will be attenuated away
+					vec3_t	delta;
+					float	len;
+
+					VectorSubtract (org, ent->s.origin, delta);
+					len = VectorLength (delta);
+					if (len > 400)
+						continue;
+				}
 			}
+
+			list[count++] = e;
 		}
-		
+	}
+
+	return count;
+}
+
+/*
+=============
+SV_VisibilityStats
+
+Prints the sv_speeds counters for the frame just sent.
+=============
+*/
+void SV_VisibilityStats (void)
+{
+	if (!sv_vis_clients)
+		return;
+
+	Com_Printf ("vis: %i clients, %i edicts, tested %i (%.1f/client), accepted %i (%.1f/client)\n",
+		sv_vis_clients, ge->num_edicts,
+		sv_vis_tested, (float)sv_vis_tested / sv_vis_clients,
+		sv_vis_accepted, (float)sv_vis_accepted / sv_vis_clients);
+	Com_Printf ("fatpvs cache: %i hits, %i misses\n", sv_fatcache.hits, sv_fatcache.misses);
+}
+
+
+/*
+=============
+SV_EmitFrameEntity
+
+Stores the state of a visible entity into a slot of svs.client_entities.
+=============
+*/
+static void SV_EmitFrameEntity (client_t *client, edict_t *clent, edict_t *ent, entity_state_t *state)
+{
+	*state = ent->s;
+	if (ent == clent && client->edict != clent)
+		state->number = client->edict->s.number;
+
+	// don't mark players missiles as solid
+	if (ent->owner == client->edict)
+		state->solid = 0;
+}
+
+
+/*
+=============
+SV_BuildClientFrame
+
+Decides which entities are going to be visible to the client, and
+copies off the playerstat and areabits.
+=============
+*/
+void SV_BuildClientFrame (client_t *client)
+{
+	int		e, i;
+	vec3_t	org;
+	edict_t	*ent;
+	edict_t	*clent;
+	client_frame_t	*frame;
+	entity_state_t	*state;
+	int		clientarea;
+	short	visible[MAX_EDICTS];
+	int		numvisible;
+
+	clent = SV_FrameViewer (client);
+	if (!clent)
+		return;		// not in game yet
+
+	frame = SV_BeginClientFrame (client, clent, org, &clientarea);
+
+	SV_FatPVS (org, fatpvs);
+
+	// build up the list of visible entities
+	frame->num_entities = 0;
+	frame->first_entity = svs.next_client_entities;
+
+	numvisible = SV_FindVisibleEntities (clent, clientarea, org, fatpvs, visible, &sv_vis_tested);
+	sv_vis_clients++;
+	sv_vis_accepted += numvisible;
+
+	for (i=0 ; i<numvisible ; i++)
+	{
+		e = visible[i];
+		ent = EDICT_NUM(e);
+
 		if (ent->s.number != e)
 		{ // note: server has limited info about entities
 			Com_DPrintf("Fixing ent->s.number: %i to %i for a %s\n",
 					ent->s.number, e, (ent->client ? "client" : "non-client") );
 			ent->s.number = e;
 		}
-		
-		if (ent == orig_clent && orig_clent != clent)
+
+		if (ent == client->edict && client->edict != clent)
 		{
 			Com_Printf ("CAN'T HAPPEN?\n");
 			continue;
 		}
-		
+
 		// add it to the circular client_entities array
 		state = &svs.client_entities[svs.next_client_entities%svs.num_client_entities];
-		*state = ent->s;
-		if (ent == clent && orig_clent != clent)
-			state->number = orig_clent->s.number;
-
-		// don't mark players missiles as solid
-		if (ent->owner == client->edict)
-			state->solid = 0;
+		SV_EmitFrameEntity (client, clent, ent, state);
 
 		svs.next_client_entities++;
 		frame->num_entities++;
@@ -609,6 +680,121 @@ void SV_BuildClientFrame (client_t *client)
 }
 
 
+/*
+=============================================================================
+
+Parallel frame building
+
+With sv_parallelframes set, the frames for all clients are built and
+delta-encoded on the job threads. Each client's entities still go into
+svs.client_entities in client order, so the bytes that come out are the
+same as from SV_BuildClientFrame and SV_WriteFrameToClient.
+
+=============================================================================
+*/
+
+static byte		sv_workerpvs[MAX_JOB_WORKERS+1][65536/8];
+
+// pass 1: decide what each client can see
+static void SV_FindFrameEntities (void *data, int index, int worker)
+{
+	sv_framejob_t	*job = (sv_framejob_t *)data + index;
+	int		i, count;
+	vec3_t	org;
+	int		clientarea;
+
+	job->num_entities = 0;
+	job->tested = 0;
+	job->clent = SV_FrameViewer (job->client);
+	if (!job->clent)
+		return;
+
+	SV_BeginClientFrame (job->client, job->clent, org, &clientarea);
+	SV_FatPVS (org, sv_workerpvs[worker]);
+
+	count = SV_FindVisibleEntities (job->clent, clientarea, org, sv_workerpvs[worker], job->entities, &job->tested);
+	job->accepted = count;
+
+	// the serial path complains about this; here we just leave it out
+	for (i=0 ; i<count ; i++)
+	{
+		if (EDICT_NUM(job->entities[i]) == job->client->edict && job->client->edict != job->clent)
+			continue;
+		job->entities[job->num_entities++] = job->entities[i];
+	}
+}
+
+// pass 2: fill in this client's slice of svs.client_entities and encode it
+static void SV_EncodeFrame (void *data, int index, int worker)
+{
+	sv_framejob_t	*job = (sv_framejob_t *)data + index;
+	client_frame_t	*frame;
+	entity_state_t	*state;
+	int		i;
+
+	if (job->clent)
+	{
+		frame = &job->client->frames[sv.framenum & UPDATE_MASK];
+		for (i=0 ; i<job->num_entities ; i++)
+		{
+			state = &svs.client_entities[(frame->first_entity+i)%svs.num_client_entities];
+			SV_EmitFrameEntity (job->client, job->clent, EDICT_NUM(job->entities[i]), state);
+		}
+	}
+
+	SV_WriteFrameToClient (job->client, &job->msg);
+}
+
+/*
+=============
+SV_BuildFramesParallel
+
+Builds and encodes the frames for count clients. The caller sets up
+jobs[i].client and jobs[i].msg; on return each msg holds what
+SV_WriteFrameToClient would have written.
+=============
+*/
+void SV_BuildFramesParallel (sv_framejob_t *jobs, int count, int numworkers)
+{
+	int		e, i;
+	edict_t	*ent;
+	client_frame_t	*frame;
+
+	// the serial path repairs bad entity numbers as it goes; do it up
+	// front so the job threads never write to an edict
+	for (e=1 ; e<ge->num_edicts ; e++)
+	{
+		ent = EDICT_NUM(e);
+		if (ent->s.number == e || !SV_EntityHasVisuals (ent))
+			continue;
+		Com_DPrintf("Fixing ent->s.number: %i to %i for a %s\n",
+				ent->s.number, e, (ent->client ? "client" : "non-client") );
+		ent->s.number = e;
+	}
+
+	if (!sv_fatcache.lock)
+		sv_fatcache.lock = Sys_CreateMutex ();
+
+	Com_ParallelFor (numworkers, count, SV_FindFrameEntities, jobs);
+
+	// hand out the slices in the same order the serial path would
+	for (i=0 ; i<count ; i++)
+	{
+		if (!jobs[i].clent)
+			continue;
+		sv_vis_clients++;
+		sv_vis_tested += jobs[i].tested;
+		sv_vis_accepted += jobs[i].accepted;
+		frame = &jobs[i].client->frames[sv.framenum & UPDATE_MASK];
+		frame->num_entities = jobs[i].num_entities;
+		frame->first_entity = svs.next_client_entities;
+		svs.next_client_entities += jobs[i].num_entities;
+	}
+
+	Com_ParallelFor (numworkers, count, SV_EncodeFrame, jobs);
+}
+
+
 /*
 ==================
 SV_RecordDemoMessage
@@ -624,7 +810,6 @@ void SV_RecordDemoMessage (void)
 	entity_state_t	nostate;
 	sizebuf_t	buf;
 	byte		buf_data[32768];
-	int			len;
 
 	if (!svs.demofile)
 		return;
@@ -660,9 +845,439 @@ void SV_RecordDemoMessage (void)
 	SZ_Write (&buf, svs.demo_multicast.data, svs.demo_multicast.cursize);
 	SZ_Clear (&svs.demo_multicast);
 
-	// now write the entire message to the file, prefixed by the length
-	len = LittleLong (buf.cursize);
-	szr = fwrite (&len, 4, 1, svs.demofile);
-	szr = fwrite (buf.data, buf.cursize, 1, svs.demofile);
+	// the writer thread prefixes the length
+	SV_DemoWrite (&buf, sv.time);
+}
+
+/*
+=============================================================================
+
+DEMO WRITER
+
+serverrecord hands each message to a writer thread through a ring of
+slots, so the tick never waits on the disk unless the ring is full. The
+writer gathers messages into blocks, and with sv_democompress set it
+deflates each block on builds that have zlib. A compressed demo starts
+with DEMO_ZMAGIC and is a run of [rawlen][complen][data] blocks, which
+inflate to exactly what an uncompressed demo holds.
+
+The stream ends with -1, which is where older readers stop. Then comes
+the configstring log, one [time][index][string] record for every
+configstring in the signon and every change after it, strings padded to
+4 bytes and signon records with time -1. Then an index of [time][offset]
+pairs, one a second, and last the log size in bytes, the pair count and
+DEMO_IMAGIC. Every server demo frame carries the whole world, and
+demoseek rebuilds the configstrings from the log, so playback can start
+at any indexed frame.
+
+=============================================================================
+*/
+
+#if defined HAVE_ZLIB && !defined DEDICATED_ONLY
+#include <zlib.h>
+#define DEMO_COMPRESSION
+#endif
+
+#define	DEMO_SLOTS			32
+#define	DEMO_SLOTSIZE		32768		// SV_RecordDemoMessage's buffer
+#define	DEMO_BLOCKSIZE		(128*1024)
+#define	DEMO_INDEX_MSEC		1000
+
+typedef struct
+{
+	int			size;
+	int			time;			// sv.time, -1 for messages that aren't frames
+	byte		data[DEMO_SLOTSIZE];
+} demoslot_t;
+
+static struct
+{
+	void		*thread;
+	void		*mutex;
+	void		*cond;			// signalled whenever head, tail or stop change
+	demoslot_t	*slots;
+	int			head, tail;		// slots produced and consumed
+	qboolean	stop;
+	int			level;			// deflate level, 0 to write raw
+
+	// writer thread only, or the main thread when there is none; read
+	// back after the thread has been joined
+	byte		*block;
+	int			blocksize;
+	int			rawpos;			// bytes in the uncompressed stream so far
+	int			filesize;
+	int			*index;			// [time, offset] pairs
+	int			numindex, maxindex;
+	int			lastindex;
+	qboolean	failed;
+
+	// main thread only, and the writer once stop is set
+	byte		*cslog;			// configstring records, see above
+	int			cslogsize, cslogmax;
+	qboolean	cslost;			// out of memory, so no index is written
+
+	// main thread only
+	int			frames;
+	int			stalls;			// times the ring was full
+	int			maxqueued;
+} demowriter;
+
+/*
+=============
+SV_DemoFlushBlock
+=============
+*/
+static void SV_DemoFlushBlock (void)
+{
+#ifdef DEMO_COMPRESSION
+	int			len;
+	static byte	packed[DEMO_BLOCKSIZE + DEMO_BLOCKSIZE/1000 + 64];
+	uLongf		packedsize;
+#endif
+
+	if (!demowriter.blocksize)
+		return;
+
+#ifdef DEMO_COMPRESSION
+	if (demowriter.level)
+	{
+		packedsize = sizeof(packed);
+		if (compress2 (packed, &packedsize, demowriter.block, demowriter.blocksize,
+			demowriter.level) != Z_OK)
+		{
+			demowriter.failed = true;
+			demowriter.blocksize = 0;
+			return;
+		}
+		len = LittleLong (demowriter.blocksize);
+		if (fwrite (&len, 4, 1, svs.demofile) != 1)
+			demowriter.failed = true;
+		len = LittleLong ((int)packedsize);
+		if (fwrite (&len, 4, 1, svs.demofile) != 1
+			|| fwrite (packed, packedsize, 1, svs.demofile) != 1)
+			demowriter.failed = true;
+		demowriter.filesize += 8 + (int)packedsize;
+		demowriter.blocksize = 0;
+		return;
+	}
+#endif
+
+	if (fwrite (demowriter.block, demowriter.blocksize, 1, svs.demofile) != 1)
+		demowriter.failed = true;
+	demowriter.filesize += demowriter.blocksize;
+	demowriter.blocksize = 0;
+}
+
+/*
+=============
+SV_DemoAppend
+
+Adds to the uncompressed stream
+=============
+*/
+static void SV_DemoAppend (const void *data, int size)
+{
+	int		count;
+
+	while (size)
+	{
+		if (demowriter.blocksize == DEMO_BLOCKSIZE)
+			SV_DemoFlushBlock ();
+		count = DEMO_BLOCKSIZE - demowriter.blocksize;
+		if (count > size)
+			count = size;
+		memcpy (demowriter.block + demowriter.blocksize, data, count);
+		demowriter.blocksize += count;
+		demowriter.rawpos += count;
+		data = (const byte *)data + count;
+		size -= count;
+	}
+}
+
+/*
+=============
+SV_DemoWriteMessage
+=============
+*/
+static void SV_DemoWriteMessage (const byte *data, int size, int time)
+{
+	int		len;
+
+	if (time >= 0 && (!demowriter.numindex
+		|| time - demowriter.lastindex >= DEMO_INDEX_MSEC))
+	{
+		if (demowriter.numindex == demowriter.maxindex)
+		{	// the zone isn't thread safe
+			demowriter.maxindex = demowriter.maxindex ? demowriter.maxindex*2 : 1024;
+			demowriter.index = realloc (demowriter.index, demowriter.maxindex*2*sizeof(int));
+		}
+		if (demowriter.index)
+		{
+			demowriter.index[demowriter.numindex*2] = LittleLong (time);
+			demowriter.index[demowriter.numindex*2+1] = LittleLong (demowriter.rawpos);
+			demowriter.numindex++;
+		}
+		else
+			demowriter.numindex = demowriter.maxindex = 0;
+		demowriter.lastindex = time;
+	}
+
+	len = LittleLong (size);
+	SV_DemoAppend (&len, 4);
+	SV_DemoAppend (data, size);
+}
+
+/*
+=============
+SV_DemoWriteTrailer
+
+Ends the stream, writes the index and closes the file
+=============
+*/
+static void SV_DemoWriteTrailer (void)
+{
+	int		len;
+
+	// seeking without the configstrings would show the wrong world
+	if (demowriter.cslost)
+		demowriter.numindex = demowriter.cslogsize = 0;
+
+	// end of stream, then the log and index, padded so they can be read
+	// in place
+	len = -1;
+	SV_DemoAppend (&len, 4);
+	len = 0;
+	SV_DemoAppend (&len, (4 - (demowriter.rawpos & 3)) & 3);
+	SV_DemoAppend (demowriter.cslog, demowriter.cslogsize);
+	SV_DemoAppend (demowriter.index, demowriter.numindex*2*sizeof(int));
+	len = LittleLong (demowriter.cslogsize);
+	SV_DemoAppend (&len, 4);
+	len = LittleLong (demowriter.numindex);
+	SV_DemoAppend (&len, 4);
+	len = LittleLong (DEMO_IMAGIC);
+	SV_DemoAppend (&len, 4);
+	SV_DemoFlushBlock ();
+
+	if (fclose (svs.demofile))
+		demowriter.failed = true;
+}
+
+/*
+=============
+SV_DemoWriterThread
+=============
+*/
+static void SV_DemoWriterThread (void *arg)
+{
+	demoslot_t	*slot;
+
+	Sys_LockMutex (demowriter.mutex);
+	while (1)
+	{
+		while (demowriter.head == demowriter.tail && !demowriter.stop)
+			Sys_WaitCond (demowriter.cond, demowriter.mutex);
+		if (demowriter.head == demowriter.tail)
+			break;		// stopped and drained
+		slot = &demowriter.slots[demowriter.tail % DEMO_SLOTS];
+		Sys_UnlockMutex (demowriter.mutex);
+
+		SV_DemoWriteMessage (slot->data, slot->size, slot->time);
+
+		Sys_LockMutex (demowriter.mutex);
+		demowriter.tail++;
+		Sys_BroadcastCond (demowriter.cond);
+	}
+	Sys_UnlockMutex (demowriter.mutex);
+
+	SV_DemoWriteTrailer ();
+}
+
+/*
+=============
+SV_DemoBeginWriting
+
+Takes over f, which stays in svs.demofile until SV_DemoEndWriting
+=============
+*/
+void SV_DemoBeginWriting (FILE *f)
+{
+	int		magic;
+
+	memset (&demowriter, 0, sizeof(demowriter));
+	svs.demofile = f;
+
+#ifdef DEMO_COMPRESSION
+	demowriter.level = sv_democompress->integer;
+	if (demowriter.level < 0)
+		demowriter.level = 0;
+	if (demowriter.level > 9)
+		demowriter.level = 9;
+#else
+	if (sv_democompress->integer)
+		Com_Printf ("This build has no zlib, recording uncompressed.\n");
+#endif
+	if (demowriter.level)
+	{
+		magic = LittleLong (DEMO_ZMAGIC);
+		szr = fwrite (&magic, 4, 1, f);
+		demowriter.filesize = 4;
+	}
+
+	demowriter.block = Z_Malloc (DEMO_BLOCKSIZE);
+	demowriter.slots = Z_Malloc (DEMO_SLOTS*sizeof(demoslot_t));
+	demowriter.mutex = Sys_CreateMutex ();
+	demowriter.cond = Sys_CreateCond ();
+	if (demowriter.mutex && demowriter.cond)
+		demowriter.thread = Sys_CreateThread (SV_DemoWriterThread, NULL);
+
+	if (!demowriter.thread)
+	{	// SV_DemoWrite writes each message itself, as it used to
+		Com_Printf ("Couldn't start the demo writer thread, writing in the server frame.\n");
+		Z_Free (demowriter.slots);
+		demowriter.slots = NULL;
+		if (demowriter.cond)
+			Sys_DestroyCond (demowriter.cond);
+		if (demowriter.mutex)
+			Sys_DestroyMutex (demowriter.mutex);
+		demowriter.cond = demowriter.mutex = NULL;
+	}
+}
+
+/*
+=============
+SV_DemoWrite
+
+Queues a message for the writer. time is sv.time for frames, which go
+into the index, and -1 for everything else.
+=============
+*/
+void SV_DemoWrite (sizebuf_t *msg, int time)
+{
+	demoslot_t	*slot;
+	int			queued;
+
+	if (!svs.demofile)
+		return;
+	if (msg->cursize > DEMO_SLOTSIZE)
+	{
+		Com_Printf ("SV_DemoWrite: %i byte message dropped\n", msg->cursize);
+		return;
+	}
+
+	if (!demowriter.thread)
+	{
+		SV_DemoWriteMessage (msg->data, msg->cursize, time);
+		if (time >= 0)
+			demowriter.frames++;
+		return;
+	}
+
+	Sys_LockMutex (demowriter.mutex);
+	if (demowriter.head - demowriter.tail >= DEMO_SLOTS)
+	{
+		demowriter.stalls++;
+		while (demowriter.head - demowriter.tail >= DEMO_SLOTS)
+			Sys_WaitCond (demowriter.cond, demowriter.mutex);
+	}
+	Sys_UnlockMutex (demowriter.mutex);
+
+	// the writer won't touch this slot until head moves past it
+	slot = &demowriter.slots[demowriter.head % DEMO_SLOTS];
+	memcpy (slot->data, msg->data, msg->cursize);
+	slot->size = msg->cursize;
+	slot->time = time;
+
+	Sys_LockMutex (demowriter.mutex);
+	demowriter.head++;
+	queued = demowriter.head - demowriter.tail;
+	Sys_BroadcastCond (demowriter.cond);
+	Sys_UnlockMutex (demowriter.mutex);
+
+	if (queued > demowriter.maxqueued)
+		demowriter.maxqueued = queued;
+	if (time >= 0)
+		demowriter.frames++;
+}
+
+/*
+=============
+SV_DemoConfigstring
+
+Logs a configstring for demoseek. time is sv.time for changes during
+the game, and -1 for the configstrings in the signon message.
+=============
+*/
+void SV_DemoConfigstring (int index, const char *val, int time)
+{
+	int		len, size;
+	byte	*rec;
+
+	if (!svs.demofile || demowriter.cslost)
+		return;
+
+	len = strlen (val) + 1;
+	size = 8 + ((len + 3) & ~3);
+	if (demowriter.cslogsize + size > demowriter.cslogmax)
+	{	// the writer thread reads this once stop is set, so no zone
+		demowriter.cslogmax = demowriter.cslogmax*2 + size + 16384;
+		rec = realloc (demowriter.cslog, demowriter.cslogmax);
+		if (!rec)
+		{
+			free (demowriter.cslog);
+			demowriter.cslog = NULL;
+			demowriter.cslogsize = demowriter.cslogmax = 0;
+			demowriter.cslost = true;
+			return;
+		}
+		demowriter.cslog = rec;
+	}
+
+	rec = demowriter.cslog + demowriter.cslogsize;
+	memset (rec, 0, size);
+	((int *)rec)[0] = LittleLong (time);
+	((int *)rec)[1] = LittleLong (index);
+	memcpy (rec + 8, val, len);
+	demowriter.cslogsize += size;
+}
+
+/*
+=============
+SV_DemoEndWriting
+
+Waits for the writer to drain the ring and close the file
+=============
+*/
+void SV_DemoEndWriting (void)
+{
+	if (!svs.demofile)
+		return;
+
+	if (demowriter.thread)
+	{
+		Sys_LockMutex (demowriter.mutex);
+		demowriter.stop = true;
+		Sys_BroadcastCond (demowriter.cond);
+		Sys_UnlockMutex (demowriter.mutex);
+		Sys_JoinThread (demowriter.thread);
+
+		Sys_DestroyCond (demowriter.cond);
+		Sys_DestroyMutex (demowriter.mutex);
+		Z_Free (demowriter.slots);
+	}
+	else
+		SV_DemoWriteTrailer ();
+	Z_Free (demowriter.block);
+	free (demowriter.index);
+	free (demowriter.cslog);
+	svs.demofile = NULL;
+
+	if (demowriter.failed)
+		Com_Printf ("ERROR: writing the demo failed, it may be incomplete.\n");
+	Com_Printf ("%i frames, %i KB recorded, %i KB written (%.0f%%)\n", demowriter.frames,
+		demowriter.rawpos/1024, demowriter.filesize/1024,
+		demowriter.rawpos ? 100.0*demowriter.filesize/demowriter.rawpos : 0);
+	if (demowriter.thread)
+		Com_Printf ("writer: %i of %i slots used at most, %i stalls\n",
+			demowriter.maxqueued, DEMO_SLOTS, demowriter.stalls);
 }
 
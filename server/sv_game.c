@@ -214,6 +214,7 @@ void PF_Configstring (int index, char *val)
 		MSG_WriteString (&sv.multicast, val);
 
 		SV_Multicast (vec3_origin, MULTICAST_ALL_R);
+		SV_DemoConfigstring (index, val, sv.time);
 	}
 }
 
@@ -287,7 +288,10 @@ void SV_InitGameProgs (void)
 	import.linkentity = SV_LinkEdict;
 	import.unlinkentity = SV_UnlinkEdict;
 	import.BoxEdicts = SV_AreaEdicts;
+	import.RadiusEdicts = SV_RadiusEdicts;
 	import.trace = SV_Trace;
+	import.tracebatch = SV_TraceBatch;
+	import.tracecaller = SV_TraceCaller;
 	import.pointcontents = SV_PointContents;
 	import.setmodel = PF_setmodel;
 	import.inPVS = CM_inPVS;
@@ -335,6 +339,7 @@ void SV_InitGameProgs (void)
 	import.AreasConnected = CM_AreasConnected;
 
 	import.Sys_Milliseconds = Sys_Milliseconds;
+	import.Sys_Microseconds = Sys_Microseconds;
 
 	import.FullPath = FS_FullPath;
 	import.FullWritePath = FS_FullWritePath;
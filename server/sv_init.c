@@ -69,6 +69,7 @@ int SV_FindIndex (char *name, int start, int max, qboolean create)
 		MSG_WriteShort (&sv.multicast, start+i);
 		MSG_WriteString (&sv.multicast, name);
 		SV_Multicast (vec3_origin, MULTICAST_ALL_R);
+		SV_DemoConfigstring (start+i, name, sv.time);
 	}
 
 	return i;
@@ -173,6 +174,9 @@ void SV_SpawnServer (char *server, char *spawnpoint, server_state_t serverstate,
 		fclose (sv.demofile);
 	}
 
+	SV_WriteTraceProfile ();
+	SV_TraceCaller (TRACE_OTHER);
+
 	svs.spawncount++;		// any partially connected client will be
 							// restarted
 	sv.state = ss_dead;
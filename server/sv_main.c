@@ -32,6 +32,14 @@ cvar_t	*sv_paused;
 cvar_t	*sv_timedemo;
 
 cvar_t	*sv_enforcetime;
+cvar_t	*sv_parallelframes;
+cvar_t	*sv_paralleltraces;
+cvar_t	*sv_traceprofile;
+cvar_t	*sv_packedprotocol;
+cvar_t	*sv_dlwindow;
+cvar_t	*sv_dlrate;
+cvar_t	*sv_democompress;
+cvar_t	*sv_speeds;
 
 cvar_t	*timeout;				// seconds without any message
 cvar_t	*zombietime;			// seconds to sink messages after disconnect
@@ -68,6 +76,8 @@ cvar_t	*sv_downloadurl;
 cvar_t	*sv_iplogfile;			// Log file by IP address
 
 cvar_t  *sv_tickrate;			//server frame rate
+cvar_t	*sv_precisetick;		// dedicated servers schedule frames in usec
+cvar_t	*sv_tickspin;			// usec busy waited before each frame
 
 int		sv_numbots;
 
@@ -128,11 +138,7 @@ void SV_DropClient (client_t *drop)
 		ge->ClientDisconnect (drop->edict);
 	}
 
-	if (drop->download)
-	{
-		FS_FreeFile (drop->download);
-		drop->download = NULL;
-	}
+	SV_CloseDownload (drop);
 
 	SV_LogEvent( drop->netchan.remote_address , "DCN" , drop->name );
 	drop->state = cs_zombie;		// become free in a few seconds
@@ -472,6 +478,7 @@ void SVC_DirectConnect (void)
 	int			challenge;
 	int			previousclients;
 	int			botnum, botkick;
+	int			protocol;
 
 	adr = net_from;
 
@@ -490,6 +497,11 @@ void SVC_DirectConnect (void)
 
 	challenge = atoi(Cmd_Argv(3));
 
+	// newer clients can ask for the packed revision after the userinfo
+	protocol = PROTOCOL_VERSION;
+	if (Cmd_Argc() > 5 && atoi(Cmd_Argv(5)) == PROTOCOL_PACKED && sv_packedprotocol->integer)
+		protocol = PROTOCOL_PACKED;
+
 	//security, overflow fixes
 
 	//limit connections from a single IP
@@ -684,6 +696,7 @@ gotnewcl:
 	ent = EDICT_NUM(edictnum);
 	newcl->edict = ent;
 	newcl->challenge = challenge; // save challenge for checksumming
+	newcl->protocol = protocol;
 
 	// get the game a chance to reject this connection or modify the userinfo
 
@@ -706,9 +719,13 @@ gotnewcl:
 	SV_LogEvent( adr , "UUS" , newcl->name );
 
 	// send the connect packet to the client
-	Netchan_OutOfBandPrint(NS_SERVER, adr, "client_connect %s", sv_downloadurl->string);
+	if (protocol == PROTOCOL_PACKED)
+		Netchan_OutOfBandPrint(NS_SERVER, adr, "client_connect \"%s\" %i", sv_downloadurl->string, protocol);
+	else
+		Netchan_OutOfBandPrint(NS_SERVER, adr, "client_connect %s", sv_downloadurl->string);
 
 	Netchan_Setup (NS_SERVER, &newcl->netchan , adr, qport);
+	newcl->netchan.packed = (protocol == PROTOCOL_PACKED);
 
 	newcl->state = cs_connected;
 
@@ -940,9 +957,75 @@ SV_ReadPackets
 =================
 */
 extern int sys_msec_as_of_packet_read;
+/*
+=================
+SV_ClientForPacket
+
+Finds the client a sequenced packet from adr with this qport belongs to.
+A small open addressed hash on (address, qport) remembers which slot
+each client was last found in. Entries are checked against the client
+before they are trusted, so a stale or overwritten entry only costs the
+scan over the slots that used to be done for every packet.
+=================
+*/
+#define	CLIENT_HASH_SIZE	1024		// power of two, well above MAX_CLIENTS
+#define	CLIENT_HASH_PROBES	4
+
+static short	sv_clienthash[CLIENT_HASH_SIZE];	// client number + 1, 0 if empty
+
+static qboolean SV_ClientMatches (int slot, netadr_t adr, int qport)
+{
+	client_t	*cl;
+
+	if (slot < 0 || slot >= maxclients->integer)
+		return false;
+	cl = &svs.clients[slot];
+	return cl->state != cs_free && cl->netchan.qport == qport
+		&& NET_CompareBaseAdr (adr, cl->netchan.remote_address);
+}
+
+static client_t *SV_ClientForPacket (netadr_t adr, int qport)
+{
+	unsigned	hash;
+	int			i, p, slot;
+
+	hash = adr.type;
+	if (adr.type == NA_IP)
+		hash ^= adr.ip[0] | (adr.ip[1]<<8) | (adr.ip[2]<<16) | ((unsigned)adr.ip[3]<<24);
+	hash = (hash ^ (qport * 0x9e3779b1)) * 0x85ebca6b;
+	hash >>= 32 - 10;		// CLIENT_HASH_SIZE bits
+
+	for (p=0 ; p<CLIENT_HASH_PROBES ; p++)
+	{
+		slot = sv_clienthash[(hash+p) & (CLIENT_HASH_SIZE-1)] - 1;
+		if (SV_ClientMatches (slot, adr, qport))
+			return &svs.clients[slot];
+	}
+
+	for (i=0 ; i<maxclients->integer ; i++)
+	{
+		if (SV_ClientMatches (i, adr, qport))
+			break;
+	}
+	if (i == maxclients->integer)
+		return NULL;
+
+	// remember it in the first empty or freed probe slot, else the first
+	for (p=0 ; p<CLIENT_HASH_PROBES ; p++)
+	{
+		slot = sv_clienthash[(hash+p) & (CLIENT_HASH_SIZE-1)] - 1;
+		if (slot < 0 || slot >= maxclients->integer || svs.clients[slot].state == cs_free)
+			break;
+	}
+	if (p == CLIENT_HASH_PROBES)
+		p = 0;
+	sv_clienthash[(hash+p) & (CLIENT_HASH_SIZE-1)] = i + 1;
+
+	return &svs.clients[i];
+}
+
 void SV_ReadPackets (void)
 {
-	int			i;
 	client_t	*cl;
 	int			qport;
 	sys_msec_as_of_packet_read = Sys_Milliseconds ();
@@ -964,34 +1047,24 @@ void SV_ReadPackets (void)
 		qport = MSG_ReadShort (&net_message) & 0xffff;
 
 		// check for packets from connected clients
-		for (i=0, cl=svs.clients ; i<maxclients->integer ; i++,cl++)
+		cl = SV_ClientForPacket (net_from, qport);
+		if (!cl)
+			continue;
+
+		if (cl->netchan.remote_address.port != net_from.port)
 		{
-			if (cl->state == cs_free)
-				continue;
-
-			if (!NET_CompareBaseAdr (net_from, cl->netchan.remote_address))
-				continue;
-			if (cl->netchan.qport != qport)
-				continue;
-			if (cl->netchan.remote_address.port != net_from.port)
-			{
-				Com_Printf ("SV_ReadPackets: fixing up a translated port\n");
-				cl->netchan.remote_address.port = net_from.port;
-			}
+			Com_Printf ("SV_ReadPackets: fixing up a translated port\n");
+			cl->netchan.remote_address.port = net_from.port;
+		}
 
-			if (Netchan_Process(&cl->netchan, &net_message))
-			{	// this is a valid, sequenced packet, so process it
-				if (cl->state != cs_zombie)
-				{
-					cl->lastmessage = svs.realtime;	// don't timeout
-					SV_ExecuteClientMessage (cl);
-				}
+		if (Netchan_Process(&cl->netchan, &net_message))
+		{	// this is a valid, sequenced packet, so process it
+			if (cl->state != cs_zombie)
+			{
+				cl->lastmessage = svs.realtime;	// don't timeout
+				SV_ExecuteClientMessage (cl);
 			}
-			break;
 		}
-
-		if (i != maxclients->integer)
-			continue;
 	}
 }
 
@@ -1065,6 +1138,247 @@ void SV_PrepWorldFrame (void)
 }
 
 
+/*
+==============================================================================
+
+TICK SCHEDULING
+
+A dedicated server with sv_precisetick keeps the server clock in microseconds
+and sleeps on the server socket until the exact time of the next frame,
+instead of rounding every wait to a millisecond. Packets that arrive while
+waiting are read straight away. The last sv_tickspin microseconds are polled
+rather than slept, so timer slack doesn't make the frame late.
+
+==============================================================================
+*/
+
+#define	NUM_TICK_BUCKETS	11
+
+static const int tick_bucketlimits[NUM_TICK_BUCKETS-1] =
+{
+	50, 100, 250, 500, 1000, 2000, 4000, 8000, 16000, 32000
+};
+
+typedef struct
+{
+	unsigned			ticks;
+	unsigned			lowclamps, highclamps;
+	unsigned			duration[NUM_TICK_BUCKETS];	// usec spent running a frame
+	unsigned			jitter[NUM_TICK_BUCKETS];	// usec a frame interval was off by
+	unsigned long long	totalduration, totaljitter;
+	unsigned long long	maxduration, maxjitter;
+	unsigned long long	laststart;					// 0 after a reset or map change
+} tickstats_t;
+
+static tickstats_t	tickstats;
+
+static unsigned long long	sv_clock;			// svs.realtime in usec
+static unsigned long long	sv_clocklast;		// Sys_Microseconds at the last update
+static int					sv_clockrealtime;	// svs.realtime when sv_clock was set
+
+static int SV_TickBucket (unsigned long long usec)
+{
+	int		i;
+
+	for (i = 0; i < NUM_TICK_BUCKETS-1; i++)
+		if (usec < tick_bucketlimits[i])
+			break;
+	return i;
+}
+
+/*
+=================
+SV_RecordTick
+
+Duration is the time spent in the frame, jitter is how far the interval
+since the previous frame was from the tick length.
+=================
+*/
+static void SV_RecordTick (unsigned long long start, unsigned long long end)
+{
+	unsigned long long	duration, jitter, interval, ticklen;
+
+	ticklen = 1000000 / sv_tickrate->integer;
+	duration = end - start;
+
+	tickstats.ticks++;
+	tickstats.duration[SV_TickBucket (duration)]++;
+	tickstats.totalduration += duration;
+	if (duration > tickstats.maxduration)
+		tickstats.maxduration = duration;
+
+	if (tickstats.laststart)
+	{
+		interval = start - tickstats.laststart;
+		jitter = interval > ticklen ? interval - ticklen : ticklen - interval;
+		tickstats.jitter[SV_TickBucket (jitter)]++;
+		tickstats.totaljitter += jitter;
+		if (jitter > tickstats.maxjitter)
+			tickstats.maxjitter = jitter;
+	}
+	tickstats.laststart = start;
+}
+
+/*
+=================
+SV_TickStats_f
+
+tickstats [reset]
+=================
+*/
+void SV_TickStats_f (void)
+{
+	unsigned	jittered;
+	int			i;
+
+	if (Cmd_Argc () > 1 && !Q_strcasecmp (Cmd_Argv (1), "reset"))
+	{
+		memset (&tickstats, 0, sizeof(tickstats));
+		Com_Printf ("Tick stats reset.\n");
+		return;
+	}
+
+	if (!tickstats.ticks)
+	{
+		Com_Printf ("No server frames have run yet.\n");
+		return;
+	}
+
+	jittered = 0;
+	for (i = 0; i < NUM_TICK_BUCKETS; i++)
+		jittered += tickstats.jitter[i];
+
+	Com_Printf ("%u ticks at %i Hz (%i usec), %s scheduler\n", tickstats.ticks,
+		sv_tickrate->integer, 1000000 / sv_tickrate->integer,
+		sv_clocklast ? "usec" : "msec");
+	Com_Printf ("duration: avg %5u max %6u usec\n",
+		(unsigned)(tickstats.totalduration / tickstats.ticks),
+		(unsigned)tickstats.maxduration);
+	if (jittered)
+		Com_Printf ("jitter:   avg %5u max %6u usec\n",
+			(unsigned)(tickstats.totaljitter / jittered),
+			(unsigned)tickstats.maxjitter);
+	Com_Printf ("lowclamps %u highclamps %u\n", tickstats.lowclamps,
+		tickstats.highclamps);
+
+	Com_Printf ("   usec     duration       jitter\n");
+	for (i = 0; i < NUM_TICK_BUCKETS; i++)
+	{
+		if (i < NUM_TICK_BUCKETS-1)
+			Com_Printf ("< %5i", tick_bucketlimits[i]);
+		else
+			Com_Printf (">=%5i", tick_bucketlimits[i-1]);
+		Com_Printf ("  %8u %3i%%  %8u %3i%%\n",
+			tickstats.duration[i],
+			(int)(100.0 * tickstats.duration[i] / tickstats.ticks),
+			tickstats.jitter[i],
+			jittered ? (int)(100.0 * tickstats.jitter[i] / jittered) : 0);
+	}
+}
+
+/*
+=================
+SV_PreciseTick
+=================
+*/
+static qboolean SV_PreciseTick (void)
+{
+	if (dedicated && dedicated->integer && sv_precisetick->integer
+		&& !sv_timedemo->integer)
+		return true;
+
+	sv_clocklast = 0;
+	return false;
+}
+
+/*
+=================
+SV_AdvanceClock
+
+Moves sv_clock on by the real time passed and derives svs.realtime from it.
+If svs.realtime was changed from outside (a new map, a clamp) the clock
+restarts from it.
+=================
+*/
+static void SV_AdvanceClock (void)
+{
+	unsigned long long	now;
+
+	now = Sys_Microseconds ();
+	if (!sv_clocklast || svs.realtime != sv_clockrealtime)
+		sv_clock = (unsigned long long)svs.realtime * 1000;
+	else
+		sv_clock += now - sv_clocklast;
+	sv_clocklast = now;
+
+	svs.realtime = sv_clockrealtime = (int)(sv_clock / 1000);
+}
+
+static void SV_SetClock (unsigned long long usec)
+{
+	sv_clock = usec;
+	svs.realtime = sv_clockrealtime = (int)(sv_clock / 1000);
+}
+
+/*
+=================
+SV_TickDeadline
+
+The usec equivalent of sv.time: the next frame is due when sv_clock gets
+here. sv.time itself is truncated to whole milliseconds.
+=================
+*/
+static unsigned long long SV_TickDeadline (void)
+{
+	if (!sv.framenum)
+		return (unsigned long long)sv.time * 1000;
+	return (unsigned long long)sv.framenum * 1000000 / sv_tickrate->integer;
+}
+
+/*
+=================
+SV_WaitForTick
+
+Returns true when the next frame is due, false if the console has input
+that the main loop needs to run first.
+=================
+*/
+static qboolean SV_WaitForTick (void)
+{
+	unsigned long long	deadline, ticklen;
+	int					spin, remaining, wake;
+
+	deadline = SV_TickDeadline ();
+	ticklen = 1000000 / sv_tickrate->integer;
+
+	// never let the time get too far off
+	if (sv_clock + ticklen < deadline)
+	{
+		if (sv_showclamp->integer)
+			Com_Printf ("sv lowclamp\n");
+		tickstats.lowclamps++;
+		SV_SetClock (deadline - ticklen);
+	}
+
+	spin = sv_tickspin->integer;
+	if (spin < 0)
+		spin = 0;
+
+	for (;;)
+	{
+		SV_AdvanceClock ();
+		if (sv_clock >= deadline)
+			return true;
+
+		remaining = (int)(deadline - sv_clock);
+		wake = NET_SleepMicroseconds (remaining > spin ? remaining - spin : 0);
+		if (wake & NET_WAKE_PACKET)
+			SV_ReadPackets ();
+		if (wake & NET_WAKE_CONSOLE)
+			return false;
+	}
+}
+
 /*
 =================
 SV_RunGameFrame
@@ -1095,6 +1409,7 @@ void SV_RunGameFrame (void)
 		{
 			if (sv_showclamp->integer)
 				Com_Printf ("sv highclamp\n");
+			tickstats.highclamps++;
 			svs.realtime = sv.time;
 		}
 	}
@@ -1116,6 +1431,8 @@ void SV_Frame (int msec)
 	int tmp_systime, tmp_hangtime;
 	static int old_systime = 0;
 	float FRAMETIME = 1.0/(float)sv_tickrate->integer;
+	unsigned long long tickstart;
+	qboolean precise;
 
 	if (!old_systime)
 		old_systime = Sys_Milliseconds ();
@@ -1125,7 +1442,11 @@ void SV_Frame (int msec)
 	if (!svs.initialized)
 		return;
 
-    svs.realtime += msec;
+	precise = SV_PreciseTick ();
+	if (precise)
+		SV_AdvanceClock ();
+	else
+		svs.realtime += msec;
 
 	// keep the random time dependent
 	rand ();
@@ -1137,19 +1458,29 @@ void SV_Frame (int msec)
 	SV_ReadPackets ();
 
 	// move autonomous things around if enough time has passed
-	if (!sv_timedemo->integer && svs.realtime < sv.time)
+	if (precise)
+	{
+		if (!SV_WaitForTick ())
+			return;
+	}
+	else if (!sv_timedemo->integer && svs.realtime < sv.time)
 	{
 		// never let the time get too far off
 		if (sv.time - svs.realtime > FRAMETIME*1000)
 		{
 			if (sv_showclamp->integer)
 				Com_Printf ("sv lowclamp\n");
+			tickstats.lowclamps++;
 			svs.realtime = sv.time - FRAMETIME*1000;
 		}
 		NET_Sleep(sv.time - svs.realtime);
 		return;
 	}
 
+	tickstart = Sys_Microseconds ();
+	if (sv.framenum == 0)
+		tickstats.laststart = 0;	// a new map, the interval means nothing
+
 	// update ping based on the last known frame from all clients
 	SV_CalcPings ();
 
@@ -1159,6 +1490,10 @@ void SV_Frame (int msec)
 	// let everything in the world think and move
 	SV_RunGameFrame ();
 
+	// never get more than one tic behind
+	if (precise && sv_clock > SV_TickDeadline ())
+		SV_SetClock (SV_TickDeadline ());
+
 	// send messages back to the clients that had packets read this frame
 	SV_SendClientMessages ();
 
@@ -1170,6 +1505,8 @@ void SV_Frame (int msec)
 
 	// clear teleport flags, etc for next frame
 	SV_PrepWorldFrame ();
+
+	SV_RecordTick (tickstart, Sys_Microseconds ());
 	
 	tmp_systime = Sys_Milliseconds ();
 	tmp_hangtime = tmp_systime-old_systime;
@@ -1407,6 +1744,22 @@ void SV_Init (void)
 	sv_paused = Cvar_Get ("paused", "0", 0);
 	sv_timedemo = Cvar_Get ("timedemo", "0", 0);
 	sv_enforcetime = Cvar_Get ("sv_enforcetime", "0", 0);
+	sv_parallelframes = Cvar_Get ("sv_parallelframes", "0", CVARDOC_INT);
+	Cvar_Describe (sv_parallelframes, "Number of extra threads used to build and encode the client frames each server frame. 0 builds them all on the main thread.");
+	sv_paralleltraces = Cvar_Get ("sv_paralleltraces", "0", CVARDOC_INT);
+	Cvar_Describe (sv_paralleltraces, "Number of extra threads used for the world part of batched game traces. 0 traces them all on the main thread.");
+	sv_traceprofile = Cvar_Get ("sv_traceprofile", "0", CVARDOC_BOOL);
+	Cvar_Describe (sv_traceprofile, "Count game traces, their time and the BSP nodes, brushes and terrain triangles they test, per calling subsystem. See the traceprofile command; totals are appended to traceprofile.csv when each map ends.");
+	sv_packedprotocol = Cvar_Get ("sv_packedprotocol", "1", CVARDOC_BOOL);
+	Cvar_Describe (sv_packedprotocol, "Let clients that ask for it use the bit packed, range coded protocol, which needs less bandwidth.");
+	sv_dlwindow = Cvar_Get ("sv_dlwindow", "32", 0);
+	Cvar_Describe (sv_dlwindow, "Chunks of 1024 bytes kept in flight for each client on a windowed download. 0 sends one chunk per round trip, as old clients get.");
+	sv_dlrate = Cvar_Get ("sv_dlrate", "1000000", 0);
+	Cvar_Describe (sv_dlrate, "Bytes per second shared by all windowed downloads.");
+	sv_democompress = Cvar_Get ("sv_democompress", "0", CVAR_ARCHIVE);
+	Cvar_Describe (sv_democompress, "Deflate level (1-9) for serverrecord demos, 0 for none. Compressed demos only play back on builds with zlib.");
+	sv_speeds = Cvar_Get ("sv_speeds", "0", CVARDOC_BOOL);
+	Cvar_Describe (sv_speeds, "Print how many entities were tested and sent for client visibility each server frame.");
 	allow_download = Cvar_Get ("allow_download", "1", CVAR_ARCHIVE);
 	allow_download_players  = Cvar_Get ("allow_download_players", "0", CVAR_ARCHIVE);
 	allow_download_models = Cvar_Get ("allow_download_models", "1", CVAR_ARCHIVE);
@@ -1414,6 +1767,10 @@ void SV_Init (void)
 	allow_download_maps	  = Cvar_Get ("allow_download_maps", "1", CVAR_ARCHIVE);
 	sv_downloadurl = Cvar_Get("sv_downloadurl", DEFAULT_DOWNLOAD_URL_1, CVAR_SERVERINFO);
 	sv_tickrate = Cvar_Get("sv_tickrate", "10", CVAR_SERVERINFO | CVAR_ARCHIVE);
+	sv_precisetick = Cvar_Get ("sv_precisetick", "1", CVARDOC_BOOL);
+	Cvar_Describe (sv_precisetick, "Dedicated servers time their frames in microseconds and sleep until exactly when the next one is due. 0 uses the old millisecond wait.");
+	sv_tickspin = Cvar_Get ("sv_tickspin", "250", CVARDOC_INT);
+	Cvar_Describe (sv_tickspin, "Microseconds before each server frame that a dedicated server polls its socket instead of sleeping, so a late timer wakeup doesn't delay the frame.");
 
 	sv_iplogfile = Cvar_Get("sv_iplogfile" , "" , CVAR_ARCHIVE);
 
@@ -1499,6 +1856,7 @@ void SV_Shutdown (char *finalmsg, qboolean reconnect)
 
 	Master_Shutdown ();
 	SV_ShutdownGameProgs ();
+	SV_WriteTraceProfile ();
 
 	// free current level
 	if (sv.demofile)
@@ -1511,8 +1869,9 @@ void SV_Shutdown (char *finalmsg, qboolean reconnect)
 		Z_Free (svs.clients);
 	if (svs.client_entities)
 		Z_Free (svs.client_entities);
-	if (svs.demofile)
-		fclose (svs.demofile);
+	if (svs.frame_jobs)
+		Z_Free (svs.frame_jobs);
+	SV_DemoEndWriting ();
 	memset (&svs, 0, sizeof(svs));
 }
 
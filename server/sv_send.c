@@ -151,6 +151,35 @@ void SV_BroadcastCommand (char *fmt, ...)
 }
 
 
+/*
+=================
+SV_MulticastLeaf
+
+Clients usually get several multicasts a frame and most of them don't
+move between frames, so remember the leaf lookup until they do.
+=================
+*/
+static void SV_MulticastLeaf (client_t *client, int *cluster, int *area)
+{
+	int		leafnum;
+	float	*org = client->edict->s.origin;
+
+	if (!client->multicast_cached
+		|| client->multicast_spawncount != svs.spawncount
+		|| !VectorCompare (org, client->multicast_origin))
+	{
+		leafnum = CM_PointLeafnum (org);
+		client->multicast_cluster = CM_LeafCluster (leafnum);
+		client->multicast_area = CM_LeafArea (leafnum);
+		client->multicast_spawncount = svs.spawncount;
+		VectorCopy (org, client->multicast_origin);
+		client->multicast_cached = true;
+	}
+
+	*cluster = client->multicast_cluster;
+	*area = client->multicast_area;
+}
+
 /*
 =================
 SV_Multicast
@@ -226,11 +255,9 @@ void SV_Multicast (vec3_t origin, multicast_t to)
 		if (mask)
 		{ // check for "hearable" or "visible"
 			// find cluster player is in
-			leafnum = CM_PointLeafnum (client->edict->s.origin);
-			cluster = CM_LeafCluster (leafnum);
+			SV_MulticastLeaf (client, &cluster, &area2);
 			if ( !(mask[cluster>>3] & (1<<(cluster & 7))) )
 				continue; // by cluster mask, player cannot see/hear this
-			area2 = CM_LeafArea (leafnum);
 			if (!CM_AreasConnected (area1, area2))
 				continue; // by leaf, player cannot see/hear this
 		}
@@ -389,26 +416,16 @@ FRAME UPDATES
 
 
 
-/*
-=======================
-SV_SendClientDatagram
-=======================
-*/
-qboolean SV_SendClientDatagram (client_t *client)
+static void SV_InitDatagram (client_t *client, sizebuf_t *msg, byte *msg_buf)
 {
-	byte		msg_buf[MAX_MSGLEN];
-	sizebuf_t	msg;
-
-	SV_BuildClientFrame (client);
-
-	SZ_Init (&msg, msg_buf, sizeof(msg_buf));
-	SZ_SetName (&msg, va("Client msg out buffer (%s)", NET_AdrToString(client->netchan.remote_address)), false);
-	msg.allowoverflow = true;
-
-	// send over all the relevant entity_state_t
-	// and the player_state_t
-	SV_WriteFrameToClient (client, &msg);
+	SZ_Init (msg, msg_buf, MAX_MSGLEN);
+	SZ_SetName (msg, va("Client msg out buffer (%s)", NET_AdrToString(client->netchan.remote_address)), false);
+	msg->allowoverflow = true;
+}
 
+// msg already holds the frame
+static void SV_TransmitDatagram (client_t *client, sizebuf_t *msg)
+{
 	// copy the accumulated multicast datagram
 	// for this client out to the message
 	// it is necessary for this to be after the WriteEntities
@@ -416,20 +433,44 @@ qboolean SV_SendClientDatagram (client_t *client)
 	if (client->datagram.overflowed)
 		Com_Printf ("WARNING: datagram overflowed for %s\n", client->name);
 	else
-		SZ_Write (&msg, client->datagram.data, client->datagram.cursize);
+		SZ_Write (msg, client->datagram.data, client->datagram.cursize);
 	SZ_Clear (&client->datagram);
 
-	if (msg.overflowed)
+	if (msg->overflowed)
 	{	// must have room left for the packet header
 		Com_Printf ("WARNING: msg overflowed for %s\n", client->name);
-		SZ_Clear (&msg);
+		SZ_Clear (msg);
 	}
 
 	// send the datagram
-	Netchan_Transmit (&client->netchan, msg.cursize, msg.data);
+	Netchan_Transmit (&client->netchan, msg->cursize, msg->data);
+
+	// record the size for rate estimation, coded packets by what went out
+	if (client->netchan.packed)
+		client->message_size[sv.framenum % RATE_MESSAGES] = client->netchan.last_sentsize;
+	else
+		client->message_size[sv.framenum % RATE_MESSAGES] = msg->cursize;
+}
 
-	// record the size for rate estimation
-	client->message_size[sv.framenum % RATE_MESSAGES] = msg.cursize;
+/*
+=======================
+SV_SendClientDatagram
+=======================
+*/
+qboolean SV_SendClientDatagram (client_t *client)
+{
+	byte		msg_buf[MAX_MSGLEN];
+	sizebuf_t	msg;
+
+	SV_BuildClientFrame (client);
+
+	SV_InitDatagram (client, &msg, msg_buf);
+
+	// send over all the relevant entity_state_t
+	// and the player_state_t
+	SV_WriteFrameToClient (client, &msg);
+
+	SV_TransmitDatagram (client, &msg);
 
 	return true;
 }
@@ -447,7 +488,10 @@ void SV_DemoCompleted (void)
 		fclose (sv.demofile);
 		sv.demofile = NULL;
 		FS_FreeFile (sv.demobuf);
+		sv.demobuf = NULL;
 		sv.demosize = sv.demo_ofs = 0;
+		sv.demoindex = NULL;
+		sv.numdemoindex = 0;
 	}
 	SV_Nextserver ();
 }
@@ -498,6 +542,9 @@ void SV_SendClientMessages (void)
 	client_t	*c;
 	int			msglen;
 	byte		msgbuf[MAX_MSGLEN];
+	qboolean	parallel;
+	int			numjobs;
+	sv_framejob_t	*job;
 
 	msglen = 0;
 
@@ -522,8 +569,8 @@ void SV_SendClientMessages (void)
 				SV_DemoCompleted ();
 				return;
 			}
-			if (msglen > MAX_MSGLEN)
-				Com_Error (ERR_DROP, "SV_SendClientMessages: msglen > MAX_MSGLEN");
+			if (msglen < 0 || msglen > MAX_MSGLEN)
+				Com_Error (ERR_DROP, "SV_SendClientMessages: bad msglen %i", msglen);
 			
 			if (sv.demo_ofs+msglen >= sv.demosize)
 			{
@@ -535,6 +582,24 @@ void SV_SendClientMessages (void)
 		}
 	}
 
+	// dropping an overflowed client changes the world for the clients
+	// after it, so those frames have to be built strictly in order
+	parallel = sv_parallelframes->integer > 0 && sv.state == ss_game;
+	for (i=0, c = svs.clients ; parallel && i<maxclients->value; i++, c++)
+	{
+		if (c->state && c->netchan.message.overflowed)
+			parallel = false;
+	}
+	if (parallel && !svs.frame_jobs)
+		svs.frame_jobs = Z_Malloc (sizeof(sv_framejob_t)*maxclients->value);
+	numjobs = 0;
+
+	if (sv.state == ss_game)
+		SV_BuildVisibilityBuckets ();
+
+	// everything below goes out in one batch where the platform allows
+	NET_BeginSendBatch (NS_SERVER);
+
 	// send a message to each connected client
 	for (i=0, c = svs.clients ; i<maxclients->value; i++, c++)
 	{
@@ -548,6 +613,10 @@ void SV_SendClientMessages (void)
 			SZ_Clear (&c->datagram);
 			SV_BroadcastPrintf (PRINT_HIGH, "%s overflowed\n", c->name);
 			SV_DropClient (c);
+
+			// the game may have freed or moved entities
+			if (sv.state == ss_game)
+				SV_BuildVisibilityBuckets ();
 		}
 
 		if (sv.state == ss_cinematic
@@ -561,6 +630,14 @@ void SV_SendClientMessages (void)
 			if (SV_RateDrop (c))
 				continue;
 
+			if (parallel)
+			{	// built and sent below
+				job = &svs.frame_jobs[numjobs++];
+				job->client = c;
+				SV_InitDatagram (c, &job->msg, job->msg_buf);
+				continue;
+			}
+
 			SV_SendClientDatagram (c);
 		}
 		else
@@ -581,5 +658,19 @@ void SV_SendClientMessages (void)
 			}
 		}
 	}
+
+	if (numjobs)
+	{
+		SV_BuildFramesParallel (svs.frame_jobs, numjobs, sv_parallelframes->integer);
+		for (i=0 ; i<numjobs ; i++)
+			SV_TransmitDatagram (svs.frame_jobs[i].client, &svs.frame_jobs[i].msg);
+	}
+
+	SV_SendDownloads ();
+
+	NET_FlushSendBatch (NS_SERVER);
+
+	if (sv_speeds->integer && sv.state == ss_game)
+		SV_VisibilityStats ();
 }
 
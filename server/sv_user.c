@@ -36,6 +36,123 @@ sv_client and sv_player will be valid.
 ============================================================
 */
 
+/*
+==================
+SV_InflateDemo
+
+Replaces a compressed demo in sv.demobuf with its contents
+==================
+*/
+#define MAX_INFLATED_DEMO	(1<<30)	// block sizes come from the file
+
+static void SV_InflateDemo (char *name)
+{
+	sizebuf_t	in, out;
+	byte		*raw;
+	size_t		ofs, rawsize;
+	int			rawlen, complen;
+
+	// first pass for the size
+	rawsize = 0;
+	for (ofs = 4; ofs + 8 <= sv.demosize; ofs += 8 + complen)
+	{
+		rawlen = LittleLong (*(int32_t *)(sv.demobuf + ofs));
+		complen = LittleLong (*(int32_t *)(sv.demobuf + ofs + 4));
+		if (rawlen <= 0 || complen <= 0 || ofs + 8 + complen > sv.demosize
+			|| (size_t)rawlen > MAX_INFLATED_DEMO - rawsize)
+			Com_Error (ERR_DROP, "%s is damaged\n", name);
+		rawsize += rawlen;
+	}
+
+	raw = Z_Malloc (rawsize + 1);
+	SZ_Init (&out, raw, rawsize);
+	for (ofs = 4; ofs + 8 <= sv.demosize; ofs += 8 + complen)
+	{
+		rawlen = LittleLong (*(int32_t *)(sv.demobuf + ofs));
+		complen = LittleLong (*(int32_t *)(sv.demobuf + ofs + 4));
+		SZ_Init (&in, sv.demobuf + ofs + 8, complen);
+		in.cursize = complen;
+		if (rawlen <= 0 || (size_t)rawlen > rawsize - out.cursize)
+			Com_Error (ERR_DROP, "%s is damaged\n", name);
+		out.maxsize = out.cursize + rawlen;
+		qdecompress (&in, &out, compression_zlib_header);
+		if (out.cursize != out.maxsize)
+			Com_Error (ERR_DROP, "%s is compressed, and this build can't inflate it\n", name);
+	}
+
+	FS_FreeFile (sv.demobuf);
+	sv.demobuf = raw;
+	sv.demosize = rawsize;
+}
+
+/*
+==================
+SV_LoadDemoIndex
+
+Finds the index and configstring log at the end of a demo. Everything
+in them is checked here, so demoseek can trust what it reads.
+==================
+*/
+static void SV_LoadDemoIndex (char *name)
+{
+	size_t		streamsize, ofs;
+	int			count, logsize, i, len;
+	int			*index;
+	byte		*rec;
+
+	sv.demoindex = NULL;
+	sv.numdemoindex = 0;
+	sv.democslog = NULL;
+	sv.democslogsize = 0;
+
+	if (sv.demosize < 12 || LittleLong (*(int32_t *)(sv.demobuf + sv.demosize - 4)) != DEMO_IMAGIC)
+		return;		// older demos have no index
+
+	count = LittleLong (*(int32_t *)(sv.demobuf + sv.demosize - 8));
+	logsize = LittleLong (*(int32_t *)(sv.demobuf + sv.demosize - 12));
+	if (count <= 0)
+		return;		// the writer couldn't keep one
+	if (logsize < 0 || (logsize & 3) || (size_t)count > sv.demosize/8
+		|| (size_t)logsize > sv.demosize || (size_t)count*8 + logsize + 12 > sv.demosize)
+		goto damaged;
+	streamsize = sv.demosize - 12 - count*8 - logsize;
+	index = (int *)(sv.demobuf + streamsize + logsize);
+
+	// every offset has to land in the stream before the log
+	for (i = 0; i < count; i++)
+	{
+		ofs = (size_t)LittleLong (index[i*2+1]);
+		if (LittleLong (index[i*2+1]) < 0 || ofs + 4 > streamsize)
+			goto damaged;
+	}
+
+	// and every record has a real configstring and ends in the log
+	for (ofs = 0; ofs < (size_t)logsize; ofs += 8 + ((len + 3) & ~3))
+	{
+		rec = sv.demobuf + streamsize + ofs;
+		if (ofs + 12 > (size_t)logsize)
+			goto damaged;
+		i = LittleLong (((int32_t *)rec)[1]);
+		if (i < 0 || i >= MAX_CONFIGSTRINGS)
+			goto damaged;
+		len = 0;
+		while (ofs + 8 + len < (size_t)logsize && rec[8+len])
+			len++;
+		if (ofs + 8 + len == (size_t)logsize)
+			goto damaged;
+		len++;
+	}
+
+	sv.demoindex = index;
+	sv.numdemoindex = count;
+	sv.democslog = sv.demobuf + streamsize;
+	sv.democslogsize = logsize;
+	return;
+
+damaged:
+	Com_Printf ("%s has a damaged index, demoseek won't work\n", name);
+}
+
 /*
 ==================
 SV_BeginDemoServer
@@ -51,6 +168,12 @@ void SV_BeginDemoserver (void)
 		Com_Error (ERR_DROP, "Couldn't open %s\n", name);
 	sv.demo_ofs = 0;
 	sv.demosize = FS_LoadFile (name, (void **)&sv.demobuf);
+
+	if (sv.demosize >= 4 && LittleLong (*(int32_t *)sv.demobuf) == DEMO_ZMAGIC)
+		SV_InflateDemo (name);
+
+	// newer demos end with an index for demoseek
+	SV_LoadDemoIndex (name);
 }
 
 /*
@@ -90,7 +213,7 @@ void SV_New_f (void)
 
 	// send the serverdata
 	MSG_WriteByte (&sv_client->netchan.message, svc_serverdata);
-	MSG_WriteLong (&sv_client->netchan.message, PROTOCOL_VERSION);
+	MSG_WriteLong (&sv_client->netchan.message, sv_client->protocol);
 	MSG_WriteLong (&sv_client->netchan.message, svs.spawncount);
 	MSG_WriteByte (&sv_client->netchan.message, sv.attractloop);
 	MSG_WriteString (&sv_client->netchan.message, gamedir);
@@ -278,6 +401,221 @@ void SV_Begin_f (void)
 
 //=============================================================================
 
+/*
+============================================================
+
+DOWNLOADS
+
+Clients fetching the same file share one mapping of it. Old clients get
+one chunk per "nextdl" round trip on the reliable channel. Clients that
+ask for a windowed download get a window of chunks on the unreliable
+channel, which they ack with clc_dlack, and every windowed download
+shares the sv_dlrate budget.
+============================================================
+*/
+
+static sv_dlfile_t	sv_dlfiles[MAX_CLIENTS];	// a client holds one at most
+static int			sv_dlbudget;				// bytes windowed downloads may still send
+
+/*
+==================
+SV_OpenDownload
+==================
+*/
+static sv_dlfile_t *SV_OpenDownload (char *name)
+{
+	sv_dlfile_t	*file, *freefile;
+	int			i;
+
+	freefile = NULL;
+	for (i = 0, file = sv_dlfiles; i < MAX_CLIENTS; i++, file++)
+	{
+		if (!file->refcount)
+		{
+			if (!freefile)
+				freefile = file;
+			continue;
+		}
+		if (!Q_strcasecmp (file->name, name))
+		{
+			file->refcount++;
+			return file;
+		}
+	}
+	if (!freefile)
+		return NULL;
+
+	file = freefile;
+	file->size = FS_MapFile (name, (void **)&file->data);
+	if (!file->data)
+		return NULL;
+	Q_strncpyz2 (file->name, name, sizeof(file->name));
+	file->refcount = 1;
+	return file;
+}
+
+/*
+==================
+SV_CloseDownload
+==================
+*/
+void SV_CloseDownload (client_t *cl)
+{
+	sv_dlfile_t	*file;
+
+	file = cl->download;
+	if (!file)
+		return;
+	cl->download = NULL;
+	cl->downloadwindowed = false;
+
+	if (--file->refcount)
+		return;
+	FS_UnmapFile (file->data);
+	file->data = NULL;
+	file->name[0] = 0;
+}
+
+/*
+==================
+SV_SendDownloadChunk
+==================
+*/
+static void SV_SendDownloadChunk (client_t *cl, int chunk)
+{
+	sizebuf_t	msg;
+	byte		msg_buf[MAX_MSGLEN];
+	int			offset, size;
+
+	offset = cl->downloadstart + chunk*DL_CHUNKSIZE;
+	size = cl->downloadsize - offset;
+	if (size > DL_CHUNKSIZE)
+		size = DL_CHUNKSIZE;
+
+	SZ_Init (&msg, msg_buf, sizeof(msg_buf));
+	MSG_WriteByte (&msg, svc_dlchunk);
+	MSG_WriteLong (&msg, offset);
+	MSG_WriteShort (&msg, size);
+	SZ_Write (&msg, cl->download->data + offset, size);
+
+	Netchan_Transmit (&cl->netchan, msg.cursize, msg.data);
+	sv_dlbudget -= msg.cursize;
+}
+
+/*
+==================
+SV_SendDownloadWindow
+
+Sends the chunks in the client's window that were never sent, or that
+went out long enough ago that they must have been lost.
+==================
+*/
+static void SV_SendDownloadWindow (client_t *cl)
+{
+	int		window, timeout;
+	int		first, chunk, i;
+	int		*sent;
+
+	window = sv_dlwindow->integer;
+	if (window > DL_WINDOW_MAX)
+		window = DL_WINDOW_MAX;
+	timeout = cl->ping*2 + 200;
+
+	first = (cl->downloadcount - cl->downloadstart) / DL_CHUNKSIZE;
+	for (i = 0; i < window && sv_dlbudget > 0; i++)
+	{
+		chunk = first + i;
+		if (cl->downloadstart + chunk*DL_CHUNKSIZE >= cl->downloadsize)
+			break;
+		if (i && (cl->downloadmask & (1ULL << (i-1))))
+			continue;	// the client has it
+		sent = &cl->downloadsent[chunk % DL_WINDOW_MAX];
+		if (*sent && svs.realtime - *sent < timeout)
+			continue;	// still in flight
+
+		SV_SendDownloadChunk (cl, chunk);
+		*sent = svs.realtime;
+	}
+}
+
+/*
+==================
+SV_DownloadAck
+
+The client has written everything before pos, and holds the chunks set
+in mask past that.
+==================
+*/
+static void SV_DownloadAck (client_t *cl, int pos, unsigned long long mask)
+{
+	int		first, last;
+
+	if (!cl->download || !cl->downloadwindowed)
+		return;
+	if (pos < cl->downloadcount || pos > cl->downloadsize)
+		return;		// stale or bogus
+	if (pos != cl->downloadsize && (pos - cl->downloadstart) % DL_CHUNKSIZE)
+		return;
+
+	// chunks leaving the window free their send times
+	first = (cl->downloadcount - cl->downloadstart) / DL_CHUNKSIZE;
+	last = (pos - cl->downloadstart) / DL_CHUNKSIZE;
+	if (last - first >= DL_WINDOW_MAX)
+		memset (cl->downloadsent, 0, sizeof(cl->downloadsent));
+	else
+		for ( ; first < last; first++)
+			cl->downloadsent[first % DL_WINDOW_MAX] = 0;
+
+	cl->downloadcount = pos;
+	cl->downloadmask = mask;
+
+	if (pos == cl->downloadsize)
+	{
+		SV_CloseDownload (cl);
+		return;
+	}
+
+	// refill the window now instead of waiting for the next frame
+	SV_SendDownloadWindow (cl);
+}
+
+/*
+==================
+SV_SendDownloads
+
+Called once a frame to top up the shared budget and the windows
+==================
+*/
+void SV_SendDownloads (void)
+{
+	static int	lasttime, nextclient;
+	client_t	*cl;
+	int			elapsed, cap;
+	int			i;
+
+	elapsed = svs.realtime - lasttime;
+	lasttime = svs.realtime;
+	if (elapsed < 0 || elapsed > 1000)
+		elapsed = 1000;
+
+	// a quarter second of budget at most, so idle time doesn't turn into a burst
+	sv_dlbudget += (int)(sv_dlrate->value * elapsed / 1000);
+	cap = (int)(sv_dlrate->value / 4) + DL_CHUNKSIZE;
+	if (sv_dlbudget > cap)
+		sv_dlbudget = cap;
+
+	// start with a different client each frame, so no one starves
+	for (i = 0; i < maxclients->integer && sv_dlbudget > 0; i++)
+	{
+		cl = &svs.clients[(nextclient + i) % maxclients->integer];
+		if (cl->state >= cs_connected && cl->download && cl->downloadwindowed)
+			SV_SendDownloadWindow (cl);
+	}
+	nextclient++;
+	if (nextclient >= maxclients->integer)
+		nextclient = 0;
+}
+
 /*
 ==================
 SV_NextDownload_f
@@ -289,7 +627,7 @@ void SV_NextDownload_f (void)
 	int		percent;
 	int		size;
 
-	if (!sv_client->download)
+	if (!sv_client->download || sv_client->downloadwindowed)
 		return;
 
 	r = sv_client->downloadsize - sv_client->downloadcount;
@@ -306,13 +644,12 @@ void SV_NextDownload_f (void)
 	percent = sv_client->downloadcount*100/size;
 	MSG_WriteByte (&sv_client->netchan.message, percent);
 	SZ_Write (&sv_client->netchan.message,
-		sv_client->download + sv_client->downloadcount - r, r);
+		sv_client->download->data + sv_client->downloadcount - r, r);
 
 	if (sv_client->downloadcount != sv_client->downloadsize)
 		return;
 
-	FS_FreeFile (sv_client->download);
-	sv_client->download = NULL;
+	SV_CloseDownload (sv_client);
 }
 
 /*
@@ -330,12 +667,16 @@ void SV_BeginDownload_f(void)
 	extern	cvar_t *allow_download_maps;
 	int		name_length; // For getting the final character.
 	int offset = 0;
+	qboolean	windowed;
 
 	name = Cmd_Argv(1);
 
 	if (Cmd_Argc() > 2)
 		offset = atoi(Cmd_Argv(2)); // downloaded offset
 
+	// newer clients can take a windowed download
+	windowed = Cmd_Argc() > 3 && atoi(Cmd_Argv(3)) && sv_dlwindow->integer > 0;
+
 	// hacked by zoid to allow more conrol over download
 	// first off, no .. or global allow check
 	if (strstr (name, "..") || !allow_download->value
@@ -369,22 +710,14 @@ void SV_BeginDownload_f(void)
     while (name[(name_length = strlen(name))] == '.' || name[name_length] == '/' )
         name[name_length] = '\0';
 
-	if (sv_client->download)
-		FS_FreeFile (sv_client->download);
-
-	sv_client->downloadsize = FS_LoadFile (name, (void **)&sv_client->download);
-	sv_client->downloadcount = offset;
+	SV_CloseDownload (sv_client);
 
-	if (offset > sv_client->downloadsize)
-		sv_client->downloadcount = sv_client->downloadsize;
+	// shared, so clients fetching the same file map it once
+	sv_client->download = SV_OpenDownload (name);
 
 	if ( !sv_client->download )
 	{
 		Com_DPrintf ("Could not download %s to %s\n", name, sv_client->name);
-		if (sv_client->download) {
-			FS_FreeFile (sv_client->download);
-			sv_client->download = NULL;
-		}
 
 		MSG_WriteByte (&sv_client->netchan.message, svc_download);
 		MSG_WriteShort (&sv_client->netchan.message, -1);
@@ -392,8 +725,33 @@ void SV_BeginDownload_f(void)
 		return;
 	}
 
-	SV_NextDownload_f ();
+	sv_client->downloadsize = sv_client->download->size;
+	sv_client->downloadcount = offset;
+
+	if (offset > sv_client->downloadsize)
+		sv_client->downloadcount = sv_client->downloadsize;
+
 	Com_DPrintf ("Downloading %s to %s\n", name, sv_client->name);
+
+	if (!windowed)
+	{
+		SV_NextDownload_f ();
+		return;
+	}
+
+	// the chunks start going out with the next frame, and the
+	// first of them carries this along
+	sv_client->downloadwindowed = true;
+	sv_client->downloadstart = sv_client->downloadcount;
+	sv_client->downloadmask = 0;
+	memset (sv_client->downloadsent, 0, sizeof(sv_client->downloadsent));
+
+	MSG_WriteByte (&sv_client->netchan.message, svc_dlstart);
+	MSG_WriteLong (&sv_client->netchan.message, sv_client->downloadsize);
+	MSG_WriteLong (&sv_client->netchan.message, sv_client->downloadcount);
+
+	if (sv_client->downloadcount == sv_client->downloadsize)
+		SV_CloseDownload (sv_client);
 }
 
 
@@ -770,6 +1128,18 @@ void SV_ExecuteClientMessage (client_t *cl)
 			cl->lastcmd = newcmd;
 			break;
 
+		case clc_dlack:
+			{
+				int			pos;
+				unsigned	lo, hi;
+
+				pos = MSG_ReadLong (&net_message);
+				lo = (unsigned)MSG_ReadLong (&net_message);
+				hi = (unsigned)MSG_ReadLong (&net_message);
+				SV_DownloadAck (cl, pos, ((unsigned long long)hi << 32) | lo);
+			}
+			break;
+
 		case clc_stringcmd:
 
 			s = MSG_ReadString (&net_message);
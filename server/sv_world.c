@@ -424,6 +424,57 @@ int SV_AreaEdicts (vec3_t mins, vec3_t maxs, edict_t **list,
 	return area_count;
 }
 
+static int SV_EdictOrder (const void *a, const void *b)
+{
+	const edict_t	*e1 = *(const edict_t **)a;
+	const edict_t	*e2 = *(const edict_t **)b;
+
+	return e1 < e2 ? -1 : e1 > e2;
+}
+
+/*
+================
+SV_RadiusEdicts
+
+The area node version of the game's findradius scan. An entity whose
+center is within radius has a linked box touching the cube around org,
+so the solid and trigger lists of the nodes that cube crosses hold every
+candidate, and only those get the distance test.
+================
+*/
+int SV_RadiusEdicts (vec3_t org, float radius, edict_t **list, int maxcount)
+{
+	vec3_t	mins, maxs, eorg;
+	edict_t	*check;
+	int		i, j, num, count;
+
+	for (i=0 ; i<3 ; i++)
+	{
+		mins[i] = org[i] - radius;
+		maxs[i] = org[i] + radius;
+	}
+
+	num = SV_AreaEdicts (mins, maxs, list, maxcount, AREA_SOLID);
+	num += SV_AreaEdicts (mins, maxs, list + num, maxcount - num, AREA_TRIGGERS);
+
+	count = 0;
+	for (i=0 ; i<num ; i++)
+	{
+		check = list[i];
+		if (!check->inuse)
+			continue;
+		for (j=0 ; j<3 ; j++)
+			eorg[j] = org[j] - (check->s.origin[j] + (check->mins[j] + check->maxs[j])*0.5);
+		if (VectorLength (eorg) > radius)
+			continue;
+		list[count++] = check;
+	}
+
+	qsort (list, count, sizeof(list[0]), SV_EdictOrder);
+
+	return count;
+}
+
 
 //===========================================================================
 
@@ -514,21 +565,18 @@ int SV_HullForEntity (edict_t *ent)
 
 /*
 ====================
-SV_ClipMoveToEntities
+SV_ClipMoveToEntityList
 
 ====================
 */
-void SV_ClipMoveToEntities ( moveclip_t *clip )
+static void SV_ClipMoveToEntityList ( moveclip_t *clip, edict_t **touchlist, int num )
 {
-	int			i, num;
-	edict_t		*touchlist[MAX_EDICTS], *touch;
+	int			i;
+	edict_t		*touch;
 	trace_t		trace;
 	int			headnode;
 	float		*angles;
 
-	num = SV_AreaEdicts (clip->boxmins, clip->boxmaxs, touchlist
-		, MAX_EDICTS, AREA_SOLID);
-
 	// be careful, it is possible to have an entity in this
 	// list removed before we get to it (killtriggered)
 	for (i=0 ; i<num ; i++)
@@ -596,6 +644,23 @@ void SV_ClipMoveToEntities ( moveclip_t *clip )
 	}
 }
 
+/*
+====================
+SV_ClipMoveToEntities
+
+====================
+*/
+void SV_ClipMoveToEntities ( moveclip_t *clip )
+{
+	int			num;
+	edict_t		*touchlist[MAX_EDICTS];
+
+	num = SV_AreaEdicts (clip->boxmins, clip->boxmaxs, touchlist
+		, MAX_EDICTS, AREA_SOLID);
+
+	SV_ClipMoveToEntityList (clip, touchlist, num);
+}
+
 
 /*
 ==================
@@ -621,17 +686,167 @@ void SV_TraceBounds (vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end, vec3_t
 	}
 }
 
+/*
+===============================================================================
+
+TRACE PROFILE
+
+With sv_traceprofile set, every game trace is charged to the caller the
+game last named with gi.tracecaller. The totals are shown by the
+traceprofile command and appended to traceprofile.csv when the map ends.
+
+===============================================================================
+*/
+
+typedef struct
+{
+	unsigned			traces;
+	unsigned long long	usec;
+	unsigned long long	nodes;
+	unsigned long long	brushes;
+	unsigned long long	terraintris;
+} tracestats_t;
+
+static const char	*sv_tracecallernames[NUM_TRACE_CALLERS] =
+{
+	"other", "pmove", "physics", "weapons", "bots"
+};
+
+static tracestats_t	sv_tracestats[NUM_TRACE_CALLERS];
+static int			sv_tracecaller;
+
+int SV_TraceCaller (int caller)
+{
+	int		old;
+
+	old = sv_tracecaller;
+	if (caller < 0 || caller >= NUM_TRACE_CALLERS)
+		caller = TRACE_OTHER;
+	sv_tracecaller = caller;
+
+	return old;
+}
+
+static void SV_ChargeTraces (int count, unsigned long long start, const cm_tracecounts_t *before)
+{
+	tracestats_t		*stats = &sv_tracestats[sv_tracecaller];
+	cm_tracecounts_t	after;
+
+	CM_ThreadTraceCounts (&after);
+	stats->traces += count;
+	stats->usec += Sys_Microseconds () - start;
+	stats->nodes += after.nodes - before->nodes;
+	stats->brushes += after.brushes - before->brushes;
+	stats->terraintris += after.terraintris - before->terraintris;
+}
+
 /*
 ==================
-SV_Trace
+SV_TraceProfile_f
 
-Moves the given mins/maxs volume through the world from start to end.
+traceprofile [reset]
+==================
+*/
+void SV_TraceProfile_f (void)
+{
+	int				i;
+	tracestats_t	*stats, total;
 
-Passedict and edicts owned by passedict are explicitly not checked.
+	if (Cmd_Argc () > 1 && !Q_strcasecmp (Cmd_Argv (1), "reset"))
+	{
+		memset (sv_tracestats, 0, sizeof(sv_tracestats));
+		return;
+	}
+
+	if (!sv_traceprofile->integer)
+		Com_Printf ("sv_traceprofile is off, totals are not being updated.\n");
+
+	memset (&total, 0, sizeof(total));
+	Com_Printf ("caller      traces     msec  usec/trace  nodes/trace  brushes/trace  tris/trace\n");
+	for (i=0 ; i<=NUM_TRACE_CALLERS ; i++)
+	{
+		if (i < NUM_TRACE_CALLERS)
+		{
+			stats = &sv_tracestats[i];
+			total.traces += stats->traces;
+			total.usec += stats->usec;
+			total.nodes += stats->nodes;
+			total.brushes += stats->brushes;
+			total.terraintris += stats->terraintris;
+		}
+		else
+			stats = &total;
+		if (!stats->traces)
+			continue;
 
+		Com_Printf ("%-8s %9u %8.1f %11.2f %12.1f %14.1f %11.1f\n",
+			i < NUM_TRACE_CALLERS ? sv_tracecallernames[i] : "total",
+			stats->traces, stats->usec / 1000.0,
+			(double)stats->usec / stats->traces,
+			(double)stats->nodes / stats->traces,
+			(double)stats->brushes / stats->traces,
+			(double)stats->terraintris / stats->traces);
+	}
+}
+
+/*
+==================
+SV_WriteTraceProfile
+
+Appends the totals for the map that is ending to traceprofile.csv in the
+game directory and starts over.
 ==================
 */
-trace_t SV_Trace (vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end, edict_t *passedict, int contentmask)
+void SV_WriteTraceProfile (void)
+{
+	int			i;
+	char		name[MAX_OSPATH];
+	FILE		*f;
+	qboolean	newfile;
+	tracestats_t	*stats;
+
+	for (i=0 ; i<NUM_TRACE_CALLERS ; i++)
+		if (sv_tracestats[i].traces)
+			break;
+	if (i == NUM_TRACE_CALLERS)
+		return;
+
+	Com_sprintf (name, sizeof(name), "%s/traceprofile.csv", FS_Gamedir());
+	f = fopen (name, "r");
+	newfile = !f;
+	if (f)
+		fclose (f);
+	f = fopen (name, "a");
+	if (!f)
+	{
+		Com_Printf ("Couldn't write %s\n", name);
+		return;
+	}
+
+	if (newfile)
+		fprintf (f, "map,caller,traces,usec,nodes,brushes,terraintris\n");
+	for (i=0 ; i<NUM_TRACE_CALLERS ; i++)
+	{
+		stats = &sv_tracestats[i];
+		if (!stats->traces)
+			continue;
+		fprintf (f, "%s,%s,%u,%llu,%llu,%llu,%llu\n", sv.name,
+			sv_tracecallernames[i], stats->traces, stats->usec,
+			stats->nodes, stats->brushes, stats->terraintris);
+	}
+	fclose (f);
+
+	memset (sv_tracestats, 0, sizeof(sv_tracestats));
+}
+
+//===========================================================================
+
+/*
+==================
+SV_ClipTrace
+==================
+*/
+static trace_t SV_ClipTrace (vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end, edict_t *passedict, int contentmask)
 {
 	moveclip_t	clip;
 
@@ -666,6 +881,140 @@ trace_t SV_Trace (vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end, edict_t *p
 
 	return clip.trace;
 }
+
+/*
+==================
+SV_Trace
+
+Moves the given mins/maxs volume through the world from start to end.
+
+Passedict and edicts owned by passedict are explicitly not checked.
+
+==================
+*/
+trace_t SV_Trace (vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end, edict_t *passedict, int contentmask)
+{
+	trace_t				trace;
+	unsigned long long	t;
+	cm_tracecounts_t	before;
+
+	if (!sv_traceprofile->integer)
+		return SV_ClipTrace (start, mins, maxs, end, passedict, contentmask);
+
+	CM_ThreadTraceCounts (&before);
+	t = Sys_Microseconds ();
+	trace = SV_ClipTrace (start, mins, maxs, end, passedict, contentmask);
+	SV_ChargeTraces (1, t, &before);
+
+	return trace;
+}
+
+/*
+==================
+SV_TraceBatch
+
+SV_Trace for count rays sharing one box size, passedict and contentmask.
+The world part goes through CM_BoxTraceBatch on sv_paralleltraces job
+threads. The entities near the rays are gathered once for the whole batch
+and clipped on this thread, because CM_HeadnodeForBox is not thread safe.
+==================
+*/
+void SV_TraceBatch (int count, vec3_t *starts, vec3_t mins, vec3_t maxs, vec3_t *ends, edict_t *passedict, int contentmask, trace_t *results)
+{
+	moveclip_t	clip;
+	edict_t		*touchlist[MAX_EDICTS], *raylist[MAX_EDICTS], *touch;
+	vec3_t		boxmins, boxmaxs, batchmins, batchmaxs;
+	int			i, j, num, raynum, numworkers;
+	qboolean	open;
+	unsigned long long	t = 0;
+	cm_tracecounts_t	before;
+
+	if (count <= 0)
+		return;
+	if (!mins)
+		mins = vec3_origin;
+	if (!maxs)
+		maxs = vec3_origin;
+
+	// while profiling, trace on this thread so the work is counted
+	numworkers = sv_paralleltraces->integer;
+	if (sv_traceprofile->integer)
+	{
+		numworkers = 0;
+		CM_ThreadTraceCounts (&before);
+		t = Sys_Microseconds ();
+	}
+
+	// clip to world
+	CM_BoxTraceBatch (count, starts, ends, mins, maxs, 0, contentmask,
+		results, numworkers);
+
+	// one area query covering every ray's move
+	open = false;
+	for (i=0 ; i<count ; i++)
+	{
+		results[i].ent = ge->edicts;
+		if (results[i].fraction == 0)
+			continue;		// blocked by the world
+
+		SV_TraceBounds (starts[i], mins, maxs, ends[i], boxmins, boxmaxs);
+		if (!open)
+		{
+			VectorCopy (boxmins, batchmins);
+			VectorCopy (boxmaxs, batchmaxs);
+			open = true;
+		}
+		AddPointToBounds (boxmins, batchmins, batchmaxs);
+		AddPointToBounds (boxmaxs, batchmins, batchmaxs);
+	}
+	if (!open)
+		goto done;		// every ray was blocked by the world
+	num = SV_AreaEdicts (batchmins, batchmaxs, touchlist, MAX_EDICTS, AREA_SOLID);
+
+	for (i=0 ; i<count ; i++)
+	{
+		if (results[i].fraction == 0)
+			continue;
+
+		memset ( &clip, 0, sizeof ( moveclip_t ) );
+		clip.trace = results[i];
+		clip.contentmask = contentmask;
+		clip.start = starts[i];
+		clip.end = ends[i];
+		clip.mins = mins;
+		clip.maxs = maxs;
+		clip.passedict = passedict;
+
+		VectorCopy (mins, clip.mins2);
+		VectorCopy (maxs, clip.maxs2);
+
+		SV_TraceBounds ( starts[i], clip.mins2, clip.maxs2, ends[i], clip.boxmins, clip.boxmaxs );
+
+		// the same overlap test SV_AreaEdicts makes, so each ray sees the
+		// entities it would have found on its own, in the same order
+		raynum = 0;
+		for (j=0 ; j<num ; j++)
+		{
+			touch = touchlist[j];
+			if (touch->absmin[0] > clip.boxmaxs[0]
+			|| touch->absmin[1] > clip.boxmaxs[1]
+			|| touch->absmin[2] > clip.boxmaxs[2]
+			|| touch->absmax[0] < clip.boxmins[0]
+			|| touch->absmax[1] < clip.boxmins[1]
+			|| touch->absmax[2] < clip.boxmins[2])
+				continue;
+			raylist[raynum++] = touch;
+		}
+
+		SV_ClipMoveToEntityList (&clip, raylist, raynum);
+		results[i] = clip.trace;
+	}
+
+done:
+	if (sv_traceprofile->integer)
+		SV_ChargeTraces (count, t, &before);
+}
+
 trace_t SV_Trace2 (vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end, edict_t *passedict, int contentmask)
 {
 	moveclip_t	clip;
@@ -19,6 +19,10 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 */
 // net_udp.c
 
+#if defined __linux__ && !defined _GNU_SOURCE
+#define _GNU_SOURCE		// recvmmsg, sendmmsg
+#endif
+
 #ifdef HAVE_CONFIG_H
 #include "config.h"
 #endif
@@ -67,7 +71,7 @@ netadr_t	net_local_adr;
 
 #define	LOOPBACK	0x7f000001
 
-#define	MAX_LOOPBACK	4
+#define	MAX_LOOPBACK	64		// room for a full download window in one frame
 
 typedef struct
 {
@@ -88,6 +92,36 @@ int			ipx_sockets[2];
 int NET_Socket (char *net_interface, int port);
 char *NET_ErrorString (void);
 
+/*
+ * Batched UDP. Where recvmmsg and sendmmsg exist, NET_GetPacket pulls up to
+ * NET_BATCH datagrams off a socket per system call and hands them out one
+ * at a time, and packets sent between NET_BeginSendBatch and
+ * NET_FlushSendBatch go out together with one system call.
+ */
+#if defined __linux__
+#define HAVE_MMSG
+#endif
+
+#define	NET_BATCH	32
+
+#if defined HAVE_MMSG
+typedef struct
+{
+	byte				data[NET_BATCH][MAX_MSGLEN];
+	struct sockaddr_in	addrs[NET_BATCH];
+	struct iovec		iovecs[NET_BATCH];
+	struct mmsghdr		msgs[NET_BATCH];
+	int					count;
+	int					next;		// receive: the next one to hand out
+	qboolean			active;		// send: between Begin and Flush
+} netbatch_t;
+
+static netbatch_t	net_recvbatch[2];
+static netbatch_t	net_sendbatch[2];
+#endif
+
+static cvar_t		*net_mmsg;
+
 //=============================================================================
 
 void NetadrToSockadr (netadr_t *a, struct sockaddr_in *s)
@@ -304,6 +338,60 @@ void NET_SendLoopPacket (netsrc_t sock, int length, void *data, netadr_t to)
 
 //=============================================================================
 
+#if defined HAVE_MMSG
+/*
+====================
+NET_GetBatchedPacket
+====================
+*/
+static qboolean NET_GetBatchedPacket (netsrc_t sock, int net_socket, netadr_t *net_from, sizebuf_t *net_message)
+{
+	netbatch_t	*batch = &net_recvbatch[sock];
+	int			i, len;
+
+	for (;;)
+	{
+		if (batch->next == batch->count)
+		{
+			for (i=0 ; i<NET_BATCH ; i++)
+			{
+				batch->iovecs[i].iov_base = batch->data[i];
+				batch->iovecs[i].iov_len = MAX_MSGLEN;
+				memset (&batch->msgs[i].msg_hdr, 0, sizeof(batch->msgs[i].msg_hdr));
+				batch->msgs[i].msg_hdr.msg_name = &batch->addrs[i];
+				batch->msgs[i].msg_hdr.msg_namelen = sizeof(batch->addrs[i]);
+				batch->msgs[i].msg_hdr.msg_iov = &batch->iovecs[i];
+				batch->msgs[i].msg_hdr.msg_iovlen = 1;
+			}
+
+			batch->next = 0;
+			batch->count = recvmmsg (net_socket, batch->msgs, NET_BATCH, MSG_DONTWAIT, NULL);
+			if (batch->count <= 0)
+			{
+				batch->count = 0;
+				if (errno != EWOULDBLOCK && errno != ECONNREFUSED)
+					Com_Printf ("NET_GetPacket: %s\n", NET_ErrorString());
+				return false;
+			}
+		}
+
+		i = batch->next++;
+		SockadrToNetadr (&batch->addrs[i], net_from);
+		len = batch->msgs[i].msg_len;
+
+		if ((batch->msgs[i].msg_hdr.msg_flags & MSG_TRUNC) || len >= net_message->maxsize)
+		{
+			Com_Printf ("Oversize packet from %s\n", NET_AdrToString (*net_from));
+			continue;
+		}
+
+		memcpy (net_message->data, batch->data[i], len);
+		net_message->cursize = len;
+		return true;
+	}
+}
+#endif
+
 qboolean	NET_GetPacket (netsrc_t sock, netadr_t *net_from, sizebuf_t *net_message)
 {
 	int			ret;
@@ -326,6 +414,15 @@ qboolean	NET_GetPacket (netsrc_t sock, netadr_t *net_from, sizebuf_t *net_messag
 		if (!net_socket)
 			continue;
 
+#if defined HAVE_MMSG
+		if (protocol == 0 && (net_mmsg->integer || net_recvbatch[sock].next < net_recvbatch[sock].count))
+		{
+			if (NET_GetBatchedPacket (sock, net_socket, net_from, net_message))
+				return true;
+			continue;
+		}
+#endif
+
 		fromlen = sizeof(from);
 		ret = recvfrom (net_socket, net_message->data, net_message->maxsize
 			, 0, (struct sockaddr *)&from, &fromlen);
@@ -399,6 +496,30 @@ void NET_SendPacket (netsrc_t sock, int length, void *data, netadr_t to)
 
 	NetadrToSockadr (&to, &addr);
 
+#if defined HAVE_MMSG
+	if (net_sendbatch[sock].active && net_socket == ip_sockets[sock])
+	{
+		netbatch_t	*batch = &net_sendbatch[sock];
+		int			i;
+
+		if (batch->count == NET_BATCH)
+			NET_FlushSendBatch (sock);
+		batch->active = true;
+
+		i = batch->count++;
+		memcpy (batch->data[i], data, length);
+		batch->addrs[i] = addr;
+		batch->iovecs[i].iov_base = batch->data[i];
+		batch->iovecs[i].iov_len = length;
+		memset (&batch->msgs[i].msg_hdr, 0, sizeof(batch->msgs[i].msg_hdr));
+		batch->msgs[i].msg_hdr.msg_name = &batch->addrs[i];
+		batch->msgs[i].msg_hdr.msg_namelen = sizeof(batch->addrs[i]);
+		batch->msgs[i].msg_hdr.msg_iov = &batch->iovecs[i];
+		batch->msgs[i].msg_hdr.msg_iovlen = 1;
+		return;
+	}
+#endif
+
 	ret = sendto (net_socket, data, length, 0, (struct sockaddr *)&addr, sizeof(addr) );
 	if (ret == -1)
 	{
@@ -407,6 +528,71 @@ void NET_SendPacket (netsrc_t sock, int length, void *data, netadr_t to)
 	}
 }
 
+/*
+====================
+NET_BeginSendBatch
+
+Holds back the packets sent on sock until NET_FlushSendBatch.
+====================
+*/
+void NET_BeginSendBatch (netsrc_t sock)
+{
+#if defined HAVE_MMSG
+	if (net_mmsg->integer && ip_sockets[sock])
+		net_sendbatch[sock].active = true;
+#endif
+}
+
+/*
+====================
+NET_FlushSendBatch
+====================
+*/
+void NET_FlushSendBatch (netsrc_t sock)
+{
+#if defined HAVE_MMSG
+	netbatch_t	*batch = &net_sendbatch[sock];
+	netadr_t	to;
+	int			sent, ret;
+
+	sent = 0;
+	while (sent < batch->count)
+	{
+		ret = sendmmsg (ip_sockets[sock], batch->msgs + sent, batch->count - sent, 0);
+		if (ret <= 0)
+		{	// the first one failed, report it and carry on after it
+			SockadrToNetadr (&batch->addrs[sent], &to);
+			Com_Printf ("NET_SendPacket ERROR: %s to %s\n", NET_ErrorString(),
+					NET_AdrToString (to));
+			sent++;
+			continue;
+		}
+		sent += ret;
+	}
+
+	batch->count = 0;
+	batch->active = false;
+#endif
+}
+
+/*
+====================
+NET_LocalPort
+====================
+*/
+int NET_LocalPort (netsrc_t sock)
+{
+	struct sockaddr_in	address;
+	socklen_t			len = sizeof(address);
+
+	if (!ip_sockets[sock])
+		return 0;
+	if (getsockname (ip_sockets[sock], (struct sockaddr *)&address, &len) == -1)
+		return 0;
+
+	return ntohs (address.sin_port);
+}
+
 /*
 ====================
 NET_OpenIP
@@ -452,6 +638,10 @@ void	NET_Config (qboolean multiplayer)
 	{	// shut down any existing sockets
 		for (i=0 ; i<2 ; i++)
 		{
+#if defined HAVE_MMSG
+			NET_FlushSendBatch (i);
+			net_recvbatch[i].count = net_recvbatch[i].next = 0;
+#endif
 			if (ip_sockets[i])
 			{
 				close (ip_sockets[i]);
@@ -482,6 +672,8 @@ NET_Init
 */
 void NET_Init (void)
 {
+	net_mmsg = Cvar_Get ("net_mmsg", "1", CVARDOC_BOOL);
+	Cvar_Describe (net_mmsg, "Receive and send UDP packets in batches with recvmmsg and sendmmsg where the system has them.");
 }
 
 
@@ -591,6 +783,48 @@ void NET_Sleep( int  msec )
 			msec, strerror( errno ) );
 	}
 }
+
+/**
+ * Sleep for usec microseconds, or until the server socket or the console
+ * has input. Returns a mask of NET_WAKE_* flags, 0 when the time ran out.
+ * pselect takes a timespec, so the wakeup is as precise as the kernel's
+ * high resolution timers rather than rounded to a millisecond.
+ */
+int NET_SleepMicroseconds( int usec )
+{
+	struct timespec timeout;
+	fd_set	fdset;
+	int result, wake;
+
+	if ( usec < 0 )
+		usec = 0;
+
+	FD_ZERO(&fdset);
+	FD_SET( fileno(stdin), &fdset );
+	FD_SET( ip_sockets[NS_SERVER], &fdset );
+
+	timeout.tv_sec = usec/1000000;
+	timeout.tv_nsec = (usec%1000000)*1000;
+	result = pselect( ip_sockets[NS_SERVER]+1, &fdset, NULL, NULL, &timeout, NULL );
+	if ( result == -1 )
+	{
+		if ( errno != EINTR )
+			Com_Printf(
+				"ERROR: NET_SleepMicroseconds( usec:%i ): pselect() error: %s\n",
+				usec, strerror( errno ) );
+		return 0;
+	}
+
+	wake = 0;
+	if ( result > 0 )
+	{
+		if ( FD_ISSET( ip_sockets[NS_SERVER], &fdset ) )
+			wake |= NET_WAKE_PACKET;
+		if ( FD_ISSET( fileno(stdin), &fdset ) )
+			wake |= NET_WAKE_CONSOLE;
+	}
+	return wake;
+}
 #else
 /**
  * Unix/Linux client, do nothing
@@ -599,4 +833,9 @@ void NET_Sleep( int unused )
 {
 }
 
+int NET_SleepMicroseconds( int unused )
+{
+	return 0;
+}
+
 #endif
@@ -33,6 +33,9 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include <dirent.h>
 #include <unistd.h>
 #include <sys/mman.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <pthread.h>
 
 #if defined HAVE_TIME_H
 # include <time.h>
@@ -385,7 +388,233 @@ void Sys_FindClose (void)
 	fdir = NULL;
 }
 
+/*
+================
+Sys_ScanDir
+
+Reentrant, unlike Sys_FindFirst, so func may scan subdirectories.
+================
+*/
+qboolean Sys_ScanDir (const char *path, void (*func) (void *arg, const char *name, qboolean isdir), void *arg)
+{
+	DIR				*dir;
+	struct dirent	*d;
+	struct stat		st;
+	char			fn[MAX_OSPATH];
+	qboolean		isdir;
+
+	if ((dir = opendir (path)) == NULL)
+		return false;
+
+	while ((d = readdir (dir)) != NULL)
+	{
+		if (strcmp (d->d_name, ".") == 0 || strcmp (d->d_name, "..") == 0)
+			continue;
+
+#if defined DT_DIR
+		if (d->d_type == DT_DIR || d->d_type == DT_REG)
+		{
+			isdir = d->d_type == DT_DIR;
+		}
+		else
+#endif
+		{
+			// symlinks and filesystems without d_type
+			Com_sprintf (fn, sizeof(fn), "%s/%s", path, d->d_name);
+			if (stat (fn, &st) == -1)
+				continue;
+			isdir = S_ISDIR (st.st_mode) != 0;
+			if (!isdir && !S_ISREG (st.st_mode))
+				continue;
+		}
+
+		func (arg, d->d_name, isdir);
+	}
+
+	closedir (dir);
+	return true;
+}
+
 
 //============================================
 
 
+
+/*
+================
+Sys_Microseconds
+
+Monotonic, only meaningful as a difference between two calls
+================
+*/
+unsigned long long Sys_Microseconds (void)
+{
+#if defined HAVE_CLOCK_GETTIME
+	struct timespec tp;
+
+	clock_gettime( CLOCK_MONOTONIC, &tp );
+	return (unsigned long long)tp.tv_sec * 1000000ULL + tp.tv_nsec / 1000;
+#else
+	struct timeval tp;
+
+	gettimeofday( &tp, NULL );
+	return (unsigned long long)tp.tv_sec * 1000000ULL + tp.tv_usec;
+#endif
+}
+
+//============================================
+
+/*
+ * Threads
+ *
+ * Thin wrappers around pthreads. The handles are opaque to the portable
+ * code, which only ever passes them back in here.
+ */
+
+typedef struct
+{
+	pthread_t	thread;
+	void		(*func) (void *);
+	void		*arg;
+} sys_thread_t;
+
+static void *Sys_ThreadStart (void *arg)
+{
+	sys_thread_t *t = (sys_thread_t *)arg;
+
+	t->func (t->arg);
+	return NULL;
+}
+
+void *Sys_CreateThread (void (*func) (void *), void *arg)
+{
+	sys_thread_t *t;
+
+	t = malloc (sizeof(*t));
+	if (t == NULL)
+		return NULL;
+	t->func = func;
+	t->arg = arg;
+	if (pthread_create (&t->thread, NULL, Sys_ThreadStart, t) != 0)
+	{
+		free (t);
+		return NULL;
+	}
+	return t;
+}
+
+void Sys_JoinThread (void *thread)
+{
+	sys_thread_t *t = (sys_thread_t *)thread;
+
+	pthread_join (t->thread, NULL);
+	free (t);
+}
+
+unsigned long Sys_ThreadId (void)
+{
+	return (unsigned long)pthread_self ();
+}
+
+int Sys_NumProcessors (void)
+{
+	long n;
+
+	n = sysconf( _SC_NPROCESSORS_ONLN );
+	if (n < 1)
+		n = 1;
+	return (int)n;
+}
+
+void *Sys_CreateMutex (void)
+{
+	pthread_mutex_t *m;
+
+	m = malloc (sizeof(*m));
+	if (m != NULL)
+		pthread_mutex_init (m, NULL);
+	return m;
+}
+
+void Sys_DestroyMutex (void *mutex)
+{
+	pthread_mutex_destroy ((pthread_mutex_t *)mutex);
+	free (mutex);
+}
+
+void Sys_LockMutex (void *mutex)
+{
+	pthread_mutex_lock ((pthread_mutex_t *)mutex);
+}
+
+void Sys_UnlockMutex (void *mutex)
+{
+	pthread_mutex_unlock ((pthread_mutex_t *)mutex);
+}
+
+void *Sys_CreateCond (void)
+{
+	pthread_cond_t *c;
+
+	c = malloc (sizeof(*c));
+	if (c != NULL)
+		pthread_cond_init (c, NULL);
+	return c;
+}
+
+void Sys_DestroyCond (void *cond)
+{
+	pthread_cond_destroy ((pthread_cond_t *)cond);
+	free (cond);
+}
+
+void Sys_WaitCond (void *cond, void *mutex)
+{
+	pthread_cond_wait ((pthread_cond_t *)cond, (pthread_mutex_t *)mutex);
+}
+
+// wakes every thread waiting on cond
+void Sys_BroadcastCond (void *cond)
+{
+	pthread_cond_broadcast ((pthread_cond_t *)cond);
+}
+
+/*
+================
+Sys_MapFile
+
+Private writable mapping so callers can swap lumps in place without
+touching the file. The mapping outlives the FILE.
+================
+*/
+void *Sys_MapFile (FILE *f, int length)
+{
+	void *base;
+
+	if (length <= 0)
+		return NULL;
+
+	base = mmap (NULL, length, PROT_READ|PROT_WRITE, MAP_PRIVATE, fileno (f), 0);
+	if (base == MAP_FAILED)
+		return NULL;
+
+	// loaders walk the whole file right away
+	madvise (base, length, MADV_WILLNEED);
+	madvise (base, length, MADV_SEQUENTIAL);
+
+	return base;
+}
+
+void Sys_UnmapFile (void *base, int length)
+{
+	munmap (base, length);
+}
+
+qboolean Sys_DropFileCache (FILE *f)
+{
+#if defined POSIX_FADV_DONTNEED
+	return posix_fadvise (fileno (f), 0, 0, POSIX_FADV_DONTNEED) == 0;
+#else
+	return false;
+#endif
+}
@@ -27,7 +27,7 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #include "wsipx.h"
 #include "qcommon/qcommon.h"
 
-#define	MAX_LOOPBACK	4
+#define	MAX_LOOPBACK	64		// room for a full download window in one frame
 
 typedef struct
 {
@@ -539,6 +539,39 @@ int NET_IPSocket (char *net_interface, int port)
 }
 
 
+/*
+====================
+NET_BeginSendBatch
+
+Winsock has no batched send, packets always go out as they are sent.
+====================
+*/
+void NET_BeginSendBatch (netsrc_t sock)
+{
+}
+
+void NET_FlushSendBatch (netsrc_t sock)
+{
+}
+
+/*
+====================
+NET_LocalPort
+====================
+*/
+int NET_LocalPort (netsrc_t sock)
+{
+	struct sockaddr_in	address;
+	int					len = sizeof(address);
+
+	if (!ip_sockets[sock])
+		return 0;
+	if (getsockname (ip_sockets[sock], (struct sockaddr *)&address, &len) == SOCKET_ERROR)
+		return 0;
+
+	return ntohs (address.sin_port);
+}
+
 /*
 ====================
 NET_OpenIP
@@ -760,6 +793,40 @@ void NET_Sleep(int msec)
 	select(i+1, &fdset, NULL, NULL, &timeout);
 }
 
+// sleeps usec or until net socket is ready, returns NET_WAKE_* flags
+int NET_SleepMicroseconds(int usec)
+{
+    struct timeval timeout;
+	fd_set	fdset;
+	extern cvar_t *dedicated;
+	int i, wake;
+
+	if (!dedicated || !dedicated->value)
+		return 0;
+	if (usec < 0)
+		usec = 0;
+
+	FD_ZERO(&fdset);
+	i = 0;
+	if (ip_sockets[NS_SERVER]) {
+		FD_SET(ip_sockets[NS_SERVER], &fdset); // network socket
+		i = ip_sockets[NS_SERVER];
+	}
+	if (ipx_sockets[NS_SERVER]) {
+		FD_SET(ipx_sockets[NS_SERVER], &fdset); // network socket
+		if (ipx_sockets[NS_SERVER] > i)
+			i = ipx_sockets[NS_SERVER];
+	}
+	if (!i)
+		return 0;	// select fails on an empty set
+	timeout.tv_sec = usec/1000000;
+	timeout.tv_usec = usec%1000000;
+	wake = 0;
+	if (select(i+1, &fdset, NULL, NULL, &timeout) > 0)
+		wake = NET_WAKE_PACKET;
+	return wake;
+}
+
 //===================================================================
 
 
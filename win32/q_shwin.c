@@ -48,7 +48,7 @@ void *Hunk_Begin (int maxsize)
 	cursize = 0;
 	hunkmaxsize = maxsize;
 #ifdef VIRTUAL_ALLOC
-	membase = VirtualAlloc (NULL, maxsize, MEM_RESERVE|MEM_TOP_DOWN, PAGE_NOACCESS);
+	membase = VirtualAlloc (NULL, maxsize, MEM_RESERVE|MEM_TOP_DOWN, PAGE_NOACCESS);
 #else
 	membase = malloc (maxsize);
 	memset (membase, 0, maxsize);
@@ -218,3 +218,211 @@ void Sys_FindClose (void)
 
 //============================================
 
+
+/*
+================
+Sys_Microseconds
+
+Monotonic, only meaningful as a difference between two calls
+================
+*/
+unsigned long long Sys_Microseconds (void)
+{
+	static LARGE_INTEGER	freq;
+	LARGE_INTEGER			count;
+
+	if (!freq.QuadPart)
+		QueryPerformanceFrequency (&freq);
+	QueryPerformanceCounter (&count);
+
+	return (unsigned long long)(count.QuadPart / freq.QuadPart) * 1000000ULL
+		+ (unsigned long long)(count.QuadPart % freq.QuadPart) * 1000000ULL / freq.QuadPart;
+}
+
+//============================================
+
+/*
+ * Threads
+ *
+ * Thin wrappers around the Win32 thread API. The handles are opaque to
+ * the portable code, which only ever passes them back in here.
+ */
+
+typedef struct
+{
+	HANDLE		thread;
+	void		(*func) (void *);
+	void		*arg;
+} sys_thread_t;
+
+static DWORD WINAPI Sys_ThreadStart (LPVOID arg)
+{
+	sys_thread_t *t = (sys_thread_t *)arg;
+
+	t->func (t->arg);
+	return 0;
+}
+
+void *Sys_CreateThread (void (*func) (void *), void *arg)
+{
+	sys_thread_t *t;
+
+	t = malloc (sizeof(*t));
+	if (t == NULL)
+		return NULL;
+	t->func = func;
+	t->arg = arg;
+	t->thread = CreateThread (NULL, 0, Sys_ThreadStart, t, 0, NULL);
+	if (t->thread == NULL)
+	{
+		free (t);
+		return NULL;
+	}
+	return t;
+}
+
+void Sys_JoinThread (void *thread)
+{
+	sys_thread_t *t = (sys_thread_t *)thread;
+
+	WaitForSingleObject (t->thread, INFINITE);
+	CloseHandle (t->thread);
+	free (t);
+}
+
+unsigned long Sys_ThreadId (void)
+{
+	return (unsigned long)GetCurrentThreadId ();
+}
+
+int Sys_NumProcessors (void)
+{
+	SYSTEM_INFO info;
+
+	GetSystemInfo (&info);
+	if (info.dwNumberOfProcessors < 1)
+		return 1;
+	return (int)info.dwNumberOfProcessors;
+}
+
+void *Sys_CreateMutex (void)
+{
+	CRITICAL_SECTION *m;
+
+	m = malloc (sizeof(*m));
+	if (m != NULL)
+		InitializeCriticalSection (m);
+	return m;
+}
+
+void Sys_DestroyMutex (void *mutex)
+{
+	DeleteCriticalSection ((CRITICAL_SECTION *)mutex);
+	free (mutex);
+}
+
+void Sys_LockMutex (void *mutex)
+{
+	EnterCriticalSection ((CRITICAL_SECTION *)mutex);
+}
+
+void Sys_UnlockMutex (void *mutex)
+{
+	LeaveCriticalSection ((CRITICAL_SECTION *)mutex);
+}
+
+void *Sys_CreateCond (void)
+{
+	CONDITION_VARIABLE *c;
+
+	c = malloc (sizeof(*c));
+	if (c != NULL)
+		InitializeConditionVariable (c);
+	return c;
+}
+
+void Sys_DestroyCond (void *cond)
+{
+	free (cond);
+}
+
+void Sys_WaitCond (void *cond, void *mutex)
+{
+	SleepConditionVariableCS ((CONDITION_VARIABLE *)cond, (CRITICAL_SECTION *)mutex, INFINITE);
+}
+
+// wakes every thread waiting on cond
+void Sys_BroadcastCond (void *cond)
+{
+	WakeAllConditionVariable ((CONDITION_VARIABLE *)cond);
+}
+
+/*
+================
+Sys_ScanDir
+
+Reentrant, unlike Sys_FindFirst, so func may scan subdirectories.
+================
+*/
+qboolean Sys_ScanDir (const char *path, void (*func) (void *arg, const char *name, qboolean isdir), void *arg)
+{
+	WIN32_FIND_DATA	data;
+	HANDLE			find;
+	char			pattern[MAX_OSPATH];
+
+	Com_sprintf (pattern, sizeof(pattern), "%s/*", path);
+	find = FindFirstFile (pattern, &data);
+	if (find == INVALID_HANDLE_VALUE)
+		return false;
+
+	do
+	{
+		if (strcmp (data.cFileName, ".") == 0 || strcmp (data.cFileName, "..") == 0)
+			continue;
+		func (arg, data.cFileName, (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0);
+	} while (FindNextFile (find, &data));
+
+	FindClose (find);
+	return true;
+}
+
+/*
+================
+Sys_MapFile
+
+Copy-on-write view so callers can swap lumps in place without touching
+the file. The view keeps the mapping object alive after it is closed.
+================
+*/
+void *Sys_MapFile (FILE *f, int length)
+{
+	HANDLE	file, mapping;
+	void	*base;
+
+	if (length <= 0)
+		return NULL;
+
+	file = (HANDLE)_get_osfhandle (_fileno (f));
+	if (file == INVALID_HANDLE_VALUE)
+		return NULL;
+
+	mapping = CreateFileMapping (file, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+	if (mapping == NULL)
+		return NULL;
+
+	base = MapViewOfFile (mapping, FILE_MAP_COPY, 0, 0, length);
+	CloseHandle (mapping);
+
+	return base;
+}
+
+void Sys_UnmapFile (void *base, int length)
+{
+	UnmapViewOfFile (base);
+}
+
+qboolean Sys_DropFileCache (FILE *f)
+{
+	// no per-file eviction on windows; use a freshly booted machine
+	return false;
+}